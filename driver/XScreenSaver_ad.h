@@ -29,6 +29,7 @@
 "*visualID:		default",
 "*captureStderr: 	True",
 "*ignoreUninstalledPrograms: False",
+"*prelaunchHacks:	False",
 "*authWarningSlack:	20",
 "*textMode:		file",
 "*textLiteral:		XScreenSaver",
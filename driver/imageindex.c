@@ -0,0 +1,1139 @@
+/* imageindex.c --- a persistent index of the image files under a directory.
+ * xscreensaver, Copyright (c) 2026 Jamie Zawinski <jwz@jwz.org>
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation.  No representations are made about the suitability of this
+ * software for any purpose.  It is provided "as is" without express or
+ * implied warranty.
+ *
+ * "xscreensaver-getimage-file" keeps its list of files as text, and throws
+ * it away and re-walks the whole tree every few hours.  With hundreds of
+ * thousands of images, both of those take seconds, and every image-using
+ * hack pays for it.  The index written here is a header, a table of
+ * directories, a table of files and a string pool, so it can be mapped and
+ * used as-is.  To bring it up to date we stat() each directory it knows
+ * about, and only re-read the ones whose modification time has changed;
+ * everything else (including image sizes that we have already looked up)
+ * is carried over from the old index.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <dirent.h>
+
+#ifdef HAVE_UNISTD_H
+# include <unistd.h>
+#endif
+
+#include "yarandom.h"
+#include "imageindex.h"
+
+extern char *progname;
+
+#define INDEX_MAGIC    "XSIMGIX1"
+#define INDEX_FILE     "xscreensaver-getimage.index"
+
+/* Check the directories for changes if the index is older than this. */
+#define INDEX_RECHECK  (60 * 10)
+
+/* JPEG, GIF, and PNG files that are are smaller than this are rejected,
+   as in xscreensaver-getimage-file. */
+#define MIN_IMAGE_WIDTH  255
+#define MIN_IMAGE_HEIGHT 255
+#define MAX_TRIES        50
+
+#define DIMS_UNPROBED    0		/* width and height not looked up yet */
+#define DIMS_UNKNOWN     0xFFFF		/* couldn't tell; assume it's fine */
+#define NO_PARENT        0xFFFFFFFF
+
+struct idx_header {
+  char magic[8];
+  unsigned int header_size, dir_size, file_size;	/* to catch ABI changes */
+  unsigned int ndirs, nfiles, strings_size;
+  unsigned int root;		/* The directory indexed, in the string pool */
+  unsigned int pad;
+  long built;			/* When the directories were last checked */
+};
+
+struct idx_dir {
+  unsigned int name;		/* Path relative to root ("" for root) */
+  unsigned int parent;
+  unsigned int first_file, nfiles;	/* Sorted by name */
+  long mtime;
+};
+
+struct idx_file {
+  unsigned int name;		/* Just the file name */
+  unsigned int dir;
+  unsigned short width, height;
+};
+
+struct image_index {
+  char *root;
+  char *file;
+  int fd;
+  char *map;
+  size_t map_size;
+  int writable_p;
+  struct idx_header *hdr;
+  struct idx_dir *dirs;
+  struct idx_file *files;
+  const char *strings;
+};
+
+
+/* Same as @good_extensions and @nondir_extensions in
+   xscreensaver-getimage-file. */
+static const char * const good_extensions[] = {
+  "jpg", "jpeg", "pjpeg", "pjpg", "png", "gif",
+  "tif", "tiff", "xbm", "xpm", 0
+};
+
+static const char * const nondir_extensions[] = {
+  "ai", "bmp", "bz2", "cr2", "crw", "db",
+  "dmg", "eps", "gz", "hqx", "htm", "html", "icns", "ilbm", "mov",
+  "nef", "pbm", "pdf", "pl", "ppm", "ps", "psd", "sea", "sh", "shtml",
+  "tar", "tgz", "thb", "txt", "xcf", "xmp", "Z", "zip", 0
+};
+
+static int
+extension_p (const char *name, const char * const *exts)
+{
+  const char *dot = strrchr (name, '.');
+  int i;
+  if (!dot) return 0;
+  dot++;
+  for (i = 0; exts[i]; i++)
+    {
+      const char *a = dot, *b = exts[i];
+      while (*a && *b && tolower ((unsigned char) *a) == tolower (*b))
+        a++, b++;
+      if (!*a && !*b) return 1;
+    }
+  return 0;
+}
+
+
+static char *
+path_join (const char *a, const char *b)
+{
+  char *s;
+  if (!*b) return strdup (a);
+  if (!*a) return strdup (b);
+  s = (char *) malloc (strlen (a) + strlen (b) + 2);
+  if (s) sprintf (s, "%s/%s", a, b);
+  return s;
+}
+
+
+char *
+image_cache_file_name (const char *name)
+{
+  const char *home = getenv ("HOME");
+  struct stat st;
+  char *dir, *file = 0;
+
+  if (!home || !*home) return 0;
+  dir = (char *) malloc (strlen (home) + strlen (name) + 40);
+  if (!dir) return 0;
+  file = (char *) malloc (strlen (home) + strlen (name) * 2 + 80);
+  if (!file) { free (dir); return 0; }
+
+  /* The same places that xscreensaver-getimage-file keeps its cache. */
+  sprintf (dir, "%s/Library/Caches", home);		/* MacOS location */
+  if (!stat (dir, &st) && S_ISDIR (st.st_mode))
+    {
+      sprintf (file, "%s/org.jwz.%s", dir, name);
+      goto DONE;
+    }
+
+  sprintf (dir, "%s/.cache", home);	/* Gnome "FreeDesktop XDG" location */
+  if (!stat (dir, &st) && S_ISDIR (st.st_mode))
+    {
+      strcat (dir, "/xscreensaver");
+      if (mkdir (dir, 0700) && errno != EEXIST)
+        {
+          free (file);
+          file = 0;
+          goto DONE;
+        }
+      sprintf (file, "%s/%s", dir, name);
+      goto DONE;
+    }
+
+  sprintf (dir, "%s/tmp", home);	/* If ~/tmp/ exists, use it. */
+  if (!stat (dir, &st) && S_ISDIR (st.st_mode))
+    sprintf (file, "%s/.%s", dir, name);
+  else
+    sprintf (file, "%s/.%s", home, name);
+
+ DONE:
+  free (dir);
+  return file;
+}
+
+
+/* Reading image sizes.  gif_size(), jpeg_size() and png_size() are the
+   same as in xscreensaver-getimage-file; that has no parsers for TIFF,
+   XPM or XBM, so those are new.  Anything else is of unknown size.
+ */
+
+static int
+gif_size (const unsigned char *b, size_t L, int *w, int *h)
+{
+  if (L < 10 || memcmp (b, "GIF8", 4) || (b[4] != '7' && b[4] != '9') ||
+      b[5] != 'a')
+    return 0;
+  *w = (b[7] << 8) | b[6];
+  *h = (b[9] << 8) | b[8];
+  return 1;
+}
+
+static int
+jpeg_size (const unsigned char *b, size_t L, int *w, int *h)
+{
+  size_t i = 2;
+  int ch = 0;
+
+  if (L < 2 || b[0] != 0xFF || b[1] != 0xD8)
+    return 0;
+
+  while (ch != 0xDA && i < L)
+    {
+      /* Find next marker, beginning with 0xFF. */
+      while (ch != 0xFF)
+        {
+          if (i >= L) return 0;
+          ch = b[i++];
+        }
+      /* markers can be padded with any number of 0xFF. */
+      while (ch == 0xFF)
+        {
+          if (i >= L) return 0;
+          ch = b[i++];
+        }
+
+      if (ch >= 0xC0 && ch <= 0xCF && ch != 0xC4 && ch != 0xCC)
+        {
+          /* it's a SOFn marker */
+          i += 3;
+          if (i + 4 > L) return 0;
+          *h = (b[i] << 8) | b[i+1];
+          *w = (b[i+2] << 8) | b[i+3];
+          return 1;
+        }
+      else
+        {
+          /* We must skip variables, since FFs in variable names aren't
+             valid JPEG markers. */
+          size_t length;
+          if (i + 2 > L) return 0;
+          length = (b[i] << 8) | b[i+1];
+          if (length < 2) return 0;
+          i += length;
+        }
+    }
+  return 0;
+}
+
+static int
+png_size (const unsigned char *b, size_t L, int *w, int *h)
+{
+  if (L < 24 || memcmp (b, "\211PNG\r", 5) || memcmp (b + 12, "IHDR", 4))
+    return 0;
+  *w = (b[16] << 24) | (b[17] << 16) | (b[18] << 8) | b[19];
+  *h = (b[20] << 24) | (b[21] << 16) | (b[22] << 8) | b[23];
+  return 1;
+}
+
+
+static int
+tiff_size (const unsigned char *b, size_t L, int *w, int *h)
+{
+  int msb;
+  size_t ifd, i;
+  unsigned int n;
+  int got = 0;
+
+  if (L < 8) return 0;
+  if (!memcmp (b, "II*\000", 4)) msb = 0;
+  else if (!memcmp (b, "MM\000*", 4)) msb = 1;
+  else return 0;
+
+# define U16(P) (msb ? ((P)[0] << 8) | (P)[1] : ((P)[1] << 8) | (P)[0])
+# define U32(P) (msb \
+                 ? ((unsigned long) (P)[0] << 24) | ((P)[1] << 16) | \
+                   ((P)[2] << 8) | (P)[3] \
+                 : ((unsigned long) (P)[3] << 24) | ((P)[2] << 16) | \
+                   ((P)[1] << 8) | (P)[0])
+
+  /* The first directory is usually right after the header, but it can be
+     anywhere, and if it isn't in the part we read, we can't tell. */
+  ifd = U32 (b + 4);
+  if (ifd + 2 > L) return 0;
+  n = U16 (b + ifd);
+  for (i = ifd + 2; n > 0 && i + 12 <= L; n--, i += 12)
+    {
+      unsigned int tag  = U16 (b + i);
+      unsigned int type = U16 (b + i + 2);
+      unsigned long v;
+      if (tag != 256 && tag != 257)	/* ImageWidth, ImageLength */
+        continue;
+      if (type == 3)			/* SHORT */
+        v = U16 (b + i + 8);
+      else if (type == 4)		/* LONG */
+        v = U32 (b + i + 8);
+      else
+        return 0;
+      if (tag == 256) *w = v, got |= 1;
+      else            *h = v, got |= 2;
+    }
+# undef U16
+# undef U32
+  return (got == 3);
+}
+
+/* Finds the number after "#define NAME_width" and "_height". */
+static int
+xbm_size (const unsigned char *b, size_t L, int *w, int *h)
+{
+  const char *s = (const char *) b;
+  const char *end = s + L;
+  int got = 0;
+
+  if (L < 8 || memcmp (b, "#define ", 8))
+    return 0;
+
+  while (s < end && got != 3)
+    {
+      const char *eol = memchr (s, '\n', end - s);
+      char line[256];
+      size_t n;
+      char *us;
+      int v;
+      if (!eol) eol = end;
+      n = eol - s;
+      if (n >= sizeof(line)) n = sizeof(line) - 1;
+      memcpy (line, s, n);
+      line[n] = 0;
+      s = eol + 1;
+
+      if (strncmp (line, "#define ", 8)) continue;
+      us = strchr (line + 8, ' ');
+      if (!us) continue;
+      *us = 0;
+      if (sscanf (us + 1, " %d", &v) != 1) continue;
+      n = strlen (line);
+      if (n > 6 && !strcmp (line + n - 6, "_width"))
+        *w = v, got |= 1;
+      else if (n > 7 && !strcmp (line + n - 7, "_height"))
+        *h = v, got |= 2;
+    }
+  return (got == 3);
+}
+
+/* The first string in an XPM is "WIDTH HEIGHT NCOLORS CHARS-PER-PIXEL". */
+static int
+xpm_size (const unsigned char *b, size_t L, int *w, int *h)
+{
+  const char *s = (const char *) b;
+  const char *end = s + L;
+  char line[256];
+  size_t n;
+
+  if (L < 9 || memcmp (b, "/* XPM */", 9))
+    return 0;
+
+  /* Skip over any comments, then find the first string. */
+  for (s += 9; s < end; s++)
+    if (s + 1 < end && s[0] == '/' && s[1] == '*')
+      {
+        for (s += 2; s + 1 < end && !(s[0] == '*' && s[1] == '/'); s++)
+          ;
+        s++;
+      }
+    else if (*s == '"')
+      break;
+  if (s >= end) return 0;
+
+  n = end - s - 1;
+  if (n >= sizeof(line)) n = sizeof(line) - 1;
+  memcpy (line, s + 1, n);
+  line[n] = 0;
+  return (sscanf (line, " %d %d", w, h) == 2);
+}
+
+
+/* Returns -1 if the file can't be read, 0 if we can't tell how big it is,
+   and 1 if we can.
+ */
+static int
+image_file_size (const char *file, int *w, int *h)
+{
+  static unsigned char buf[1024 * 50];	/* The first 50k should be enough. */
+  int fd = open (file, O_RDONLY);
+  ssize_t n;
+  size_t L = 0;
+
+  if (fd < 0) return -1;
+  while (L < sizeof(buf) &&
+         ((n = read (fd, buf + L, sizeof(buf) - L)) > 0 ||
+          (n < 0 && errno == EINTR)))
+    if (n > 0) L += n;
+  close (fd);
+
+  return (gif_size (buf, L, w, h) ||
+          jpeg_size (buf, L, w, h) ||
+          png_size (buf, L, w, h) ||
+          tiff_size (buf, L, w, h) ||
+          xpm_size (buf, L, w, h) ||
+          xbm_size (buf, L, w, h));
+}
+
+
+/* Mapping an existing index.
+ */
+
+static void
+unmap_index (image_index *ix)
+{
+  if (ix->map) munmap (ix->map, ix->map_size);
+  if (ix->fd >= 0) close (ix->fd);
+  ix->map = 0;
+  ix->fd = -1;
+  ix->hdr = 0;
+}
+
+
+static int
+map_index (image_index *ix)
+{
+  struct stat st;
+  struct idx_header *hdr;
+  size_t size;
+  unsigned int i;
+
+  unmap_index (ix);
+
+  ix->writable_p = 1;
+  ix->fd = open (ix->file, O_RDWR);
+  if (ix->fd < 0)
+    {
+      ix->writable_p = 0;
+      ix->fd = open (ix->file, O_RDONLY);
+    }
+  if (ix->fd < 0) return 0;
+
+  if (fstat (ix->fd, &st) || st.st_size < sizeof(*hdr))
+    goto FAIL;
+
+  ix->map_size = st.st_size;
+  ix->map = (char *) mmap (0, ix->map_size,
+                           PROT_READ | (ix->writable_p ? PROT_WRITE : 0),
+                           MAP_SHARED, ix->fd, 0);
+  if (ix->map == (char *) MAP_FAILED)
+    {
+      ix->map = 0;
+      goto FAIL;
+    }
+
+  hdr = (struct idx_header *) ix->map;
+  if (memcmp (hdr->magic, INDEX_MAGIC, sizeof(hdr->magic)) ||
+      hdr->header_size != sizeof(struct idx_header) ||
+      hdr->dir_size    != sizeof(struct idx_dir) ||
+      hdr->file_size   != sizeof(struct idx_file))
+    goto FAIL;
+
+  size = (sizeof(*hdr) +
+          hdr->ndirs  * sizeof(struct idx_dir) +
+          hdr->nfiles * sizeof(struct idx_file) +
+          hdr->strings_size);
+  if (size != ix->map_size || hdr->strings_size == 0)
+    goto FAIL;
+
+  ix->hdr = hdr;
+  ix->dirs = (struct idx_dir *) (ix->map + sizeof(*hdr));
+  ix->files = (struct idx_file *) (ix->dirs + hdr->ndirs);
+  ix->strings = (const char *) (ix->files + hdr->nfiles);
+
+  /* Don't trust anything in it that could send us off the end. */
+  if (ix->strings[hdr->strings_size - 1] ||
+      hdr->root >= hdr->strings_size ||
+      strcmp (ix->strings + hdr->root, ix->root))
+    goto FAIL;
+  for (i = 0; i < hdr->ndirs; i++)
+    {
+      const struct idx_dir *d = &ix->dirs[i];
+      if (d->name >= hdr->strings_size ||
+          (d->parent != NO_PARENT && d->parent >= i) ||
+          d->first_file > hdr->nfiles ||
+          d->nfiles > hdr->nfiles - d->first_file)
+        goto FAIL;
+    }
+  for (i = 0; i < hdr->nfiles; i++)
+    if (ix->files[i].name >= hdr->strings_size ||
+        ix->files[i].dir >= hdr->ndirs)
+      goto FAIL;
+
+  return 1;
+
+ FAIL:
+  unmap_index (ix);
+  return 0;
+}
+
+
+/* Building a new index, re-using what we can of the old one.
+ */
+
+struct seen_inode {
+  dev_t dev;
+  ino_t ino;
+  int used;
+};
+
+struct builder {
+  image_index *old;
+  unsigned int *old_hash;	/* old dir names -> dir number + 1 */
+  size_t old_hash_size;
+  unsigned int *old_child;	/* first child of each old dir, + 1 */
+  unsigned int *old_sibling;	/* next child of the same parent, + 1 */
+
+  struct idx_dir *dirs;
+  size_t ndirs, dirs_size;
+  struct idx_file *files;
+  size_t nfiles, files_size;
+  char *strings;
+  size_t strings_len, strings_size;
+
+  struct seen_inode *seen;	/* for breaking recursive symlink loops */
+  size_t nseen, seen_size;
+
+  int changed_p;
+  int failed_p;
+  int verbose_p;
+  int read_count, reused_count;
+};
+
+
+static int
+grow (void **array, size_t *size, size_t want, size_t elt)
+{
+  if (want > *size)
+    {
+      size_t n = (*size ? *size * 2 : 256);
+      void *a;
+      while (n < want) n *= 2;
+      a = realloc (*array, n * elt);
+      if (!a) return 0;
+      *array = a;
+      *size = n;
+    }
+  return 1;
+}
+
+
+static unsigned long
+string_hash (const char *s)
+{
+  unsigned long h = 5381;
+  while (*s) h = (h * 33) ^ (unsigned char) *s++;
+  return h;
+}
+
+
+static unsigned int
+add_string (struct builder *b, const char *s)
+{
+  size_t L = strlen (s) + 1;
+  unsigned int off = b->strings_len;
+  if (!grow ((void **) &b->strings, &b->strings_size, b->strings_len + L, 1))
+    {
+      b->failed_p = 1;
+      return 0;
+    }
+  memcpy (b->strings + off, s, L);
+  b->strings_len += L;
+  return off;
+}
+
+
+static int
+seen_insert (struct seen_inode *table, size_t size, dev_t dev, ino_t ino)
+{
+  size_t i = ((unsigned long) dev * 31 + (unsigned long) ino) % size;
+  while (table[i].used)
+    {
+      if (table[i].dev == dev && table[i].ino == ino)
+        return 1;
+      i = (i + 1) % size;
+    }
+  table[i].dev = dev;
+  table[i].ino = ino;
+  table[i].used = 1;
+  return 0;
+}
+
+
+/* Returns 1 if we've been here before (via some symlink.) */
+static int
+seen_p (struct builder *b, dev_t dev, ino_t ino)
+{
+  if (b->nseen * 2 >= b->seen_size)
+    {
+      size_t size = (b->seen_size ? b->seen_size * 2 : 1024);
+      struct seen_inode *table = (struct seen_inode *)
+        calloc (size, sizeof(*table));
+      size_t i;
+      if (!table)
+        {
+          b->failed_p = 1;
+          return 1;
+        }
+      for (i = 0; i < b->seen_size; i++)
+        if (b->seen[i].used)
+          seen_insert (table, size, b->seen[i].dev, b->seen[i].ino);
+      free (b->seen);
+      b->seen = table;
+      b->seen_size = size;
+    }
+
+  if (seen_insert (b->seen, b->seen_size, dev, ino))
+    return 1;
+  b->nseen++;
+  return 0;
+}
+
+
+static void
+hash_old_dirs (struct builder *b)
+{
+  image_index *ix = b->old;
+  unsigned int n = ix->hdr->ndirs;
+  unsigned int i;
+
+  b->old_hash_size = n * 2 + 1;
+  b->old_hash = (unsigned int *) calloc (b->old_hash_size, sizeof(int));
+  b->old_child = (unsigned int *) calloc (n + 1, sizeof(int));
+  b->old_sibling = (unsigned int *) calloc (n + 1, sizeof(int));
+  if (!b->old_hash || !b->old_child || !b->old_sibling)
+    {
+      b->old = 0;
+      return;
+    }
+
+  for (i = n; i > 0; i--)   /* backwards, so the child lists stay sorted */
+    {
+      const struct idx_dir *d = &ix->dirs[i-1];
+      size_t h = string_hash (ix->strings + d->name) % b->old_hash_size;
+      while (b->old_hash[h])
+        h = (h + 1) % b->old_hash_size;
+      b->old_hash[h] = i;
+      if (d->parent != NO_PARENT)
+        {
+          b->old_sibling[i-1] = b->old_child[d->parent];
+          b->old_child[d->parent] = i;
+        }
+    }
+}
+
+
+static const struct idx_dir *
+find_old_dir (struct builder *b, const char *name)
+{
+  image_index *ix = b->old;
+  size_t h;
+  if (!ix) return 0;
+  h = string_hash (name) % b->old_hash_size;
+  while (b->old_hash[h])
+    {
+      const struct idx_dir *d = &ix->dirs[b->old_hash[h] - 1];
+      if (!strcmp (ix->strings + d->name, name))
+        return d;
+      h = (h + 1) % b->old_hash_size;
+    }
+  return 0;
+}
+
+
+static void
+add_file (struct builder *b, const char *name, unsigned int dir,
+          int width, int height)
+{
+  struct idx_file *f;
+  if (!grow ((void **) &b->files, &b->files_size, b->nfiles + 1,
+             sizeof(*b->files)))
+    {
+      b->failed_p = 1;
+      return;
+    }
+  f = &b->files[b->nfiles++];
+  f->name = add_string (b, name);
+  f->dir = dir;
+  f->width = width;
+  f->height = height;
+}
+
+
+/* Finds the size we already know for this file, if any. */
+static void
+old_file_size (struct builder *b, const struct idx_dir *od, const char *name,
+               int *w, int *h)
+{
+  image_index *ix = b->old;
+  unsigned int lo = od->first_file, hi = od->first_file + od->nfiles;
+  *w = *h = DIMS_UNPROBED;
+  while (lo < hi)
+    {
+      unsigned int mid = (lo + hi) / 2;
+      int c = strcmp (name, ix->strings + ix->files[mid].name);
+      if (c == 0)
+        {
+          *w = ix->files[mid].width;
+          *h = ix->files[mid].height;
+          return;
+        }
+      else if (c < 0)
+        hi = mid;
+      else
+        lo = mid + 1;
+    }
+}
+
+
+static int
+strcmp_p (const void *a, const void *b)
+{
+  return strcmp (*(char **) a, *(char **) b);
+}
+
+
+static void
+scan_dir (struct builder *b, const char *root, const char *name,
+          unsigned int parent)
+{
+  char *full = path_join (root, name);
+  const struct idx_dir *od;
+  struct idx_dir *d;
+  struct stat st;
+  unsigned int me;
+
+  if (!full) { b->failed_p = 1; return; }
+
+  if (stat (full, &st) || !S_ISDIR (st.st_mode))
+    {
+      if (b->verbose_p)
+        fprintf (stderr, "%s: couldn't open %s: %s\n", progname, full,
+                 strerror (errno));
+      b->changed_p = 1;
+      free (full);
+      return;
+    }
+
+  if (seen_p (b, st.st_dev, st.st_ino))  /* break symlink loops */
+    {
+      free (full);
+      return;
+    }
+
+  if (!grow ((void **) &b->dirs, &b->dirs_size, b->ndirs + 1,
+             sizeof(*b->dirs)))
+    {
+      b->failed_p = 1;
+      free (full);
+      return;
+    }
+  me = b->ndirs++;
+  d = &b->dirs[me];
+  d->name = add_string (b, name);
+  d->parent = parent;
+  d->first_file = b->nfiles;
+  d->nfiles = 0;
+  d->mtime = st.st_mtime;
+
+  od = find_old_dir (b, name);
+
+  if (od && od->mtime == st.st_mtime &&
+      ((od->parent == NO_PARENT) == (parent == NO_PARENT)))
+    {
+      /* Nothing has been added or removed here: copy the old entries,
+         and look only at the subdirectories we already knew about. */
+      image_index *ix = b->old;
+      unsigned int i, c;
+      for (i = od->first_file; i < od->first_file + od->nfiles; i++)
+        add_file (b, ix->strings + ix->files[i].name, me,
+                  ix->files[i].width, ix->files[i].height);
+      b->dirs[me].nfiles = b->nfiles - b->dirs[me].first_file;
+      b->reused_count++;
+
+      for (c = b->old_child[od - ix->dirs]; c; c = b->old_sibling[c-1])
+        scan_dir (b, root, ix->strings + ix->dirs[c-1].name, me);
+    }
+  else
+    {
+      DIR *dd = opendir (full);
+      struct dirent *de;
+      char **files = 0, **dirs = 0;
+      size_t nfiles = 0, files_size = 0, ndirs = 0, dirs_size = 0;
+      size_t i;
+
+      b->changed_p = 1;
+      b->read_count++;
+      if (b->verbose_p > 1)
+        fprintf (stderr, "%s:  + reading dir %s/...\n", progname, full);
+
+      while (dd && (de = readdir (dd)))
+        {
+          const char *f = de->d_name;
+          int L = strlen (f);
+          char *sub;
+
+          if (*f == '.')			/* silently ignore dot files/dirs */
+            continue;
+          if (f[L-1] == '~' || f[L-1] == '%' || f[L-1] == '#')
+            continue;				/* ignore backup files */
+
+          if (extension_p (f, good_extensions))
+            {
+              /* Assume that files ending in .jpg exist and are not
+                 directories. */
+              if (grow ((void **) &files, &files_size, nfiles + 1,
+                        sizeof(*files)) &&
+                  (files[nfiles] = strdup (f)))
+                nfiles++;
+              else
+                b->failed_p = 1;
+              continue;
+            }
+
+          if (extension_p (f, nondir_extensions))
+            continue;
+
+          /* Now we need to stat the file to see if it's a subdirectory. */
+          sub = path_join (full, f);
+          if (sub && !stat (sub, &st) && S_ISDIR (st.st_mode))
+            {
+              if (grow ((void **) &dirs, &dirs_size, ndirs + 1,
+                        sizeof(*dirs)) &&
+                  (dirs[ndirs] = path_join (name, f)))
+                ndirs++;
+              else
+                b->failed_p = 1;
+            }
+          free (sub);
+        }
+      if (dd) closedir (dd);
+
+      qsort (files, nfiles, sizeof(*files), strcmp_p);
+      for (i = 0; i < nfiles; i++)
+        {
+          int w = DIMS_UNPROBED, h = DIMS_UNPROBED;
+          if (od) old_file_size (b, od, files[i], &w, &h);
+          add_file (b, files[i], me, w, h);
+          free (files[i]);
+        }
+      free (files);
+      b->dirs[me].nfiles = b->nfiles - b->dirs[me].first_file;
+
+      qsort (dirs, ndirs, sizeof(*dirs), strcmp_p);
+      for (i = 0; i < ndirs; i++)
+        {
+          scan_dir (b, root, dirs[i], me);
+          free (dirs[i]);
+        }
+      free (dirs);
+    }
+
+  free (full);
+}
+
+
+static int
+write_index (struct builder *b, image_index *ix)
+{
+  struct idx_header hdr;
+  char *tmp = (char *) malloc (strlen (ix->file) + 30);
+  FILE *out;
+  int ok;
+
+  if (!tmp) return 0;
+  memset (&hdr, 0, sizeof(hdr));
+  memcpy (hdr.magic, INDEX_MAGIC, sizeof(hdr.magic));
+  hdr.header_size = sizeof(struct idx_header);
+  hdr.dir_size    = sizeof(struct idx_dir);
+  hdr.file_size   = sizeof(struct idx_file);
+  hdr.ndirs  = b->ndirs;
+  hdr.nfiles = b->nfiles;
+  hdr.root   = add_string (b, ix->root);
+  hdr.strings_size = b->strings_len;
+  hdr.built  = time ((time_t *) 0);
+  if (b->failed_p) { free (tmp); return 0; }
+
+  /* Write a new file and rename it, so that anyone who has the old one
+     mapped can keep using it. */
+  sprintf (tmp, "%s.%lu", ix->file, (unsigned long) getpid());
+  out = fopen (tmp, "wb");
+  if (!out)
+    {
+      if (b->verbose_p)
+        fprintf (stderr, "%s: unable to write %s: %s\n", progname, tmp,
+                 strerror (errno));
+      free (tmp);
+      return 0;
+    }
+
+  ok = (fwrite (&hdr, sizeof(hdr), 1, out) == 1 &&
+        fwrite (b->dirs, sizeof(*b->dirs), b->ndirs, out) == b->ndirs &&
+        fwrite (b->files, sizeof(*b->files), b->nfiles, out) == b->nfiles &&
+        fwrite (b->strings, 1, b->strings_len, out) == b->strings_len);
+  if (fclose (out)) ok = 0;
+  if (ok && rename (tmp, ix->file)) ok = 0;
+  if (!ok)
+    {
+      if (b->verbose_p)
+        fprintf (stderr, "%s: unable to write %s\n", progname, ix->file);
+      unlink (tmp);
+    }
+  free (tmp);
+  return ok;
+}
+
+
+static void
+update_index (image_index *ix, int verbose_p)
+{
+  struct builder b;
+  time_t now = time ((time_t *) 0);
+
+  memset (&b, 0, sizeof(b));
+  b.verbose_p = verbose_p;
+  if (ix->hdr)
+    {
+      b.old = ix;
+      hash_old_dirs (&b);
+    }
+
+  if (verbose_p)
+    fprintf (stderr, "%s: %s %s...\n", progname,
+             (b.old ? "checking" : "recursively reading"), ix->root);
+
+  scan_dir (&b, ix->root, "", NO_PARENT);
+
+  if (verbose_p)
+    fprintf (stderr, "%s: f=%lu; d=%lu; read=%d; reused=%d.\n",
+             progname, (unsigned long) b.nfiles, (unsigned long) b.ndirs,
+             b.read_count, b.reused_count);
+
+  if (b.failed_p)
+    {
+      if (verbose_p)
+        fprintf (stderr, "%s: out of memory indexing %s\n",
+                 progname, ix->root);
+    }
+  else if (b.old && !b.changed_p &&
+           b.ndirs == ix->hdr->ndirs && b.nfiles == ix->hdr->nfiles &&
+           ix->writable_p)
+    {
+      /* Nothing changed: just note that we looked. */
+      ix->hdr->built = now;
+    }
+  else
+    {
+      unmap_index (ix);
+      if (write_index (&b, ix))
+        map_index (ix);
+    }
+
+  free (b.old_hash);
+  free (b.old_child);
+  free (b.old_sibling);
+  free (b.dirs);
+  free (b.files);
+  free (b.strings);
+  free (b.seen);
+}
+
+
+image_index *
+image_index_open (const char *dir, int verbose_p)
+{
+  image_index *ix;
+  struct stat st;
+  char *lock = 0;
+  int lock_fd = -1;
+  int L;
+
+  if (!dir || !*dir ||
+      !strncmp (dir, "http:", 5) ||
+      !strncmp (dir, "https:", 6) ||
+      !strncmp (dir, "feed:", 5))
+    return 0;   /* Let xscreensaver-getimage-file do the feed. */
+
+  ix = (image_index *) calloc (1, sizeof(*ix));
+  if (!ix) return 0;
+  ix->fd = -1;
+
+  if (dir[0] == '~' && dir[1] == '/' && getenv ("HOME"))
+    ix->root = path_join (getenv ("HOME"), dir + 2);  /* allow literal "~/" */
+  else
+    ix->root = strdup (dir);
+  if (!ix->root) goto FAIL;
+  L = strlen (ix->root);
+  while (L > 1 && ix->root[L-1] == '/')		/* omit trailing / */
+    ix->root[--L] = 0;
+
+  if (stat (ix->root, &st) || !S_ISDIR (st.st_mode))
+    goto FAIL;
+
+  ix->file = image_cache_file_name (INDEX_FILE);
+  if (!ix->file) goto FAIL;
+
+  if (map_index (ix) && ix->hdr->built + INDEX_RECHECK > time ((time_t *) 0))
+    return ix;
+
+  /* Only one of us should be walking the file system at a time. */
+  lock = (char *) malloc (strlen (ix->file) + 10);
+  if (!lock) goto FAIL;
+  sprintf (lock, "%s.lock", ix->file);
+  lock_fd = open (lock, O_RDWR | O_CREAT, 0600);
+  if (lock_fd >= 0)
+    {
+      if (verbose_p > 1)
+        fprintf (stderr, "%s: awaiting lock: %s\n", progname, lock);
+      flock (lock_fd, LOCK_EX);
+    }
+
+  /* Someone else might have done it while we waited. */
+  if (! (map_index (ix) &&
+         ix->hdr->built + INDEX_RECHECK > time ((time_t *) 0)))
+    update_index (ix, verbose_p);
+
+  if (lock_fd >= 0)
+    {
+      flock (lock_fd, LOCK_UN);
+      close (lock_fd);
+    }
+  free (lock);
+
+  if (!ix->hdr) goto FAIL;
+  return ix;
+
+ FAIL:
+  image_index_close (ix);
+  return 0;
+}
+
+
+char *
+image_index_random_file (image_index *ix, int verbose_p)
+{
+  int i;
+
+  if (!ix->hdr->nfiles)
+    {
+      fprintf (stderr, "%s: no files in %s\n", progname, ix->root);
+      return 0;
+    }
+
+  for (i = 0; i < MAX_TRIES; i++)
+    {
+      struct idx_file *f = &ix->files[random() % ix->hdr->nfiles];
+      const char *dname = ix->strings + ix->dirs[f->dir].name;
+      const char *fname = ix->strings + f->name;
+      char *rel = path_join (dname, fname);
+      int w = f->width, h = f->height;
+
+      if (!rel) return 0;
+
+      if (w == DIMS_UNPROBED && h == DIMS_UNPROBED)
+        {
+          char *full = path_join (ix->root, rel);
+          int status = (full ? image_file_size (full, &w, &h) : -1);
+          free (full);
+
+          if (status < 0)
+            {
+              /* Nonexistent files are obviously too small! */
+              if (verbose_p)
+                fprintf (stderr, "%s: %s: %s\n", progname, rel,
+                         strerror (errno));
+              free (rel);
+              continue;
+            }
+          else if (status == 0 || w <= 0 || h <= 0)
+            {
+              /* Assume that unknown files are of good sizes. */
+              if (verbose_p)
+                fprintf (stderr, "%s: %s: unable to determine image size\n",
+                         progname, rel);
+              w = h = DIMS_UNKNOWN;
+            }
+          else
+            {
+              if (w >= DIMS_UNKNOWN) w = DIMS_UNKNOWN - 1;
+              if (h >= DIMS_UNKNOWN) h = DIMS_UNKNOWN - 1;
+            }
+
+          if (ix->writable_p)	/* Remember it for next time. */
+            {
+              f->width  = w;
+              f->height = h;
+            }
+        }
+
+      if (w != DIMS_UNKNOWN &&
+          (w < MIN_IMAGE_WIDTH || h < MIN_IMAGE_HEIGHT))
+        {
+          if (verbose_p)
+            fprintf (stderr, "%s: %s: too small (%d x %d)\n",
+                     progname, rel, w, h);
+          free (rel);
+          continue;
+        }
+
+      if (verbose_p)
+        {
+          if (w == DIMS_UNKNOWN)
+            fprintf (stderr, "%s: %s\n", progname, rel);
+          else
+            fprintf (stderr, "%s: %s: %d x %d\n", progname, rel, w, h);
+        }
+      return rel;
+    }
+
+  fprintf (stderr, "%s: no suitable images in %s (after %d tries)\n",
+           progname, ix->root, MAX_TRIES);
+
+  /* Maybe it's stale: check the directories again next time. */
+  if (ix->writable_p)
+    ix->hdr->built = 0;
+
+  return 0;
+}
+
+
+void
+image_index_close (image_index *ix)
+{
+  if (!ix) return;
+  unmap_index (ix);
+  free (ix->root);
+  free (ix->file);
+  free (ix);
+}
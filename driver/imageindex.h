@@ -0,0 +1,40 @@
+/* imageindex.h --- a persistent index of the image files under a directory.
+ * xscreensaver, Copyright (c) 2026 Jamie Zawinski <jwz@jwz.org>
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation.  No representations are made about the suitability of this
+ * software for any purpose.  It is provided "as is" without express or
+ * implied warranty.
+ */
+
+#ifndef __XSCREENSAVER_IMAGEINDEX_H__
+#define __XSCREENSAVER_IMAGEINDEX_H__
+
+/* This is what "xscreensaver-getimage-file" does for local directories,
+   but with the list of files kept in a binary file that can be mapped
+   instead of parsed, and that is brought up to date by re-reading only
+   the directories whose modification times have changed.  The image
+   dimensions are filled in as files get picked, so that too-small images
+   are only ever read once.
+ */
+typedef struct image_index image_index;
+
+/* Returns 0 if the directory can't be indexed (e.g., it's a URL, or
+   doesn't exist), in which case use "xscreensaver-getimage-file". */
+extern image_index *image_index_open (const char *dir, int verbose_p);
+
+/* Returns a randomly-chosen image file that is large enough to use, as a
+   pathname relative to the directory; or 0 if there are none.
+   Free it when done. */
+extern char *image_index_random_file (image_index *, int verbose_p);
+
+extern void image_index_close (image_index *);
+
+/* Returns the name of a file in the same cache directory that
+   "xscreensaver-getimage-file" uses.  Free it when done. */
+extern char *image_cache_file_name (const char *name);
+
+#endif /* __XSCREENSAVER_IMAGEINDEX_H__ */
@@ -0,0 +1,340 @@
+/* interrupts.c --- noticing keyboard and mouse activity in /proc/interrupts.
+ * xscreensaver, Copyright (c) 2026 Jamie Zawinski <jwz@jwz.org>
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation.  No representations are made about the suitability of this
+ * software for any purpose.  It is provided "as is" without express or
+ * implied warranty.
+ *
+ * /proc/interrupts has one column per CPU, so on a big machine it is
+ * hundreds of KB, and re-reading and re-parsing all of it every few seconds
+ * just to look at two rows adds up.  So we find the two rows once, remember
+ * where they were, and pread() only those bytes from then on, checking that
+ * the row we got is still the one we wanted.  Better still, newer kernels
+ * have /sys/kernel/irq/N/per_cpu_count, which has nothing but the counters
+ * for that one IRQ.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <fcntl.h>
+
+#ifdef HAVE_UNISTD_H
+# include <unistd.h>
+#endif
+
+#include "interrupts.h"
+
+struct irq_row {
+  char label[32];		/* The start of the row, e.g. "  1:" */
+  int label_len;		/* 0 if we don't have this row */
+  off_t offset;			/* Where the row began, last we looked */
+  int sys_fd;			/* /sys/kernel/irq/N/per_cpu_count, or -1 */
+  char *last;			/* The row as of the last poll */
+  size_t last_len, last_size;
+};
+
+struct irq_sampler {
+  int fd;
+  int sys_p;			/* Whether /sys/kernel/irq/ describes fd */
+  char *buf;
+  size_t buf_size;
+  struct irq_row rows[2];	/* Keyboard, mouse */
+};
+
+
+static void
+close_on_exec (int fd)
+{
+# if defined(HAVE_FCNTL) && defined(FD_CLOEXEC)
+  /* Close this fd upon exec instead of inheriting / leaking it. */
+  if (fcntl (fd, F_SETFD, FD_CLOEXEC) != 0)
+    perror ("fcntl: CLOEXEC:");
+# endif
+}
+
+
+static int
+grow_buf (irq_sampler *s, size_t size)
+{
+  if (size > s->buf_size)
+    {
+      char *b = (char *) realloc (s->buf, size);
+      if (!b) return 0;
+      s->buf = b;
+      s->buf_size = size;
+    }
+  return 1;
+}
+
+
+/* Reads the whole file into s->buf.  Returns its length, or -1.
+ */
+static long
+read_all (irq_sampler *s)
+{
+  size_t len = 0;
+
+  if (!grow_buf (s, 64 * 1024)) return -1;
+  while (1)
+    {
+      ssize_t n = pread (s->fd, s->buf + len, s->buf_size - len - 1, len);
+      if (n < 0)
+        {
+          if (errno == EINTR) continue;
+          return -1;
+        }
+      if (n == 0) break;
+      len += n;
+      if (len + 1 >= s->buf_size && !grow_buf (s, s->buf_size * 2))
+        return -1;
+    }
+  s->buf[len] = 0;
+  return len;
+}
+
+
+static void
+set_row (irq_sampler *s, struct irq_row *row, const char *line, off_t offset)
+{
+  const char *colon = strchr (line, ':');
+  int len = (colon ? colon - line + 1 : 0);
+  int irq;
+
+  if (len >= sizeof(row->label))
+    len = 0;
+
+  if (row->sys_fd >= 0 &&
+      (len != row->label_len || memcmp (row->label, line, len)))
+    {
+      /* A different IRQ than last time. */
+      close (row->sys_fd);
+      row->sys_fd = -1;
+    }
+
+  row->label_len = len;
+  memcpy (row->label, line, row->label_len);
+  row->label[row->label_len] = 0;
+  row->offset = offset;
+
+  if (s->sys_p && row->sys_fd < 0 && row->label_len &&
+      sscanf (row->label, " %d:", &irq) == 1)
+    {
+      char file[100];
+      sprintf (file, "/sys/kernel/irq/%d/per_cpu_count", irq);
+      row->sys_fd = open (file, O_RDONLY);
+      if (row->sys_fd >= 0)
+        close_on_exec (row->sys_fd);
+    }
+}
+
+
+/* Finds the keyboard and mouse rows.  Returns 0 if there are none.
+ */
+static int
+find_rows (irq_sampler *s)
+{
+  long len = read_all (s);
+  char *line, *end;
+  int i8042_count = 0;
+  int checked_kbd = 0, checked_ptr = 0;
+
+  if (len < 0) return 0;
+
+  for (line = s->buf; line < s->buf + len; line = end + 1)
+    {
+      int i8042_p;
+
+      end = strchr (line, '\n');
+      if (!end) end = s->buf + len;
+      *end = 0;
+
+      i8042_p = !!strstr (line, "i8042");
+      if (i8042_p) i8042_count++;
+
+      if (strchr (line, ','))
+        {
+          /* Ignore any line that has a comma on it: this is because
+             a setup like this:
+
+                 12:     930935          XT-PIC  usb-uhci, PS/2 Mouse
+
+             is really bad news.  It *looks* like we can note mouse
+             activity from that line, but really, that interrupt gets
+             fired any time any USB device has activity!  So we have
+             to ignore any shared IRQs.
+           */
+        }
+      else if (!checked_kbd &&
+               (strstr (line, "keyboard") ||
+                (i8042_p && i8042_count == 1)))
+        {
+          /* Assume the keyboard interrupt is the line that says "keyboard",
+             or the *first* line that says "i8042".
+           */
+          set_row (s, &s->rows[0], line, line - s->buf);
+          checked_kbd = 1;
+        }
+      else if (!checked_ptr &&
+               (strstr (line, "PS/2 Mouse") ||
+                (i8042_p && i8042_count == 2)))
+        {
+          /* Assume the mouse interrupt is the line that says "PS/2 mouse",
+             or the *second* line that says "i8042".
+           */
+          set_row (s, &s->rows[1], line, line - s->buf);
+          checked_ptr = 1;
+        }
+
+      if (checked_kbd && checked_ptr)
+        break;
+    }
+
+  if (!checked_kbd) s->rows[0].label_len = 0;
+  if (!checked_ptr) s->rows[1].label_len = 0;
+  return (s->rows[0].label_len || s->rows[1].label_len);
+}
+
+
+/* Reads the current contents of the row into s->buf.
+   Returns its length, or -1 if it has moved (or vanished.)
+ */
+static long
+read_row (irq_sampler *s, struct irq_row *row)
+{
+  size_t want = (row->last_len ? row->last_len + 64 : 1024);
+
+  if (row->sys_fd >= 0)
+    {
+      ssize_t n;
+      if (!grow_buf (s, want)) return -1;
+      while (1)
+        {
+          n = pread (row->sys_fd, s->buf, want, 0);
+          if (n < 0 && errno == EINTR) continue;
+          if (n < 0) return -1;
+          if (n < (ssize_t) want) return n;
+          want *= 2;
+          if (!grow_buf (s, want)) return -1;
+        }
+    }
+
+  while (1)
+    {
+      ssize_t n;
+      char *nl;
+      if (!grow_buf (s, want)) return -1;
+      n = pread (s->fd, s->buf, want, row->offset);
+      if (n < 0 && errno == EINTR) continue;
+      if (n < row->label_len ||
+          memcmp (s->buf, row->label, row->label_len))
+        return -1;
+      nl = memchr (s->buf, '\n', n);
+      if (nl) return nl - s->buf;
+      if (n < (ssize_t) want) return n;	/* Last row, without a newline */
+      want *= 2;
+    }
+}
+
+
+irq_sampler *
+irq_sampler_open (const char *file, const char **why)
+{
+  irq_sampler *s = (irq_sampler *) calloc (1, sizeof(*s));
+  if (why) *why = 0;
+  if (!s)
+    {
+      if (why) *why = "out of memory";
+      return 0;
+    }
+  s->rows[0].sys_fd = s->rows[1].sys_fd = -1;
+
+  s->fd = open (file, O_RDONLY);
+  if (s->fd < 0)
+    {
+      if (why) *why = "error opening";
+      free (s);
+      return 0;
+    }
+  close_on_exec (s->fd);
+
+  /* Only the real thing has per-IRQ files (test-interrupts uses a fake.) */
+  s->sys_p = !strcmp (file, "/proc/interrupts");
+
+  if (!find_rows (s))
+    {
+      if (why) *why = "no keyboard or mouse data";
+      irq_sampler_close (s);
+      return 0;
+    }
+
+  return s;
+}
+
+
+int
+irq_sampler_poll (irq_sampler *s)
+{
+  int result = 0;
+  int i;
+
+  for (i = 0; i < 2; i++)
+    {
+      struct irq_row *row = &s->rows[i];
+      long n;
+
+      if (!row->label_len) continue;
+
+      n = read_row (s, row);
+      if (n < 0)
+        {
+          /* Rows come and go, and grow wider: look for it again. */
+          if (!find_rows (s)) return -1;
+          if (!row->label_len) continue;
+          n = read_row (s, row);
+          if (n < 0) return -1;
+        }
+
+      if (row->last_len &&
+          (n != row->last_len || memcmp (s->buf, row->last, n)))
+        result |= (i == 0 ? IRQ_SAMPLER_KBD : IRQ_SAMPLER_PTR);
+
+      if (n > row->last_size)
+        {
+          char *b = (char *) realloc (row->last, n);
+          if (!b) return -1;
+          row->last = b;
+          row->last_size = n;
+        }
+      memcpy (row->last, s->buf, n);
+      row->last_len = n;
+    }
+
+  return result;
+}
+
+
+void
+irq_sampler_close (irq_sampler *s)
+{
+  int i;
+  if (!s) return;
+  for (i = 0; i < 2; i++)
+    {
+      if (s->rows[i].sys_fd >= 0) close (s->rows[i].sys_fd);
+      free (s->rows[i].last);
+    }
+  if (s->fd >= 0) close (s->fd);
+  free (s->buf);
+  free (s);
+}
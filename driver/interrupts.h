@@ -0,0 +1,37 @@
+/* interrupts.h --- noticing keyboard and mouse activity in /proc/interrupts.
+ * xscreensaver, Copyright (c) 2026 Jamie Zawinski <jwz@jwz.org>
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation.  No representations are made about the suitability of this
+ * software for any purpose.  It is provided "as is" without express or
+ * implied warranty.
+ */
+
+#ifndef __XSCREENSAVER_INTERRUPTS_H__
+#define __XSCREENSAVER_INTERRUPTS_H__
+
+/* Finds the keyboard and mouse rows in the given file (normally
+   "/proc/interrupts") once, and after that re-reads only those rows.
+   Where the kernel has /sys/kernel/irq/N/per_cpu_count, that is read
+   instead, which doesn't make the kernel format the other rows at all.
+ */
+typedef struct irq_sampler irq_sampler;
+
+#define IRQ_SAMPLER_KBD 1
+#define IRQ_SAMPLER_PTR 2
+
+/* Returns 0 and sets *why if the file can't be read, or has no keyboard
+   or mouse rows. */
+extern irq_sampler *irq_sampler_open (const char *file, const char **why);
+
+/* Returns which of IRQ_SAMPLER_KBD and IRQ_SAMPLER_PTR have had interrupts
+   since the last call, or -1 if the file can no longer be read.  The first
+   call always returns 0. */
+extern int irq_sampler_poll (irq_sampler *);
+
+extern void irq_sampler_close (irq_sampler *);
+
+#endif /* __XSCREENSAVER_INTERRUPTS_H__ */
@@ -275,6 +275,7 @@ static const char * const prefs[] = {
   "captureStdout",		/* not saved -- obsolete */
   "logFile",			/* not saved */
   "ignoreUninstalledPrograms",
+  "prelaunchHacks",
   "font",
   "dpmsEnabled",
   "dpmsQuickOff",
@@ -816,6 +817,7 @@ write_init_file (Display *dpy,
       CHECK("logFile")		continue;  /* don't save */
       CHECK("ignoreUninstalledPrograms")
                                 type = pref_bool, b = p->ignore_uninstalled_p;
+      CHECK("prelaunchHacks")	type = pref_bool, b = p->prelaunch_p;
 
       CHECK("font")		type = pref_str,  s =    stderr_font;
 
@@ -1064,6 +1066,7 @@ load_init_file (Display *dpy, saver_preferences *p)
   p->ignore_uninstalled_p = get_boolean_resource (dpy, 
                                                   "ignoreUninstalledPrograms",
                                                   "Boolean");
+  p->prelaunch_p = get_boolean_resource (dpy, "prelaunchHacks", "Boolean");
 
   p->initial_delay   = 1000 * get_seconds_resource (dpy, "initialDelay", "Time");
   p->splash_duration = 1000 * get_seconds_resource (dpy, "splashDuration", "Time");
@@ -745,6 +745,8 @@ describe_dead_child (saver_info *si, pid_t kid, int wait_status)
 	saver_screen_info *ssi = &si->screens[i];
 	if (kid == ssi->pid)
 	  ssi->pid = 0;
+	if (kid == ssi->prelaunch_pid)
+	  ssi->prelaunch_pid = 0;
       }
 }
 
@@ -871,8 +873,8 @@ print_path_error (const char *program)
    Otherwise, -1 is returned and an error may have been
    printed to stderr.
  */
-pid_t
-fork_and_exec (saver_screen_info *ssi, const char *command)
+static pid_t
+fork_and_exec_1 (saver_screen_info *ssi, Window window, const char *command)
 {
   saver_info *si = ssi->global;
   saver_preferences *p = &si->prefs;
@@ -891,7 +893,7 @@ fork_and_exec (saver_screen_info *ssi, const char *command)
     case 0:
       close (ConnectionNumber (si->dpy));	/* close display fd */
       limit_subproc_memory (p->inferior_memory_limit, p->verbose_p);
-      hack_subproc_environment (ssi->screen, ssi->screensaver_window);
+      hack_subproc_environment (ssi->screen, window);
 
       if (p->verbose_p)
         fprintf (stderr, "%s: %d: spawning \"%s\" in pid %lu.\n",
@@ -918,6 +920,92 @@ fork_and_exec (saver_screen_info *ssi, const char *command)
 }
 
 
+pid_t
+fork_and_exec (saver_screen_info *ssi, const char *command)
+{
+  return fork_and_exec_1 (ssi, ssi->screensaver_window, command);
+}
+
+
+/* Which hack to run next on this screen, or -1 for none.  Sets *force if
+   it was asked for by name, and so must be run even if it seems unusable.
+   If prelaunch_p, this is for the prelaunch window rather than right now.
+ */
+static int
+choose_screenhack (saver_screen_info *ssi, Bool prelaunch_p, Bool *force)
+{
+  saver_info *si = ssi->global;
+  saver_preferences *p = &si->prefs;
+  int new_hack;
+
+  *force = False;
+
+  if (p->screenhacks_count < 1)
+    {
+      /* No hacks at all */
+      new_hack = -1;
+    }
+  else if (p->screenhacks_count == 1)
+    {
+      /* Exactly one hack in the list */
+      new_hack = 0;
+    }
+  else if (si->selection_mode == -1)
+    {
+      /* Select the next hack, wrapping. */
+      new_hack = (ssi->current_hack + 1) % p->screenhacks_count;
+    }
+  else if (si->selection_mode == -2)
+    {
+      /* Select the previous hack, wrapping. */
+      if (ssi->current_hack < 0)
+        new_hack = p->screenhacks_count - 1;
+      else
+        new_hack = ((ssi->current_hack + p->screenhacks_count - 1)
+                    % p->screenhacks_count);
+    }
+  else if (si->selection_mode > 0)
+    {
+      /* Select a specific hack, by number (via the ACTIVATE command.) */
+      new_hack = ((si->selection_mode - 1) % p->screenhacks_count);
+      *force = True;
+    }
+  else if (p->mode == ONE_HACK &&
+           p->selected_hack >= 0)
+    {
+      /* Select a specific hack, by number (via "One Saver" mode.) */
+      new_hack = p->selected_hack;
+      *force = True;
+    }
+  else if (p->mode == BLANK_ONLY || p->mode == DONT_BLANK)
+    {
+      new_hack = -1;
+    }
+  else if (p->mode == RANDOM_HACKS_SAME &&
+           ssi->number != 0)
+    {
+      /* Use the same hack that's running on screen 0.
+         (Assumes this function was called on screen 0 first.)
+       */
+      if (!prelaunch_p)
+        new_hack = si->screens[0].current_hack;
+      else if (si->screens[0].prelaunch_pid)
+        new_hack = si->screens[0].prelaunch_hack;
+      else
+        new_hack = -1;
+    }
+  else  /* (p->mode == RANDOM_HACKS) */
+    {
+      /* Select a random hack (but not the one we just ran.) */
+      while ((new_hack = random () % p->screenhacks_count)
+             == ssi->current_hack)
+        ;
+    }
+
+  return new_hack;
+}
+
+
 void
 spawn_screenhack (saver_screen_info *ssi)
 {
@@ -945,62 +1033,7 @@ spawn_screenhack (saver_screen_info *ssi)
 
     AGAIN:
 
-      if (p->screenhacks_count < 1)
-        {
-          /* No hacks at all */
-          new_hack = -1;
-        }
-      else if (p->screenhacks_count == 1)
-        {
-          /* Exactly one hack in the list */
-          new_hack = 0;
-        }
-      else if (si->selection_mode == -1)
-        {
-          /* Select the next hack, wrapping. */
-          new_hack = (ssi->current_hack + 1) % p->screenhacks_count;
-        }
-      else if (si->selection_mode == -2)
-        {
-          /* Select the previous hack, wrapping. */
-          if (ssi->current_hack < 0)
-            new_hack = p->screenhacks_count - 1;
-          else
-            new_hack = ((ssi->current_hack + p->screenhacks_count - 1)
-                        % p->screenhacks_count);
-        }
-      else if (si->selection_mode > 0)
-	{
-          /* Select a specific hack, by number (via the ACTIVATE command.) */
-	  new_hack = ((si->selection_mode - 1) % p->screenhacks_count);
-	  force = True;
-	}
-      else if (p->mode == ONE_HACK &&
-               p->selected_hack >= 0)
-	{
-          /* Select a specific hack, by number (via "One Saver" mode.) */
-          new_hack = p->selected_hack;
-	  force = True;
-	}
-      else if (p->mode == BLANK_ONLY || p->mode == DONT_BLANK)
-        {
-          new_hack = -1;
-        }
-      else if (p->mode == RANDOM_HACKS_SAME &&
-               ssi->number != 0)
-	{
-	  /* Use the same hack that's running on screen 0.
-             (Assumes this function was called on screen 0 first.)
-           */
-          new_hack = si->screens[0].current_hack;
-	}
-      else  /* (p->mode == RANDOM_HACKS) */
-	{
-	  /* Select a random hack (but not the one we just ran.) */
-	  while ((new_hack = random () % p->screenhacks_count)
-		 == ssi->current_hack)
-	    ;
-	}
+      new_hack = choose_screenhack (ssi, False, &force);
 
       if (new_hack < 0)   /* don't run a hack */
         {
@@ -1077,6 +1110,7 @@ kill_screenhack (saver_screen_info *ssi)
   if (ssi->pid)
     kill_job (si, ssi->pid, SIGTERM);
   ssi->pid = 0;
+  discard_prelaunched_screenhack (ssi);
 }
 
 
@@ -1091,6 +1125,211 @@ suspend_screenhack (saver_screen_info *ssi, Bool suspend_p)
 }
 
 
+static Bool
+job_stopped_p (pid_t pid)
+{
+  struct screenhack_job *job = find_job (pid);
+  return (job && job->status == job_stopped);
+}
+
+
+/* Whether the hack grabs images, going by whether its configuration file
+   has an <xscreensaver-image> tag.  Grabbing the desktop maps the hack's
+   window, which for the prelaunch window would put it on screen over the
+   running hack, and then the grab would get that hack's output instead of
+   the desktop.  So these are never prelaunched.
+ */
+static Bool
+hack_grabs_images_p (const char *command)
+{
+  Bool grabs_p = False;
+#ifdef HACK_CONFIGURATION_PATH
+  const char *dir = HACK_CONFIGURATION_PATH;
+  const char *name, *end, *s;
+  char *file;
+  FILE *in;
+
+  while (*command == ' ' || *command == '\t')
+    command++;
+  for (end = command; *end && *end != ' ' && *end != '\t'; end++)
+    ;
+  for (name = s = command; s < end; s++)
+    if (*s == '/')
+      name = s + 1;
+  if (name == end)
+    return False;
+
+  file = (char *) malloc (strlen (dir) + (end - name) + 10);
+  if (!file) return False;
+  sprintf (file, "%s/%.*s.xml", dir, (int) (end - name), name);
+  in = fopen (file, "r");
+  free (file);
+  if (in)
+    {
+      char buf[1024];
+      while (!grabs_p && fgets (buf, sizeof(buf)-1, in))
+        if (strstr (buf, "<xscreensaver-image"))
+          grabs_p = True;
+      fclose (in);
+    }
+#endif /* HACK_CONFIGURATION_PATH */
+  return grabs_p;
+}
+
+
+/* Starts the hack that the cycle timer will want next in an unmapped
+   window, so that it can do its slow startup (dynamic linking, GL setup,
+   loading images and models) while the current hack is still on screen.
+ */
+void
+prelaunch_screenhack (saver_screen_info *ssi)
+{
+  saver_info *si = ssi->global;
+  saver_preferences *p = &si->prefs;
+  int retry_count = 0;
+  screenhack *hack;
+  pid_t forked;
+  int new_hack;
+  Bool force;
+
+  if (ssi->prelaunch_pid || !monitor_powered_on_p (si))
+    return;
+
+ AGAIN:
+  new_hack = choose_screenhack (ssi, True, &force);
+  if (new_hack < 0)
+    return;
+
+  hack = p->screenhacks[new_hack];
+
+  /* Don't pick something else instead: that would mean image grabbers
+     never got to run.  The cycle timer will start this one, or another
+     random one, the usual way. */
+  if (hack_grabs_images_p (hack->command))
+    {
+      if (p->verbose_p)
+        fprintf (stderr, "%s: %d: not prelaunching \"%s\": "
+                 "it grabs images.\n", blurb(), ssi->number,
+                 (hack->name ? hack->name : hack->command));
+      return;
+    }
+
+  if (force
+      ? !create_prelaunch_window (ssi, hack->visual)
+      : (!hack->enabled_p ||
+         !on_path_p (hack->command) ||
+         !create_prelaunch_window (ssi, hack->visual)))
+    {
+      /* Let spawn_screenhack() sort it out (and complain) at cycle time. */
+      if (force || ++retry_count > (p->screenhacks_count*4))
+        return;
+      goto AGAIN;
+    }
+
+  forked = fork_and_exec_1 (ssi, ssi->prelaunch_window, hack->command);
+  if (forked <= 0)
+    {
+      destroy_prelaunch_window (ssi);
+      return;
+    }
+
+  ssi->prelaunch_pid = forked;
+  ssi->prelaunch_hack = new_hack;
+}
+
+
+/* Called a few seconds after prelaunch_screenhack(), once the hack has
+   (probably) finished starting up, so that it stops using the CPU.
+ */
+void
+pause_prelaunched_screenhack (saver_screen_info *ssi)
+{
+#ifdef SIGSTOP
+  saver_info *si = ssi->global;
+  saver_preferences *p = &si->prefs;
+  XWindowAttributes xgwa;
+
+  if (!ssi->prelaunch_pid || job_stopped_p (ssi->prelaunch_pid))
+    return;
+
+  /* Hacks that grab the desktop image map their window while doing so.
+     hack_grabs_images_p() should have kept this one from being launched,
+     but if it has no configuration file, it's on screen now over the
+     running hack, and what it grabbed was that hack rather than the
+     desktop.  Throw it away, and let the cycle timer start a new one. */
+  XGetWindowAttributes (si->dpy, ssi->prelaunch_window, &xgwa);
+  if (xgwa.map_state != IsUnmapped)
+    {
+      if (p->verbose_p)
+        fprintf (stderr, "%s: %d: prelaunch window was mapped; "
+                 "killing pid %lu.\n",
+                 blurb(), ssi->number, (unsigned long) ssi->prelaunch_pid);
+      discard_prelaunched_screenhack (ssi);
+      return;
+    }
+
+  kill_job (si, ssi->prelaunch_pid, SIGSTOP);
+#endif /* SIGSTOP */
+}
+
+
+/* Replaces the running hack with the prelaunched one, if there is one.
+   Returns False if there isn't.
+ */
+Bool
+adopt_prelaunched_screenhack (saver_screen_info *ssi)
+{
+  saver_info *si = ssi->global;
+  saver_preferences *p = &si->prefs;
+
+  if (!ssi->prelaunch_pid ||
+      !ssi->prelaunch_window ||
+      ssi->prelaunch_hack >= p->screenhacks_count)  /* init file changed */
+    return False;
+
+  if (ssi->pid)
+    kill_job (si, ssi->pid, SIGTERM);
+  ssi->pid = 0;
+
+  adopt_prelaunch_window (ssi);
+
+  ssi->pid = ssi->prelaunch_pid;
+  ssi->current_hack = ssi->prelaunch_hack;
+  ssi->prelaunch_pid = 0;
+
+#ifdef SIGSTOP
+  if (job_stopped_p (ssi->pid))
+    kill_job (si, ssi->pid, SIGCONT);
+#endif /* SIGSTOP */
+
+  store_saver_status (si);  /* store current hack number */
+  return True;
+}
+
+
+static void
+kill_prelaunched_job (saver_info *si, pid_t pid)
+{
+#ifdef SIGSTOP
+  /* A stopped process can't act on SIGTERM until it is continued. */
+  if (job_stopped_p (pid))
+    kill_job (si, pid, SIGCONT);
+#endif /* SIGSTOP */
+  kill_job (si, pid, SIGTERM);
+}
+
+
+void
+discard_prelaunched_screenhack (saver_screen_info *ssi)
+{
+  saver_info *si = ssi->global;
+  if (ssi->prelaunch_pid)
+    kill_prelaunched_job (si, ssi->prelaunch_pid);
+  ssi->prelaunch_pid = 0;
+  destroy_prelaunch_window (ssi);
+}
+
+
 /* Called when we're exiting abnormally, to kill off the subproc. */
 void
 emergency_kill_subproc (saver_info *si)
@@ -1108,6 +1347,11 @@ emergency_kill_subproc (saver_info *si)
 	  kill_job (si, ssi->pid, SIGTERM);
 	  ssi->pid = 0;
 	}
+      if (ssi->prelaunch_pid)
+	{
+	  kill_prelaunched_job (si, ssi->prelaunch_pid);
+	  ssi->prelaunch_pid = 0;
+	}
     }
 }
 
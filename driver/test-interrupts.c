@@ -0,0 +1,200 @@
+/* test-interrupts.c --- checking and timing the /proc/interrupts sampler.
+ * xscreensaver, Copyright (c) 2026 Jamie Zawinski <jwz@jwz.org>
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation.  No representations are made about the suitability of this
+ * software for any purpose.  It is provided "as is" without express or
+ * implied warranty.
+ *
+ * With no file argument, this writes a fake /proc/interrupts with one column
+ * per CPU (128 by default), checks that the sampler notices the keyboard and
+ * mouse counters changing (including after the rows move), and then times
+ * one check_pointer_timer tick's worth of work against re-reading the whole
+ * file with stdio, which is how it used to be done.  With a file argument,
+ * only the timing is done, on that file: try /proc/interrupts.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#ifdef HAVE_UNISTD_H
+# include <unistd.h>
+#endif
+
+#include "interrupts.h"
+
+static char *progname;
+static int ncpus = 128;
+static int nrows = 200;
+
+
+static void
+write_fake (const char *file, int shift, unsigned long kbd, unsigned long ptr)
+{
+  FILE *f = fopen (file, "w");
+  int i, j;
+  if (!f) { perror (file); exit (1); }
+
+  fprintf (f, "     ");
+  for (j = 0; j < ncpus; j++)
+    fprintf (f, "      CPU%-4d", j);
+  fprintf (f, "\n");
+
+  for (i = 0; i < nrows + shift; i++)
+    {
+      int irq = (i < shift ? 1000 + i : i - shift);
+      unsigned long n = 12345678 + irq * 1000;
+      const char *name = "PCI-MSI 524288-edge      nvme0q3";
+      if (irq == 1)  n = kbd, name = "IO-APIC    1-edge      i8042";
+      if (irq == 12) n = ptr, name = "IO-APIC   12-edge      i8042";
+      if (irq == 9)  name = "IO-APIC    9-fasteoi   acpi, usb";
+      fprintf (f, "%4d:", irq);
+      for (j = 0; j < ncpus; j++)
+        fprintf (f, " %10lu", (j == 0 ? n : n / (j + 1)));
+      fprintf (f, "  %s\n", name);
+    }
+  fclose (f);
+}
+
+
+/* What proc_interrupts_activity_p() in timers.c used to do on every tick.
+ */
+static int
+stdio_poll (const char *file)
+{
+  static char last_kbd[10240], last_ptr[10240];
+  char line[sizeof(last_kbd)];
+  int kbd = 0, ptr = 0, i8042 = 0, result = 0;
+  FILE *f = fopen (file, "r");
+  if (!f) return -1;
+  while (fgets (line, sizeof(line)-1, f))
+    {
+      int i8042_p = !!strstr (line, "i8042");
+      if (i8042_p) i8042++;
+      if (strchr (line, ','))
+        ;
+      else if (!kbd && (strstr (line, "keyboard") || (i8042_p && i8042 == 1)))
+        {
+          if (*last_kbd && strcmp (line, last_kbd)) result |= IRQ_SAMPLER_KBD;
+          strcpy (last_kbd, line);
+          kbd = 1;
+        }
+      else if (!ptr && (strstr (line, "PS/2 Mouse") || (i8042_p && i8042 == 2)))
+        {
+          if (*last_ptr && strcmp (line, last_ptr)) result |= IRQ_SAMPLER_PTR;
+          strcpy (last_ptr, line);
+          ptr = 1;
+        }
+      if (kbd && ptr) break;
+    }
+  fclose (f);
+  return result;
+}
+
+
+static double
+now (void)
+{
+  struct timeval tv;
+  gettimeofday (&tv, 0);
+  return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+
+static void
+check (irq_sampler *s, int expected, const char *what)
+{
+  int got = irq_sampler_poll (s);
+  if (got != expected)
+    {
+      fprintf (stderr, "%s: %s: got %d, expected %d\n",
+               progname, what, got, expected);
+      exit (1);
+    }
+}
+
+
+int
+main (int argc, char **argv)
+{
+  const char *file = 0;
+  char fake[100];
+  irq_sampler *s;
+  const char *why = 0;
+  int ticks = 2000;
+  double t0, t1, t2;
+  int i;
+
+  progname = argv[0];
+  for (i = 1; i < argc; i++)
+    if (!strcmp (argv[i], "-cpus") && i+1 < argc)
+      ncpus = atoi (argv[++i]);
+    else if (!strcmp (argv[i], "-ticks") && i+1 < argc)
+      ticks = atoi (argv[++i]);
+    else if (argv[i][0] != '-' && !file)
+      file = argv[i];
+    else
+      {
+        fprintf (stderr, "usage: %s [-cpus N] [-ticks N] [file]\n", progname);
+        exit (1);
+      }
+
+  if (!file)
+    {
+      sprintf (fake, "/tmp/test-interrupts.%d", (int) getpid());
+      file = fake;
+
+      write_fake (file, 0, 100, 200);
+      s = irq_sampler_open (file, &why);
+      if (!s)
+        {
+          fprintf (stderr, "%s: %s: %s\n", progname, file, why);
+          exit (1);
+        }
+      check (s, 0, "first poll");
+      check (s, 0, "no change");
+      write_fake (file, 0, 101, 200);
+      check (s, IRQ_SAMPLER_KBD, "keyboard");
+      write_fake (file, 0, 101, 201);
+      check (s, IRQ_SAMPLER_PTR, "mouse");
+      write_fake (file, 3, 102, 202);
+      check (s, IRQ_SAMPLER_KBD | IRQ_SAMPLER_PTR, "rows moved");
+      check (s, 0, "no change after move");
+      irq_sampler_close (s);
+      fprintf (stderr, "%s: %d CPUs: ok\n", progname, ncpus);
+    }
+
+  s = irq_sampler_open (file, &why);
+  if (!s)
+    {
+      fprintf (stderr, "%s: %s: %s\n", progname, file, why);
+      exit (1);
+    }
+
+  t0 = now();
+  for (i = 0; i < ticks; i++)
+    stdio_poll (file);
+  t1 = now();
+  for (i = 0; i < ticks; i++)
+    irq_sampler_poll (s);
+  t2 = now();
+
+  fprintf (stderr, "%s: %s: stdio %.1f us/tick, sampler %.1f us/tick\n",
+           progname, file,
+           (t1 - t0) * 1000000 / ticks,
+           (t2 - t1) * 1000000 / ticks);
+
+  irq_sampler_close (s);
+  if (file == fake)
+    unlink (fake);
+  exit (0);
+}
@@ -49,6 +49,10 @@
 
 #include "xscreensaver.h"
 
+#ifdef HAVE_PROC_INTERRUPTS
+# include "interrupts.h"
+#endif /* HAVE_PROC_INTERRUPTS */
+
 #undef ABS
 #define ABS(x)((x)<0?-(x):(x))
 
@@ -162,6 +166,9 @@ notice_events (saver_info *si, Window window, Bool top_p)
      count as activity...  Fortunately, /proc/interrupts helps, on
      systems that have it.  Oh, if it's a PS/2 mouse, not serial or USB.
      This sucks!
+
+     None of this applies when the server has XInput2: then we don't come
+     here at all, and raw events tell us about clicks and wheels, too.
    */
   XSelectInput (si->dpy, window,
                 SubstructureNotifyMask | PropertyChangeMask | events);
@@ -239,6 +246,66 @@ start_notice_events_timer (saver_info *si, Window w, Bool verbose_p)
 }
 
 
+/* With prefs.prelaunch_p, the next hack is started this long before the
+   cycle timer goes off, and suspended this long after that: long enough
+   for most hacks to get through their startup, but not much longer.
+ */
+#define PRELAUNCH_LEAD   5000
+#define PRELAUNCH_SETTLE 3500
+
+static void
+prelaunch_stop_timer (XtPointer closure, XtIntervalId *id)
+{
+  saver_info *si = (saver_info *) closure;
+  int i;
+  si->prelaunch_id = 0;
+  for (i = 0; i < si->nscreens; i++)
+    pause_prelaunched_screenhack (&si->screens[i]);
+}
+
+static void
+prelaunch_timer (XtPointer closure, XtIntervalId *id)
+{
+  saver_info *si = (saver_info *) closure;
+  int i;
+  si->prelaunch_id = 0;
+
+  if (!si->screen_blanked_p ||
+      !si->cycle_id ||
+      si->dbox_up_p ||
+      si->throttled_p ||
+      si->demoing_p ||
+      si->selection_mode != 0)
+    return;
+
+  for (i = 0; i < si->nscreens; i++)
+    prelaunch_screenhack (&si->screens[i]);
+
+  si->prelaunch_id = XtAppAddTimeOut (si->app, PRELAUNCH_SETTLE,
+                                      prelaunch_stop_timer, (XtPointer) si);
+}
+
+/* Called whenever the cycle timer is started: arranges for the next hack
+   to be started a little early, if that's what we're doing.
+ */
+void
+schedule_prelaunch_timer (saver_info *si, Time how_long)
+{
+  saver_preferences *p = &si->prefs;
+
+  if (si->prelaunch_id)
+    XtRemoveTimeOut (si->prelaunch_id);
+  si->prelaunch_id = 0;
+
+  if (p->prelaunch_p &&
+      !si->demoing_p &&
+      si->selection_mode == 0 &&
+      how_long > PRELAUNCH_LEAD * 2)
+    si->prelaunch_id = XtAppAddTimeOut (si->app, how_long - PRELAUNCH_LEAD,
+                                        prelaunch_timer, (XtPointer) si);
+}
+
+
 /* When the screensaver is active, this timer will periodically change
    the running program.
  */
@@ -270,13 +337,24 @@ cycle_timer (XtPointer closure, XtIntervalId *id)
       int i;
       maybe_reload_init_file (si);
       for (i = 0; i < si->nscreens; i++)
-        kill_screenhack (&si->screens[i]);
+        {
+          /* If prelaunch_timer() already started the next hack, just show
+             it, instead of starting one from scratch. */
+          saver_screen_info *ssi = &si->screens[i];
+          if (si->throttled_p ||
+              si->selection_mode != 0 ||
+              !adopt_prelaunched_screenhack (ssi))
+            kill_screenhack (ssi);
+        }
 
       raise_window (si, True, True, False);
 
       if (!si->throttled_p)
-        for (i = 0; i < si->nscreens; i++)
-          spawn_screenhack (&si->screens[i]);
+        {
+          for (i = 0; i < si->nscreens; i++)
+            if (!si->screens[i].pid)
+              spawn_screenhack (&si->screens[i]);
+        }
       else
         {
           if (p->verbose_p)
@@ -293,6 +371,8 @@ cycle_timer (XtPointer closure, XtIntervalId *id)
       if (p->debug_p)
         fprintf (stderr, "%s: starting cycle_timer (%ld, %ld)\n",
                  blurb(), how_long, si->cycle_id);
+
+      schedule_prelaunch_timer (si, how_long);
     }
   else
     {
@@ -546,6 +626,38 @@ check_pointer_timer (XtPointer closure, XtIntervalId *id)
 }
 
 
+#ifdef HAVE_XINPUT2
+/* Raw motion that arrives less than a second after the last look at the
+   pointer doesn't get a look of its own, but it mustn't be forgotten
+   either: the first event of a short nudge usually sees a move of only a
+   pixel or two, less than the hysteresis, and the rest of the nudge comes
+   within the same second.  So this timer takes one more look at the end
+   of that second, and if the pointer has moved, wakes up
+   sleep_until_idle() the same way idle_timer() does.
+ */
+static void
+raw_motion_timer (XtPointer closure, XtIntervalId *id)
+{
+  saver_info *si = (saver_info *) closure;
+  Bool moved_p = False;
+  int i;
+
+  si->raw_motion_timer_id = 0;
+  si->last_raw_motion_check = time ((time_t *) 0);
+
+  for (i = 0; i < si->nscreens; i++)
+    if (pointer_moved_p (&si->screens[i], False))
+      moved_p = True;
+
+  if (moved_p)
+    {
+      si->raw_motion_moved_p = True;
+      idle_timer (closure, 0);
+    }
+}
+#endif /* HAVE_XINPUT2 */
+
+
 /* An unfortunate situation is this: the saver is not active, because the
    user has been typing.  The machine is a laptop.  The user closes the lid
    and suspends it.  The CPU halts.  Some hours later, the user opens the
@@ -681,6 +793,7 @@ swallow_unlock_typeahead_events (saver_info *si, XEvent *e)
       explicitly informed by MIT-SCREEN-SAVER server event;
       poll server idle time with XIDLE extension;
       select events on all windows, and note absence of recent events;
+      select XInput2 raw events on the root, and note absence of them;
       note that /proc/interrupts has not changed in a while;
       activated by clientmessage.
 
@@ -690,6 +803,7 @@ swallow_unlock_typeahead_events (saver_info *si, XEvent *e)
       explicitly informed by SGI SCREEN_SAVER server event;
       explicitly informed by MIT-SCREEN-SAVER server event;
       select events on all windows, and note events on any of them;
+      note XInput2 raw key, button or motion events;
       note that a client updated their window's _NET_WM_USER_TIME property;
       note that /proc/interrupts has changed;
       deactivated by clientmessage.
@@ -716,10 +830,12 @@ sleep_until_idle (saver_info *si, Bool until_idle_p)
   } event;
 
   /* We need to select events on all windows if we're not using any extensions.
-     Otherwise, we don't need to. */
+     Otherwise, we don't need to.  XInput2 counts: raw events on the root
+     window tell us about input to every window. */
   Bool scanning_all_windows = !(si->using_xidle_extension ||
                                 si->using_mit_saver_extension ||
-                                si->using_sgi_saver_extension);
+                                si->using_sgi_saver_extension ||
+                                si->using_xinput2_extension);
 
   /* We need to periodically wake up and check for idleness if we're not using
      any extensions, or if we're using the XIDLE extension.  The other two
@@ -736,11 +852,13 @@ sleep_until_idle (saver_info *si, Bool until_idle_p)
      position with the XIDLE extension, but we do need to periodically wake up
      and query the server with that extension.  For our purposes, polling
      /proc/interrupts is just like polling the mouse position.  It has to
-     happen on the same kind of schedule. */
+     happen on the same kind of schedule.  With XInput2, raw motion events
+     tell us when to look at the mouse, so there's no need to poll. */
   Bool polling_mouse_position = (si->using_proc_interrupts ||
                                  !(si->using_xidle_extension ||
                                    si->using_mit_saver_extension ||
-                                   si->using_sgi_saver_extension) ||
+                                   si->using_sgi_saver_extension ||
+                                   si->using_xinput2_extension) ||
 				   si->using_xinput_extension);
 
   const char *why = 0;  /* What caused the idle-state to change? */
@@ -764,6 +882,21 @@ sleep_until_idle (saver_info *si, Bool until_idle_p)
 
       switch (event.x_event.xany.type) {
       case 0:		/* our synthetic "timeout" event has been signalled */
+#ifdef HAVE_XINPUT2
+        if (si->raw_motion_moved_p)
+          {
+            /* No, it was raw_motion_timer() that woke us. */
+            si->raw_motion_moved_p = False;
+            if (until_idle_p)
+              reset_timers (si);
+            else if (!si->demoing_p)
+              {
+                why = "XI2 mouse motion";
+                goto DONE;
+              }
+            break;
+          }
+#endif /* HAVE_XINPUT2 */
 	if (until_idle_p)
 	  {
 	    Time idle;
@@ -1174,6 +1307,76 @@ sleep_until_idle (saver_info *si, Bool until_idle_p)
 	else
 #endif /* HAVE_SGI_SAVER_EXTENSION */
 
+#ifdef HAVE_XINPUT2
+        if (si->using_xinput2_extension &&
+            event.x_event.type == GenericEvent &&
+            event.x_event.xcookie.extension == si->xinput2_opcode)
+          {
+            /* A raw event from XInput2: some key, button or wheel was
+               pressed, or some mouse moved, no matter what window it was
+               in.  Never look at which key it was.
+             */
+            XGenericEventCookie *cookie = &event.x_event.xcookie;
+            int evtype = 0;
+
+            if (XGetEventData (si->dpy, cookie))
+              {
+                evtype = cookie->evtype;
+                XFreeEventData (si->dpy, cookie);
+              }
+
+            if (evtype == XI_RawMotion)
+              {
+                /* Raw motion has no position, and comes in at whatever rate
+                   the mouse reports, so look at the pointer at most once a
+                   second, and let the usual hysteresis decide whether it
+                   really moved.
+                 */
+                time_t now = time ((time_t *) 0);
+                Bool moved_p = False;
+                int i;
+
+                if (now == si->last_raw_motion_check)
+                  {
+                    if (!si->raw_motion_timer_id)
+                      si->raw_motion_timer_id =
+                        XtAppAddTimeOut (si->app, 1000, raw_motion_timer,
+                                         (XtPointer) si);
+                    break;
+                  }
+                si->last_raw_motion_check = now;
+
+                for (i = 0; i < si->nscreens; i++)
+                  if (pointer_moved_p (&si->screens[i], False))
+                    moved_p = True;
+                if (!moved_p)
+                  break;
+              }
+            else if (evtype != XI_RawKeyPress &&
+                     evtype != XI_RawButtonPress)
+              break;
+
+            if (until_idle_p)
+              {
+                /* Don't restart the idle timer on every keystroke. */
+                if (si->last_activity_time != time ((time_t *) 0))
+                  reset_timers (si);
+              }
+            else if (si->demoing_p && evtype == XI_RawMotion)
+              /* When we're demoing a single hack, mouse motion doesn't
+                 cause deactivation.  Only clicks and keypresses do. */
+              ;
+            else
+              {
+                why = (evtype == XI_RawMotion ? "XI2 mouse motion" :
+                       evtype == XI_RawKeyPress ? "XI2 keyboard activity" :
+                       "XI2 mouse click");
+                goto DONE;
+              }
+          }
+        else
+#endif /* HAVE_XINPUT2 */
+
 #ifdef HAVE_XINPUT
         /* If we got a MotionNotify event, check to see if the mouse has
            moved far enough to count as "real" motion, if not, then ignore
@@ -1313,6 +1516,14 @@ sleep_until_idle (saver_info *si, Bool until_idle_p)
       XtRemoveTimeOut (si->check_pointer_timer_id);
       si->check_pointer_timer_id = 0;
     }
+#ifdef HAVE_XINPUT2
+  if (si->raw_motion_timer_id)
+    {
+      XtRemoveTimeOut (si->raw_motion_timer_id);
+      si->raw_motion_timer_id = 0;
+    }
+  si->raw_motion_moved_p = False;
+#endif /* HAVE_XINPUT2 */
   if (si->timer_id)
     {
       XtRemoveTimeOut (si->timer_id);
@@ -1440,146 +1651,48 @@ query_proc_interrupts_available (saver_info *si, const char **why)
 }
 
 
+/* The keyboard and mouse rows are found once, and after that only those
+   rows are re-read; see interrupts.c.
+ */
 static Bool
 proc_interrupts_activity_p (saver_info *si)
 {
-  static FILE *f0 = 0;
-  FILE *f1 = 0;
-  int fd;
-  static char last_kbd_line[255] = { 0, };
-  static char last_ptr_line[255] = { 0, };
-  char new_line[sizeof(last_kbd_line)];
-  Bool checked_kbd = False, kbd_changed = False;
-  Bool checked_ptr = False, ptr_changed = False;
-  int i8042_count = 0;
-
-  if (!f0)
-    {
-      /* First time -- open the file. */
-      f0 = fopen (PROC_INTERRUPTS, "r");
-      if (!f0)
-        {
-          char buf[255];
-          sprintf(buf, "%s: error opening %s", blurb(), PROC_INTERRUPTS);
-          perror (buf);
-          goto FAIL;
-        }
-
-# if defined(HAVE_FCNTL) && defined(FD_CLOEXEC)
-      /* Close this fd upon exec instead of inheriting / leaking it. */
-      if (fcntl (fileno (f0), F_SETFD, FD_CLOEXEC) != 0)
-        perror ("fcntl: CLOEXEC:");
-# endif
-    }
+  static irq_sampler *sampler = 0;
+  static Bool failed_p = False;
+  const char *why = 0;
+  int changed;
 
-  if (f0 == (FILE *) -1)	    /* means we got an error initializing. */
+  if (failed_p)			/* means we got an error initializing. */
     return False;
 
-  fd = dup (fileno (f0));
-  if (fd < 0)
-    {
-      char buf[255];
-      sprintf(buf, "%s: could not dup() the %s fd", blurb(), PROC_INTERRUPTS);
-      perror (buf);
-      goto FAIL;
-    }
-
-  f1 = fdopen (fd, "r");
-  if (!f1)
+  if (!sampler)
     {
-      char buf[255];
-      sprintf(buf, "%s: could not fdopen() the %s fd", blurb(),
-              PROC_INTERRUPTS);
-      perror (buf);
-      goto FAIL;
+      /* First time -- open the file. */
+      sampler = irq_sampler_open (PROC_INTERRUPTS, &why);
+      if (!sampler)
+        goto FAIL;
     }
 
-  /* Actually, I'm unclear on why this fseek() is necessary, given the timing
-     of the dup() above, but it is. */
-  if (fseek (f1, 0, SEEK_SET) != 0)
+  changed = irq_sampler_poll (sampler);
+  if (changed < 0)
     {
-      char buf[255];
-      sprintf(buf, "%s: error rewinding %s", blurb(), PROC_INTERRUPTS);
-      perror (buf);
+      why = "error reading";
       goto FAIL;
     }
 
-  /* Now read through the pseudo-file until we find the "keyboard",
-     "PS/2 mouse", or "i8042" lines. */
-
-  while (fgets (new_line, sizeof(new_line)-1, f1))
-    {
-      Bool i8042_p = !!strstr (new_line, "i8042");
-      if (i8042_p) i8042_count++;
-
-      if (strchr (new_line, ','))
-        {
-          /* Ignore any line that has a comma on it: this is because
-             a setup like this:
-
-                 12:     930935          XT-PIC  usb-uhci, PS/2 Mouse
-
-             is really bad news.  It *looks* like we can note mouse
-             activity from that line, but really, that interrupt gets
-             fired any time any USB device has activity!  So we have
-             to ignore any shared IRQs.
-           */
-        }
-      else if (!checked_kbd &&
-               (strstr (new_line, "keyboard") ||
-                (i8042_p && i8042_count == 1)))
-        {
-          /* Assume the keyboard interrupt is the line that says "keyboard",
-             or the *first* line that says "i8042".
-           */
-          kbd_changed = (*last_kbd_line && !!strcmp (new_line, last_kbd_line));
-          strcpy (last_kbd_line, new_line);
-          checked_kbd = True;
-        }
-      else if (!checked_ptr &&
-               (strstr (new_line, "PS/2 Mouse") ||
-                (i8042_p && i8042_count == 2)))
-        {
-          /* Assume the mouse interrupt is the line that says "PS/2 mouse",
-             or the *second* line that says "i8042".
-           */
-          ptr_changed = (*last_ptr_line && !!strcmp (new_line, last_ptr_line));
-          strcpy (last_ptr_line, new_line);
-          checked_ptr = True;
-        }
-
-      if (checked_kbd && checked_ptr)
-        break;
-    }
-
-  if (checked_kbd || checked_ptr)
-    {
-      fclose (f1);
-
-      if (si->prefs.debug_p && (kbd_changed || ptr_changed))
-        fprintf (stderr, "%s: /proc/interrupts activity: %s\n",
-                 blurb(),
-                 ((kbd_changed && ptr_changed) ? "mouse and kbd" :
-                  kbd_changed ? "kbd" :
-                  ptr_changed ? "mouse" : "ERR"));
-
-      return (kbd_changed || ptr_changed);
-    }
-
+  if (si->prefs.debug_p && changed)
+    fprintf (stderr, "%s: /proc/interrupts activity: %s\n",
+             blurb(),
+             (changed == (IRQ_SAMPLER_KBD | IRQ_SAMPLER_PTR) ? "mouse and kbd" :
+              changed == IRQ_SAMPLER_KBD ? "kbd" : "mouse"));
 
-  /* If we got here, we didn't find either a "keyboard" or a "PS/2 Mouse"
-     line in the file at all. */
-  fprintf (stderr, "%s: no keyboard or mouse data in %s?\n",
-           blurb(), PROC_INTERRUPTS);
+  return (changed != 0);
 
  FAIL:
-  if (f1)
-    fclose (f1);
-
-  if (f0 && f0 != (FILE *) -1)
-    fclose (f0);
-
-  f0 = (FILE *) -1;
+  fprintf (stderr, "%s: %s: %s\n", blurb(), PROC_INTERRUPTS, why);
+  irq_sampler_close (sampler);
+  sampler = 0;
+  failed_p = True;
   return False;
 }
 
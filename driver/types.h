@@ -75,6 +75,10 @@ struct xinput_dev_info {
 };
 #endif
 
+#ifdef HAVE_XINPUT2
+#include <X11/extensions/XInput2.h>
+#endif
+
 /* This structure holds all the user-specified parameters, read from the
    command line, the resource database, or entered through a dialog box.
  */
@@ -93,6 +97,8 @@ struct saver_preferences {
   Bool capture_stderr_p;	/* whether to redirect stdout/stderr  */
   Bool ignore_uninstalled_p;	/* whether to avoid displaying or complaining
                                    about hacks that are not on $PATH */
+  Bool prelaunch_p;		/* whether to start the next hack, stopped,
+                                   a few seconds before the cycle ends */
   Bool debug_p;			/* pay no mind to the man behind the curtain */
   Bool xsync_p;			/* whether XSynchronize has been called */
 
@@ -230,6 +236,14 @@ struct saver_info {
   int num_xinput_devices;
 # endif
 
+  Bool using_xinput2_extension;    /* XI2 raw events instead of window scan. */
+#ifdef HAVE_XINPUT2
+  int xinput2_opcode;              /* To recognise our GenericEvents.        */
+  time_t last_raw_motion_check;    /* Raw motion is only polled once/second. */
+  XtIntervalId raw_motion_timer_id; /* Look again at the end of the second. */
+  Bool raw_motion_moved_p;         /* ...and it saw the pointer move.      */
+# endif
+
   /* =======================================================================
      blanking
      ======================================================================= */
@@ -311,6 +325,7 @@ struct saver_info {
 
   XtIntervalId lock_id;		/* Timer to implement `prefs.lock_timeout' */
   XtIntervalId cycle_id;	/* Timer to implement `prefs.cycle' */
+  XtIntervalId prelaunch_id;	/* Timer to implement `prefs.prelaunch_p' */
   XtIntervalId timer_id;	/* Timer to implement `prefs.timeout' */
   XtIntervalId watchdog_id;	/* Timer to implement `prefs.watchdog */
   XtIntervalId check_pointer_timer_id;	/* `prefs.pointer_timeout' */
@@ -429,6 +444,14 @@ struct saver_screen_info {
   int current_hack;		/* Index into `prefs.screenhacks' */
   pid_t pid;
 
+  int prelaunch_hack;		/* The next hack, if it has been started */
+  pid_t prelaunch_pid;		/* early (see `prefs.prelaunch_p'.)  It runs */
+  Window prelaunch_window;	/* in this unmapped window until the cycle */
+  Visual *prelaunch_visual;	/* timer goes off and adopts it. */
+  Colormap prelaunch_cmap;
+  unsigned long prelaunch_black_pixel;
+  Bool prelaunch_install_cmap_p;
+
   int stderr_text_x;
   int stderr_text_y;
   int stderr_line_height;
@@ -1150,6 +1150,34 @@ safe_XF86VidModeGetViewPort (Display *dpy, int screen, int *xP, int *yP)
 #endif /* HAVE_XF86VMODE */
 
 
+/* Fills in the attributes that every saver window gets, and returns
+   the mask for them.
+ */
+static unsigned long
+saver_window_attributes (XSetWindowAttributes *attrs,
+                         Colormap cmap, unsigned long black_pixel)
+{
+  attrs->override_redirect = True;
+
+  /* When use_mit_saver_extension or use_sgi_saver_extension is true, we won't
+     actually be reading these events during normal operation; but we still
+     need to see Button events for demo-mode to work properly.
+   */
+  attrs->event_mask = (KeyPressMask | KeyReleaseMask |
+		       ButtonPressMask | ButtonReleaseMask |
+		       PointerMotionMask);
+
+  attrs->backing_store = NotUseful;
+  attrs->colormap = cmap;
+  attrs->background_pixel = black_pixel;
+  attrs->backing_pixel = black_pixel;
+  attrs->border_pixel = black_pixel;
+
+  return (CWOverrideRedirect | CWEventMask | CWBackingStore | CWColormap |
+	  CWBackPixel | CWBackingPixel | CWBorderPixel);
+}
+
+
 static void
 initialize_screensaver_window_1 (saver_screen_info *ssi)
 {
@@ -1202,23 +1230,7 @@ initialize_screensaver_window_1 (saver_screen_info *ssi)
       ssi->black_pixel = BlackPixelOfScreen (ssi->screen);
     }
 
-  attrmask = (CWOverrideRedirect | CWEventMask | CWBackingStore | CWColormap |
-	      CWBackPixel | CWBackingPixel | CWBorderPixel);
-  attrs.override_redirect = True;
-
-  /* When use_mit_saver_extension or use_sgi_saver_extension is true, we won't
-     actually be reading these events during normal operation; but we still
-     need to see Button events for demo-mode to work properly.
-   */
-  attrs.event_mask = (KeyPressMask | KeyReleaseMask |
-		      ButtonPressMask | ButtonReleaseMask |
-		      PointerMotionMask);
-
-  attrs.backing_store = NotUseful;
-  attrs.colormap = ssi->cmap;
-  attrs.background_pixel = ssi->black_pixel;
-  attrs.backing_pixel = ssi->black_pixel;
-  attrs.border_pixel = ssi->black_pixel;
+  attrmask = saver_window_attributes (&attrs, ssi->cmap, ssi->black_pixel);
 
   if (!p->verbose_p || printed_visual_info)
     ;
@@ -1870,34 +1882,17 @@ get_screen_gl_visual (saver_info *si, int real_screen_number)
 }
 
 
-Bool
-select_visual (saver_screen_info *ssi, const char *visual_name)
+/* Returns the visual that the named one means on this screen (or 0 if there
+   isn't one) and whether it needs its own colormap.
+ */
+static Visual *
+hack_visual (saver_screen_info *ssi, const char *visual_name,
+             Bool *install_cmap_ret)
 {
-  XWindowAttributes xgwa;
   saver_info *si = ssi->global;
   saver_preferences *p = &si->prefs;
   Bool install_cmap_p = p->install_cmap_p;
-  Bool was_installed_p = (ssi->cmap != DefaultColormapOfScreen(ssi->screen));
   Visual *new_v = 0;
-  Bool got_it;
-
-  /* On some systems (most recently, MacOS X) OpenGL programs get confused
-     when you kill one and re-start another on the same window.  So maybe
-     it's best to just always destroy and recreate the xscreensaver window
-     when changing hacks, instead of trying to reuse the old one?
-   */
-  Bool always_recreate_window_p = True;
-
-  get_screen_gl_visual (si, 0);   /* let's probe all the GL visuals early */
-
-  /* We make sure the existing window is actually on ssi->screen before
-     trying to use it, in case things moved around radically when monitors
-     were added or deleted.  If we don't do this we could get a BadMatch
-     even though the depths match.  I think.
-   */
-  memset (&xgwa, 0, sizeof(xgwa));
-  if (ssi->screensaver_window)
-    XGetWindowAttributes (si->dpy, ssi->screensaver_window, &xgwa);
 
   if (visual_name && *visual_name)
     {
@@ -1933,12 +1928,84 @@ select_visual (saver_screen_info *ssi, const char *visual_name)
       new_v = ssi->default_visual;
     }
 
-  got_it = !!new_v;
-
   if (new_v && new_v != DefaultVisualOfScreen(ssi->screen))
     /* It's not the default visual, so we have no choice but to install. */
     install_cmap_p = True;
 
+  *install_cmap_ret = install_cmap_p;
+  return new_v;
+}
+
+
+/* Called once ssi->screensaver_window has been replaced by a new window:
+   puts the new one on top and gets rid of the old one.
+ */
+static void
+replace_screensaver_window (saver_screen_info *ssi,
+                            Window old_w, Colormap old_c)
+{
+  saver_info *si = ssi->global;
+  saver_preferences *p = &si->prefs;
+
+  /* stderr_overlay_window is a child of screensaver_window, so we need
+     to destroy that as well (actually, we just need to invalidate and
+     drop our pointers to it, but this will destroy it, which is ok so
+     long as it happens before old_w itself is destroyed.) */
+  reset_stderr (ssi);
+
+  raise_window (si, True, True, False);
+  store_vroot_property (si->dpy,
+                        ssi->screensaver_window, ssi->screensaver_window);
+
+  /* Transfer any grabs from the old window to the new. */
+  maybe_transfer_grabs (ssi, old_w, ssi->screensaver_window, ssi->number);
+
+  /* Now we can destroy the old window without horking our grabs. */
+  XDestroyWindow (si->dpy, old_w);
+
+  if (p->verbose_p)
+    fprintf (stderr, "%s: %d: destroyed old saver window 0x%lx.\n",
+             blurb(), ssi->number, (unsigned long) old_w);
+
+  if (old_c &&
+      old_c != DefaultColormapOfScreen (ssi->screen) &&
+      old_c != ssi->demo_cmap)
+    XFreeColormap (si->dpy, old_c);
+}
+
+
+Bool
+select_visual (saver_screen_info *ssi, const char *visual_name)
+{
+  XWindowAttributes xgwa;
+  saver_info *si = ssi->global;
+  saver_preferences *p = &si->prefs;
+  Bool install_cmap_p;
+  Bool was_installed_p = (ssi->cmap != DefaultColormapOfScreen(ssi->screen));
+  Visual *new_v;
+  Bool got_it;
+
+  /* On some systems (most recently, MacOS X) OpenGL programs get confused
+     when you kill one and re-start another on the same window.  So maybe
+     it's best to just always destroy and recreate the xscreensaver window
+     when changing hacks, instead of trying to reuse the old one?
+   */
+  Bool always_recreate_window_p = True;
+
+  get_screen_gl_visual (si, 0);   /* let's probe all the GL visuals early */
+
+  /* We make sure the existing window is actually on ssi->screen before
+     trying to use it, in case things moved around radically when monitors
+     were added or deleted.  If we don't do this we could get a BadMatch
+     even though the depths match.  I think.
+   */
+  memset (&xgwa, 0, sizeof(xgwa));
+  if (ssi->screensaver_window)
+    XGetWindowAttributes (si->dpy, ssi->screensaver_window, &xgwa);
+
+  new_v = hack_visual (ssi, visual_name, &install_cmap_p);
+  got_it = !!new_v;
+
   ssi->install_cmap_p = install_cmap_p;
 
   if ((ssi->screen != xgwa.screen) ||
@@ -1970,32 +2037,111 @@ select_visual (saver_screen_info *ssi, const char *visual_name)
       ssi->screensaver_window = 0;
 
       initialize_screensaver_window_1 (ssi);
+      replace_screensaver_window (ssi, old_w, old_c);
+    }
 
-      /* stderr_overlay_window is a child of screensaver_window, so we need
-	 to destroy that as well (actually, we just need to invalidate and
-	 drop our pointers to it, but this will destroy it, which is ok so
-	 long as it happens before old_w itself is destroyed.) */
-      reset_stderr (ssi);
+  return got_it;
+}
 
-      raise_window (si, True, True, False);
-      store_vroot_property (si->dpy,
-			    ssi->screensaver_window, ssi->screensaver_window);
 
-      /* Transfer any grabs from the old window to the new. */
-      maybe_transfer_grabs (ssi, old_w, ssi->screensaver_window, ssi->number);
+/* Creates an unmapped window for the next hack to start up in, a few
+   seconds before it is needed.  Returns False if there is no such visual.
+ */
+Bool
+create_prelaunch_window (saver_screen_info *ssi, const char *visual_name)
+{
+  saver_info *si = ssi->global;
+  saver_preferences *p = &si->prefs;
+  XSetWindowAttributes attrs;
+  unsigned long attrmask;
+  Bool install_cmap_p;
+  Visual *v;
 
-      /* Now we can destroy the old window without horking our grabs. */
-      XDestroyWindow (si->dpy, old_w);
+  destroy_prelaunch_window (ssi);
 
-      if (p->verbose_p)
-	fprintf (stderr, "%s: %d: destroyed old saver window 0x%lx.\n",
-		 blurb(), ssi->number, (unsigned long) old_w);
+  get_screen_gl_visual (si, 0);
+  v = hack_visual (ssi, visual_name, &install_cmap_p);
+  if (! v) return False;
 
-      if (old_c &&
-	  old_c != DefaultColormapOfScreen (ssi->screen) &&
-	  old_c != ssi->demo_cmap)
-	XFreeColormap (si->dpy, old_c);
+  if (install_cmap_p)
+    {
+      XColor black;
+      black.red = black.green = black.blue = 0;
+      ssi->prelaunch_cmap = XCreateColormap (si->dpy,
+                                             RootWindowOfScreen (ssi->screen),
+                                             v, AllocNone);
+      if (! XAllocColor (si->dpy, ssi->prelaunch_cmap, &black)) abort ();
+      ssi->prelaunch_black_pixel = black.pixel;
+    }
+  else
+    {
+      ssi->prelaunch_cmap = DefaultColormapOfScreen (ssi->screen);
+      ssi->prelaunch_black_pixel = BlackPixelOfScreen (ssi->screen);
     }
 
-  return got_it;
+  ssi->prelaunch_visual = v;
+  ssi->prelaunch_install_cmap_p = install_cmap_p;
+
+  attrmask = saver_window_attributes (&attrs, ssi->prelaunch_cmap,
+                                      ssi->prelaunch_black_pixel);
+  ssi->prelaunch_window =
+    XCreateWindow (si->dpy, RootWindowOfScreen (ssi->screen),
+                   ssi->x, ssi->y, ssi->width, ssi->height,
+                   0, visual_depth (ssi->screen, v), InputOutput,
+                   v, attrmask, &attrs);
+
+  if (p->verbose_p)
+    fprintf (stderr, "%s: %d: prelaunch window is 0x%lx.\n",
+             blurb(), ssi->number, (unsigned long) ssi->prelaunch_window);
+  return True;
+}
+
+
+/* Makes the prelaunch window be the saver window, in place of the old one.
+ */
+void
+adopt_prelaunch_window (saver_screen_info *ssi)
+{
+  saver_info *si = ssi->global;
+  saver_preferences *p = &si->prefs;
+  Colormap old_c = ssi->cmap;
+  Window old_w = ssi->screensaver_window;
+
+  if (! ssi->prelaunch_window) abort();
+
+  if (p->verbose_p)
+    {
+      fprintf (stderr, "%s: %d: visual ", blurb(), ssi->number);
+      describe_visual (stderr, ssi->screen, ssi->prelaunch_visual,
+                       ssi->prelaunch_install_cmap_p);
+    }
+
+  reset_stderr (ssi);
+  ssi->current_visual = ssi->prelaunch_visual;
+  ssi->current_depth = visual_depth (ssi->screen, ssi->current_visual);
+  ssi->install_cmap_p = ssi->prelaunch_install_cmap_p;
+  ssi->cmap = ssi->prelaunch_cmap;
+  ssi->black_pixel = ssi->prelaunch_black_pixel;
+  ssi->screensaver_window = ssi->prelaunch_window;
+  ssi->prelaunch_window = 0;
+  ssi->prelaunch_cmap = 0;
+
+  /* This resizes it, in case the screen changed since it was created, and
+     sets its IDs and cursor. */
+  initialize_screensaver_window_1 (ssi);
+  replace_screensaver_window (ssi, old_w, old_c);
+}
+
+
+void
+destroy_prelaunch_window (saver_screen_info *ssi)
+{
+  saver_info *si = ssi->global;
+  if (ssi->prelaunch_window)
+    XDestroyWindow (si->dpy, ssi->prelaunch_window);
+  if (ssi->prelaunch_cmap &&
+      ssi->prelaunch_cmap != DefaultColormapOfScreen (ssi->screen))
+    XFreeColormap (si->dpy, ssi->prelaunch_cmap);
+  ssi->prelaunch_window = 0;
+  ssi->prelaunch_cmap = 0;
 }
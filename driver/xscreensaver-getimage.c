@@ -22,6 +22,13 @@
 #include <errno.h>
 #include <sys/stat.h>
 #include <sys/time.h>
+#include <sys/file.h>		/* for flock() */
+#include <fcntl.h>
+#include <dirent.h>
+
+#ifdef HAVE_UNISTD_H
+# include <unistd.h>
+#endif
 
 #ifdef HAVE_SYS_WAIT_H
 # include <sys/wait.h>		/* for waitpid() and associated macros */
@@ -45,6 +52,8 @@
 #include "prefs.h"
 #include "version.h"
 #include "vroot.h"
+#include "thread_util.h"
+#include "imageindex.h"
 
 #ifndef _XSCREENSAVER_VROOT_H_
 # error Error!  You have an old version of vroot.h!  Check -I args.
@@ -90,6 +99,7 @@ static char *defaults[] = {
 
 char *progname = 0;
 char *progclass = "XScreenSaver";
+static char *self_path = 0;	/* argv[0] as we were run, for -prefetch */
 XrmDatabase db;
 XtAppContext app;
 
@@ -298,11 +308,351 @@ compute_image_scaling (int src_w, int src_h,
 
 
 /* Scales an XImage, modifying it in place.
-   This doesn't do dithering or smoothing, so it might have artifacts.
+   On TrueColor visuals, this averages the source pixels covered by each
+   destination pixel when shrinking, and interpolates between them when
+   enlarging, one axis at a time, with the rows split up between threads.
+   Otherwise, the pixels are colormap indexes that can't be averaged, so
+   it just picks the nearest one.
    If out of memory, returns False, and the XImage will have been
    destroyed and freed.
  */
 #if !defined(USE_EXTERNAL_SCREEN_GRABBER) || defined(HAVE_JPEGLIB)
+
+#define SCALE_ONE (1 << 14)	/* Filter weights are fixed-point */
+
+/* Which source pixels go into one destination pixel, and how much. */
+typedef struct {
+  int first, count;
+  int *weights;
+} scale_contrib;
+
+/* How to get 8-bit R, G and B out of a pixel, and back. */
+typedef struct {
+  unsigned long mask[3];
+  int shift[3];
+  unsigned long max[3];
+  Bool direct_p;		/* 32 bits per pixel, in our byte order */
+  Bool bytes_p;			/* And each channel is 8 bits */
+} scale_format;
+
+typedef struct scale_job {
+  struct threadpool threadpool;
+  XImage *src, *dst;
+  scale_format fmt;
+  scale_contrib *xc, *yc;
+  unsigned char *tmp;		/* dst->width x src->height, RGB */
+  int pass, rows;
+} scale_job;
+
+struct scale_thread {
+  scale_job *job;
+  unsigned id;
+};
+
+
+static scale_contrib *
+scale_contributions (int src_size, int dst_size)
+{
+  double scale = (double) src_size / dst_size;
+  int max_taps = (scale > 1 ? (int) ceil (scale) + 1 : 2);
+  scale_contrib *c = (scale_contrib *) calloc (dst_size, sizeof(*c));
+  int *w = (int *) calloc (dst_size * max_taps, sizeof(*w));
+  double *f = (double *) calloc (max_taps, sizeof(*f));
+  int o;
+
+  if (!c || !w || !f)
+    {
+      if (c) free (c);
+      if (w) free (w);
+      if (f) free (f);
+      return 0;
+    }
+
+  for (o = 0; o < dst_size; o++)
+    {
+      scale_contrib *cc = &c[o];
+      int i, sum = 0, biggest = 0;
+      cc->weights = w + o * max_taps;
+
+      if (scale > 1)		/* Area-average the pixels under this one */
+        {
+          double x0 = o * scale;
+          double x1 = x0 + scale;
+          int last = (int) ceil (x1) - 1;
+          if (last >= src_size) last = src_size - 1;
+          cc->first = (int) x0;
+          cc->count = last - cc->first + 1;
+          if (cc->count > max_taps) cc->count = max_taps;
+          for (i = 0; i < cc->count; i++)
+            {
+              double a = cc->first + i, b = a + 1;
+              if (a < x0) a = x0;
+              if (b > x1) b = x1;
+              f[i] = (b > a ? (b - a) / scale : 0);
+            }
+        }
+      else			/* Interpolate between the nearest two */
+        {
+          double x = (o + 0.5) * scale - 0.5;
+          double frac;
+          if (x < 0) x = 0;
+          cc->first = (int) x;
+          frac = x - cc->first;
+          if (cc->first >= src_size - 1)
+            cc->first = src_size - 1, frac = 0;
+          cc->count = (frac > 0 ? 2 : 1);
+          f[0] = 1 - frac;
+          f[1] = frac;
+        }
+
+      for (i = 0; i < cc->count; i++)
+        {
+          cc->weights[i] = (int) (f[i] * SCALE_ONE + 0.5);
+          sum += cc->weights[i];
+          if (cc->weights[i] > cc->weights[biggest]) biggest = i;
+        }
+      cc->weights[biggest] += SCALE_ONE - sum;
+    }
+
+  free (f);
+  return c;
+}
+
+
+static void
+free_scale_contributions (scale_contrib *c)
+{
+  if (!c) return;
+  free (c[0].weights);
+  free (c);
+}
+
+
+static void
+scale_format_init (scale_format *fmt, Visual *visual, XImage *a, XImage *b)
+{
+  int lsb = 1;
+  int i;
+  fmt->mask[0] = visual->red_mask;
+  fmt->mask[1] = visual->green_mask;
+  fmt->mask[2] = visual->blue_mask;
+  for (i = 0; i < 3; i++)
+    {
+      unsigned long m = fmt->mask[i];
+      fmt->shift[i] = 0;
+      if (m)
+        while (!(m & 1)) m >>= 1, fmt->shift[i]++;
+      fmt->max[i] = m;
+    }
+  lsb = (*(char *) &lsb == 1);
+  fmt->direct_p = (a->bits_per_pixel == 32 && b->bits_per_pixel == 32 &&
+                   sizeof(unsigned int) == 4 &&
+                   a->byte_order == (lsb ? LSBFirst : MSBFirst) &&
+                   b->byte_order == a->byte_order);
+  fmt->bytes_p = (fmt->direct_p &&
+                  fmt->max[0] == 255 && fmt->max[1] == 255 &&
+                  fmt->max[2] == 255);
+}
+
+
+/* Pass 0: scales each source row horizontally, into job->tmp.
+ */
+static void
+scale_rows (scale_job *job, int y0, int y1)
+{
+  XImage *src = job->src;
+  scale_format *fmt = &job->fmt;
+  int dw = job->dst->width;
+  unsigned char *rgb = (unsigned char *) malloc (src->width * 3);
+  int x, y, i, k;
+
+  if (!rgb) return;	/* Leaves black lines rather than nothing */
+
+  for (y = y0; y < y1; y++)
+    {
+      unsigned int *row = (unsigned int *)
+        (src->data + y * src->bytes_per_line);
+      unsigned char *out = job->tmp + (size_t) y * dw * 3;
+
+      if (fmt->bytes_p)
+        {
+          int rs = fmt->shift[0], gs = fmt->shift[1], bs = fmt->shift[2];
+          for (x = 0; x < src->width; x++)
+            {
+              unsigned int p = row[x];
+              rgb[x*3]   = p >> rs;
+              rgb[x*3+1] = p >> gs;
+              rgb[x*3+2] = p >> bs;
+            }
+        }
+      else
+        for (x = 0; x < src->width; x++)
+          {
+            unsigned long p = (fmt->direct_p
+                               ? row[x]
+                               : XGetPixel (src, x, y));
+            for (i = 0; i < 3; i++)
+              {
+                unsigned long v = (p & fmt->mask[i]) >> fmt->shift[i];
+                if (fmt->max[i] != 255 && fmt->max[i])
+                  v = v * 255 / fmt->max[i];
+                rgb[x*3 + i] = v;
+              }
+          }
+
+      for (x = 0; x < dw; x++)
+        {
+          scale_contrib *c = &job->xc[x];
+          const unsigned char *in = rgb + c->first * 3;
+          int r = 0, g = 0, b = 0;
+          for (k = 0; k < c->count; k++, in += 3)
+            {
+              int w = c->weights[k];
+              r += w * in[0];
+              g += w * in[1];
+              b += w * in[2];
+            }
+          out[x*3]   = (r + SCALE_ONE/2) >> 14;
+          out[x*3+1] = (g + SCALE_ONE/2) >> 14;
+          out[x*3+2] = (b + SCALE_ONE/2) >> 14;
+        }
+    }
+
+  free (rgb);
+}
+
+
+/* Pass 1: scales job->tmp vertically, into the destination rows.
+ */
+static void
+scale_columns (scale_job *job, int y0, int y1)
+{
+  XImage *dst = job->dst;
+  scale_format *fmt = &job->fmt;
+  int n = dst->width * 3;
+  int *acc = (int *) malloc (n * sizeof(*acc));
+  int x, y, i, k;
+
+  if (!acc) return;
+
+  for (y = y0; y < y1; y++)
+    {
+      scale_contrib *c = &job->yc[y];
+      unsigned int *row = (unsigned int *)
+        (dst->data + y * dst->bytes_per_line);
+
+      memset (acc, 0, n * sizeof(*acc));
+      for (k = 0; k < c->count; k++)
+        {
+          const unsigned char *in = job->tmp + (size_t) (c->first + k) * n;
+          int w = c->weights[k];
+          for (i = 0; i < n; i++)
+            acc[i] += w * in[i];
+        }
+
+      for (x = 0; x < dst->width; x++)
+        {
+          unsigned long p = 0;
+          for (i = 0; i < 3; i++)
+            {
+              unsigned long v = (acc[x*3 + i] + SCALE_ONE/2) >> 14;
+              if (v > 255) v = 255;
+              if (fmt->max[i] != 255)
+                v = (v * fmt->max[i] + 127) / 255;
+              p |= (v << fmt->shift[i]) & fmt->mask[i];
+            }
+          if (fmt->direct_p)
+            row[x] = p;
+          else
+            XPutPixel (dst, x, y, p);
+        }
+    }
+
+  free (acc);
+}
+
+
+static int
+scale_thread_create (void *self_raw, struct threadpool *pool, unsigned id)
+{
+  struct scale_thread *self = (struct scale_thread *) self_raw;
+  self->job = GET_PARENT_OBJ (scale_job, threadpool, pool);
+  self->id = id;
+  return 0;
+}
+
+
+static void
+scale_thread_destroy (void *self_raw)
+{
+}
+
+
+static void
+scale_thread_run (void *self_raw)
+{
+  struct scale_thread *self = (struct scale_thread *) self_raw;
+  scale_job *job = self->job;
+  unsigned n = job->threadpool.count;
+  int y0 = (int) (((long) job->rows * self->id) / n);
+  int y1 = (int) (((long) job->rows * (self->id + 1)) / n);
+  if (y1 <= y0)
+    return;
+  else if (job->pass == 0)
+    scale_rows (job, y0, y1);
+  else
+    scale_columns (job, y0, y1);
+}
+
+
+/* Returns False if there wasn't enough memory to do it that way.
+ */
+static Bool
+scale_ximage_filtered (Display *dpy, Visual *visual,
+                       XImage *ximage, XImage *ximage2)
+{
+  static const struct threadpool_class cls = {
+    sizeof (struct scale_thread),
+    scale_thread_create,
+    scale_thread_destroy
+  };
+  scale_job job;
+  Bool ok = False;
+
+  memset (&job, 0, sizeof(job));
+  job.src = ximage;
+  job.dst = ximage2;
+  scale_format_init (&job.fmt, visual, ximage, ximage2);
+  job.xc = scale_contributions (ximage->width,  ximage2->width);
+  job.yc = scale_contributions (ximage->height, ximage2->height);
+  job.tmp = (unsigned char *)
+    malloc ((size_t) ximage2->width * ximage->height * 3);
+
+  if (job.xc && job.yc && job.tmp &&
+      !threadpool_create (&job.threadpool, &cls, dpy,
+                          hardware_concurrency (dpy)))
+    {
+      job.pass = 0;
+      job.rows = ximage->height;
+      threadpool_run (&job.threadpool, scale_thread_run);
+      threadpool_wait (&job.threadpool);
+
+      job.pass = 1;
+      job.rows = ximage2->height;
+      threadpool_run (&job.threadpool, scale_thread_run);
+      threadpool_wait (&job.threadpool);
+
+      threadpool_destroy (&job.threadpool);
+      ok = True;
+    }
+
+  free_scale_contributions (job.xc);
+  free_scale_contributions (job.yc);
+  if (job.tmp) free (job.tmp);
+  return ok;
+}
+
+
 static Bool
 scale_ximage (Screen *screen, Visual *visual,
               XImage *ximage, int new_width, int new_height)
@@ -332,13 +682,19 @@ scale_ximage (Screen *screen, Visual *visual,
       return False;
     }
 
-  /* Brute force scaling... */
-  xscale = (double) ximage->width  / ximage2->width;
-  yscale = (double) ximage->height / ximage2->height;
-  for (y = 0; y < ximage2->height; y++)
-    for (x = 0; x < ximage2->width; x++)
-      XPutPixel (ximage2, x, y,
-                 XGetPixel (ximage, x * xscale, y * yscale));
+  if (visual_class (screen, visual) == TrueColor &&
+      scale_ximage_filtered (dpy, visual, ximage, ximage2))
+    ;
+  else
+    {
+      /* Brute force scaling... */
+      xscale = (double) ximage->width  / ximage2->width;
+      yscale = (double) ximage->height / ximage2->height;
+      for (y = 0; y < ximage2->height; y++)
+        for (x = 0; x < ximage2->width; x++)
+          XPutPixel (ximage2, x, y,
+                     XGetPixel (ximage, x * xscale, y * yscale));
+    }
 
   free (ximage->data);
   ximage->data = 0;
@@ -848,10 +1204,14 @@ jpg_error_exit (j_common_ptr cinfo)
 
 
 /* Reads a JPEG file, returns an RGB XImage of it.
+   If it is much larger than max_width x max_height, it is decoded at
+   1/2, 1/4 or 1/8 size, but never smaller than it will be displayed.
  */
 static XImage *
 read_jpeg_ximage (Screen *screen, Visual *visual, Drawable drawable,
-                  Colormap cmap, const char *filename, Bool verbose_p)
+                  Colormap cmap, const char *filename,
+                  unsigned int max_width, unsigned int max_height,
+                  Bool verbose_p)
 {
   Display *dpy = DisplayOfScreen (screen);
   int depth = visual_depth (screen, visual);
@@ -862,6 +1222,8 @@ read_jpeg_ximage (Screen *screen, Visual *visual, Drawable drawable,
   getimg_jpg_error_mgr jerr;
   JSAMPARRAY scanbuf = 0;
   int y;
+  int lsb = 1;
+  Bool direct_p;
 
   jerr.filename = filename;
   jerr.screen = screen;
@@ -903,6 +1265,25 @@ read_jpeg_ximage (Screen *screen, Visual *visual, Drawable drawable,
   cinfo.out_color_space = JCS_RGB;
   cinfo.quantize_colors = FALSE;
 
+  /* Shrinking in the DCT domain while decoding is much faster than
+     decoding every pixel of a huge photo only to throw most of them away.
+     scale_ximage() takes it the rest of the way.
+   */
+  if (max_width && max_height && cinfo.image_width && cinfo.image_height)
+    {
+      double rw = (double) max_width  / cinfo.image_width;
+      double rh = (double) max_height / cinfo.image_height;
+      double r = (rw < rh ? rw : rh);
+      int d = 1;
+      while (d < 8 && r * d * 2 <= 1)
+        d *= 2;
+      cinfo.scale_num = 1;
+      cinfo.scale_denom = d;
+      if (verbose_p && d > 1)
+        fprintf (stderr, "%s: decoding %dx%d image at 1/%d size\n",
+                 progname, cinfo.image_width, cinfo.image_height, d);
+    }
+
   jpeg_start_decompress (&cinfo);
 
   ximage = XCreateImage (dpy, visual, depth, ZPixmap, 0, 0,
@@ -924,6 +1305,12 @@ read_jpeg_ximage (Screen *screen, Visual *visual, Drawable drawable,
       goto FAIL;
     }
 
+  /* Store 32-bit pixels directly if we can, instead of with XPutPixel. */
+  lsb = (*(char *) &lsb == 1);
+  direct_p = (depth > 16 && ximage->bits_per_pixel == 32 &&
+              sizeof(unsigned int) == 4 &&
+              ximage->byte_order == (lsb ? LSBFirst : MSBFirst));
+
   y = 0;
   while (cinfo.output_scanline < cinfo.output_height)
     {
@@ -955,7 +1342,11 @@ read_jpeg_ximage (Screen *screen, Visual *visual, Drawable drawable,
               else
                 abort();
 
-              XPutPixel (ximage, x, y, pixel);
+              if (direct_p)
+                ((unsigned int *) (ximage->data + y * ximage->bytes_per_line))
+                  [x] = pixel;
+              else
+                XPutPixel (ximage, x, y, pixel);
             }
           y++;
         }
@@ -1030,7 +1421,7 @@ read_file_jpeglib (Screen *screen, Window window, Drawable drawable,
   /* Read the file...
    */
   ximage = read_jpeg_ximage (screen, visual, drawable, cmap,
-                             filename, verbose_p);
+                             filename, win_width, win_height, verbose_p);
   if (!ximage) return False;
 
   /* Scale it, if necessary...
@@ -1274,8 +1665,20 @@ get_filename_1 (Screen *screen, const char *directory, grab_type type,
 /* Returns a pathname to an image file.  Free the string when you're done.
  */
 static char *
-get_filename (Screen *screen, const char *directory, Bool verbose_p)
+get_filename (Screen *screen, const char *directory, Bool verbose_p,
+              Bool *indexed_ret)
 {
+  /* Local directories are chosen from directly, using the index; URLs
+     still go through "xscreensaver-getimage-file".
+   */
+  image_index *ix = image_index_open (directory, verbose_p);
+  if (indexed_ret) *indexed_ret = !!ix;
+  if (ix)
+    {
+      char *f = image_index_random_file (ix, verbose_p);
+      image_index_close (ix);
+      return f;
+    }
   return get_filename_1 (screen, directory, GRAB_FILE, verbose_p);
 }
 
@@ -1301,6 +1704,439 @@ get_desktop_filename (Screen *screen, Bool verbose_p)
 #endif /* USE_EXTERNAL_SCREEN_GRABBER */
 
 
+/* Decoding ahead.
+
+   Most of the time spent here goes to decoding and scaling the image,
+   while the hack sits there waiting for it.  So after loading an image
+   from a local directory, we start a background copy of ourselves that
+   decodes the next few randomly-chosen images at the size of this
+   drawable, and leaves them in the cache directory as raw XImage data.
+   If one of those fits the next time we're run, we need only XPutImage it.
+   This is only done for TrueColor visuals, where the pixels don't depend
+   on the colormap.
+ */
+
+#define DECODE_AHEAD   2		/* How many images to keep ready */
+#define AHEAD_MAX_AGE  (60 * 60)	/* Seconds before they're stale */
+#define AHEAD_MAGIC    "XSIMGAH1"
+
+struct ahead_header {
+  char magic[8];
+  unsigned int width, height, depth;	/* Of the whole drawable */
+  unsigned int bits_per_pixel, bytes_per_line, byte_order;
+  unsigned long red_mask, green_mask, blue_mask;
+  int x, y;				/* Where the image is, within that */
+  unsigned int w, h;
+  unsigned int dir_len, file_len;	/* These follow, then the pixels */
+};
+
+
+/* Returns the directory to keep decoded images in, creating it if
+   necessary.  Free the string when done.
+ */
+static char *
+ahead_dir (void)
+{
+  char *d = image_cache_file_name ("xscreensaver-getimage-ahead");
+  if (d && mkdir (d, 0700) && errno != EEXIST)
+    {
+      free (d);
+      d = 0;
+    }
+  return d;
+}
+
+
+/* Reads the header of a decoded-ahead file, and returns whether it was
+   decoded from this directory for this size and kind of drawable.
+   If so, also returns the image's file name: free it when done.
+ */
+static Bool
+read_ahead_header (FILE *in, struct ahead_header *h, const char *dir,
+                   Visual *visual, unsigned int width, unsigned int height,
+                   unsigned int depth, char **file_ret)
+{
+  char *d, *f;
+  Bool ok;
+
+  if (1 != fread (h, sizeof(*h), 1, in) ||
+      memcmp (h->magic, AHEAD_MAGIC, sizeof(h->magic)) ||
+      h->width  != width  ||
+      h->height != height ||
+      h->depth  != depth  ||
+      h->red_mask   != visual->red_mask   ||
+      h->green_mask != visual->green_mask ||
+      h->blue_mask  != visual->blue_mask  ||
+      h->dir_len  != strlen (dir) ||
+      h->file_len > 10240)
+    return False;
+
+  d = (char *) malloc (h->dir_len + 1);
+  f = (char *) malloc (h->file_len + 1);
+  ok = (d && f &&
+        (!h->dir_len  || 1 == fread (d, h->dir_len,  1, in)) &&
+        (!h->file_len || 1 == fread (f, h->file_len, 1, in)));
+  if (ok)
+    {
+      d[h->dir_len] = 0;
+      f[h->file_len] = 0;
+      ok = !strcmp (d, dir);
+    }
+  if (d) free (d);
+  if (ok)
+    *file_ret = f;
+  else if (f)
+    free (f);
+  return ok;
+}
+
+
+/* If an image from the given directory has already been decoded for a
+   drawable like this one, renders it and returns True.
+ */
+static Bool
+display_prefetched (Screen *screen, Window window, Drawable drawable,
+                    const char *dir, Bool verbose_p,
+                    char **file_ret, XRectangle *geom_ret)
+{
+  Display *dpy = DisplayOfScreen (screen);
+  XWindowAttributes xgwa;
+  Window root;
+  int x, y;
+  unsigned int w = 0, h = 0, bw, depth;
+  char *adir;
+  DIR *dirp;
+  struct dirent *de;
+  Bool done = False;
+
+  XGetWindowAttributes (dpy, window, &xgwa);
+  if (visual_class (screen, xgwa.visual) != TrueColor)
+    return False;
+  if (window == drawable && root_window_p (screen, window))
+    return False;   /* That wants the image in the window's background. */
+  XGetGeometry (dpy, drawable, &root, &x, &y, &w, &h, &bw, &depth);
+
+  adir = ahead_dir ();
+  if (!adir) return False;
+  dirp = opendir (adir);
+  if (!dirp)
+    {
+      free (adir);
+      return False;
+    }
+
+  while (!done && (de = readdir (dirp)))
+    {
+      struct ahead_header hdr;
+      char *path, *taken, *file = 0;
+      FILE *in;
+
+      if (strncmp (de->d_name, "ahead-", 6))
+        continue;
+
+      path  = (char *) malloc (strlen (adir) + strlen (de->d_name) + 2);
+      taken = (char *) malloc (strlen (adir) + 40);
+      sprintf (path, "%s/%s", adir, de->d_name);
+      sprintf (taken, "%s/taken-%lu", adir, (unsigned long) getpid());
+
+      in = fopen (path, "r");
+
+      /* Renaming it claims it: another getimage might be reading the
+         same directory, and only one of us can win.
+       */
+      if (in &&
+          read_ahead_header (in, &hdr, dir, xgwa.visual, w, h, depth,
+                             &file) &&
+          !rename (path, taken))
+        {
+          size_t size = (size_t) hdr.bytes_per_line * hdr.height;
+          char *data = (char *) malloc (size);
+          unlink (taken);
+
+          if (data && 1 == fread (data, size, 1, in))
+            {
+              XImage *ximage = XCreateImage (dpy, xgwa.visual, depth,
+                                             ZPixmap, 0, data, w, h, 8,
+                                             hdr.bytes_per_line);
+              if (ximage &&
+                  ximage->bits_per_pixel == hdr.bits_per_pixel &&
+                  ximage->byte_order == hdr.byte_order)
+                {
+                  XGCValues gcv;
+                  GC gc = XCreateGC (dpy, drawable, 0, &gcv);
+                  if (verbose_p)
+                    fprintf (stderr, "%s: already decoded \"%s\"\n",
+                             progname, file);
+                  XPutImage (dpy, drawable, gc, ximage, 0, 0, 0, 0, w, h);
+                  XFreeGC (dpy, gc);
+                  XSync (dpy, False);
+
+                  geom_ret->x      = hdr.x;
+                  geom_ret->y      = hdr.y;
+                  geom_ret->width  = hdr.w;
+                  geom_ret->height = hdr.h;
+                  *file_ret = file;
+                  file = 0;
+                  done = True;
+                }
+              if (ximage)
+                {
+                  ximage->data = 0;
+                  XDestroyImage (ximage);
+                }
+            }
+          if (data) free (data);
+        }
+
+      if (file) free (file);
+      if (in) fclose (in);
+      free (path);
+      free (taken);
+    }
+
+  closedir (dirp);
+  free (adir);
+  return done;
+}
+
+
+/* Writes the decoded image into the directory under a new name.
+ */
+static Bool
+write_ahead_file (const char *adir, XImage *ximage, Visual *visual,
+                  const char *dir, const char *file, XRectangle *geom, int n)
+{
+  struct ahead_header hdr;
+  char *tmp   = (char *) malloc (strlen (adir) + 40);
+  char *final = (char *) malloc (strlen (adir) + 80);
+  FILE *out;
+  Bool ok = False;
+
+  memset (&hdr, 0, sizeof(hdr));
+  memcpy (hdr.magic, AHEAD_MAGIC, sizeof(hdr.magic));
+  hdr.width          = ximage->width;
+  hdr.height         = ximage->height;
+  hdr.depth          = ximage->depth;
+  hdr.bits_per_pixel = ximage->bits_per_pixel;
+  hdr.bytes_per_line = ximage->bytes_per_line;
+  hdr.byte_order     = ximage->byte_order;
+  hdr.red_mask       = visual->red_mask;
+  hdr.green_mask     = visual->green_mask;
+  hdr.blue_mask      = visual->blue_mask;
+  hdr.x              = geom->x;
+  hdr.y              = geom->y;
+  hdr.w              = geom->width;
+  hdr.h              = geom->height;
+  hdr.dir_len        = strlen (dir);
+  hdr.file_len       = strlen (file);
+
+  sprintf (tmp, "%s/tmp-%lu", adir, (unsigned long) getpid());
+  sprintf (final, "%s/ahead-%lu-%lu-%d", adir,
+           (unsigned long) time ((time_t *) 0), (unsigned long) getpid(), n);
+
+  out = fopen (tmp, "w");
+  if (out)
+    {
+      ok = (1 == fwrite (&hdr, sizeof(hdr), 1, out) &&
+            (!hdr.dir_len  || 1 == fwrite (dir,  hdr.dir_len,  1, out)) &&
+            (!hdr.file_len || 1 == fwrite (file, hdr.file_len, 1, out)) &&
+            1 == fwrite (ximage->data,
+                         (size_t) ximage->bytes_per_line * ximage->height,
+                         1, out));
+      if (fclose (out)) ok = False;
+      if (ok && rename (tmp, final)) ok = False;
+      if (!ok)
+        {
+          perror (tmp);
+          unlink (tmp);
+        }
+    }
+
+  free (tmp);
+  free (final);
+  return ok;
+}
+
+
+/* This is what "-prefetch WxH" does: tops up the decoded images from
+   the given directory for drawables of that size, then exits.
+ */
+static void
+prefetch_images (Screen *screen, const char *dir,
+                 unsigned int width, unsigned int height, Bool verbose_p)
+{
+  Display *dpy = DisplayOfScreen (screen);
+  Window root = RootWindowOfScreen (screen);
+  Visual *visual = DefaultVisualOfScreen (screen);
+  unsigned int depth = DefaultDepthOfScreen (screen);
+  time_t now = time ((time_t *) 0);
+  image_index *ix;
+  char *adir, *lock;
+  int lock_fd;
+  DIR *dirp;
+  struct dirent *de;
+  int count = 0;
+  int tries = 0;
+
+  if (visual_class (screen, visual) != TrueColor)
+    return;
+  adir = ahead_dir ();
+  if (!adir) return;
+
+  /* If another one of us is already at it, let it be. */
+  lock = (char *) malloc (strlen (adir) + 10);
+  sprintf (lock, "%s/lock", adir);
+  lock_fd = open (lock, O_RDWR | O_CREAT, 0600);
+  free (lock);
+  if (lock_fd < 0 || flock (lock_fd, LOCK_EX | LOCK_NB))
+    {
+      if (lock_fd >= 0) close (lock_fd);
+      free (adir);
+      return;
+    }
+
+  /* Throw away stale ones, and count the ones that are still good. */
+  dirp = opendir (adir);
+  while (dirp && (de = readdir (dirp)))
+    {
+      char *path;
+      struct stat st;
+
+      if (*de->d_name == '.' || !strcmp (de->d_name, "lock"))
+        continue;
+
+      path = (char *) malloc (strlen (adir) + strlen (de->d_name) + 2);
+      sprintf (path, "%s/%s", adir, de->d_name);
+      if (stat (path, &st))
+        ;
+      else if (st.st_mtime + AHEAD_MAX_AGE < now)
+        unlink (path);
+      else if (!strncmp (de->d_name, "ahead-", 6))
+        {
+          struct ahead_header hdr;
+          char *file = 0;
+          FILE *in = fopen (path, "r");
+          if (in &&
+              read_ahead_header (in, &hdr, dir, visual, width, height, depth,
+                                 &file))
+            {
+              count++;
+              free (file);
+            }
+          if (in) fclose (in);
+        }
+      free (path);
+    }
+  if (dirp) closedir (dirp);
+
+  if (verbose_p)
+    fprintf (stderr, "%s: %d of %d images decoded ahead for %ux%u\n",
+             progname, count, DECODE_AHEAD, width, height);
+
+  ix = (count < DECODE_AHEAD ? image_index_open (dir, verbose_p) : 0);
+  while (ix && count < DECODE_AHEAD && tries++ < DECODE_AHEAD * 3)
+    {
+      char *file = image_index_random_file (ix, verbose_p);
+      char *absfile;
+      Pixmap pixmap;
+      XRectangle geom = { 0, 0, 0, 0 };
+
+      if (!file) break;
+      absfile = (char *) malloc (strlen (dir) + strlen (file) + 2);
+      strcpy (absfile, dir);
+      if (dir[strlen(dir)-1] != '/')
+        strcat (absfile, "/");
+      strcat (absfile, file);
+
+      pixmap = XCreatePixmap (dpy, root, width, height, depth);
+      if (display_file (screen, root, pixmap, absfile, verbose_p, &geom))
+        {
+          XImage *ximage = XGetImage (dpy, pixmap, 0, 0, width, height,
+                                      ~0L, ZPixmap);
+          if (ximage &&
+              write_ahead_file (adir, ximage, visual, dir, file, &geom,
+                                count))
+            count++;
+          if (ximage) XDestroyImage (ximage);
+        }
+      XFreePixmap (dpy, pixmap);
+      free (absfile);
+      free (file);
+    }
+
+  if (ix) image_index_close (ix);
+  close (lock_fd);
+  free (adir);
+}
+
+
+/* Runs "-prefetch" in the background, to decode the next images for a
+   drawable like this one.  We don't wait for it.
+ */
+static void
+spawn_prefetch (Display *dpy, Drawable drawable, const char *dir,
+                Bool verbose_p)
+{
+  Window root;
+  int x, y;
+  unsigned int w = 0, h = 0, bw, d;
+  char size[40];
+  char *av[20];
+  int ac = 0;
+  pid_t forked;
+
+  if (!self_path) return;
+  XGetGeometry (dpy, drawable, &root, &x, &y, &w, &h, &bw, &d);
+  sprintf (size, "%ux%u", w, h);
+
+  av[ac++] = self_path;
+  av[ac++] = "-display";
+  av[ac++] = DisplayString (dpy);
+  if (verbose_p)
+    av[ac++] = "-verbose";
+  av[ac++] = "-prefetch";
+  av[ac++] = size;
+  av[ac++] = "-directory";
+  av[ac++] = (char *) dir;
+  av[ac] = 0;
+
+  switch ((int) (forked = fork ()))
+    {
+    case -1:
+      {
+        char buf[255];
+        sprintf (buf, "%s: couldn't fork", progname);
+        perror (buf);
+        break;
+      }
+    case 0:
+      {
+        /* Whoever ran us is likely waiting for EOF on our stdout, so the
+           background process must not hold it open.
+         */
+        int null = open ("/dev/null", O_RDWR);
+        close (ConnectionNumber (dpy));		/* close display fd */
+        if (null >= 0)
+          {
+            dup2 (null, 0);
+            dup2 (null, 1);
+            if (null > 1) close (null);
+          }
+# if defined(HAVE_NICE)
+        errno = 0;
+        if (nice (10) == -1 && errno != 0)
+          perror ("nice");
+# endif
+        execvp (av[0], av);			/* shouldn't return. */
+        exit (-1);                              /* exits fork */
+        break;
+      }
+    default:
+      break;
+    }
+}
+
+
 /* Grabs a video frame, and renders it on the Drawable.
    Returns False if it fails;
  */
@@ -1514,6 +2350,8 @@ get_image (Screen *screen,
   struct stat st;
   const char *file_prop = 0;
   char *absfile = 0;
+  char *prefetched = 0;
+  Bool prefetch_p = False;
   XRectangle geom = { 0, 0, 0, 0 };
 
   if (! drawable_window_p (dpy, window))
@@ -1641,11 +2479,19 @@ get_image (Screen *screen,
     }
 
 
+  /* If the next image from the directory has already been decoded,
+     use that.  Either way, decode some more in the background.
+   */
+  if (which == GRAB_FILE && !file &&
+      display_prefetched (screen, window, drawable, dir, verbose_p,
+                          &prefetched, &geom))
+    prefetch_p = True;
+
   /* If we're to search a directory to find an image file, do so now.
    */
-  if (which == GRAB_FILE && !file)
+  if (which == GRAB_FILE && !file && !prefetched)
     {
-      file = get_filename (screen, dir, verbose_p);
+      file = get_filename (screen, dir, verbose_p, &prefetch_p);
       if (!file)
         {
           which = GRAB_BARS;
@@ -1680,6 +2526,11 @@ get_image (Screen *screen,
       break;
 
     case GRAB_FILE:
+      if (prefetched)
+        {
+          file_prop = prefetched;
+          break;
+        }
       if (*file && *file != '/')	/* pathname is relative to dir. */
         {
           if (absfile) free (absfile);
@@ -1743,7 +2594,13 @@ get_image (Screen *screen,
   }
 
   if (absfile) free (absfile);
+  if (prefetched) free (prefetched);
   XSync (dpy, False);
+
+  if (prefetch_p &&
+      !(window == drawable && root_window_p (screen, window)) &&
+      visual_class (screen, DefaultVisualOfScreen (screen)) == TrueColor)
+    spawn_prefetch (dpy, drawable, dir, verbose_p);
 }
 
 
@@ -1812,10 +2669,11 @@ main (int argc, char **argv)
   Drawable drawable = (Drawable) 0;
   const char *window_str = 0;
   const char *drawable_str = 0;
+  const char *prefetch_str = 0;
   char *s;
   int i;
 
-  progname = argv[0];
+  self_path = progname = argv[0];
   s = strrchr (progname, '/');
   if (s) progname = s+1;
   oprogname = progname;
@@ -1857,6 +2715,11 @@ main (int argc, char **argv)
   dpy = XtDisplay (toplevel);
   screen = XtScreen (toplevel);
   db = XtDatabase (dpy);
+
+  /* Image scaling uses threads if "useThreads" is set (see thread_util.c.)
+     The hacks default it to true, but xscreensaver has no such resource.
+   */
+  XrmCombineDatabase (XrmGetStringDatabase ("*useThreads: True"), &db, False);
   XtGetApplicationNameAndClass (dpy, &s, &progclass);
   XSetErrorHandler (x_ehandler);
   XSync (dpy, False);
@@ -1889,6 +2752,7 @@ main (int argc, char **argv)
       else if (!strcmp (argv[i], "-images"))     P.random_image_p = True;
       else if (!strcmp (argv[i], "-no-images"))  P.random_image_p = False;
       else if (!strcmp (argv[i], "-file"))       file = argv[++i];
+      else if (!strcmp (argv[i], "-prefetch"))   prefetch_str = argv[++i];
       else if (!strcmp (argv[i], "-directory") || !strcmp (argv[i], "-dir"))
         P.image_directory = argv[++i];
       else if (!strcmp (argv[i], "-root") || !strcmp (argv[i], "root"))
@@ -1942,6 +2806,23 @@ main (int argc, char **argv)
         }
     }
 
+  if (prefetch_str)
+    {
+      /* Not a user option: it's how we decode ahead in the background. */
+      unsigned int w = 0, h = 0;
+      char dummy;
+      if (2 != sscanf (prefetch_str, " %ux%u %c", &w, &h, &dummy) ||
+          w < 32 || h < 32 ||
+          !P.image_directory || !*P.image_directory)
+        {
+          fprintf (stderr, "\n%s: unparsable -prefetch: \"%s\"\n",
+                   progname, prefetch_str);
+          goto LOSE;
+        }
+      prefetch_images (screen, P.image_directory, w, h, P.verbose_p);
+      exit (0);
+    }
+
   if (window == 0)
     {
       fprintf (stderr, "\n%s: no window ID specified!\n", progname);
@@ -1037,6 +1037,25 @@ initialize_server_extensions (saver_info *si)
     }
 #endif
 
+  /* If the server can send us raw input events, we don't need to select
+     events on every window to notice activity.  The SGI, MIT and XIDLE
+     extensions notice activity on their own, so this is only instead of
+     the window scan.
+   */
+  si->using_xinput2_extension = False;
+#ifdef HAVE_XINPUT2
+  if (!si->using_xidle_extension &&
+      !si->using_mit_saver_extension &&
+      !si->using_sgi_saver_extension &&
+      query_xinput2_extension (si))
+    {
+      si->using_xinput2_extension = True;
+      init_xinput2_extension (si);
+      if (p->verbose_p)
+        fprintf (stderr, "%s: using XInput2 raw events.\n", blurb());
+    }
+#endif /* HAVE_XINPUT2 */
+
   if (!system_has_proc_interrupts_p)
     {
       si->using_proc_interrupts = False;
@@ -1082,7 +1101,8 @@ debug_multiscreen_timer (XtPointer closure, XtIntervalId *id)
    on all the existing windows, and launch timers to select events on
    newly-created windows as well.
 
-   If a server extension is being used, this does nothing.
+   If a server extension (including XInput2 raw events) is being used,
+   this does nothing.
  */
 static void
 select_events (saver_info *si)
@@ -1092,7 +1112,8 @@ select_events (saver_info *si)
 
   if (si->using_xidle_extension ||
       si->using_mit_saver_extension ||
-      si->using_sgi_saver_extension)
+      si->using_sgi_saver_extension ||
+      si->using_xinput2_extension)
     return;
 
   if (p->initial_delay)
@@ -1313,13 +1334,16 @@ main_loop (saver_info *si)
 
       /* Don't start the cycle timer in demo mode. */
       if (!si->demoing_p && p->cycle)
-	si->cycle_id = XtAppAddTimeOut (si->app,
-                                        (si->selection_mode
-                                         /* see comment in cycle_timer() */
-                                         ? 1000 * 60 * 60
-                                         : p->cycle),
-                                        cycle_timer,
-					(XtPointer) si);
+        {
+          si->cycle_id = XtAppAddTimeOut (si->app,
+                                          (si->selection_mode
+                                           /* see comment in cycle_timer() */
+                                           ? 1000 * 60 * 60
+                                           : p->cycle),
+                                          cycle_timer,
+                                          (XtPointer) si);
+          schedule_prelaunch_timer (si, p->cycle);
+        }
 
 
 #ifndef NO_LOCKING
@@ -1440,6 +1464,12 @@ main_loop (saver_info *si)
 	  si->cycle_id = 0;
 	}
 
+      if (si->prelaunch_id)
+	{
+	  XtRemoveTimeOut (si->prelaunch_id);
+	  si->prelaunch_id = 0;
+	}
+
       if (si->lock_id)
 	{
 	  XtRemoveTimeOut (si->lock_id);
@@ -51,6 +51,11 @@ extern Bool query_xinput_extension (saver_info *);
 extern void init_xinput_extension (saver_info *si);
 #endif
 
+#ifdef HAVE_XINPUT2
+extern Bool query_xinput2_extension (saver_info *);
+extern void init_xinput2_extension (saver_info *);
+#endif
+
 /* Display Power Management System (DPMS) interface. */
 extern Bool monitor_powered_on_p (saver_info *si);
 extern void monitor_power_on (saver_info *si, Bool on_p);
@@ -124,6 +129,7 @@ extern void handle_splash_event (saver_info *si, XEvent *e);
 
 extern void start_notice_events_timer (saver_info *, Window, Bool verbose_p);
 extern void cycle_timer (XtPointer si, XtIntervalId *id);
+extern void schedule_prelaunch_timer (saver_info *si, Time how_long);
 extern void activate_lock_timer (XtPointer si, XtIntervalId *id);
 extern void reset_watchdog_timer (saver_info *si, Bool on_p);
 extern void idle_timer (XtPointer si, XtIntervalId *id);
@@ -158,9 +164,17 @@ extern void spawn_screenhack (saver_screen_info *ssi);
 extern pid_t fork_and_exec (saver_screen_info *ssi, const char *command);
 extern void kill_screenhack (saver_screen_info *ssi);
 extern void suspend_screenhack (saver_screen_info *ssi, Bool suspend_p);
+extern void prelaunch_screenhack (saver_screen_info *ssi);
+extern void pause_prelaunched_screenhack (saver_screen_info *ssi);
+extern Bool adopt_prelaunched_screenhack (saver_screen_info *ssi);
+extern void discard_prelaunched_screenhack (saver_screen_info *ssi);
 extern Bool screenhack_running_p (saver_info *si);
 extern void emergency_kill_subproc (saver_info *si);
 extern Bool select_visual (saver_screen_info *ssi, const char *visual_name);
+extern Bool create_prelaunch_window (saver_screen_info *ssi,
+                                     const char *visual_name);
+extern void adopt_prelaunch_window (saver_screen_info *ssi);
+extern void destroy_prelaunch_window (saver_screen_info *ssi);
 extern void store_saver_status (saver_info *si);
 extern const char *signal_name (int signal);
 
@@ -15,6 +15,7 @@
 #endif
 
 #include <stdio.h>
+#include <string.h>
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
 #include <X11/Xatom.h>
@@ -241,6 +242,59 @@ close_xinput_extension (saver_info *si)
 #endif
 #endif /* HAVE_XINPUT */
 
+
+#ifdef HAVE_XINPUT2
+/* XInput2 raw events.
+
+   Raw events are delivered to anyone who selects them on the root window,
+   no matter which window has focus, who else has selected them, or (with
+   XI 2.1) who has grabbed the device.  So one selection per screen tells
+   us about every key, click, wheel-scroll and motion, and we don't have to
+   walk the window tree selecting KeyPress on every window.
+ */
+
+Bool
+query_xinput2_extension (saver_info *si)
+{
+  int ev, er;
+  int major = 2, minor = 1;
+
+  if (! XQueryExtension (si->dpy, "XInputExtension", &si->xinput2_opcode,
+                         &ev, &er))
+    return False;
+
+  /* This tells the server which version we speak, and returns the version
+     that it speaks.  Raw events arrived in 2.0, and were made to work
+     through grabs in 2.1. */
+  if (XIQueryVersion (si->dpy, &major, &minor) != Success)
+    return False;
+
+  return (major >= 2);
+}
+
+void
+init_xinput2_extension (saver_info *si)
+{
+  unsigned char bits[XIMaskLen (XI_LASTEVENT)];
+  XIEventMask mask;
+  int i;
+
+  memset (bits, 0, sizeof(bits));
+  XISetMask (bits, XI_RawKeyPress);
+  XISetMask (bits, XI_RawButtonPress);
+  XISetMask (bits, XI_RawMotion);
+
+  mask.deviceid = XIAllMasterDevices;
+  mask.mask_len = sizeof(bits);
+  mask.mask = bits;
+
+  for (i = 0; i < ScreenCount (si->dpy); i++)   /* *real* screens */
+    XISelectEvents (si->dpy, RootWindow (si->dpy, i), &mask, 1);
+
+  si->last_raw_motion_check = 0;
+}
+#endif /* HAVE_XINPUT2 */
+
 
 /* SGI SCREEN_SAVER server extension hackery.
  */
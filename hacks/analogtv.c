@@ -64,6 +64,16 @@
    - removed unusable hashnoise code
  */
 
+/* The inner loops of analogtv_add_signal and analogtv_blast_imagerow
+   have SSE2 and NEON versions, chosen at compile time the same way
+   fireworkx.c does it.  The plain C loops are kept as the reference: the
+   vector versions do the same float operations in the same order, so on
+   x86 they produce exactly the same pixels.  (analogtv_ntsc_to_yiq is
+   not among them: its filters are recursive, so it is bound by the
+   latency of each step, and running Y, I and Q in the lanes of one
+   vector turned out no faster than the scalar code.)
+ */
+
 #ifdef HAVE_JWXYZ
 # include "jwxyz.h"
 #else /* !HAVE_JWXYZ */
@@ -72,6 +82,13 @@
 #endif
 #include <limits.h>
 
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
+#ifdef __ARM_NEON
+# include <arm_neon.h>
+#endif
+
 #include <assert.h>
 #include <errno.h>
 #include "utils.h"
@@ -109,6 +126,12 @@ do { \
 #endif
 
 
+#if defined(__SSE2__) || defined(__ARM_NEON)
+/* Whether to use the vector versions of the inner loops.  Only the
+   self-test turns this off, to check them against the plain C. */
+static int analogtv_simd = 1;
+#endif /* __SSE2__ || __ARM_NEON */
+
 #define FASTRND_A 1103515245
 #define FASTRND_C 12345
 #define FASTRND (fastrnd = fastrnd*FASTRND_A+FASTRND_C)
@@ -1288,6 +1311,61 @@ static void analogtv_add_signal(const analogtv *it, const analogtv_reception *re
 
   assert(p <= pe);
   assert(!((pe - p) % 4));
+
+#if defined(__SSE2__) || defined(__ARM_NEON)
+  if (analogtv_simd) {
+# ifdef __SSE2__
+    const __m128 levelv = _mm_set1_ps(level);
+    const __m128 hflossv = _mm_set1_ps(hfloss);
+# else
+    const float32x4_t levelv = vdupq_n_f32(level);
+    const float32x4_t hflossv = vdupq_n_f32(hfloss);
+# endif
+    while (p != pe) {
+      int s4;
+      float sigr;
+# ifdef __SSE2__
+      __m128i b;
+      __m128 sig, out;
+# else
+      float32x4_t sig, out;
+# endif
+
+      /* Same as below, but the four samples are a vector. */
+      memcpy(&s4, s, sizeof(s4));
+# ifdef __SSE2__
+      b = _mm_cvtsi32_si128(s4);
+      b = _mm_unpacklo_epi8(b, b);
+      b = _mm_unpacklo_epi16(b, b);
+      sig = _mm_cvtepi32_ps(_mm_srai_epi32(b, 24));
+# else
+      sig = vcvtq_f32_s32(vmovl_s16(vget_low_s16(
+              vmovl_s8(vcreate_s8((unsigned int) s4)))));
+# endif
+
+      dp[0]=(float)((int)s[0]+(int)s[1]+(int)s[2]+(int)s[3]);
+      sigr=(dp[1]*rec->ghostfir[0] + dp[2]*rec->ghostfir[1] +
+            dp[3]*rec->ghostfir[2] + dp[4]*rec->ghostfir[3]);
+      dp[4]=dp[3]; dp[3]=dp[2]; dp[2]=dp[1]; dp[1]=dp[0];
+
+# ifdef __SSE2__
+      out = _mm_add_ps(_mm_add_ps(sig, _mm_set1_ps(sigr)),
+                       _mm_mul_ps(_mm_shuffle_ps(sig, sig,
+                                                 _MM_SHUFFLE(1,0,3,2)),
+                                  hflossv));
+      _mm_storeu_ps(p, _mm_add_ps(_mm_loadu_ps(p), _mm_mul_ps(out, levelv)));
+# else
+      out = vaddq_f32(vaddq_f32(sig, vdupq_n_f32(sigr)),
+                      vmulq_f32(vextq_f32(sig, sig, 2), hflossv));
+      vst1q_f32(p, vaddq_f32(vld1q_f32(p), vmulq_f32(out, levelv)));
+# endif
+
+      p += 4;
+      s += 4;
+      if (s>=se) s = ss + (s-se);
+    }
+  } else
+#endif /* __SSE2__ || __ARM_NEON */
   while (p != pe) {
     float sig0,sig1,sig2,sig3,sigr;
 
@@ -1430,7 +1508,45 @@ analogtv_blast_imagerow(const analogtv *it,
         unsigned int *pixelptr=(unsigned int *)rowdata;
         unsigned int pix;
 
-        for (rpf=rgbf; rpf!=rgbf_end; rpf+=3) {
+        rpf=rgbf;
+#if defined(__SSE2__) || defined(__ARM_NEON)
+        if (analogtv_simd) {
+          /* Scale, clamp and truncate 4 pixels (12 floats) at a time.
+             Clamping before truncating gives the same index as below. */
+          int ntsci[12];
+# ifdef __SSE2__
+          const __m128 lm = _mm_set1_ps(levelmult);
+          const __m128 mx = _mm_set1_ps(ANALOGTV_CV_MAX-1);
+# else
+          const float32x4_t lm = vdupq_n_f32(levelmult);
+          const float32x4_t mx = vdupq_n_f32(ANALOGTV_CV_MAX-1);
+# endif
+          for (; rgbf_end-rpf >= 12; rpf+=12) {
+            for (i=0; i<12; i+=4)
+# ifdef __SSE2__
+              _mm_storeu_si128((__m128i *) (ntsci+i),
+                               _mm_cvttps_epi32(_mm_min_ps(
+                                 _mm_mul_ps(_mm_loadu_ps(rpf+i), lm), mx)));
+# else
+              vst1q_s32(ntsci+i, vcvtq_s32_f32(vminq_f32(
+                          vmulq_f32(vld1q_f32(rpf+i), lm), mx)));
+# endif
+            for (i=0; i<12; i+=3) {
+              pix = (it->red_values[ntsci[i]] |
+                     it->green_values[ntsci[i+1]] |
+                     it->blue_values[ntsci[i+2]]);
+              pixelptr[0] = pix;
+              if (xrepl>=2) {
+                pixelptr[1] = pix;
+                if (xrepl>=3) pixelptr[2] = pix;
+              }
+              pixelptr+=xrepl;
+            }
+          }
+        }
+#endif /* __SSE2__ || __ARM_NEON */
+
+        for (; rpf!=rgbf_end; rpf+=3) {
           int ntscri=rpf[0]*levelmult;
           int ntscgi=rpf[1]*levelmult;
           int ntscbi=rpf[2]*levelmult;
@@ -2516,3 +2632,182 @@ analogtv_draw_xpm(analogtv *tv, analogtv_input *input,
     }
   }
 }
+
+
+#ifdef SELFTEST
+
+/* Check that the vector code in analogtv_add_signal() and
+   analogtv_blast_imagerow() gives the same results as the plain C that
+   it replaces, on random signals, and compare their speed.
+
+   Usage: test-analogtv [iterations]
+ */
+
+#include <stdio.h>
+#include <sys/time.h>
+
+char *progname = "test-analogtv";
+char *progclass = "TestAnalogTV";
+Bool mono_p;
+
+#if defined(__SSE2__) || defined(__ARM_NEON)
+
+static double
+double_time (void)
+{
+  struct timeval now;
+  gettimeofday (&now, 0);
+  return (now.tv_sec + ((double) now.tv_usec * 0.000001));
+}
+
+/* Adds one random reception to some random noise, both ways, and returns
+   the number of samples that came out differently.  The two ways add
+   things up in the same order, but a compiler may still fuse a multiply
+   and an add in one and not the other, so this allows a little slop.
+ */
+static int
+test_add_signal (analogtv *it, analogtv_reception *rec, float *out[2],
+                 double times[2])
+{
+  unsigned start = 4 * (random() % ((ANALOGTV_SIGNAL_LEN - 2048) / 4));
+  unsigned end = start + 2048;
+  int ec = (random() & 1) ? 0 : start + 4 * (random() % 600);
+  int bad = 0;
+  unsigned i;
+  int k;
+
+  rec->ofs = frand (ANALOGTV_SIGNAL_LEN);
+  rec->level = 0.1 + frand (1.0);
+  rec->hfloss = frand (0.5);
+  for (i = 0; i < ANALOGTV_GHOSTFIR_LEN; i++)
+    rec->ghostfir[i] = frand (0.2) - 0.1;
+  it->random1 = random();
+
+  for (i = start; i < end; i++)
+    out[0][i] = out[1][i] = frand (20.0) - 10.0;
+
+  for (k = 0; k < 2; k++)
+    {
+      double t0 = double_time();
+      analogtv_simd = k;
+      it->rx_signal = out[k];
+      analogtv_add_signal (it, rec, start, end, ec);
+      times[k] += double_time() - t0;
+    }
+
+  for (i = start; i < end; i++)
+    if (fabs (out[0][i] - out[1][i]) > 1e-4 * (1 + fabs (out[0][i])))
+      bad++;
+  return bad;
+}
+
+/* Draws one random row into a 32 bit image, both ways, and returns
+   whether the pixels came out differently. */
+static int
+test_blast_imagerow (analogtv *it, XImage images[2], float *rgbf,
+                     double times[2])
+{
+  int width = 1 + random() % 800;
+  int lineheight = 1 + random() % ANALOGTV_MAX_LINEHEIGHT;
+  int i, k;
+
+  it->xrepl = 1 + random() % 3;
+  for (i = 0; i < lineheight; i++)
+    {
+      it->leveltable[lineheight][i].index = random() % 3;
+      it->leveltable[lineheight][i].value = 0.25 + frand (1.0);
+    }
+  /* Big enough that some pixels have to be clamped. */
+  for (i = 0; i < width * 3; i++)
+    rgbf[i] = frand (1200.0);
+
+  for (k = 0; k < 2; k++)
+    {
+      double t0;
+      images[k].width = width * it->xrepl;
+      images[k].height = lineheight;
+      images[k].bytes_per_line = images[k].width * 4;
+      memset (images[k].data, 0, images[k].bytes_per_line * lineheight);
+      t0 = double_time();
+      analogtv_simd = k;
+      it->image = &images[k];
+      analogtv_blast_imagerow (it, rgbf, rgbf + width * 3, 0, lineheight);
+      times[k] += double_time() - t0;
+    }
+
+  return !!memcmp (images[0].data, images[1].data,
+                   images[0].bytes_per_line * lineheight);
+}
+
+int
+main (int argc, char **argv)
+{
+  int iterations = (argc > 1 ? atoi (argv[1]) : 10000);
+  analogtv *it = (analogtv *) calloc (1, sizeof(*it));
+  analogtv_input *inp = (analogtv_input *) calloc (1, sizeof(*inp));
+  analogtv_reception rec;
+  float *out[2];
+  float *rgbf = (float *) calloc (800 * 3, sizeof(*rgbf));
+  XImage images[2];
+  double add_times[2] = { 0, 0 }, blast_times[2] = { 0, 0 };
+  int add_bad = 0, blast_bad = 0;
+  int i, k;
+
+# undef ya_rand_init
+  ya_rand_init (0);
+  analogtv_init();
+
+  memset (&rec, 0, sizeof(rec));
+  rec.input = inp;
+  for (i = 0; i < (int) sizeof(inp->signal); i++)
+    (&inp->signal[0][0])[i] = (signed char) random();
+
+  for (i = 0; i < ANALOGTV_CV_MAX; i++)
+    {
+      it->red_values[i]   = random() & 0xff0000;
+      it->green_values[i] = random() & 0x00ff00;
+      it->blue_values[i]  = random() & 0x0000ff;
+    }
+
+  memset (images, 0, sizeof(images));
+  for (k = 0; k < 2; k++)
+    {
+      out[k] = (float *) calloc (ANALOGTV_SIGNAL_LEN, sizeof(*out[k]));
+      images[k].format = ZPixmap;
+      images[k].bits_per_pixel = 32;
+      images[k].byte_order = localbyteorder;
+      images[k].data = (char *) calloc (ANALOGTV_MAX_LINEHEIGHT,
+                                        800 * 3 * 4);
+      if (!out[k] || !images[k].data) abort();
+    }
+  if (!it || !inp || !rgbf) abort();
+
+  for (i = 0; i < iterations; i++)
+    {
+      add_bad += test_add_signal (it, &rec, out, add_times);
+      blast_bad += test_blast_imagerow (it, images, rgbf, blast_times);
+    }
+
+  fprintf (stderr, "add_signal:    %d runs, %d mismatched samples;"
+           " plain %.3f sec, vector %.3f sec\n",
+           iterations, add_bad, add_times[0], add_times[1]);
+  fprintf (stderr, "blast_imagerow: %d runs, %d mismatched rows;"
+           " plain %.3f sec, vector %.3f sec\n",
+           iterations, blast_bad, blast_times[0], blast_times[1]);
+
+  return add_bad || blast_bad;
+}
+
+#else /* !(__SSE2__ || __ARM_NEON) */
+
+int
+main (int argc, char **argv)
+{
+  fprintf (stderr, "%s: built without SSE2 or NEON; nothing to compare\n",
+           progname);
+  return 0;
+}
+
+#endif /* !(__SSE2__ || __ARM_NEON) */
+
+#endif /* SELFTEST */
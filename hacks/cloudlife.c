@@ -26,6 +26,7 @@
  */
 
 #include "screenhack.h"
+#include "thread_util.h"
 
 #ifndef MAX_WIDTH
 #include <limits.h>
@@ -43,13 +44,25 @@
 #define inline			/* */
 #endif
 
+/* The ages are kept a byte per cell, but the rules only care whether a
+ * cell is alive and whether it is older than max_age.  Those two facts are
+ * also kept as bit planes, 64 cells to a word, so that a tick can do the
+ * neighbour counts for a whole word at once.  Cell x of a row is bit x%64
+ * of word x/64.
+ */
 struct field {
     unsigned int height;
     unsigned int width;
     unsigned int max_age;
     unsigned int cell_size;
-    unsigned char *cells;
-    unsigned char *new_cells;
+    unsigned int words;		/* words per row of each bit plane */
+    unsigned int settle;	/* ticks to keep drawing a changed cell */
+    unsigned char *cells;	/* ages; 0 for dead cells */
+    uint64_t *alive, *new_alive;
+    uint64_t *old, *new_old;	/* cells with age > max_age */
+    uint64_t *changed;		/* cells that changed since the row settled */
+    uint64_t *inner;		/* per word: the cells that are on screen */
+    unsigned int *fresh;	/* per row: ticks until it has settled */
 };
 
 struct state {
@@ -75,11 +88,18 @@ struct state {
   XColor *colors;
 
   struct field *field;
+  struct threadpool threadpool;
+  unsigned long *counts;	/* per thread: the sum of the ages it ticked */
 
   XPoint fg_points[MAX_WIDTH];
   XPoint bg_points[MAX_WIDTH];
 };
 
+struct cloudlife_thread {
+  struct state *st;
+  unsigned int id;
+};
+
 
 static void 
 *xrealloc(void *p, size_t size)
@@ -96,8 +116,11 @@ static struct field *
 init_field(struct state *st)
 {
     struct field *f = xrealloc(NULL, sizeof(struct field));
+    unsigned int pixels;
+
     f->height = 0;
     f->width = 0;
+    f->words = 0;
     f->cell_size = get_integer_resource(st->dpy, "cellSize", "Integer");
     f->max_age = get_integer_resource(st->dpy, "maxAge", "Integer");
 
@@ -107,22 +130,70 @@ init_field(struct state *st)
       exit (1);
     }
 
+    /* Only one random pixel of a cell is drawn per tick, so a cell that
+       changed is drawn for long enough that it is almost surely covered. */
+    pixels = 1 << (2 * f->cell_size);
+    f->settle = (pixels == 1 ? 1 : 4 * pixels);
+
     f->cells = NULL;
-    f->new_cells = NULL;
+    f->alive = f->new_alive = NULL;
+    f->old = f->new_old = NULL;
+    f->changed = NULL;
+    f->inner = NULL;
+    f->fresh = NULL;
     return f;
 }
 
+static void
+free_field(struct field * f)
+{
+    free(f->cells);
+    free(f->alive);
+    free(f->new_alive);
+    free(f->old);
+    free(f->new_old);
+    free(f->changed);
+    free(f->inner);
+    free(f->fresh);
+    free(f);
+}
+
 static void 
 resize_field(struct field * f, unsigned int w, unsigned int h)
 {
     int s = w * h * sizeof(unsigned char);
+    unsigned int n = (w + 63) / 64;
+    int bs = n * h * sizeof(uint64_t);
+    unsigned int i, x;
+
     f->width = w;
     f->height = h;
+    f->words = n;
 
     f->cells = xrealloc(f->cells, s);
-    f->new_cells = xrealloc(f->new_cells, s);
+    f->alive = xrealloc(f->alive, bs);
+    f->new_alive = xrealloc(f->new_alive, bs);
+    f->old = xrealloc(f->old, bs);
+    f->new_old = xrealloc(f->new_old, bs);
+    f->changed = xrealloc(f->changed, bs);
+    f->inner = xrealloc(f->inner, n * sizeof(uint64_t));
+    f->fresh = xrealloc(f->fresh, h * sizeof(unsigned int));
     memset(f->cells, 0, s);
-    memset(f->new_cells, 0, s);
+    memset(f->alive, 0, bs);
+    memset(f->new_alive, 0, bs);
+    memset(f->old, 0, bs);
+    memset(f->new_old, 0, bs);
+    memset(f->changed, 0, bs);
+    memset(f->fresh, 0, h * sizeof(unsigned int));
+
+    /* columns 0 and width-1 are off screen, as are the bits past width. */
+    for (i = 0; i < n; i++) {
+	f->inner[i] = 0;
+	for (x = i * 64; x < i * 64 + 64 && x < w; x++) {
+	    if (x > 0 && x < w - 1)
+		f->inner[i] |= (uint64_t) 1 << (x & 63);
+	}
+    }
 }
 
 static inline unsigned char 
@@ -132,108 +203,278 @@ static inline unsigned char
                        y * f->width * sizeof(unsigned char));
 }
 
-static inline unsigned char 
-*new_cell_at(struct field * f, unsigned int x, unsigned int y)
+static void
+set_cell(struct field * f, unsigned int x, unsigned int y, unsigned char age)
 {
-    return (f->new_cells + x * sizeof(unsigned char) + 
-                           y * f->width * sizeof(unsigned char));
+    unsigned int i = y * f->words + x / 64;
+    uint64_t bit = (uint64_t) 1 << (x & 63);
+
+    *cell_at(f, x, y) = age;
+    if (age)
+	f->alive[i] |= bit;
+    else
+	f->alive[i] &= ~bit;
+    if (age > f->max_age)
+	f->old[i] |= bit;
+    else
+	f->old[i] &= ~bit;
+}
+
+/* Have every cell drawn again, as if they had all just changed. */
+static void
+refresh_field(struct field * f)
+{
+    unsigned int y;
+
+    memset(f->changed, 0xff, f->words * f->height * sizeof(uint64_t));
+    for (y = 0; y < f->height; y++)
+	f->fresh[y] = f->settle;
+}
+
+/* Have every live cell drawn again, after the foreground color changed. */
+static void
+recolor_field(struct field * f)
+{
+    unsigned int y, i;
+
+    for (y = 0; y < f->height; y++) {
+	const uint64_t *alive = f->alive + y * f->words;
+	uint64_t *changed = f->changed + y * f->words;
+	uint64_t any = 0;
+	for (i = 0; i < f->words; i++) {
+	    changed[i] |= alive[i];
+	    any |= alive[i];
+	}
+	if (any)
+	    f->fresh[y] = f->settle;
+    }
 }
 
 static void
 draw_field(struct state *st, struct field * f)
 {
-    unsigned int x, y;
+    unsigned int x, y, i;
     unsigned int rx, ry = 0;	/* random amount to offset the dot */
     unsigned int size = 1 << f->cell_size;
     unsigned int mask = size - 1;
     unsigned int fg_count, bg_count;
 
-    /* columns 0 and width-1 are off screen and not drawn. */
+    /* rows 0 and height-1 are off screen and not drawn. */
     for (y = 1; y < f->height - 1; y++) {
+	const uint64_t *alive = f->alive + y * f->words;
+	uint64_t *changed = f->changed + y * f->words;
+
+	/* rows with no recent changes are already drawn. */
+	if (!f->fresh[y])
+	    continue;
+
 	fg_count = 0;
 	bg_count = 0;
 
-	/* rows 0 and height-1 are off screen and not drawn. */
-	for (x = 1; x < f->width - 1; x++) {
-	    rx = random();
-	    ry = rx >> f->cell_size;
-	    rx &= mask;
-	    ry &= mask;
-
-	    if (*cell_at(f, x, y)) {
-		st->fg_points[fg_count].x = (short) x *size - rx - 1;
-		st->fg_points[fg_count].y = (short) y *size - ry - 1;
-		fg_count++;
-	    } else {
-		st->bg_points[bg_count].x = (short) x *size - rx - 1;
-		st->bg_points[bg_count].y = (short) y *size - ry - 1;
-		bg_count++;
+	/* columns 0 and width-1 are off screen and not drawn. */
+	for (i = 0; i < f->words; i++) {
+	    uint64_t bits = changed[i] & f->inner[i];
+	    for (x = i * 64; bits; x++, bits >>= 1) {
+		if (!(bits & 1))
+		    continue;
+
+		rx = random();
+		ry = rx >> f->cell_size;
+		rx &= mask;
+		ry &= mask;
+
+		if ((alive[i] >> (x & 63)) & 1) {
+		    st->fg_points[fg_count].x = (short) x *size - rx - 1;
+		    st->fg_points[fg_count].y = (short) y *size - ry - 1;
+		    fg_count++;
+		} else {
+		    st->bg_points[bg_count].x = (short) x *size - rx - 1;
+		    st->bg_points[bg_count].y = (short) y *size - ry - 1;
+		    bg_count++;
+		}
 	    }
 	}
 	XDrawPoints(st->dpy, st->window, st->fgc, st->fg_points, fg_count,
 		    CoordModeOrigin);
 	XDrawPoints(st->dpy, st->window, st->bgc, st->bg_points, bg_count,
 		    CoordModeOrigin);
+
+	/* the random dots may have missed some of each cell, so once the
+	   row has settled, finish its changed cells off. */
+	if (!--f->fresh[y]) {
+	    if (size > 1)
+		for (i = 0; i < f->words; i++) {
+		    uint64_t bits = changed[i] & f->inner[i];
+		    for (x = i * 64; bits; x++, bits >>= 1)
+			if (bits & 1)
+			    XFillRectangle(st->dpy, st->window,
+					   ((alive[i] >> (x & 63)) & 1
+					    ? st->fgc : st->bgc),
+					   x * size - size, y * size - size,
+					   size, size);
+		}
+	    memset(changed, 0, f->words * sizeof(uint64_t));
+	}
     }
 }
 
-static inline unsigned int 
-cell_value(unsigned char c, unsigned int age)
+/* Neighbours in the same row, shifted onto the cells they border. */
+#define WEST(R,I,N) (((R)[I] << 1) | ((I) > 0 ? (R)[(I)-1] >> 63 : 0))
+#define EAST(R,I,N) (((R)[I] >> 1) | ((I) + 1 < (N) ? (R)[(I)+1] << 63 : 0))
+
+/* Counts a neighbour into the "at least 1 .. 4" planes of a word. */
+#define COUNT_ALIVE(X) do {						\
+    uint64_t _x = (X);							\
+    a4 |= a3 & _x; a3 |= a2 & _x; a2 |= a1 & _x; a1 |= _x;		\
+  } while (0)
+#define COUNT_OLD(X) do {						\
+    uint64_t _x = (X);							\
+    o2 |= o1 & _x; o1 |= _x;						\
+  } while (0)
+
+/* Computes the next generation of rows y0 through y1-1 from the current
+ * bit planes, and brings their ages up to date.  Rows outside that range
+ * are only read, so bands of rows can be done in parallel.  Returns the
+ * sum of the new ages.
+ *
+ * A live neighbour counts 1, or 3 if it is old.  With n live neighbours of
+ * which m are old, the count is 2 only for n=2,m=0, and 3 only for n=3,m=0
+ * or n=1,m=1; so it is enough to count each plane up to 4 and 2.
+ */
+static unsigned long
+tick_rows(struct field * f, unsigned int y0, unsigned int y1)
 {
-    if (!c) {
-	return 0;
-    } else if (c > age) {
-	return (3);
-    } else {
-	return (1);
+    unsigned int n = f->words;
+    unsigned int y, i, x, x1;
+    unsigned long count = 0;
+
+    for (y = y0; y < y1; y++) {
+	const uint64_t *up = f->alive + (y - 1) * n, *mid = up + n, *dn = mid + n;
+	const uint64_t *oup = f->old + (y - 1) * n, *omid = oup + n, *odn = omid + n;
+	uint64_t *next = f->new_alive + y * n;
+	uint64_t *next_old = f->new_old + y * n;
+	uint64_t *changed = f->changed + y * n;
+	unsigned char *ages = f->cells + y * f->width;
+	uint64_t diff = 0;
+
+	for (i = 0; i < n; i++) {
+	    uint64_t a1 = 0, a2 = 0, a3 = 0, a4 = 0, o1 = 0, o2 = 0;
+	    uint64_t two, three, live;
+
+	    COUNT_ALIVE(WEST(up, i, n));
+	    COUNT_ALIVE(up[i]);
+	    COUNT_ALIVE(EAST(up, i, n));
+	    COUNT_ALIVE(WEST(mid, i, n));
+	    COUNT_ALIVE(EAST(mid, i, n));
+	    COUNT_ALIVE(WEST(dn, i, n));
+	    COUNT_ALIVE(dn[i]);
+	    COUNT_ALIVE(EAST(dn, i, n));
+
+	    if (a1) {
+		COUNT_OLD(WEST(oup, i, n));
+		COUNT_OLD(oup[i]);
+		COUNT_OLD(EAST(oup, i, n));
+		COUNT_OLD(WEST(omid, i, n));
+		COUNT_OLD(EAST(omid, i, n));
+		COUNT_OLD(WEST(odn, i, n));
+		COUNT_OLD(odn[i]);
+		COUNT_OLD(EAST(odn, i, n));
+	    }
+
+	    two = a2 & ~a3 & ~o1;
+	    three = (a3 & ~a4 & ~o1) | (a1 & ~a2 & o1 & ~o2);
+	    live = ((mid[i] & (two | three)) | three) & f->inner[i];
+
+	    next[i] = live;
+	    changed[i] |= live ^ mid[i];
+	    diff |= live ^ mid[i];
+
+	    /* Survivors get a year older, and newborns are 1. */
+	    x = i * 64;
+	    x1 = (x + 64 < f->width ? x + 64 : f->width);
+	    if (!live) {
+		if (mid[i])
+		    memset(ages + x, 0, x1 - x);
+		next_old[i] = 0;
+	    } else {
+		uint64_t o = 0;
+		for (; x < x1; x++, live >>= 1) {
+		    if (live & 1) {
+			if (ages[x] < 255)
+			    ages[x]++;
+			count += ages[x];
+			if (ages[x] > f->max_age)
+			    o |= (uint64_t) 1 << (x & 63);
+		    } else {
+			ages[x] = 0;
+		    }
+		}
+		next_old[i] = o;
+	    }
+	}
+
+	if (diff)
+	    f->fresh[y] = f->settle;
     }
+    return count;
 }
 
-static inline unsigned int 
-is_alive(struct field * f, unsigned int x, unsigned int y)
+/* Each thread takes an equal band of the rows that are not on the edge. */
+static void
+cloudlife_thread_run(void *self_raw)
 {
-    unsigned int count;
-    unsigned int i, j;
-    unsigned char *p;
+    struct cloudlife_thread *self = (struct cloudlife_thread *) self_raw;
+    struct field *f = self->st->field;
+    unsigned int rows = f->height - 2;
+    unsigned int count = self->st->threadpool.count;
 
-    count = 0;
+    self->st->counts[self->id] = tick_rows(f, 1 + rows * self->id / count,
+			    1 + rows * (self->id + 1) / count);
+}
 
-    for (i = x - 1; i <= x + 1; i++) {
-	for (j = y - 1; j <= y + 1; j++) {
-	    if (y != j || x != i) {
-		count += cell_value(*cell_at(f, i, j), f->max_age);
-	    }
-	}
-    }
+static int
+cloudlife_thread_create(void *self_raw, struct threadpool *pool, unsigned id)
+{
+    struct cloudlife_thread *self = (struct cloudlife_thread *) self_raw;
+    struct state *st;
 
-    p = cell_at(f, x, y);
-    if (*p) {
-	if (count == 2 || count == 3) {
-	    return ((*p) + 1);
-	} else {
-	    return (0);
-	}
-    } else {
-	if (count == 3) {
-	    return (1);
-	} else {
-	    return (0);
-	}
-    }
+    st = GET_PARENT_OBJ(struct state, threadpool, pool);
+    self->st = st;
+    self->id = id;
+    return 0;
 }
 
-static unsigned int 
-do_tick(struct field * f)
+static void
+cloudlife_thread_destroy(void *self_raw)
 {
-    unsigned int x, y;
-    unsigned int count = 0;
-    for (x = 1; x < f->width - 1; x++) {
-	for (y = 1; y < f->height - 1; y++) {
-	    count += *new_cell_at(f, x, y) = is_alive(f, x, y);
-	}
+}
+
+static unsigned long
+do_tick(struct state *st, struct field * f)
+{
+    unsigned long count = 0;
+    unsigned int i, row = f->words * (f->height - 1);
+    uint64_t *swap;
+
+    /* the edges are not computed, and die after every tick. */
+    memset(f->new_alive, 0, f->words * sizeof(uint64_t));
+    memset(f->new_alive + row, 0, f->words * sizeof(uint64_t));
+    memset(f->new_old, 0, f->words * sizeof(uint64_t));
+    memset(f->new_old + row, 0, f->words * sizeof(uint64_t));
+    memset(f->cells, 0, f->width);
+    memset(f->cells + f->width * (f->height - 1), 0, f->width);
+
+    if (st->threadpool.count) {
+	threadpool_run(&st->threadpool, cloudlife_thread_run);
+	threadpool_wait(&st->threadpool);
+	for (i = 0; i < st->threadpool.count; i++)
+	    count += st->counts[i];
+    } else {
+	count = tick_rows(f, 1, f->height - 1);
     }
-    memcpy(f->cells, f->new_cells, f->width * f->height *
-           sizeof(unsigned char));
+
+    swap = f->alive; f->alive = f->new_alive; f->new_alive = swap;
+    swap = f->old; f->old = f->new_old; f->new_old = swap;
     return count;
 }
 
@@ -257,9 +498,10 @@ populate_field(struct field * f, unsigned int p)
 
     for (x = 0; x < f->width; x++) {
 	for (y = 0; y < f->height; y++) {
-	    *cell_at(f, x, y) = random_cell(p);
+	    set_cell(f, x, y, random_cell(p));
 	}
     }
+    refresh_field(f);
 }
 
 static void 
@@ -268,13 +510,13 @@ populate_edges(struct field * f, unsigned int p)
     unsigned int i;
 
     for (i = f->width; i--;) {
-	*cell_at(f, i, 0) = random_cell(p);
-	*cell_at(f, i, f->height - 1) = random_cell(p);
+	set_cell(f, i, 0, random_cell(p));
+	set_cell(f, i, f->height - 1, random_cell(p));
     }
 
     for (i = f->height; i--;) {
-	*cell_at(f, f->width - 1, i) = random_cell(p);
-	*cell_at(f, 0, i) = random_cell(p);
+	set_cell(f, f->width - 1, i, random_cell(p));
+	set_cell(f, 0, i, random_cell(p));
     }
 }
 
@@ -315,6 +557,19 @@ cloudlife_init (Display *dpy, Window window)
                                         "background", "Background");
     st->bgc = XCreateGC(st->dpy, st->window, GCForeground, &st->gcv);
 
+    {
+      static const struct threadpool_class cls = {
+        sizeof(struct cloudlife_thread),
+        cloudlife_thread_create,
+        cloudlife_thread_destroy
+      };
+      unsigned count = hardware_concurrency(st->dpy);
+
+      st->counts = xrealloc(NULL, count * sizeof(*st->counts));
+      if (threadpool_create(&st->threadpool, &cls, st->dpy, count))
+        st->threadpool.count = 0;	/* See the note in thread_util.h. */
+    }
+
     return st;
 }
 
@@ -330,6 +585,7 @@ cloudlife_draw (Display *dpy, Window window, void *closure)
         st->colorindex = st->ncolors;
       st->colorindex--;
       XSetForeground(st->dpy, st->fgc, st->colors[st->colorindex].pixel);
+      recolor_field(st->field);
     }
     st->colortimer--;
   } 
@@ -345,13 +601,13 @@ cloudlife_draw (Display *dpy, Window window, void *closure)
 
   draw_field(st, st->field);
 
-  if (do_tick(st->field) < (st->field->height + st->field->width) / 4) {
+  if (do_tick(st, st->field) < (st->field->height + st->field->width) / 4) {
     populate_field(st->field, st->density);
   }
 
   if (st->cycles % (st->field->max_age /2) == 0) {
     populate_edges(st->field, st->density);
-    do_tick(st->field);
+    do_tick(st, st->field);
     populate_edges(st->field, 0);
   }
 
@@ -382,6 +638,7 @@ cloudlife_event (Display *dpy, Window window, void *closure, XEvent *event)
     {
       XClearWindow (dpy, window);
       st->cycles = 0;
+      free_field(st->field);
       st->field = init_field(st);
       return True;
     }
@@ -392,6 +649,10 @@ static void
 cloudlife_free (Display *dpy, Window window, void *closure)
 {
   struct state *st = (struct state *) closure;
+  if (st->threadpool.count)
+    threadpool_destroy (&st->threadpool);
+  free (st->counts);
+  free_field (st->field);
   free (st);
 }
 
@@ -406,6 +667,7 @@ static const char *cloudlife_defaults[] = {
     "*maxAge:		64",
     "*initialDensity:	30",
     "*cellSize:		3",
+    THREAD_DEFAULTS
 #ifdef HAVE_MOBILE
     "*ignoreRotation:   True",
 #endif
@@ -421,6 +683,7 @@ static XrmOptionDescRec cloudlife_options[] = {
     {"-cell-size", ".cellSize", XrmoptionSepArg, 0},
     {"-initial-density", ".initialDensity", XrmoptionSepArg, 0},
     {"-max-age", ".maxAge", XrmoptionSepArg, 0},
+    THREAD_OPTIONS
     {0, 0, 0, 0}
 };
 
@@ -20,6 +20,7 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 
 #include "delaunay.h"
@@ -299,3 +300,563 @@ delaunay_xyzcompare (const void *v1, const void *v2)
   else
     return(0);
 }
+
+
+/* The incremental triangulator.
+
+   The mesh begins as one big triangle around the bounding rectangle, and
+   points are added one at a time with the Bowyer-Watson method, as above:
+   the triangles whose circumcircles contain the new point are removed,
+   and the hole is filled with a fan of triangles around that point.  But
+   here each triangle knows its three neighbors, so the triangle holding
+   the point is found by walking toward it from the previous insertion,
+   and the hole is found by searching outward from there, instead of by
+   testing every triangle.  Each batch is inserted in Hilbert curve order,
+   so that consecutive points are close together and the walks are short.
+
+   Internally the triangles are counter-clockwise (with Y up), and the
+   first three points are the corners of the big triangle.
+ */
+
+typedef struct {
+  int v[3];	/* corners; v[0] is -1 if this slot is free */
+  int n[3];	/* neighbor across the edge opposite v[i], or -1 */
+} DTRI;
+
+typedef struct {
+  int a, b;	/* the edge, counter-clockwise around the hole */
+  int out;	/* the triangle on the far side, or -1 */
+  int out_i;	/* which of its neighbor slots points back at the hole */
+} DEDGE;
+
+struct delaunay_mesh {
+  double xmin, ymin, xmax, ymax;
+  XYZ *p;		/* points, including the three outer corners */
+  int np, p_size;
+  DTRI *t;		/* triangles, some of which may be free */
+  int nt, t_size;
+  int free_t;		/* chain of free slots, through n[0] */
+  int nfree;
+  int last;		/* where to start the next walk */
+  unsigned int *mark;	/* per triangle: in the current hole if == stamp */
+  unsigned int stamp;
+  int *hole;		/* the triangles being removed */
+  int hole_size;
+  DEDGE *edges;		/* the boundary of the hole */
+  int edges_size;
+  int *fan;		/* per point: new triangle starting at that corner */
+};
+
+
+/* Twice the signed area of abc: positive if counter-clockwise.
+ */
+static double
+dm_orient (const XYZ *a, const XYZ *b, const XYZ *c)
+{
+  return ((b->x - a->x) * (c->y - a->y) -
+          (b->y - a->y) * (c->x - a->x));
+}
+
+
+/* Positive if d is strictly inside the circumcircle of the
+   counter-clockwise triangle abc.
+ */
+static double
+dm_incircle (const XYZ *a, const XYZ *b, const XYZ *c, const XYZ *d)
+{
+  double adx = a->x - d->x, ady = a->y - d->y;
+  double bdx = b->x - d->x, bdy = b->y - d->y;
+  double cdx = c->x - d->x, cdy = c->y - d->y;
+  double ad = adx * adx + ady * ady;
+  double bd = bdx * bdx + bdy * bdy;
+  double cd = cdx * cdx + cdy * cdy;
+  return (adx * (bdy * cd - bd * cdy) -
+          ady * (bdx * cd - bd * cdx) +
+          ad  * (bdx * cdy - bdy * cdx));
+}
+
+
+/* Makes room for n more of something.  Returns nonzero if out of memory.
+ */
+static int
+dm_grow (void **array, int *size, int needed, size_t item)
+{
+  int n = *size;
+  void *a;
+  if (needed <= n) return 0;
+  if (n < 64) n = 64;
+  while (n < needed) n *= 2;
+  a = realloc (*array, n * item);
+  if (!a) return 1;
+  *array = a;
+  *size = n;
+  return 0;
+}
+
+
+delaunay_mesh *
+delaunay_mesh_create (double xmin, double ymin, double xmax, double ymax)
+{
+  delaunay_mesh *m = (delaunay_mesh *) calloc (1, sizeof(*m));
+  double dx = xmax - xmin, dy = ymax - ymin;
+  double dmax = (dx > dy ? dx : dy);
+  double xmid = (xmax + xmin) / 2.0;
+  double ymid = (ymax + ymin) / 2.0;
+  DTRI *t;
+
+  if (!m) return 0;
+  if (dmax < 1) dmax = 1;
+  m->xmin = xmin; m->ymin = ymin;
+  m->xmax = xmax; m->ymax = ymax;
+  m->free_t = -1;
+
+  if (dm_grow ((void **) &m->p, &m->p_size, 3, sizeof(*m->p)) ||
+      dm_grow ((void **) &m->t, &m->t_size, 1, sizeof(*m->t)))
+    {
+      delaunay_mesh_free (m);
+      return 0;
+    }
+  m->fan  = (int *) malloc (m->p_size * sizeof(*m->fan));
+  m->mark = (unsigned int *) calloc (m->t_size, sizeof(*m->mark));
+  if (!m->fan || !m->mark)
+    {
+      delaunay_mesh_free (m);
+      return 0;
+    }
+
+  /* The same shape of outer triangle as delaunay() uses. */
+  m->p[0].x = xmid - 20 * dmax; m->p[0].y = ymid - dmax; m->p[0].z = 0;
+  m->p[1].x = xmid + 20 * dmax; m->p[1].y = ymid - dmax; m->p[1].z = 0;
+  m->p[2].x = xmid; m->p[2].y = ymid + 20 * dmax; m->p[2].z = 0;
+  m->np = 3;
+
+  t = &m->t[0];
+  t->v[0] = 0; t->v[1] = 1; t->v[2] = 2;
+  t->n[0] = t->n[1] = t->n[2] = -1;
+  m->nt = 1;
+  m->last = 0;
+  return m;
+}
+
+
+void
+delaunay_mesh_free (delaunay_mesh *m)
+{
+  if (!m) return;
+  free (m->p);
+  free (m->fan);
+  free (m->t);
+  free (m->mark);
+  free (m->hole);
+  free (m->edges);
+  free (m);
+}
+
+
+const XYZ *
+delaunay_mesh_points (const delaunay_mesh *m, int *nv)
+{
+  *nv = m->np - 3;
+  return m->p + 3;
+}
+
+
+int
+delaunay_mesh_triangles (const delaunay_mesh *m, ITRIANGLE *v)
+{
+  int i, n = 0;
+  for (i = 0; i < m->nt; i++)
+    {
+      const DTRI *t = &m->t[i];
+      if (t->v[0] < 3 || t->v[1] < 3 || t->v[2] < 3)
+        continue;	/* free, or touches the outer triangle */
+      v[n].p1 = t->v[0] - 3;
+      v[n].p2 = t->v[2] - 3;
+      v[n].p3 = t->v[1] - 3;
+      n++;
+    }
+  return n;
+}
+
+
+/* Returns the triangle containing point pi, or -1.
+ */
+static int
+dm_locate (delaunay_mesh *m, int pi)
+{
+  const XYZ *p = &m->p[pi];
+  int t = m->last;
+  int steps = 0;
+  int i;
+
+  if (t < 0 || t >= m->nt || m->t[t].v[0] < 0)
+    for (t = 0; t < m->nt && m->t[t].v[0] < 0; t++)
+      ;
+
+  /* Step across any edge that has the point on its far side.  Starting
+     with a different edge each time keeps this from going in circles on
+     the rare occasions when rounding makes it want to. */
+  while (steps++ < m->nt)
+    {
+      const DTRI *tt = &m->t[t];
+      int k = steps % 3;
+      for (i = 0; i < 3; i++, k = (k == 2 ? 0 : k + 1))
+        if (dm_orient (&m->p[tt->v[k == 2 ? 0 : k + 1]],
+                       &m->p[tt->v[k == 0 ? 2 : k - 1]], p) < 0)
+          break;
+      if (i == 3) return t;
+      t = tt->n[k];
+      if (t < 0) return -1;	/* off the outside */
+    }
+
+  /* Lost; try them all. */
+  for (t = 0; t < m->nt; t++)
+    {
+      const DTRI *tt = &m->t[t];
+      if (tt->v[0] >= 0 &&
+          dm_orient (&m->p[tt->v[0]], &m->p[tt->v[1]], p) >= 0 &&
+          dm_orient (&m->p[tt->v[1]], &m->p[tt->v[2]], p) >= 0 &&
+          dm_orient (&m->p[tt->v[2]], &m->p[tt->v[0]], p) >= 0)
+        return t;
+    }
+  return -1;
+}
+
+
+/* Adds point pi to the triangulation.  Returns nonzero if out of memory.
+ */
+static int
+dm_insert (delaunay_mesh *m, int pi)
+{
+  const XYZ *p = &m->p[pi];
+  int nhole = 0, nedges = 0;
+  int i, j, start;
+
+  start = dm_locate (m, pi);
+  if (start < 0) return 2;
+
+  for (i = 0; i < 3; i++)
+    {
+      const XYZ *c = &m->p[m->t[start].v[i]];
+      if (c->x == p->x && c->y == p->y)
+        return 0;	/* already there */
+    }
+
+  /* Collect the hole: start with the triangle containing the point, and
+     spread to each neighbor whose circumcircle contains it too.  A
+     neighbor is also taken if the point isn't strictly inside the shared
+     edge, so that the hole is always a star around the point. */
+  if (++m->stamp == 0)
+    {
+      memset (m->mark, 0, m->t_size * sizeof(*m->mark));
+      m->stamp = 1;
+    }
+  if (dm_grow ((void **) &m->hole, &m->hole_size, 1, sizeof(*m->hole)))
+    return 1;
+  m->hole[nhole++] = start;
+  m->mark[start] = m->stamp;
+
+  for (j = 0; j < nhole; j++)
+    {
+      int h = m->hole[j];
+      for (i = 0; i < 3; i++)
+        {
+          const DTRI *ht = &m->t[h];
+          int nb = ht->n[i];
+          if (nb >= 0 && m->mark[nb] != m->stamp &&
+              (dm_orient (&m->p[ht->v[i == 2 ? 0 : i + 1]],
+                          &m->p[ht->v[i == 0 ? 2 : i - 1]], p) <= 0 ||
+               dm_incircle (&m->p[m->t[nb].v[0]], &m->p[m->t[nb].v[1]],
+                            &m->p[m->t[nb].v[2]], p) > 0))
+            {
+              if (dm_grow ((void **) &m->hole, &m->hole_size, nhole + 1,
+                           sizeof(*m->hole)))
+                return 1;
+              m->hole[nhole++] = nb;
+              m->mark[nb] = m->stamp;
+            }
+        }
+    }
+
+  /* Its boundary is every edge that doesn't lead to another part of it. */
+  for (j = 0; j < nhole; j++)
+    {
+      int h = m->hole[j];
+      for (i = 0; i < 3; i++)
+        {
+          const DTRI *ht = &m->t[h];
+          int nb = ht->n[i];
+          DEDGE *e;
+          if (nb >= 0 && m->mark[nb] == m->stamp)
+            continue;
+          if (dm_grow ((void **) &m->edges, &m->edges_size, nedges + 1,
+                       sizeof(*m->edges)))
+            return 1;
+          e = &m->edges[nedges++];
+          e->a = ht->v[i == 2 ? 0 : i + 1];
+          e->b = ht->v[i == 0 ? 2 : i - 1];
+          e->out = nb;
+          e->out_i = -1;
+          if (nb >= 0)
+            for (e->out_i = 0; m->t[nb].n[e->out_i] != h; e->out_i++)
+              ;
+        }
+    }
+
+  /* The hole has nhole triangles and is replaced by nedges of them, which
+     is two more.  Make sure they fit before changing anything. */
+  if (m->nt + nedges - nhole - m->nfree > m->t_size)
+    {
+      int old = m->t_size;
+      unsigned int *mk;
+      if (dm_grow ((void **) &m->t, &m->t_size,
+                   m->nt + nedges - nhole - m->nfree, sizeof(*m->t)))
+        return 1;
+      mk = (unsigned int *) realloc (m->mark, m->t_size * sizeof(*mk));
+      if (!mk) return 1;
+      memset (mk + old, 0, (m->t_size - old) * sizeof(*mk));
+      m->mark = mk;
+    }
+
+  for (j = 0; j < nhole; j++)
+    {
+      m->t[m->hole[j]].v[0] = -1;
+      m->t[m->hole[j]].n[0] = m->free_t;
+      m->free_t = m->hole[j];
+    }
+  m->nfree += nhole;
+
+  /* Fill the hole with a fan around the point: one triangle per edge. */
+  for (j = 0; j < nedges; j++)
+    {
+      DEDGE *e = &m->edges[j];
+      DTRI *nt;
+      int ti;
+      if (m->free_t >= 0)
+        {
+          ti = m->free_t;
+          m->free_t = m->t[ti].n[0];
+          m->nfree--;
+        }
+      else
+        ti = m->nt++;
+      nt = &m->t[ti];
+      nt->v[0] = e->a;
+      nt->v[1] = e->b;
+      nt->v[2] = pi;
+      nt->n[2] = e->out;
+      if (e->out >= 0)
+        m->t[e->out].n[e->out_i] = ti;
+      m->fan[e->a] = ti;
+      e->out = ti;
+    }
+
+  /* Stitch the fan together: the triangle on edge (a,b) shares the edge
+     b-p with the one on edge (b,c). */
+  for (j = 0; j < nedges; j++)
+    {
+      int ti = m->edges[j].out;
+      int next = m->fan[m->edges[j].b];
+      m->t[ti].n[0] = next;
+      m->t[next].n[1] = ti;
+    }
+
+  m->last = m->edges[0].out;
+  return 0;
+}
+
+
+/* The distance of (x,y) along a Hilbert curve filling a 65536^2 square.
+ */
+static unsigned long
+dm_hilbert (unsigned int x, unsigned int y)
+{
+  unsigned long d = 0;
+  unsigned int s;
+  for (s = 1 << 15; s > 0; s >>= 1)
+    {
+      unsigned int rx = (x & s) > 0;
+      unsigned int ry = (y & s) > 0;
+      d += (unsigned long) s * s * ((3 * rx) ^ ry);
+      if (ry == 0)
+        {
+          unsigned int tmp;
+          if (rx == 1)
+            {
+              x = 65535 - x;
+              y = 65535 - y;
+            }
+          tmp = x; x = y; y = tmp;
+        }
+    }
+  return d;
+}
+
+
+typedef struct { unsigned long key; int i; } DORDER;
+
+static int
+dm_order_compare (const void *v1, const void *v2)
+{
+  const DORDER *a = (const DORDER *) v1;
+  const DORDER *b = (const DORDER *) v2;
+  return (a->key < b->key ? -1 : a->key > b->key ? 1 : a->i - b->i);
+}
+
+
+int
+delaunay_mesh_add (delaunay_mesh *m, int nv, const XYZ *pxyz)
+{
+  DORDER *order;
+  double sx = m->xmax - m->xmin, sy = m->ymax - m->ymin;
+  int i, base = m->np, status = 0;
+
+  if (nv <= 0) return 0;
+  if (dm_grow ((void **) &m->p, &m->p_size, m->np + nv, sizeof(*m->p)))
+    return 1;
+  {
+    int *f = (int *) realloc (m->fan, m->p_size * sizeof(*f));
+    if (!f) return 1;
+    m->fan = f;
+  }
+
+  order = (DORDER *) malloc (nv * sizeof(*order));
+  if (!order) return 1;
+
+  sx = (sx > 0 ? 65535 / sx : 0);
+  sy = (sy > 0 ? 65535 / sy : 0);
+  for (i = 0; i < nv; i++)
+    {
+      double x = pxyz[i].x, y = pxyz[i].y;
+      if (x < m->xmin || x > m->xmax || y < m->ymin || y > m->ymax)
+        {
+          free (order);
+          return 2;
+        }
+      m->p[base + i] = pxyz[i];
+      order[i].key = dm_hilbert ((x - m->xmin) * sx, (y - m->ymin) * sy);
+      order[i].i = base + i;
+    }
+  m->np += nv;
+
+  qsort (order, nv, sizeof(*order), dm_order_compare);
+  for (i = 0; i < nv && !status; i++)
+    status = dm_insert (m, order[i].i);
+
+  free (order);
+  return status;
+}
+
+
+#ifdef SELFTEST
+
+/* Compare the speed of delaunay() and delaunay_mesh_add(), and check that
+   they make the same number of triangles, on two kinds of points:
+
+   random: uniformly distributed real coordinates, so no three points are
+   collinear and no four are cocircular (in practice).
+
+   grid: every integer position in a strip 4096 pixels wide, like
+   tessellimage's pixel positions, shuffled.  This is the degenerate
+   case: whole rows are collinear, and every unit square is cocircular.
+
+   Usage: test-delaunay [max-points [max-points-for-the-old-one]]
+ */
+
+#include <stdio.h>
+#include <sys/time.h>
+
+static double
+double_time (void)
+{
+  struct timeval now;
+  gettimeofday (&now, 0);
+  return (now.tv_sec + ((double) now.tv_usec * 0.000001));
+}
+
+static void
+random_points (XYZ *p, int n, double *w, double *h)
+{
+  int i;
+  *w = 4096;
+  *h = 4096;
+  for (i = 0; i < n; i++)
+    {
+      p[i].x = *w * (random() / 2147483648.0);
+      p[i].y = *h * (random() / 2147483648.0);
+    }
+}
+
+static void
+grid_points (XYZ *p, int n, double *w, double *h)
+{
+  int i;
+  *w = 4095;
+  *h = n / 4096;
+  for (i = 0; i < n; i++)
+    {
+      p[i].x = i % 4096;
+      p[i].y = i / 4096;
+    }
+  for (i = n-1; i > 0; i--)
+    {
+      int j = random() % (i + 1);
+      XYZ tmp = p[i]; p[i] = p[j]; p[j] = tmp;
+    }
+}
+
+int
+main (int argc, char **argv)
+{
+  int max = (argc > 1 ? atoi (argv[1]) : 1000000);
+  int old_max = (argc > 2 ? atoi (argv[2]) : 100000);
+  int ok = 1;
+  int n, k;
+
+  for (k = 0; k < 2; k++)
+    for (n = 10000; n <= max; n *= 10)
+      {
+        const char *name = (k == 0 ? "random" : "grid");
+        XYZ *p = (XYZ *) calloc (n + 3, sizeof(*p));
+        ITRIANGLE *v = (ITRIANGLE *) calloc (3 * n, sizeof(*v));
+        delaunay_mesh *m;
+        int ntri_old = -1, ntri_new;
+        double w, h, t0, t1, t2;
+
+        if (k == 0)
+          random_points (p, n, &w, &h);
+        else
+          grid_points (p, n, &w, &h);
+
+        t0 = double_time();
+        m = delaunay_mesh_create (0, 0, w, h);
+        if (!m || delaunay_mesh_add (m, n, p)) abort();
+        ntri_new = delaunay_mesh_triangles (m, v);
+        delaunay_mesh_free (m);
+        t1 = double_time();
+
+        if (n <= old_max)
+          {
+            qsort (p, n, sizeof(*p), delaunay_xyzcompare);
+            if (delaunay (n, p, v, &ntri_old)) abort();
+          }
+        t2 = double_time();
+
+        if (ntri_old >= 0)
+          fprintf (stderr, "%-6s %8d points: mesh %.3f sec, %d tris;"
+                   " delaunay %.3f sec, %d tris%s\n",
+                   name, n, t1 - t0, ntri_new, t2 - t1, ntri_old,
+                   (ntri_new == ntri_old ? "" : "  MISMATCH"));
+        else
+          fprintf (stderr, "%-6s %8d points: mesh %.3f sec, %d tris\n",
+                   name, n, t1 - t0, ntri_new);
+        if (ntri_old >= 0 && ntri_new != ntri_old)
+          ok = 0;
+
+        free (p);
+        free (v);
+      }
+  return !ok;
+}
+
+#endif /* SELFTEST */
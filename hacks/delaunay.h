@@ -48,5 +48,40 @@ extern int delaunay (int nv, XYZ *pxyz, ITRIANGLE *v, int *ntri);
 extern int delaunay_xyzcompare (const void *v1, const void *v2);
 
 
+/* An incremental triangulation, to which points can be added a batch at
+   a time without re-doing the ones already there.  Each point is found
+   by walking across the mesh from the last one inserted, and the hole it
+   makes is re-filled locally, so a batch costs about O(n log n) instead
+   of the O(n^1.5) or worse of delaunay() above.  The points need not be
+   sorted.
+ */
+typedef struct delaunay_mesh delaunay_mesh;
+
+/* All points that will ever be added must lie within this rectangle.
+   Returns 0 if out of memory.
+ */
+extern delaunay_mesh *delaunay_mesh_create (double xmin, double ymin,
+                                            double xmax, double ymax);
+extern void delaunay_mesh_free (delaunay_mesh *);
+
+/* Adds NV points.  They are numbered in the order given, following any
+   that were already there.  A point that duplicates an existing one is
+   numbered, but is not a corner of any triangle.  Returns nonzero if out
+   of memory, or if a point was outside the rectangle.
+ */
+extern int delaunay_mesh_add (delaunay_mesh *, int nv, const XYZ *pxyz);
+
+/* Returns the points added so far, and how many there are.
+ */
+extern const XYZ *delaunay_mesh_points (const delaunay_mesh *, int *nv);
+
+/* Fills in the current triangles, wound the same way as by delaunay(),
+   and returns how many there are.  The array must have room for twice
+   as many triangles as there are points.
+ */
+extern int delaunay_mesh_triangles (const delaunay_mesh *, ITRIANGLE *v);
+
+
+
 #endif /* __DELAUNAY_H__ */
 
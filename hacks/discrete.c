@@ -34,7 +34,7 @@ static const char sccsid[] = "@(#)discrete.c	5.00 2000/11/01 xlockmore";
 #ifdef STANDALONE
 # define MODE_discrete
 #define DEFAULTS	"*delay: 20000 \n" \
-					"*count:  4096 \n" \
+					"*count:  16384 \n" \
 					"*cycles: 2500 \n" \
 					"*ncolors: 100 \n" \
 					"*fpsSolid: true \n" \
@@ -47,6 +47,8 @@ static const char sccsid[] = "@(#)discrete.c	5.00 2000/11/01 xlockmore";
 # include "xlock.h"		/* in xlockmore distribution */
 #endif /* STANDALONE */
 
+#include "point_plot.h"
+
 #ifdef MODE_discrete
 
 ENTRYPOINT ModeSpecOpt discrete_opts =
@@ -56,7 +58,7 @@ ENTRYPOINT ModeSpecOpt discrete_opts =
 ModStruct   discrete_description =
 {"discrete", "init_discrete", "draw_discrete", "release_discrete",
  "refresh_discrete", "init_discrete", (char *) NULL, &discrete_opts,
- 1000, 4096, 2500, 1, 64, 1.0, "",
+ 1000, 16384, 2500, 1, 64, 1.0, "",
  "Shows various discrete maps", 0, NULL};
 
 #endif
@@ -99,6 +101,14 @@ typedef struct {
 	int         count;
 	XPoint     *pointBuffer;	/* pointer for XDrawPoints */
 
+	/* Hits per pixel, colored by how many there are, and drawn all at
+	   once.  If that can't be allocated, points go out with XDrawPoints
+	   in the color of the moment, as they used to. */
+	point_plot *plot;
+	unsigned long *palette;
+	int         npalette;
+	double      scale;
+
     int sqrt_sign, std_sign;
 
 #ifdef STANDALONE
@@ -109,6 +119,52 @@ typedef struct {
 
 static discretestruct *discretes = (discretestruct *) NULL;
 
+/* Makes the point_plot, or empties it, for a new picture. */
+static void
+init_plot (ModeInfo * mi, discretestruct *hp)
+{
+	int         i;
+
+	if (hp->plot && (hp->plot->width != hp->maxx ||
+			 hp->plot->height != hp->maxy)) {
+		point_plot_free(hp->plot);
+		hp->plot = (point_plot *) NULL;
+	}
+	if (!hp->plot)
+		hp->plot = point_plot_create(MI_DISPLAY(mi), MI_VISUAL(mi),
+					     MI_DEPTH(mi), hp->maxx, hp->maxy);
+	else
+		point_plot_clear(hp->plot);
+	if (!hp->plot)
+		return;
+
+	if (!hp->palette) {
+		hp->palette = (unsigned long *)
+			malloc(sizeof (unsigned long) *
+			       (MI_NPIXELS(mi) > 2 ? MI_NPIXELS(mi) : 1));
+		if (!hp->palette) {
+			point_plot_free(hp->plot);
+			hp->plot = (point_plot *) NULL;
+			return;
+		}
+	}
+	if (MI_NPIXELS(mi) > 2) {
+		hp->npalette = MI_NPIXELS(mi);
+		for (i = 0; i < hp->npalette; i++)
+			hp->palette[i] = MI_PIXEL(mi, i);
+	} else {
+		hp->npalette = 1;
+		hp->palette[0] = MI_WHITE_PIXEL(mi);
+	}
+
+	/* The picture builds up like a long exposure: by the end, pixels
+	   that got about 8 times the average number of hits have the last
+	   color.  The scale doesn't change while it does so, so that
+	   point_plot's color table doesn't have to be made again. */
+	hp->scale = (hp->npalette - 1) /
+		(8.0 * MI_CYCLES(mi) * MI_COUNT(mi) / hp->maxx / hp->maxy + 1);
+}
+
 ENTRYPOINT void
 init_discrete (ModeInfo * mi)
 {
@@ -254,6 +310,8 @@ init_discrete (ModeInfo * mi)
 	MI_CLEARWINDOW(mi);
 #endif
 
+	init_plot(mi, hp);
+
 	XSetForeground(MI_DISPLAY(mi), MI_GC(mi), MI_WHITE_PIXEL(mi));
 	hp->count = 0;
     hp->sqrt_sign = 1;
@@ -287,7 +345,7 @@ draw_discrete_1 (ModeInfo * mi)
 
 	MI_IS_DRAWN(mi) = True;
 
-	if (MI_NPIXELS(mi) > 2) {
+	if (MI_NPIXELS(mi) > 2 && !hp->plot) {
 		XSetForeground(dsp, gc, MI_PIXEL(mi, hp->pix));
 		if (++hp->pix >= MI_NPIXELS(mi))
 			hp->pix = 0;
@@ -391,11 +449,18 @@ draw_discrete_1 (ModeInfo * mi)
 				hp->j = (oldj - hp->b) / (2 * hp->i);
 				break;
 		}
-		xp->x = hp->maxx / 2 + (int) ((hp->i - hp->ic) * hp->is);
-		xp->y = hp->maxy / 2 - (int) ((hp->j - hp->jc) * hp->js);
-		xp++;
+		if (hp->plot)
+			POINT_PLOT_ADD(hp->plot,
+				       hp->maxx / 2 + (int) ((hp->i - hp->ic) * hp->is),
+				       hp->maxy / 2 - (int) ((hp->j - hp->jc) * hp->js));
+		else {
+			xp->x = hp->maxx / 2 + (int) ((hp->i - hp->ic) * hp->is);
+			xp->y = hp->maxy / 2 - (int) ((hp->j - hp->jc) * hp->js);
+			xp++;
+		}
 	}
-	XDrawPoints(dsp, win, gc, hp->pointBuffer, count, CoordModeOrigin);
+	if (!hp->plot)
+		XDrawPoints(dsp, win, gc, hp->pointBuffer, count, CoordModeOrigin);
 }
 
 ENTRYPOINT void
@@ -415,6 +480,12 @@ draw_discrete (ModeInfo * mi)
     hp->count++;
   }
 
+  if (hp->plot) {
+    point_plot_render (hp->plot, hp->palette, hp->npalette, hp->scale,
+                       MI_BLACK_PIXEL(mi));
+    point_plot_put (hp->plot, MI_WINDOW(mi), MI_GC(mi));
+  }
+
   if (hp->count > cycles) {
     hp->eraser = erase_window (MI_DISPLAY(mi), MI_WINDOW(mi), hp->eraser);
     init_discrete(mi);
@@ -429,6 +500,8 @@ reshape_discrete(ModeInfo * mi, int width, int height)
   hp->maxx = width;
   hp->maxy = height;
   XClearWindow (MI_DISPLAY (mi), MI_WINDOW(mi));
+  if (hp->plot)
+    init_plot (mi, hp);
 }
 
 ENTRYPOINT void
@@ -444,6 +517,10 @@ release_discrete(ModeInfo * mi)
 				(void) free((void *) hp->pointBuffer);
 				/* hp->pointBuffer = NULL; */
 			}
+			if (hp->plot != NULL)
+				point_plot_free(hp->plot);
+			if (hp->palette != NULL)
+				(void) free((void *) hp->palette);
 		}
 		(void) free((void *) discretes);
 		discretes = (discretestruct *) NULL;
@@ -69,6 +69,18 @@ typedef struct {
   float e;		/* coeficient of elasticity */
   float max_radius;	/* largest radius of any ball */
 
+  /* Broad phase: balls are binned into square cells at least as wide as
+     the largest possible collision distance, so only balls in the same or
+     adjacent cells need to be tested against each other.  Each cell is a
+     doubly-linked list threaded through grid_next/grid_prev; 0 is nil,
+     since balls are numbered from 1. */
+  int grid_w, grid_h;	/* size of the grid, in cells */
+  float grid_size;	/* width of one cell, in pixels */
+  int *grid_head;	/* first ball in each cell */
+  int *grid_next, *grid_prev;	/* per ball */
+  int *grid_cell;	/* which cell each ball is in */
+  int *grid_cand;	/* scratch: collision candidates for one ball */
+
   Bool random_sizes_p;  /* Whether balls should be various sizes up to max. */
   Bool shake_p;		/* Whether to mess with gravity when things settle. */
   Bool dbuf;            /* Whether we're using double buffering. */
@@ -361,6 +373,10 @@ fluidballs_init (Display *dpy, Window window)
   state->py  = (float *) malloc (sizeof (*state->py)  * (state->count + 1));
   state->opx = (float *) malloc (sizeof (*state->opx) * (state->count + 1));
   state->opy = (float *) malloc (sizeof (*state->opy) * (state->count + 1));
+  state->grid_next = (int *) malloc (sizeof (int) * (state->count + 1));
+  state->grid_prev = (int *) malloc (sizeof (int) * (state->count + 1));
+  state->grid_cell = (int *) malloc (sizeof (int) * (state->count + 1));
+  state->grid_cand = (int *) malloc (sizeof (int) * (state->count + 1));
 
   for (i=1; i<=state->count; i++)
     {
@@ -589,6 +605,123 @@ repaint_balls (b_state *state)
 }
 
 
+/* Which grid cell the point is in.  Points off the edges (balls are only
+   forced back on screen after the collisions) go in the edge cells.
+ */
+static int
+grid_cell_of (b_state *state, float x, float y)
+{
+  float fx = (x - state->xmin) / state->grid_size;
+  float fy = (y - state->ymin) / state->grid_size;
+  int cx = (fx >= 0 ? (fx < state->grid_w ? (int) fx : state->grid_w - 1) : 0);
+  int cy = (fy >= 0 ? (fy < state->grid_h ? (int) fy : state->grid_h - 1) : 0);
+  return cy * state->grid_w + cx;
+}
+
+
+static void
+grid_insert (b_state *state, int i, int cell)
+{
+  int head = state->grid_head[cell];
+  state->grid_cell[i] = cell;
+  state->grid_prev[i] = 0;
+  state->grid_next[i] = head;
+  if (head) state->grid_prev[head] = i;
+  state->grid_head[cell] = i;
+}
+
+
+/* Re-files ball i if it has moved into a different cell.
+ */
+static void
+grid_move (b_state *state, int i)
+{
+  int cell = grid_cell_of (state, state->px[i], state->py[i]);
+  int old = state->grid_cell[i];
+  if (cell == old) return;
+
+  if (state->grid_prev[i])
+    state->grid_next[state->grid_prev[i]] = state->grid_next[i];
+  else
+    state->grid_head[old] = state->grid_next[i];
+  if (state->grid_next[i])
+    state->grid_prev[state->grid_next[i]] = state->grid_prev[i];
+
+  grid_insert (state, i, cell);
+}
+
+
+/* Bins every ball by its current position.  The cells are a bit wider
+   than two of the largest balls, so that any two balls that overlap are
+   in the same or adjacent cells; and if there are few balls on a big
+   window, wider still, so that clearing the grid doesn't dominate.
+ */
+static void
+build_grid (b_state *state)
+{
+  float w = state->xmax - state->xmin;
+  float h = state->ymax - state->ymin;
+  float size = state->max_radius * 2 * 1.01;
+  float sparse = sqrt (w * h / state->count);
+  int gw, gh, i;
+
+  if (size < sparse) size = sparse;
+  gw = w / size + 1;
+  gh = h / size + 1;
+  if (gw < 1) gw = 1;
+  if (gh < 1) gh = 1;
+
+  if (gw != state->grid_w || gh != state->grid_h || !state->grid_head)
+    {
+      if (state->grid_head) free (state->grid_head);
+      state->grid_head = (int *) malloc (sizeof (int) * gw * gh);
+      state->grid_w = gw;
+      state->grid_h = gh;
+    }
+  state->grid_size = size;
+  memset (state->grid_head, 0, sizeof (int) * gw * gh);
+
+  for (i = state->count; i >= 1; i--)
+    grid_insert (state, i, grid_cell_of (state, state->px[i], state->py[i]));
+}
+
+
+/* Collects the balls numbered above `after' in the 3x3 block of cells
+   around `cell' into grid_cand, in ascending order.  Returns how many.
+ */
+static int
+grid_candidates (b_state *state, int cell, int after)
+{
+  int cx = cell % state->grid_w;
+  int cy = cell / state->grid_w;
+  int x, y, n = 0;
+
+  for (y = cy - 1; y <= cy + 1; y++)
+    {
+      if (y < 0 || y >= state->grid_h) continue;
+      for (x = cx - 1; x <= cx + 1; x++)
+        {
+          int b;
+          if (x < 0 || x >= state->grid_w) continue;
+          for (b = state->grid_head[y * state->grid_w + x]; b;
+               b = state->grid_next[b])
+            if (b > after)
+              {
+                /* Insertion sort: there are only ever a handful. */
+                int j = n++;
+                while (j > 0 && state->grid_cand[j-1] > b)
+                  {
+                    state->grid_cand[j] = state->grid_cand[j-1];
+                    j--;
+                  }
+                state->grid_cand[j] = b;
+              }
+        }
+    }
+  return n;
+}
+
+
 /* Implements the laws of physics: move balls to their new positions.
  */
 static void
@@ -619,10 +752,20 @@ update_balls (b_state *state)
          state->tc);
     }
 
-  /* For each ball, compute the influence of every other ball. */
+  build_grid (state);
+
+  /* For each ball, compute the influence of every other ball that is
+     close enough to touch it.  The pairs are visited in the same order as
+     testing every b > a would, so the results are the same as that.
+   */
   for (a=1; a <= state->count -  1; a++)
-    for (b=a + 1; b <= state->count; b++)
+    {
+      int cell = state->grid_cell[a];
+      int n = grid_candidates (state, cell, a);
+      int i;
+      for (i = 0; i < n; i++)
       {
+         b = state->grid_cand[i];
          d = ((state->px[a] - state->px[b]) *
               (state->px[a] - state->px[b]) +
               (state->py[a] - state->py[b]) *
@@ -678,8 +821,21 @@ update_balls (b_state *state)
             state->vy[a] = vya;
             state->vx[b] = vxb;
             state->vy[b] = vyb;
+
+            grid_move (state, b);
+            grid_move (state, a);
+
+            /* If a was pushed into another cell, the rest of its
+               candidates are the ones near where it is now. */
+            if (state->grid_cell[a] != cell)
+              {
+                cell = state->grid_cell[a];
+                n = grid_candidates (state, cell, b);
+                i = -1;
+              }
          }
       }
+    }
 
    /* Force all balls to be on screen.
     */
@@ -793,6 +949,11 @@ static void
 fluidballs_free (Display *dpy, Window window, void *closure)
 {
   b_state *state = (b_state *) closure;
+  if (state->grid_head) free (state->grid_head);
+  free (state->grid_next);
+  free (state->grid_prev);
+  free (state->grid_cell);
+  free (state->grid_cand);
   free (state);
 }
 
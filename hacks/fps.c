@@ -64,9 +64,20 @@ fps_init (Display *dpy, Window window)
   return st;
 }
 
+static unsigned long hist_percentile (const unsigned long *hist, double);
+
 void
 fps_free (fps_state *st)
 {
+  if (st->total_frames)
+    fprintf (stderr,
+             "%s: %lu frames: p50 %.1f, p95 %.1f, p99 %.1f, max %.1f ms\n",
+             progname, st->total_frames,
+             hist_percentile (st->total_hist, 0.50) / 1000.0,
+             hist_percentile (st->total_hist, 0.95) / 1000.0,
+             hist_percentile (st->total_hist, 0.99) / 1000.0,
+             st->total_max / 1000.0);
+
   if (st->draw_gc)  XFreeGC (st->dpy, st->draw_gc);
   if (st->erase_gc) XFreeGC (st->dpy, st->erase_gc);
   if (st->font) XFreeFont (st->dpy, st->font);
@@ -78,6 +89,103 @@ void
 fps_slept (fps_state *st, unsigned long usecs)
 {
   st->slept += usecs;
+  st->frame_slept += usecs;
+}
+
+
+static int
+hist_bucket (unsigned long usecs)
+{
+  int e = 0;
+  int b;
+  if (usecs < FPS_HIST_LINEAR)
+    return (int) usecs;
+  while ((usecs >> e) >= FPS_HIST_LINEAR)
+    e++;
+  /* Now usecs is in [8 << e, 16 << e): the top 4 bits pick the bucket. */
+  b = FPS_HIST_LINEAR + (e - 1) * FPS_HIST_SUB +
+      (int) ((usecs >> e) - FPS_HIST_SUB);
+  if (b >= FPS_HIST_BUCKETS) b = FPS_HIST_BUCKETS - 1;
+  return b;
+}
+
+
+/* The largest value that lands in the given bucket. */
+static unsigned long
+hist_value (int b)
+{
+  int e;
+  if (b < FPS_HIST_LINEAR)
+    return b;
+  b -= FPS_HIST_LINEAR;
+  e = b / FPS_HIST_SUB + 1;
+  return (((unsigned long) (b % FPS_HIST_SUB + FPS_HIST_SUB + 1)) << e) - 1;
+}
+
+
+static unsigned long
+hist_percentile (const unsigned long *hist, double p)
+{
+  unsigned long total = 0, target, n = 0;
+  int i;
+  for (i = 0; i < FPS_HIST_BUCKETS; i++)
+    total += hist[i];
+  if (! total) return 0;
+  target = (unsigned long) (total * p + 0.5);
+  if (target < 1) target = 1;
+  for (i = 0; i < FPS_HIST_BUCKETS; i++)
+    {
+      n += hist[i];
+      if (n >= target)
+        return hist_value (i);
+    }
+  return hist_value (FPS_HIST_BUCKETS - 1);
+}
+
+
+static void
+frame_time (struct timeval *tv)
+{
+# ifdef GETTIMEOFDAY_TWO_ARGS
+  struct timezone tzp;
+  gettimeofday(tv, &tzp);
+# else
+  gettimeofday(tv);
+# endif
+}
+
+
+/* Call these around each frame: the draw, the XSync, and the event
+   processing.  Time spent in fps_slept() in between is not counted.
+ */
+void
+fps_frame_begin (fps_state *st)
+{
+  frame_time (&st->frame_start);
+  st->frame_slept = 0;
+}
+
+
+void
+fps_frame_end (fps_state *st)
+{
+  struct timeval now;
+  long usecs;
+  int b;
+
+  if (st->frame_start.tv_sec == 0) return;
+  frame_time (&now);
+  usecs = ((now.tv_sec - st->frame_start.tv_sec) * 1000000L +
+           (now.tv_usec - st->frame_start.tv_usec) -
+           (long) st->frame_slept);
+  if (usecs < 0) usecs = 0;  /* clock went backward, or usleep was short */
+
+  b = hist_bucket (usecs);
+  st->recent_hist[b]++;
+  st->total_hist[b]++;
+  st->total_frames++;
+  if (usecs > st->recent_max) st->recent_max = usecs;
+  if (usecs > st->total_max)  st->total_max  = usecs;
 }
 
 
@@ -151,6 +259,32 @@ fps_compute (fps_state *st, unsigned long polys, double depth)
             sprintf (st->string + strlen(st->string), "%lu%s ", polys, s);
         }
 
+      if (st->recent_max > 0)
+        {
+          int i;
+          sprintf (st->string + strlen(st->string),
+                   "\nMS:   %.1f / %.1f / %.1f \nMax:  %.1f ms ",
+                   hist_percentile (st->recent_hist, 0.50) / 1000.0,
+                   hist_percentile (st->recent_hist, 0.95) / 1000.0,
+                   hist_percentile (st->recent_hist, 0.99) / 1000.0,
+                   st->recent_max / 1000.0);
+
+          /* Age the recent histogram so that old stalls scroll off after
+             a few seconds, and let the max age along with it. */
+          for (i = 0; i < FPS_HIST_BUCKETS; i++)
+            st->recent_hist[i] >>= 1;
+          if (! st->recent_hist[hist_bucket (st->recent_max)])
+            {
+              st->recent_max = 0;
+              for (i = FPS_HIST_BUCKETS-1; i >= 0; i--)
+                if (st->recent_hist[i])
+                  {
+                    st->recent_max = hist_value (i);
+                    break;
+                  }
+            }
+        }
+
       if (depth >= 0.0)
         {
           unsigned long L = strlen (st->string);
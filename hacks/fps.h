@@ -22,6 +22,8 @@ typedef struct fps_state fps_state;
 extern fps_state *fps_init (Display *, Window);
 extern void fps_free (fps_state *);
 extern void fps_slept (fps_state *, unsigned long usecs);
+extern void fps_frame_begin (fps_state *);
+extern void fps_frame_end (fps_state *);
 extern double fps_compute (fps_state *, unsigned long polys, double depth);
 extern void fps_draw (fps_state *);
 
@@ -16,6 +16,14 @@
 #include "fps.h"
 #undef HAVE_GLBITMAP
 
+/* Frame times are kept in a log-linear histogram, HDR-style: 16 exact
+   buckets for 0-15 microseconds, then 8 buckets per power of two up to
+   two minutes, so every bucket is within 12.5% of its true value.
+ */
+#define FPS_HIST_LINEAR   16
+#define FPS_HIST_SUB      8
+#define FPS_HIST_BUCKETS  (FPS_HIST_LINEAR + 23 * FPS_HIST_SUB)
+
 
 struct fps_state {
   Display *dpy;
@@ -35,6 +43,17 @@ struct fps_state {
   int frame_count;
   unsigned long slept;
   struct timeval prev_frame_end, this_frame_end;
+
+  /* Per-frame busy time (draw_cb, XSync and event handling, but not time
+     spent sleeping), as bracketed by fps_frame_begin/fps_frame_end.
+     The "recent" histogram is halved every second; the "total" one is
+     reported by fps_free. */
+  struct timeval frame_start;
+  unsigned long frame_slept;
+  unsigned long recent_hist[FPS_HIST_BUCKETS];
+  unsigned long total_hist[FPS_HIST_BUCKETS];
+  unsigned long recent_max, total_max;	/* usecs */
+  unsigned long total_frames;
 };
 
 #endif /* __XSCREENSAVER_FPSI_H__ */
@@ -9,119 +9,396 @@
  * implied warranty.
  */
 
+#if !defined(HAVE_JWZGLES) && !defined(HAVE_COCOA) && !defined(HAVE_ANDROID)
+# define USE_VBO  /* Real X11 with desktop GL: keep models in buffer objects */
+# define GL_GLEXT_PROTOTYPES 1
+#endif
+
 #include "gllist.h"
 
-void
-renderList (const struct gllist *list, int wire_p)
+#include <stdio.h>
+
+#ifdef USE_VBO
+# include <GL/glx.h>
+extern unsigned long gl_context_generation;	/* xlock-gl-utils.c */
+#endif
+
+/* Everything renderList and renderListNormals need to know about a gllist
+   is worked out the first time they see it, and kept here: the wireframe
+   edges as GL_LINES indices, the normal "hairs", and, on desktop GL, buffer
+   objects holding the vertex data and the edge indices.  The gllists
+   themselves are const, so this is a side table keyed on the list.
+
+   Buffer objects belong to a context, so entries are per context.  While a
+   display list is being compiled we draw from client memory instead: the
+   driver is making its own copy anyway.
+
+   A context is known by its address, which a later context can reuse.  So
+   each entry also remembers gl_context_generation, and when init_GL has
+   made a context since, the buffer objects are forgotten and uploaded
+   again.  The edges and normals are in client memory and stay.
+ */
+typedef struct gllist_cache gllist_cache;
+struct gllist_cache {
+  const struct gllist *list;
+  const void *data;		/* In case a list was freed and reallocated */
+  int points;
+  const void *context;
+  unsigned long generation;
+
+  int stride, skip;		/* Floats per point; offset of the vertex */
+  GLuint *edges;		/* GL_LINES indices for wireframe, or 0 */
+  int nedges;
+
+  int vbo_p;			/* Whether this context has buffer objects */
+  GLuint vbo, ibo;
+
+  struct {
+    GLfloat length;
+    GLfloat *array;		/* Pairs of vertexes: center, tip */
+    int count;
+  } normals[2];
+
+  gllist_cache *next;
+};
+
+static gllist_cache *gllist_caches = 0;
+
+
+static const void *
+current_context (void)
 {
-  while (list)
+# ifdef USE_VBO
+  return (const void *) glXGetCurrentContext();
+# else
+  return 0;
+# endif
+}
+
+static unsigned long
+context_generation (void)
+{
+# ifdef USE_VBO
+  return gl_context_generation;
+# else
+  return 0;
+# endif
+}
+
+
+static void
+list_format (const struct gllist *list, int *stride, int *skip)
+{
+  switch (list->format) {
+  case GL_C3F_V3F: case GL_N3F_V3F: *skip = 3; *stride = 6; break;
+  case GL_V3F:                      *skip = 0; *stride = 3; break;
+  default: abort(); break; /* write me */
+  }
+}
+
+
+/* Treat every tuple of points as its own line loop.
+ */
+static void
+make_edges (gllist_cache *c)
+{
+  const struct gllist *list = c->list;
+  int i, j, tick;
+
+  switch (list->primitive) {
+  case GL_QUADS: tick = 4; break;
+  case GL_TRIANGLES: tick = 3; break;
+  case GL_LINES: case GL_POINTS: return;
+  default: abort(); break; /* write me */
+  }
+
+  c->nedges = (list->points / tick) * tick * 2;
+  if (! c->nedges) return;
+  c->edges = (GLuint *) malloc (c->nedges * sizeof(*c->edges));
+  if (! c->edges) abort();
+
+  for (i = 0, j = 0; i + tick <= list->points; i += tick)
     {
-      if (!wire_p || list->primitive == GL_LINES ||
-          list->primitive == GL_POINTS)
+      int k;
+      for (k = 0; k < tick; k++)
         {
-          glInterleavedArrays (list->format, 0, list->data);
-          glDrawArrays (list->primitive, 0, list->points);
+          c->edges[j++] = i + k;
+          c->edges[j++] = i + (k + 1) % tick;
         }
-      else
-        {
-          /* For wireframe, do it the hard way: treat every tuple of
-             points as its own line loop.
-           */
-          const GLfloat *p = (GLfloat *) list->data;
-          int i, j, tick, skip, stride;
-
-          switch (list->primitive) {
-          case GL_QUADS: tick = 4; break;
-          case GL_TRIANGLES: tick = 3; break;
-          default: abort(); break; /* write me */
-          }
+    }
+}
+
 
-          switch (list->format) {
-          case GL_C3F_V3F: case GL_N3F_V3F: skip = 3; stride = 6; break;
-          default: abort(); break; /* write me */
+static int
+vbo_supported_p (void)
+{
+# ifdef USE_VBO
+  const char *s = (const char *) glGetString (GL_VERSION);
+  int major = 0, minor = 0;
+  if (!s || sscanf (s, "%d.%d", &major, &minor) != 2)
+    return 0;
+  return (major > 1 || (major == 1 && minor >= 5));
+# else
+  return 0;
+# endif
+}
+
+
+static gllist_cache *
+find_gllist_cache (const struct gllist *list)
+{
+  const void *context = current_context();
+  gllist_cache *c;
+
+  for (c = gllist_caches; c; c = c->next)
+    if (c->list == list && c->context == context &&
+        c->data == list->data && c->points == list->points)
+      {
+        if (c->generation != context_generation())
+          {
+            /* This may be a new context that has never seen these
+               buffers.  If it's the old one after all, they leak, but
+               only once per init_GL. */
+            c->vbo = c->ibo = 0;
+            c->vbo_p = vbo_supported_p();
+            c->generation = context_generation();
           }
+        return c;
+      }
 
-          glBegin (GL_LINE_LOOP);
-          for (i = 0, j = skip;
-               i < list->points;
-               i++, j += stride)
-            {
-              if (i && !(i % tick))
-                {
-                  glEnd();
-                  glBegin (GL_LINE_LOOP);
-                }
-              glVertex3f (p[j], p[j+1], p[j+2]);
-            }
-          glEnd();
+  c = (gllist_cache *) calloc (1, sizeof(*c));
+  if (! c) abort();
+  c->list    = list;
+  c->data    = list->data;
+  c->points  = list->points;
+  c->context = context;
+  c->generation = context_generation();
+  c->vbo_p   = vbo_supported_p();
+  list_format (list, &c->stride, &c->skip);
+  make_edges (c);
+
+  c->next = gllist_caches;
+  gllist_caches = c;
+  return c;
+}
+
+
+#ifdef USE_VBO
+
+static int
+compiling_p (void)
+{
+  GLint n = 0;
+  glGetIntegerv (GL_LIST_INDEX, &n);
+  return (n != 0);
+}
+
+
+static void
+upload_gllist (gllist_cache *c)
+{
+  glGenBuffers (1, &c->vbo);
+  glBindBuffer (GL_ARRAY_BUFFER, c->vbo);
+  glBufferData (GL_ARRAY_BUFFER,
+                c->points * c->stride * sizeof(GLfloat),
+                c->data, GL_STATIC_DRAW);
+  glBindBuffer (GL_ARRAY_BUFFER, 0);
+
+  if (c->nedges)
+    {
+      glGenBuffers (1, &c->ibo);
+      glBindBuffer (GL_ELEMENT_ARRAY_BUFFER, c->ibo);
+      glBufferData (GL_ELEMENT_ARRAY_BUFFER,
+                    c->nedges * sizeof(*c->edges),
+                    c->edges, GL_STATIC_DRAW);
+      glBindBuffer (GL_ELEMENT_ARRAY_BUFFER, 0);
+    }
+}
+
+
+static void
+render_gllist (gllist_cache *c, int wire_p)
+{
+  int vbo_p = c->vbo_p && !compiling_p();
+  const GLfloat *data = (const GLfloat *) c->data;
+  const GLuint *edges = c->edges;
+
+  if (vbo_p)
+    {
+      if (! c->vbo) upload_gllist (c);
+      glBindBuffer (GL_ARRAY_BUFFER, c->vbo);
+      glBindBuffer (GL_ELEMENT_ARRAY_BUFFER, c->ibo);
+      data  = 0;		/* Offsets into the buffers from here on */
+      edges = 0;
+    }
+
+  glPushClientAttrib (GL_CLIENT_VERTEX_ARRAY_BIT);
+
+  if (wire_p && c->nedges)
+    {
+      glDisableClientState (GL_COLOR_ARRAY);
+      glDisableClientState (GL_NORMAL_ARRAY);
+      glDisableClientState (GL_TEXTURE_COORD_ARRAY);
+      glEnableClientState (GL_VERTEX_ARRAY);
+      glVertexPointer (3, GL_FLOAT, c->stride * sizeof(GLfloat),
+                       data + c->skip);
+      glDrawElements (GL_LINES, c->nedges, GL_UNSIGNED_INT, edges);
+    }
+  else if (!wire_p || c->list->primitive == GL_LINES ||
+           c->list->primitive == GL_POINTS)
+    {
+      glInterleavedArrays (c->list->format, 0, data);
+      glDrawArrays (c->list->primitive, 0, c->points);
+    }
+
+  glPopClientAttrib();
+
+  if (vbo_p)
+    {
+      glBindBuffer (GL_ARRAY_BUFFER, 0);
+      glBindBuffer (GL_ELEMENT_ARRAY_BUFFER, 0);
+    }
+}
+
+#else  /* !USE_VBO */
+
+/* jwzgles has no glDrawElements, so wireframe is drawn by hand here.
+ */
+static void
+render_gllist (gllist_cache *c, int wire_p)
+{
+  const struct gllist *list = c->list;
+
+  if (!wire_p || list->primitive == GL_LINES ||
+      list->primitive == GL_POINTS)
+    {
+      glInterleavedArrays (list->format, 0, list->data);
+      glDrawArrays (list->primitive, 0, list->points);
+    }
+  else
+    {
+      const GLfloat *p = (GLfloat *) list->data;
+      int i;
+
+      glBegin (GL_LINES);
+      for (i = 0; i < c->nedges; i++)
+        {
+          const GLfloat *v = p + c->edges[i] * c->stride + c->skip;
+          glVertex3f (v[0], v[1], v[2]);
         }
-      list = list->next;
+      glEnd();
     }
 }
 
+#endif /* !USE_VBO */
+
 
 void
-renderListNormals (const struct gllist *list, GLfloat length, int faces_p)
+renderList (const struct gllist *list, int wire_p)
 {
   while (list)
     {
-      const GLfloat *p = (GLfloat *) list->data;
-      int i, j, tick, skip, stride;
-      GLfloat v[3], n[3];
-
-      if (list->primitive == GL_LINES) continue;
-
-      if (! faces_p)
-        tick = 1;
-      else
-        switch (list->primitive) {
-        case GL_QUADS: tick = 4; break;
-        case GL_TRIANGLES: tick = 3; break;
-        default: abort(); break; /* write me */
+      render_gllist (find_gllist_cache (list), wire_p);
+      list = list->next;
+    }
+}
+
+
+/* Average the normals and vertexes of each face (or of each vertex) once,
+   and keep them as line segments of the given length.
+ */
+static void
+make_normals (gllist_cache *c, GLfloat length, int faces_p)
+{
+  const struct gllist *list = c->list;
+  const GLfloat *p = (GLfloat *) list->data;
+  GLfloat *out;
+  int i, j, tick;
+  GLfloat v[3], n[3];
+
+  if (! faces_p)
+    tick = 1;
+  else
+    switch (list->primitive) {
+    case GL_QUADS: tick = 4; break;
+    case GL_TRIANGLES: tick = 3; break;
+    default: abort(); break; /* write me */
+    }
+
+  free (c->normals[faces_p].array);
+  c->normals[faces_p].length = length;
+  c->normals[faces_p].count = list->points / tick;
+  c->normals[faces_p].array = out = (GLfloat *)
+    malloc ((c->normals[faces_p].count * 6 + 1) * sizeof(*out));
+  if (! out) abort();
+
+  v[0] = v[1] = v[2] = 0;
+  n[0] = n[1] = n[2] = 0;
+
+  for (i = 0, j = 0;
+       i <= list->points;
+       i++, j += c->stride)
+    {
+      if (i && !(i % tick))
+        {
+          v[0] /= tick;
+          v[1] /= tick;
+          v[2] /= tick;
+          *out++ = v[0];
+          *out++ = v[1];
+          *out++ = v[2];
+          *out++ = v[0] + n[0] / tick * length;
+          *out++ = v[1] + n[1] / tick * length;
+          *out++ = v[2] + n[2] / tick * length;
+          v[0] = v[1] = v[2] = 0;
+          n[0] = n[1] = n[2] = 0;
         }
 
-      switch (list->format) {
-      case GL_N3F_V3F: skip = 0; stride = 6; break;
-      case GL_C3F_V3F: continue; break;
-      default: abort(); break; /* write me */
-      }
+      if (i == list->points) break;
+      n[0] += p[j];
+      n[1] += p[j+1];
+      n[2] += p[j+2];
+      v[0] += p[j+3];
+      v[1] += p[j+4];
+      v[2] += p[j+5];
+    }
+}
 
-      v[0] = v[1] = v[2] = 0;
-      n[0] = n[1] = n[2] = 0;
 
-      for (i = 0, j = skip;
-           i <= list->points;
-           i++, j += stride)
+void
+renderListNormals (const struct gllist *list, GLfloat length, int faces_p)
+{
+  faces_p = !!faces_p;
+  while (list)
+    {
+      if (list->primitive != GL_LINES &&
+          list->primitive != GL_POINTS &&
+          list->format == GL_N3F_V3F)
         {
-          if (i && !(i % tick))
-            {
-              n[0] /= tick;
-              n[1] /= tick;
-              n[2] /= tick;
-              v[0] /= tick;
-              v[1] /= tick;
-              v[2] /= tick;
-              glPushMatrix();
-              glTranslatef (v[0], v[1], v[2]);
-              glScalef (length, length, length);
-              glBegin (GL_LINES);
-              glVertex3f (0, 0, 0);
-              glVertex3f (n[0], n[1], n[2]);
-              glEnd();
-              glPopMatrix();
-              v[0] = v[1] = v[2] = 0;
-              n[0] = n[1] = n[2] = 0;
-            }
-
-          if (i == list->points) break;
-          n[0] += p[j];
-          n[1] += p[j+1];
-          n[2] += p[j+2];
-          v[0] += p[j+3];
-          v[1] += p[j+4];
-          v[2] += p[j+5];
+          gllist_cache *c = find_gllist_cache (list);
+
+          if (!c->normals[faces_p].array ||
+              c->normals[faces_p].length != length)
+            make_normals (c, length, faces_p);
+          if (! c->normals[faces_p].count)
+            goto NEXT;
 
+# ifndef HAVE_JWZGLES  /* glPushClientAttrib unimplemented */
+          glPushClientAttrib (GL_CLIENT_VERTEX_ARRAY_BIT);
+# endif
+          glDisableClientState (GL_COLOR_ARRAY);
+          glDisableClientState (GL_NORMAL_ARRAY);
+          glDisableClientState (GL_TEXTURE_COORD_ARRAY);
+          glEnableClientState (GL_VERTEX_ARRAY);
+          glVertexPointer (3, GL_FLOAT, 0, c->normals[faces_p].array);
+          glDrawArrays (GL_LINES, 0, c->normals[faces_p].count * 2);
+# ifdef HAVE_JWZGLES
+          glDisableClientState (GL_VERTEX_ARRAY);
+# else
+          glPopClientAttrib();
+# endif
         }
+    NEXT:
       list = list->next;
     }
 }
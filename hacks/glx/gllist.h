@@ -38,6 +38,9 @@ struct gllist
   struct gllist *next;
 };
 
+/* The first call for each list and context uploads it to buffer objects,
+   along with the edges used for wireframe.  Later calls are one draw call.
+ */
 void renderList (const struct gllist *, int wire_p);
 void renderListNormals (const struct gllist *, GLfloat length, int facesp);
 
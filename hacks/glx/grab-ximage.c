@@ -42,6 +42,7 @@
 #include "grab-ximage.h"
 #include "grabscreen.h"
 #include "visual.h"
+#include "pixel_convert.h"
 
 /* If REFORMAT_IMAGE_DATA is defined, then we convert Pixmaps to textures
    like this:
@@ -100,46 +101,6 @@ bigendian (void)
 
 #ifdef REFORMAT_IMAGE_DATA
 
-/* Given a bitmask, returns the position and width of the field.
- */
-static void
-decode_mask (unsigned long mask, unsigned long *pos_ret,
-             unsigned long *size_ret)
-{
-  int i;
-  for (i = 0; i < 32; i++)
-    if (mask & (1L << i))
-      {
-        int j = 0;
-        *pos_ret = i;
-        for (; i < 32; i++, j++)
-          if (! (mask & (1L << i)))
-            break;
-        *size_ret = j;
-        return;
-      }
-}
-
-
-/* Given a value and a field-width, expands the field to fill out 8 bits.
- */
-static unsigned char
-spread_bits (unsigned char value, unsigned char width)
-{
-  switch (width)
-    {
-    case 8: return value;
-    case 7: return (value << 1) | (value >> 6);
-    case 6: return (value << 2) | (value >> 4);
-    case 5: return (value << 3) | (value >> 2);
-    case 4: return (value << 4) | (value);
-    case 3: return (value << 5) | (value << 2) | (value >> 2);
-    case 2: return (value << 6) | (value << 4) | (value);
-    default: abort(); break;
-    }
-}
-
-
 static XImage *
 convert_ximage_to_rgba32 (Screen *screen, XImage *image)
 {
@@ -148,11 +109,7 @@ convert_ximage_to_rgba32 (Screen *screen, XImage *image)
 
   int x, y;
   unsigned long crpos=0, cgpos=0, cbpos=0, capos=0; /* bitfield positions */
-  unsigned long srpos=0, sgpos=0, sbpos=0;
-  unsigned long srmsk=0, sgmsk=0, sbmsk=0;
-  unsigned long srsiz=0, sgsiz=0, sbsiz=0;
   XColor *colors = 0;
-  unsigned char spread_map[3][256];
 
   /* Note: height+2 in "to" to work around an array bounds overrun
      in gluBuild2DMipmaps / gluScaleImage.
@@ -183,15 +140,27 @@ convert_ximage_to_rgba32 (Screen *screen, XImage *image)
       XQueryColors (dpy, cmap, colors, ncolors);
     }
 
+  /* trying to track down an intermittent crash in ximage_putpixel_32 */
+  if (to->width  < from->width)  abort();
+  if (to->height < from->height) abort();
+
   if (colors == 0)  /* truecolor */
     {
-      srmsk = to->red_mask;
-      sgmsk = to->green_mask;
-      sbmsk = to->blue_mask;
-
-      decode_mask (srmsk, &srpos, &srsiz);
-      decode_mask (sgmsk, &sgpos, &sgsiz);
-      decode_mask (sbmsk, &sbpos, &sbsiz);
+      /* "RGBA" in memory order is what pixel_convert does. */
+      pixel_converter pc;
+      if (! from->red_mask)
+        {
+          from->red_mask   = to->red_mask;
+          from->green_mask = to->green_mask;
+          from->blue_mask  = to->blue_mask;
+        }
+      if (! pixel_converter_init (&pc, from))
+        abort();
+      for (y = 0; y < from->height; y++)
+        pixel_convert_row_rgba (&pc, from, y,
+                                (unsigned char *)
+                                to->data + y * to->bytes_per_line);
+      return to;
     }
 
   /* Pack things in "RGBA" order in client endianness. */
@@ -200,21 +169,6 @@ convert_ximage_to_rgba32 (Screen *screen, XImage *image)
   else
     crpos =  0, cgpos =  8, cbpos = 16, capos = 24;
 
-  if (colors == 0)  /* truecolor */
-    {
-      int i;
-      for (i = 0; i < 256; i++)
-        {
-          spread_map[0][i] = spread_bits (i, srsiz);
-          spread_map[1][i] = spread_bits (i, sgsiz);
-          spread_map[2][i] = spread_bits (i, sbsiz);
-        }
-    }
-
-  /* trying to track down an intermittent crash in ximage_putpixel_32 */
-  if (to->width  < from->width)  abort();
-  if (to->height < from->height) abort();
-
   for (y = 0; y < from->height; y++)
     for (x = 0; x < from->width; x++)
       {
@@ -222,22 +176,9 @@ convert_ximage_to_rgba32 (Screen *screen, XImage *image)
         unsigned char sr, sg, sb;
         unsigned long cp;
 
-        if (colors)
-          {
-            sr = colors[sp].red   & 0xFF;
-            sg = colors[sp].green & 0xFF;
-            sb = colors[sp].blue  & 0xFF;
-          }
-        else
-          {
-            sr = (sp & srmsk) >> srpos;
-            sg = (sp & sgmsk) >> sgpos;
-            sb = (sp & sbmsk) >> sbpos;
-
-            sr = spread_map[0][sr];
-            sg = spread_map[1][sg];
-            sb = spread_map[2][sb];
-          }
+        sr = colors[sp].red   & 0xFF;
+        sg = colors[sp].green & 0xFF;
+        sb = colors[sp].blue  & 0xFF;
 
         cp = ((sr << crpos) |
               (sg << cgpos) |
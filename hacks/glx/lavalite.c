@@ -64,14 +64,16 @@
  *      with depth buffering turned off?
  */
 
+#include "thread_util.h"
+
 #define DEFAULTS	"*delay:	30000       \n" \
 			"*showFPS:      False       \n" \
 			"*wireframe:    False       \n" \
 			"*geometry:	600x900\n"      \
 			"*count:      " DEF_COUNT " \n" \
+			THREAD_DEFAULTS_XLOCK \
 
 # define refresh_lavalite 0
-# define release_lavalite 0
 
 
 #define BLOBS_PER_GROUP 4
@@ -213,6 +215,7 @@ typedef struct {
   Bool just_started_p;		   /* so we launch some goo right away */
 
   int grid_size;		   /* resolution for marching-cubes */
+  marching_mesh *mesh;
   int nballs;
   metaball *balls;
 
@@ -270,6 +273,7 @@ static XrmOptionDescRec opts[] = {
   { "-fluid-texture",".fluidTexture",  XrmoptionSepArg, 0 },
   { "-base-texture", ".baseTexture",   XrmoptionSepArg, 0 },
   { "-table-texture",".tableTexture",  XrmoptionSepArg, 0 },
+  THREAD_OPTIONS
 };
 
 static argtype vars[] = {
@@ -1051,14 +1055,39 @@ compute_metaball_influence (lavalite_configuration *bp,
 }
 
 
-/* callback for marching_cubes() */
-static void *
-obj_init (double grid_size, void *closure)
+/* callback for marching_mesh_compute(): whether any ball's field of
+   influence reaches into the given box.
+ */
+static int
+obj_brick (double x0, double y0, double z0,
+           double x1, double y1, double z1,
+           void *closure)
 {
   lavalite_configuration *bp = (lavalite_configuration *) closure;
-  bp->grid_size = grid_size;
+  double s = 1.0 / bp->grid_size;
+  int i;
 
-  return closure;
+  x0 = x0 * s - 0.5;	/* same transformation as obj_compute() */
+  x1 = x1 * s - 0.5;
+  y0 = y0 * s - 0.5;
+  y1 = y1 * s - 0.5;
+  z0 *= s;
+  z1 *= s;
+
+  for (i = 0; i < bp->nballs; i++)
+    {
+      metaball *b = &bp->balls[i];
+      double dx, dy, dz;
+      if (!b->alive_p) continue;
+
+      /* distance from the ball to the nearest point of the box */
+      dx = (b->x < x0 ? x0 - b->x : b->x > x1 ? b->x - x1 : 0);
+      dy = (b->y < y0 ? y0 - b->y : b->y > y1 ? b->y - y1 : 0);
+      dz = (b->z < z0 ? z0 - b->z : b->z > z1 ? b->z - z1 : 0);
+      if (dx*dx + dy*dy + dz*dz <= b->R * b->R)
+        return 1;
+    }
+  return 0;
 }
 
 
@@ -1099,7 +1128,7 @@ clipped_by_glass_p (double x, double y, double z,
 
 
 
-/* callback for marching_cubes() */
+/* callback for marching_mesh_compute() */
 static double
 obj_compute (double x, double y, double z, void *closure)
 {
@@ -1121,13 +1150,6 @@ obj_compute (double x, double y, double z, void *closure)
 }
 
 
-/* callback for marching_cubes() */
-static void
-obj_free (void *closure)
-{
-}
-
-
 /* Send a new blob travelling upward.
    This blob will actually be composed of N metaballs that are near
    each other.
@@ -1214,15 +1236,16 @@ animate_lava (ModeInfo *mi)
   mi->polygon_count = 0;
   {
     double s;
-    if (bp->grid_size == 0) bp->grid_size = 1;  /* first time through */
+    bp->grid_size = resolution;
     s = 1.0/bp->grid_size;
 
     glPushMatrix();
     glTranslatef (-0.5, -0.5, 0);
     glScalef (s, s, s);
-    marching_cubes (resolution, isolevel, wire, do_smooth,
-                    obj_init, obj_compute, obj_free, bp,
-                    &mi->polygon_count);
+    mi->polygon_count =
+      marching_mesh_compute (bp->mesh, resolution, isolevel, do_smooth,
+                             obj_compute, obj_brick, bp);
+    marching_mesh_draw (bp->mesh, wire);
     glPopMatrix();
   }
 
@@ -1410,6 +1433,13 @@ init_lavalite (ModeInfo *mi)
   bp->bottle_list = glGenLists (1);
   bp->ball_list = glGenLists (1);
 
+  bp->mesh = marching_mesh_new (MI_DISPLAY (mi));
+  if (!bp->mesh)
+    {
+      fprintf(stderr, "%s: out of memory\n", progname);
+      exit(1);
+    }
+
   generate_bottle (mi);
   generate_static_blobs (mi);
 }
@@ -1536,6 +1566,15 @@ draw_lavalite (ModeInfo *mi)
   glXSwapBuffers(dpy, window);
 }
 
+
+ENTRYPOINT void
+release_lavalite (ModeInfo *mi)
+{
+  lavalite_configuration *bp = &bps[MI_SCREEN(mi)];
+  marching_mesh_free (bp->mesh);
+  bp->mesh = 0;
+}
+
 XSCREENSAVER_MODULE ("Lavalite", lavalite)
 
 #endif /* USE_GL */
@@ -19,6 +19,7 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <math.h>
 
 #ifndef HAVE_JWXYZ
@@ -33,9 +34,14 @@
 # include "jwzgles.h"
 #endif /* HAVE_JWZGLES */
 
+#include "thread_util.h"
 #include "marching.h"
 #include "normals.h"
 
+#ifndef HAVE_JWZGLES /* glDrawElements unimplemented... */
+# define USE_VERTEX_ARRAY
+#endif
+
 extern char *progname;
 
 #undef ABS
@@ -643,3 +649,707 @@ marching_cubes (int grid_size,     /* density of the mesh */
   if (polygon_count)
     *polygon_count = polys;
 }
+
+
+
+/* The threaded version.
+ */
+
+#define BRICK 8		/* cells per side of an empty-space brick */
+
+struct marching_thread {
+  marching_mesh *owner;
+  unsigned id;
+
+  int z0, z1;			/* the cell layers this thread polygonizes */
+
+  /* Vertex numbers of the vertices on the X and Y edges of one plane of
+     samples, and on the Z edges between two planes.  An entry is only
+     meaningful if it is at least the number of the first vertex made
+     while polygonizing the layer that plane belongs to; that way, none
+     of these ever need to be cleared between layers.
+   */
+  int *first[2];		/* plane z0: kept for stitching to the seam */
+  int *roll[2][2];		/* the other planes, alternating */
+  int *zmap;
+  int **last;			/* plane z1, after the run */
+  int last_start;		/* first vertex of layer z1-1 */
+
+  GLfloat *verts, *norms;	/* 3 per vertex */
+  int nverts, vsize, nsize;
+  GLuint *tris;			/* 3 per triangle */
+  int ntris, tsize;
+
+  int *remap;			/* vertex numbers in the merged mesh */
+  int remap_size;
+};
+
+struct marching_mesh {
+  struct threadpool threadpool;
+  struct marching_thread **threads;
+
+  int grid_size;		/* what the per-thread edge maps were made for */
+  double isolevel;
+  int smooth_p;
+  double (*compute_fn) (double x, double y, double z, void *closure);
+  void *closure;
+
+  float *field;			/* grid_size^3 samples */
+  int field_size;
+  unsigned char *bricks;	/* nbricks^3 flags */
+  int nbricks, bricks_size;
+  int active_bricks;
+
+  GLfloat *verts, *norms;	/* the merged mesh */
+  int nverts, vsize, nsize;
+  GLuint *tris;
+  int ntris, tsize;
+  GLuint *lines;		/* wireframe: 6 per triangle */
+  int lsize;
+};
+
+
+/* Edge e of a cell is the edge of kind axis[e] (0 = X, 1 = Y, 2 = Z)
+   starting at corner dx, dy of the lower plane (dz = 0) or the upper one,
+   using the same corner and edge numbering as march_one_cube().
+ */
+static const struct { char axis, dx, dy, dz; } cell_edges[12] = {
+  { 0, 0, 0, 0 }, { 1, 1, 0, 0 }, { 0, 0, 1, 0 }, { 1, 0, 0, 0 },
+  { 0, 0, 0, 1 }, { 1, 1, 0, 1 }, { 0, 0, 1, 1 }, { 1, 0, 0, 1 },
+  { 2, 0, 0, 0 }, { 2, 1, 0, 0 }, { 2, 1, 1, 0 }, { 2, 0, 1, 0 },
+};
+
+
+static void *
+grow_array (void *array, int *size, int needed, size_t elt)
+{
+  if (needed <= *size)
+    return array;
+  *size = (needed < 1024 ? 1024 : needed + needed / 2);
+  array = realloc (array, *size * elt);
+  if (!array)
+    {
+      fprintf (stderr, "%s: out of memory (%d)\n", progname, *size);
+      exit (1);
+    }
+  return array;
+}
+
+
+static int
+marching_thread_create (void *self_raw, struct threadpool *pool, unsigned id)
+{
+  struct marching_thread *self = (struct marching_thread *) self_raw;
+  memset (self, 0, sizeof(*self));
+  self->owner = GET_PARENT_OBJ (marching_mesh, threadpool, pool);
+  self->id = id;
+  self->owner->threads[id] = self;
+  return 0;
+}
+
+
+static void
+marching_thread_destroy (void *self_raw)
+{
+  struct marching_thread *self = (struct marching_thread *) self_raw;
+  int i;
+  for (i = 0; i < 2; i++)
+    {
+      free (self->first[i]);
+      free (self->roll[0][i]);
+      free (self->roll[1][i]);
+    }
+  free (self->zmap);
+  free (self->verts);
+  free (self->norms);
+  free (self->tris);
+  free (self->remap);
+}
+
+
+static int
+brick_active_p (const marching_mesh *mm, int bx, int by, int bz)
+{
+  int nb = mm->nbricks;
+  if (bx < 0 || by < 0 || bz < 0 || bx >= nb || by >= nb || bz >= nb)
+    return 0;
+  return mm->bricks[(bz * nb + by) * nb + bx];
+}
+
+
+/* Phase 1: sample the field on the Z planes below this thread's cell
+   layers (and the top plane, on the last thread), but only at the corners
+   of cells in active bricks.  A sample on the border between two active
+   bricks is done by the upper one.
+ */
+static void
+marching_thread_sample (void *self_raw)
+{
+  struct marching_thread *self = (struct marching_thread *) self_raw;
+  marching_mesh *mm = self->owner;
+  int g = mm->grid_size;
+  int nb = mm->nbricks;
+  int pz0 = self->z0;
+  int pz1 = (self->id == mm->threadpool.count - 1 ? g : self->z1);
+  int z, bx, by;
+
+# define ACTIVE(BX,BY,Z) \
+    (brick_active_p (mm, (BX), (BY), (Z) / BRICK) || \
+     ((Z) > 0 && brick_active_p (mm, (BX), (BY), ((Z) - 1) / BRICK)))
+
+  for (z = pz0; z < pz1; z++)
+    for (by = 0; by < nb; by++)
+      for (bx = 0; bx < nb; bx++)
+        {
+          int x0, y0, x1, y1, x, y;
+          if (! ACTIVE (bx, by, z)) continue;
+          x0 = bx * BRICK;
+          y0 = by * BRICK;
+          x1 = x0 + BRICK; if (x1 > g-1) x1 = g-1;
+          y1 = y0 + BRICK; if (y1 > g-1) y1 = g-1;
+          if (! ACTIVE (bx+1, by, z)) x1++;
+          if (! ACTIVE (bx, by+1, z)) y1++;
+          for (y = y0; y < y1; y++)
+            {
+              float *out = mm->field + ((long) z * g + y) * g;
+              for (x = x0; x < x1; x++)
+                out[x] = mm->compute_fn (x, y, z, mm->closure);
+            }
+        }
+# undef ACTIVE
+}
+
+
+/* Returns the number of the vertex where the surface crosses the given
+   edge of the grid, making it if it isn't already in the map.
+ */
+static int
+edge_vertex (struct marching_thread *self, int *map, int start,
+             int x, int y, int z, int axis)
+{
+  marching_mesh *mm = self->owner;
+  int g = mm->grid_size;
+  int m = y * g + x;
+  long i0, i1;
+  double v0, v1, iso = mm->isolevel;
+  double mu;
+  GLfloat *p;
+  int v;
+
+  if (map[m] >= start)
+    return map[m];
+
+  i0 = ((long) z * g + y) * g + x;
+  i1 = i0 + (axis == 0 ? 1 : axis == 1 ? g : (long) g * g);
+  v0 = mm->field[i0];
+  v1 = mm->field[i1];
+
+  /* Same as interp_vertex(). */
+  if (ABS(iso-v0) < 0.00001)      mu = 0;
+  else if (ABS(iso-v1) < 0.00001) mu = 1;
+  else if (ABS(v0-v1) < 0.00001)  mu = 0;
+  else mu = (iso - v0) / (v1 - v0);
+
+  v = self->nverts++;
+  self->verts = (GLfloat *)
+    grow_array (self->verts, &self->vsize, self->nverts * 3, sizeof(GLfloat));
+  p = self->verts + v * 3;
+  p[0] = x + (axis == 0 ? mu : 0);
+  p[1] = y + (axis == 1 ? mu : 0);
+  p[2] = z + (axis == 2 ? mu : 0);
+
+  if (mm->smooth_p)
+    {
+      /* Same as do_function_normal(). */
+      double off = 0.5;
+      void *c = mm->closure;
+      GLfloat *n;
+      self->norms = (GLfloat *)
+        grow_array (self->norms, &self->nsize, self->nverts * 3,
+                    sizeof(GLfloat));
+      n = self->norms + v * 3;
+      n[0] = (mm->compute_fn (p[0]-off, p[1], p[2], c) -
+              mm->compute_fn (p[0]+off, p[1], p[2], c));
+      n[1] = (mm->compute_fn (p[0], p[1]-off, p[2], c) -
+              mm->compute_fn (p[0], p[1]+off, p[2], c));
+      n[2] = (mm->compute_fn (p[0], p[1], p[2]-off, c) -
+              mm->compute_fn (p[0], p[1], p[2]+off, c));
+    }
+
+  map[m] = v;
+  return v;
+}
+
+
+/* Phase 2: polygonize cell layers z0 through z1-1.
+ */
+static void
+marching_thread_polygonize (void *self_raw)
+{
+  struct marching_thread *self = (struct marching_thread *) self_raw;
+  marching_mesh *mm = self->owner;
+  int g = mm->grid_size;
+  int nb = mm->nbricks;
+  double iso = mm->isolevel;
+  int **lo = self->first, **hi = self->roll[0];
+  int lo_start = 0;
+  int z;
+
+  self->nverts = 0;
+  self->ntris = 0;
+  self->last = 0;
+  self->last_start = 0;
+
+  if (self->z0 >= self->z1)
+    return;
+
+  /* Entries left over from the last frame could look current.  Nothing
+     is ever stored there below zero. */
+  {
+    size_t size = (size_t) g * g * sizeof(int);
+    memset (self->first[0],   0xFF, size);
+    memset (self->first[1],   0xFF, size);
+    memset (self->roll[0][0], 0xFF, size);
+    memset (self->roll[0][1], 0xFF, size);
+    memset (self->roll[1][0], 0xFF, size);
+    memset (self->roll[1][1], 0xFF, size);
+    memset (self->zmap,       0xFF, size);
+  }
+
+  for (z = self->z0; z < self->z1; z++)
+    {
+      int hi_start = self->nverts;
+      int bz = z / BRICK, bx, by;
+
+      if (z == self->z0)
+        lo_start = hi_start;
+
+      for (by = 0; by < nb; by++)
+        for (bx = 0; bx < nb; bx++)
+          {
+            int x0, y0, x1, y1, x, y;
+            if (! mm->bricks[(bz * nb + by) * nb + bx]) continue;
+            x0 = bx * BRICK;
+            y0 = by * BRICK;
+            x1 = x0 + BRICK; if (x1 > g-1) x1 = g-1;
+            y1 = y0 + BRICK; if (y1 > g-1) y1 = g-1;
+
+            for (y = y0; y < y1; y++)
+              {
+                const float *f0 = mm->field + ((long) z * g + y) * g;
+                const float *f1 = f0 + (long) g * g;
+                for (x = x0; x < x1; x++)
+                  {
+                    int cubeindex = 0;
+                    int edges, i;
+                    int vertlist[12];
+                    GLuint *t;
+
+                    if (f0[x]       < iso) cubeindex |= 1;
+                    if (f0[x+1]     < iso) cubeindex |= 2;
+                    if (f0[x+1+g]   < iso) cubeindex |= 4;
+                    if (f0[x+g]     < iso) cubeindex |= 8;
+                    if (f1[x]       < iso) cubeindex |= 16;
+                    if (f1[x+1]     < iso) cubeindex |= 32;
+                    if (f1[x+1+g]   < iso) cubeindex |= 64;
+                    if (f1[x+g]     < iso) cubeindex |= 128;
+
+                    edges = edgeTable[cubeindex];
+                    if (!edges) continue;
+
+                    for (i = 0; i < 12; i++)
+                      if (edges & (1 << i))
+                        {
+                          int ex = x + cell_edges[i].dx;
+                          int ey = y + cell_edges[i].dy;
+                          int axis = cell_edges[i].axis;
+                          int *map;
+                          int start;
+                          if (axis == 2)
+                            map = self->zmap, start = hi_start;
+                          else if (cell_edges[i].dz)
+                            map = hi[axis], start = hi_start;
+                          else
+                            map = lo[axis], start = lo_start;
+                          vertlist[i] = edge_vertex (self, map, start,
+                                                     ex, ey,
+                                                     z + cell_edges[i].dz,
+                                                     axis);
+                        }
+
+                    for (i = 0; triTable[cubeindex][i] != -1; i++)
+                      ;
+                    self->tris = (GLuint *)
+                      grow_array (self->tris, &self->tsize, self->ntris + i,
+                                  sizeof(GLuint));
+                    t = self->tris + self->ntris;
+                    self->ntris += i;
+                    for (i = 0; triTable[cubeindex][i] != -1; i++)
+                      *t++ = vertlist[triTable[cubeindex][i]];
+                  }
+              }
+          }
+
+      /* The upper plane of this layer is the lower plane of the next. */
+      self->last = hi;
+      self->last_start = hi_start;
+      lo = hi;
+      lo_start = hi_start;
+      hi = (hi == self->roll[0] ? self->roll[1] : self->roll[0]);
+    }
+
+  self->ntris /= 3;
+}
+
+
+static void
+marching_alloc_maps (marching_mesh *mm, int g)
+{
+  unsigned i;
+  size_t size = (size_t) g * g * sizeof(int);
+  for (i = 0; i < mm->threadpool.count; i++)
+    {
+      struct marching_thread *t = mm->threads[i];
+      int **maps[7];
+      int j;
+      maps[0] = &t->first[0];
+      maps[1] = &t->first[1];
+      maps[2] = &t->roll[0][0];
+      maps[3] = &t->roll[0][1];
+      maps[4] = &t->roll[1][0];
+      maps[5] = &t->roll[1][1];
+      maps[6] = &t->zmap;
+      for (j = 0; j < sizeof(maps)/sizeof(*maps); j++)
+        {
+          *maps[j] = (int *) realloc (*maps[j], size);
+          if (!*maps[j])
+            {
+              fprintf (stderr, "%s: out of memory for %dx%d grid\n",
+                       progname, g, g);
+              exit (1);
+            }
+        }
+    }
+}
+
+
+marching_mesh *
+marching_mesh_new (Display *dpy)
+{
+  static const struct threadpool_class cls = {
+    sizeof (struct marching_thread),
+    marching_thread_create,
+    marching_thread_destroy
+  };
+  marching_mesh *mm = (marching_mesh *) calloc (1, sizeof(*mm));
+  unsigned count = hardware_concurrency (dpy);
+  int err;
+
+  if (!mm) return 0;
+  mm->threads = (struct marching_thread **)
+    calloc (count, sizeof(*mm->threads));
+  if (!mm->threads)
+    {
+      free (mm);
+      return 0;
+    }
+
+  err = threadpool_create (&mm->threadpool, &cls, dpy, count);
+  if (err)
+    {
+      fprintf (stderr, "%s: threadpool_create: %s\n", progname,
+               strerror (err));
+      free (mm->threads);
+      free (mm);
+      return 0;
+    }
+  return mm;
+}
+
+
+void
+marching_mesh_free (marching_mesh *mm)
+{
+  if (!mm) return;
+  threadpool_destroy (&mm->threadpool);
+  free (mm->threads);
+  free (mm->field);
+  free (mm->bricks);
+  free (mm->verts);
+  free (mm->norms);
+  free (mm->tris);
+  free (mm->lines);
+  free (mm);
+}
+
+
+/* Phase 3: concatenate the threads' meshes.  The vertices on the plane
+   between two slabs were made by both threads, so the second copy of
+   each of those is dropped.
+ */
+static void
+marching_merge (marching_mesh *mm)
+{
+  int g = mm->grid_size;
+  unsigned n = mm->threadpool.count;
+  struct marching_thread *prev = 0;
+  int nverts = 0, ntris = 0;
+  unsigned i;
+  int j, k;
+
+  for (i = 0; i < n; i++)
+    {
+      nverts += mm->threads[i]->nverts;
+      ntris  += mm->threads[i]->ntris;
+    }
+
+  mm->verts = (GLfloat *)
+    grow_array (mm->verts, &mm->vsize, nverts * 3, sizeof(GLfloat));
+  if (mm->smooth_p)
+    mm->norms = (GLfloat *)
+      grow_array (mm->norms, &mm->nsize, nverts * 3, sizeof(GLfloat));
+  mm->tris = (GLuint *)
+    grow_array (mm->tris, &mm->tsize, ntris * 3, sizeof(GLuint));
+
+  mm->nverts = 0;
+  mm->ntris = 0;
+
+  for (i = 0; i < n; i++)
+    {
+      struct marching_thread *t = mm->threads[i];
+
+      if (t->z0 >= t->z1)
+        continue;
+
+      t->remap = (int *)
+        grow_array (t->remap, &t->remap_size, t->nverts, sizeof(int));
+      for (j = 0; j < t->nverts; j++)
+        t->remap[j] = -1;
+
+      /* The first plane of this slab is the last plane of the previous
+         non-empty one.  Vertices are only ever made in the first plane
+         during the first layer, so they are all there, numbered from 0. */
+      if (prev)
+        for (k = 0; k < 2; k++)
+          {
+            const int *mine = t->first[k];
+            const int *theirs = prev->last[k];
+            for (j = 0; j < g * g; j++)
+              if (mine[j] >= 0 && mine[j] < t->nverts &&
+                  theirs[j] >= prev->last_start &&
+                  theirs[j] < prev->nverts)
+                t->remap[mine[j]] = prev->remap[theirs[j]];
+          }
+
+      for (j = 0; j < t->nverts; j++)
+        if (t->remap[j] < 0)
+          {
+            int v = mm->nverts++;
+            memcpy (mm->verts + v * 3, t->verts + j * 3, 3 * sizeof(GLfloat));
+            if (mm->smooth_p)
+              memcpy (mm->norms + v * 3, t->norms + j * 3,
+                      3 * sizeof(GLfloat));
+            t->remap[j] = v;
+          }
+
+      for (j = 0; j < t->ntris * 3; j++)
+        mm->tris[mm->ntris * 3 + j] = t->remap[t->tris[j]];
+      mm->ntris += t->ntris;
+
+      prev = t;
+    }
+
+  /* Faceted: every triangle gets its own three vertices, all with the
+     triangle's normal. */
+  if (! mm->smooth_p)
+    {
+      int nv = mm->ntris * 3;
+      int vsize = 0;
+      GLfloat *verts = (GLfloat *)
+        grow_array (0, &vsize, nv * 3, sizeof(GLfloat));
+      mm->norms = (GLfloat *)
+        grow_array (mm->norms, &mm->nsize, nv * 3, sizeof(GLfloat));
+      for (j = 0; j < mm->ntris; j++)
+        {
+          XYZ p[3], nn;
+          for (k = 0; k < 3; k++)
+            {
+              const GLfloat *v = mm->verts + mm->tris[j*3+k] * 3;
+              GLfloat *o = verts + (j*3+k) * 3;
+              p[k].x = o[0] = v[0];
+              p[k].y = o[1] = v[1];
+              p[k].z = o[2] = v[2];
+            }
+          nn = calc_normal (p[0], p[1], p[2]);
+          for (k = 0; k < 3; k++)
+            {
+              GLfloat *o = mm->norms + (j*3+k) * 3;
+              o[0] = nn.x;
+              o[1] = nn.y;
+              o[2] = nn.z;
+              mm->tris[j*3+k] = j*3+k;
+            }
+        }
+      free (mm->verts);
+      mm->verts = verts;
+      mm->vsize = vsize;
+      mm->nverts = nv;
+    }
+}
+
+
+unsigned long
+marching_mesh_compute (marching_mesh *mm,
+                       int grid_size, double isolevel, int smooth_p,
+                       double (*compute_fn) (double x, double y, double z,
+                                             void *closure),
+                       int (*brick_fn) (double x0, double y0, double z0,
+                                        double x1, double y1, double z1,
+                                        void *closure),
+                       void *closure)
+{
+  int g = grid_size;
+  int nb = (g - 1 + BRICK - 1) / BRICK;
+  unsigned n = mm->threadpool.count;
+  int *layer_bricks;
+  long total, acc, goal;
+  int bx, by, bz, z;
+  unsigned i;
+
+  mm->nverts = 0;
+  mm->ntris = 0;
+  if (g < 2) return 0;
+
+  if (g != mm->grid_size)
+    {
+      long size = (long) g * g * g;
+      free (mm->field);
+      mm->field = (float *) malloc (size * sizeof(*mm->field));
+      if (!mm->field)
+        {
+          fprintf (stderr, "%s: out of memory for %dx%dx%d grid\n",
+                   progname, g, g, g);
+          exit (1);
+        }
+      marching_alloc_maps (mm, g);
+      mm->grid_size = g;
+    }
+
+  mm->isolevel   = isolevel;
+  mm->smooth_p   = smooth_p;
+  mm->compute_fn = compute_fn;
+  mm->closure    = closure;
+  mm->nbricks    = nb;
+  mm->bricks = (unsigned char *)
+    grow_array (mm->bricks, &mm->bricks_size, nb * nb * nb, 1);
+
+  layer_bricks = (int *) calloc (nb, sizeof(*layer_bricks));
+  if (!layer_bricks)
+    {
+      fprintf (stderr, "%s: out of memory\n", progname);
+      exit (1);
+    }
+
+  mm->active_bricks = 0;
+  for (bz = 0; bz < nb; bz++)
+    for (by = 0; by < nb; by++)
+      for (bx = 0; bx < nb; bx++)
+        {
+          int x0 = bx * BRICK, y0 = by * BRICK, z0 = bz * BRICK;
+          int x1 = x0 + BRICK, y1 = y0 + BRICK, z1 = z0 + BRICK;
+          int on;
+          if (x1 > g-1) x1 = g-1;
+          if (y1 > g-1) y1 = g-1;
+          if (z1 > g-1) z1 = g-1;
+          on = (brick_fn ? !!brick_fn (x0, y0, z0, x1, y1, z1, closure) : 1);
+          mm->bricks[(bz * nb + by) * nb + bx] = on;
+          layer_bricks[bz] += on;
+          mm->active_bricks += on;
+        }
+
+  /* Give each thread a run of cell layers with about the same number of
+     active bricks in it. */
+  total = 0;
+  for (z = 0; z < g-1; z++)
+    total += layer_bricks[z / BRICK];
+  acc = 0;
+  z = 0;
+  for (i = 0; i < n; i++)
+    {
+      struct marching_thread *t = mm->threads[i];
+      goal = total * (i + 1) / n;
+      t->z0 = z;
+      while (z < g-1 && (acc < goal || i == n-1))
+        acc += layer_bricks[z++ / BRICK];
+      t->z1 = z;
+    }
+  free (layer_bricks);
+
+  if (mm->active_bricks)
+    {
+      threadpool_run (&mm->threadpool, marching_thread_sample);
+      threadpool_wait (&mm->threadpool);
+      threadpool_run (&mm->threadpool, marching_thread_polygonize);
+      threadpool_wait (&mm->threadpool);
+      marching_merge (mm);
+    }
+
+  return mm->ntris;
+}
+
+
+void
+marching_mesh_draw (marching_mesh *mm, int wireframe_p)
+{
+  glFrontFace (GL_CCW);
+  if (mm->ntris <= 0) return;
+
+# ifdef USE_VERTEX_ARRAY
+  glEnableClientState (GL_VERTEX_ARRAY);
+  glEnableClientState (GL_NORMAL_ARRAY);
+  glVertexPointer (3, GL_FLOAT, 0, mm->verts);
+  glNormalPointer (GL_FLOAT, 0, mm->norms);
+
+  if (wireframe_p)
+    {
+      const GLuint *t = mm->tris;
+      GLuint *l;
+      int i;
+      mm->lines = (GLuint *)
+        grow_array (mm->lines, &mm->lsize, mm->ntris * 6, sizeof(GLuint));
+      l = mm->lines;
+      for (i = 0; i < mm->ntris; i++, t += 3)
+        {
+          *l++ = t[0]; *l++ = t[1];
+          *l++ = t[1]; *l++ = t[2];
+          *l++ = t[2]; *l++ = t[0];
+        }
+      glDrawElements (GL_LINES, mm->ntris * 6, GL_UNSIGNED_INT, mm->lines);
+    }
+  else
+    glDrawElements (GL_TRIANGLES, mm->ntris * 3, GL_UNSIGNED_INT, mm->tris);
+
+  glDisableClientState (GL_VERTEX_ARRAY);
+  glDisableClientState (GL_NORMAL_ARRAY);
+
+# else /* !USE_VERTEX_ARRAY */
+  {
+    const GLuint *t = mm->tris;
+    int i, j;
+    if (!wireframe_p)
+      glBegin (GL_TRIANGLES);
+    for (i = 0; i < mm->ntris; i++, t += 3)
+      {
+        if (wireframe_p) glBegin (GL_LINE_LOOP);
+        for (j = 0; j < 3; j++)
+          {
+            glNormal3fv (mm->norms + t[j] * 3);
+            glVertex3fv (mm->verts + t[j] * 3);
+          }
+        if (wireframe_p) glEnd ();
+      }
+    if (!wireframe_p)
+      glEnd ();
+  }
+# endif /* !USE_VERTEX_ARRAY */
+}
@@ -45,4 +45,38 @@ marching_cubes (int grid_size,     /* density of the mesh */
 
                 unsigned long *polygon_count);
 
+
+/* The same thing, but faster: the field is sampled and polygonized by a
+   pool of threads, and the result is kept as an indexed triangle mesh
+   with shared vertices, which is drawn with vertex arrays.
+
+   The grid is divided into bricks of 8x8x8 cells.  If brick_fn is given,
+   it is called with the grid-space bounds of each brick (a box from
+   x0,y0,z0 to x1,y1,z1), and must return 0 only if the surface can't pass
+   through that box.  The field is neither sampled nor polygonized there.
+
+   compute_fn is called from several threads at once, so it must not
+   modify anything.  As above, it is called with grid coordinates from
+   0 to grid_size-1, and more often than that if smooth_p is set.
+ */
+typedef struct marching_mesh marching_mesh;
+
+extern marching_mesh *marching_mesh_new (Display *);
+extern void marching_mesh_free (marching_mesh *);
+
+/* Rebuilds the mesh and returns the number of triangles in it. */
+extern unsigned long
+marching_mesh_compute (marching_mesh *,
+                       int grid_size, double isolevel, int smooth_p,
+                       double (*compute_fn) (double x, double y, double z,
+                                             void *closure),
+                       int (*brick_fn) (double x0, double y0, double z0,
+                                        double x1, double y1, double z1,
+                                        void *closure),
+                       void *closure);
+
+/* Emits the most recently computed mesh, in grid coordinates.  This may
+   be called inside glNewList(). */
+extern void marching_mesh_draw (marching_mesh *, int wireframe_p);
+
 #endif /* __MARCHING_H__ */
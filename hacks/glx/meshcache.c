@@ -0,0 +1,98 @@
+/* meshcache, Copyright (c) 2026 Jamie Zawinski <jwz@jwz.org>
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation.  No representations are made about the suitability of this
+ * software for any purpose.  It is provided "as is" without express or 
+ * implied warranty.
+ *
+ * A cache of vertex arrays for the unit primitives.  See meshcache.h.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <stdlib.h>
+
+#ifdef HAVE_COCOA
+#elif defined(HAVE_ANDROID)
+# include <GLES/gl.h>
+#else
+# include <GL/gl.h>
+#endif
+
+#ifdef HAVE_JWZGLES
+# include "jwzgles.h"
+#endif /* HAVE_JWZGLES */
+
+#include "meshcache.h"
+
+static cached_mesh *mesh_cache = 0;
+
+
+cached_mesh *
+find_cached_mesh (mesh_kind kind, int a, int b, int c, int d)
+{
+  cached_mesh *m;
+  for (m = mesh_cache; m; m = m->next)
+    if (m->kind == kind &&
+        m->key[0] == a && m->key[1] == b &&
+        m->key[2] == c && m->key[3] == d)
+      return m;
+  return 0;
+}
+
+
+cached_mesh *
+new_cached_mesh (mesh_kind kind, int a, int b, int c, int d,
+                 int max_vertices)
+{
+  cached_mesh *m = (cached_mesh *) calloc (1, sizeof(*m));
+  if (!m) abort();
+  m->kind = kind;
+  m->key[0] = a;
+  m->key[1] = b;
+  m->key[2] = c;
+  m->key[3] = d;
+  m->size = max_vertices;
+  m->array = (mesh_vertex *) calloc (max_vertices, sizeof(*m->array));
+  if (!m->array) abort();
+  m->next = mesh_cache;
+  mesh_cache = m;
+  return m;
+}
+
+
+void
+cached_mesh_add_draw (cached_mesh *m, GLenum mode, int first, int count)
+{
+  if (m->ndraws >= sizeof(m->draws)/sizeof(*m->draws)) abort();
+  if (first + count > m->size) abort();
+  m->draws[m->ndraws].mode  = mode;
+  m->draws[m->ndraws].first = first;
+  m->draws[m->ndraws].count = count;
+  m->ndraws++;
+}
+
+
+int
+draw_cached_mesh (const cached_mesh *m)
+{
+  int i;
+
+  glEnableClientState (GL_VERTEX_ARRAY);
+  glEnableClientState (GL_NORMAL_ARRAY);
+  glEnableClientState (GL_TEXTURE_COORD_ARRAY);
+
+  glVertexPointer   (3, GL_FLOAT, sizeof(*m->array), &m->array[0].p);
+  glNormalPointer   (   GL_FLOAT, sizeof(*m->array), &m->array[0].n);
+  glTexCoordPointer (2, GL_FLOAT, sizeof(*m->array), &m->array[0].s);
+
+  for (i = 0; i < m->ndraws; i++)
+    glDrawArrays (m->draws[i].mode, m->draws[i].first, m->draws[i].count);
+
+  return m->polys;
+}
@@ -0,0 +1,71 @@
+/* meshcache, Copyright (c) 2026 Jamie Zawinski <jwz@jwz.org>
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation.  No representations are made about the suitability of this
+ * software for any purpose.  It is provided "as is" without express or 
+ * implied warranty.
+ */
+
+/* A cache of vertex arrays for the unit primitives in sphere.c and tube.c,
+   which are drawn hundreds of times per frame by some hacks, almost always
+   with the same few parameters.  Each shape is computed the first time it
+   is asked for, and after that it's just a few glDrawArrays calls.
+
+   The arrays are in client memory rather than in buffer objects, so one
+   cache serves every GL context, and a cached shape can still be compiled
+   into a display list.
+ */
+
+#ifndef __MESHCACHE_H__
+#define __MESHCACHE_H__
+
+typedef struct { GLfloat x, y, z; } mesh_xyz;
+
+typedef struct {
+  mesh_xyz p;			/* vertex */
+  mesh_xyz n;			/* normal */
+  GLfloat s, t;			/* texture */
+} mesh_vertex;
+
+typedef enum { MESH_SPHERE, MESH_DOME, MESH_TUBE, MESH_CONE } mesh_kind;
+
+typedef struct cached_mesh cached_mesh;
+struct cached_mesh {
+  mesh_kind kind;
+  int key[4];			/* whatever parameters the shape depends on */
+
+  mesh_vertex *array;
+  int size, count;		/* allocated, used */
+  int polys;			/* returned by draw_cached_mesh */
+
+  int ndraws;
+  struct { GLenum mode; int first, count; } draws[3];
+
+  cached_mesh *next;
+};
+
+/* Returns the mesh made earlier with these parameters, or 0.
+ */
+extern cached_mesh *find_cached_mesh (mesh_kind, int a, int b, int c, int d);
+
+/* Adds an empty mesh to the cache, with room for the given number of
+   vertices, all zeroed.  The caller fills in the array, and lists the
+   primitives to draw with cached_mesh_add_draw().
+ */
+extern cached_mesh *new_cached_mesh (mesh_kind, int a, int b, int c, int d,
+                                     int max_vertices);
+
+/* Says to draw vertices [first, first+count) of the array with mode.
+ */
+extern void cached_mesh_add_draw (cached_mesh *, GLenum mode,
+                                  int first, int count);
+
+/* Draws it, leaving the vertex, normal and texture coordinate arrays
+   enabled.  Returns the polygon count.
+ */
+extern int draw_cached_mesh (const cached_mesh *);
+
+#endif /* __MESHCACHE_H__ */
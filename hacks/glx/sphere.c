@@ -36,11 +36,12 @@
 #endif /* HAVE_JWZGLES */
 
 #include "sphere.h"
+#include "meshcache.h"
 
-typedef struct { GLfloat x, y, z; } XYZ;
+typedef mesh_xyz XYZ;
 
-static int
-unit_sphere_1 (int stacks, int slices, int wire_p, int half_p)
+static cached_mesh *
+make_sphere (int stacks, int slices, int wire_p, int half_p)
 {
   int polys = 0;
   int i,j;
@@ -55,7 +56,9 @@ unit_sphere_1 (int stacks, int slices, int wire_p, int half_p)
   int mode = (wire_p ? GL_LINE_STRIP : GL_TRIANGLE_STRIP);
 
   int arraysize, out;
-  struct { XYZ p; XYZ n; GLfloat s, t; } *array;
+  int key_slices = slices;
+  cached_mesh *m;
+  mesh_vertex *array;
 
   if (r < 0)
     r = -r;
@@ -63,8 +66,9 @@ unit_sphere_1 (int stacks, int slices, int wire_p, int half_p)
     slices = -slices;
 
   arraysize = (stacks+1) * (slices+1) * (wire_p ? 4 : 2);
-  array = (void *) calloc (arraysize, sizeof(*array));
-  if (! array) abort();
+  m = new_cached_mesh (half_p ? MESH_DOME : MESH_SPHERE,
+                       stacks, key_slices, wire_p, 0, arraysize);
+  array = m->array;
   out = 0;
 
   if (slices < 4 || stacks < 2 || r <= 0)
@@ -126,19 +130,22 @@ unit_sphere_1 (int stacks, int slices, int wire_p, int half_p)
 
  END:
 
-  glEnableClientState (GL_VERTEX_ARRAY);
-  glEnableClientState (GL_NORMAL_ARRAY);
-  glEnableClientState (GL_TEXTURE_COORD_ARRAY);
-
-  glVertexPointer   (3, GL_FLOAT, sizeof(*array), &array[0].p);
-  glNormalPointer   (   GL_FLOAT, sizeof(*array), &array[0].n);
-  glTexCoordPointer (2, GL_FLOAT, sizeof(*array), &array[0].s);
-
-  glDrawArrays (mode, 0, out);
+  cached_mesh_add_draw (m, mode, 0, out);
+  m->polys = polys;
+  return m;
+}
 
-  free (array);
 
-  return polys;
+static int
+unit_sphere_1 (int stacks, int slices, int wire_p, int half_p)
+{
+  cached_mesh *m;
+  wire_p = !!wire_p;
+  m = find_cached_mesh (half_p ? MESH_DOME : MESH_SPHERE,
+                        stacks, slices, wire_p, 0);
+  if (!m)
+    m = make_sphere (stacks, slices, wire_p, half_p);
+  return draw_cached_mesh (m);
 }
 
 
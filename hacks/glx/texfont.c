@@ -45,6 +45,7 @@
 
 #include "xft.h"
 #include "resources.h"
+#include "utf8wc.h"
 #include "texfont.h"
 #include "fps.h"	/* for current_device_rotation() */
 
@@ -70,11 +71,36 @@ struct texfont_cache {
   texfont_cache *next;
 };
 
+/* One glyph in the atlas texture.
+ */
+typedef struct {
+  unsigned long uc;		/* 0 means this hash slot is empty */
+  short x, y;			/* top left of the ink, in the atlas */
+  short width, height;		/* size of the ink */
+  short origin_x, origin_y;	/* XGlyphInfo x, y: the origin, in the ink */
+  short advance;		/* XGlyphInfo xOff */
+} texfont_glyph;
+
 struct texture_font_data {
   Display *dpy;
   XftFont *xftfont;
   int cache_size;
   texfont_cache *cache;
+
+  /* Every glyph drawn so far, packed into rows of one texture, so that
+     most strings can be drawn with no new rendering at all.  If the atlas
+     fills up, strings with new glyphs in them fall back to the cache.
+   */
+  GLuint atlas_texid;
+  int atlas_size;		/* width and height; 0 if not yet made */
+  int atlas_x, atlas_y;		/* where the next glyph goes */
+  int atlas_row_height;
+  Bool atlas_full_p;
+  texfont_glyph *glyphs;	/* open hash table, by character */
+  int glyphs_size, glyphs_count;
+
+  GLfloat *quad_verts, *quad_texcoords;	/* 2 each, 6 per glyph */
+  int quads_count, quads_size;
 };
 
 
@@ -336,11 +362,15 @@ load_texture_font (Display *dpy, char *res)
    If an XftDraw is supplied, render the string as well, at X,Y.
    Positive Y is down (X11 style, not OpenGL style).
  */
+static void append_glyph_quads (texture_font_data *, const char *, int len,
+                                int x, int y);
+
 static void
 iterate_texture_string (texture_font_data *data,
                         const char *s,
                         int draw_x, int draw_y,
                         XftDraw *xftdraw, XftColor *xftcolor,
+                        Bool quads_p,
                         XCharStruct *metrics_ret)
 {
   int line_height = data->xftfont->ascent + data->xftfont->descent;
@@ -421,6 +451,9 @@ iterate_texture_string (texture_font_data *data,
                                draw_y +
                                oy + (osub_p ? subscript_offset : 0),
                                (FcChar8 *) os, (int) (s - os));
+          if (quads_p && s != os)
+            append_glyph_quads (data, os, (int) (s - os),
+                                ox, oy + (osub_p ? subscript_offset : 0));
           if (!*s) break;
           os = s+1;
           ox = x;
@@ -444,12 +477,441 @@ texture_string_metrics (texture_font_data *data, const char *s,
                         int *ascent_ret, int *descent_ret)
 {
   if (metrics_ret)
-    iterate_texture_string (data, s, 0, 0, 0, 0, metrics_ret);
+    iterate_texture_string (data, s, 0, 0, 0, 0, False, metrics_ret);
   if (ascent_ret)  *ascent_ret  = data->xftfont->ascent;
   if (descent_ret) *descent_ret = data->xftfont->descent;
 }
 
 
+/* The glyph atlas.
+ */
+
+#define ATLAS_PAD 3	/* blank pixels around each glyph, for filtering */
+
+/* Same texel format as bitmap_to_texture(). */
+#ifdef GL_INTENSITY
+# define ATLAS_IFORMAT GL_INTENSITY
+# define ATLAS_FORMAT  GL_LUMINANCE
+# define ATLAS_TEXEL   1
+#else
+# define ATLAS_IFORMAT GL_LUMINANCE_ALPHA
+# define ATLAS_FORMAT  GL_LUMINANCE_ALPHA
+# define ATLAS_TEXEL   2
+#endif
+
+/* Glyphs are added to the atlas a few at a time with glTexSubImage2D, so
+   let GL keep the mipmaps up to date, if it can.  Otherwise the atlas is
+   only filtered linearly.
+ */
+#if defined(GL_GENERATE_MIPMAP) && !defined(HAVE_JWZGLES)
+# define ATLAS_MIPMAP
+#endif
+
+/* Each mip level halves the padding, so past log2(ATLAS_PAD+1) levels
+   the texels at a glyph's edge take in some of its neighbours' ink, and
+   small text grows smudges.  Stop there: text that small is fuzzy
+   anyway.
+ */
+#define ATLAS_MAX_LEVEL 2
+
+
+static texfont_glyph *
+find_glyph (texture_font_data *data, unsigned long uc)
+{
+  unsigned long mask = data->glyphs_size - 1;
+  unsigned long i;
+  if (!data->glyphs_size) return 0;
+  for (i = (uc * 2654435761UL) & mask;
+       data->glyphs[i].uc;
+       i = (i + 1) & mask)
+    if (data->glyphs[i].uc == uc)
+      return &data->glyphs[i];
+  return 0;
+}
+
+
+/* Adds the glyph to the hash table.
+ */
+static void
+add_glyph (texture_font_data *data, const texfont_glyph *g)
+{
+  unsigned long mask, i;
+
+  if ((data->glyphs_count + 1) * 2 > data->glyphs_size)
+    {
+      texfont_glyph *old = data->glyphs;
+      int old_size = data->glyphs_size;
+      int j;
+      data->glyphs_size = (old_size ? old_size * 2 : 256);
+      data->glyphs = (texfont_glyph *)
+        calloc (data->glyphs_size, sizeof(*data->glyphs));
+      if (!data->glyphs) abort();
+      data->glyphs_count = 0;
+      for (j = 0; j < old_size; j++)
+        if (old[j].uc)
+          add_glyph (data, &old[j]);
+      free (old);
+    }
+
+  mask = data->glyphs_size - 1;
+  for (i = (g->uc * 2654435761UL) & mask;
+       data->glyphs[i].uc;
+       i = (i + 1) & mask)
+    ;
+  data->glyphs[i] = *g;
+  data->glyphs_count++;
+}
+
+
+/* Creates the empty atlas texture, and leaves it bound.
+ */
+static void
+make_atlas (texture_font_data *data)
+{
+  GLint max;
+  unsigned char *blank;
+
+  glGetIntegerv (GL_MAX_TEXTURE_SIZE, &max);
+  data->atlas_size = (max < 1024 ? max : 1024);
+
+  blank = (unsigned char *)
+    calloc (data->atlas_size * ATLAS_TEXEL, data->atlas_size);
+  if (!blank) abort();
+
+  glGenTextures (1, &data->atlas_texid);
+  glBindTexture (GL_TEXTURE_2D, data->atlas_texid);
+# ifdef ATLAS_MIPMAP
+  glTexParameteri (GL_TEXTURE_2D, GL_GENERATE_MIPMAP, GL_TRUE);
+  glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, ATLAS_MAX_LEVEL);
+# endif
+  glTexImage2D (GL_TEXTURE_2D, 0, ATLAS_IFORMAT,
+                data->atlas_size, data->atlas_size, 0,
+                ATLAS_FORMAT, GL_UNSIGNED_BYTE, blank);
+  free (blank);
+  check_gl_error ("texture font atlas");
+}
+
+
+/* Finds a place in the atlas for the glyph's ink, filling the atlas in
+   rows.  Returns False if there's no room left.
+ */
+static Bool
+place_glyph (texture_font_data *data, texfont_glyph *g)
+{
+  int w = g->width  + ATLAS_PAD * 2;
+  int h = g->height + ATLAS_PAD * 2;
+  if (data->atlas_x + w > data->atlas_size)
+    {
+      data->atlas_x = 0;
+      data->atlas_y += data->atlas_row_height;
+      data->atlas_row_height = 0;
+    }
+  if (data->atlas_x + w > data->atlas_size ||
+      data->atlas_y + h > data->atlas_size)
+    return False;
+
+  g->x = data->atlas_x + ATLAS_PAD;
+  g->y = data->atlas_y + ATLAS_PAD;
+  data->atlas_x += w;
+  if (h > data->atlas_row_height)
+    data->atlas_row_height = h;
+  return True;
+}
+
+
+/* Renders the glyphs side by side into one Pixmap, and copies each of
+   them into its place in the atlas, which is bound.
+ */
+static void
+rasterize_glyphs (texture_font_data *data, const texfont_glyph *glyphs,
+                  int count)
+{
+  Window window = RootWindow (data->dpy, 0);
+  XWindowAttributes xgwa;
+  XGCValues gcv;
+  GC gc;
+  Pixmap p;
+  XImage *image;
+  XRenderColor rcolor;
+  XftColor xftcolor;
+  XftDraw *xftdraw;
+  unsigned char *buf;
+  int width = 0, height = 0;
+  int i, x;
+
+  for (i = 0; i < count; i++)
+    {
+      width += glyphs[i].width + ATLAS_PAD * 2;
+      if (height < glyphs[i].height + ATLAS_PAD * 2)
+        height = glyphs[i].height + ATLAS_PAD * 2;
+    }
+
+  XGetWindowAttributes (data->dpy, window, &xgwa);
+  p = XCreatePixmap (data->dpy, window, width, height, xgwa.depth);
+  gcv.foreground = BlackPixelOfScreen (xgwa.screen);
+  gc = XCreateGC (data->dpy, p, GCForeground, &gcv);
+  XFillRectangle (data->dpy, p, gc, 0, 0, width, height);
+  XFreeGC (data->dpy, gc);
+
+  rcolor.red = rcolor.green = rcolor.blue = rcolor.alpha = 0xFFFF;
+  XftColorAllocValue (data->dpy, xgwa.visual, xgwa.colormap,
+                      &rcolor, &xftcolor);
+  xftdraw = XftDrawCreate (data->dpy, p, xgwa.visual, xgwa.colormap);
+  for (i = 0, x = 0; i < count; i++)
+    {
+      char s[10];
+      int n = utf8_encode (glyphs[i].uc, s, sizeof(s));
+      XftDrawStringUtf8 (xftdraw, &xftcolor, data->xftfont,
+                         x + ATLAS_PAD + glyphs[i].origin_x,
+                         ATLAS_PAD + glyphs[i].origin_y,
+                         (FcChar8 *) s, n);
+      x += glyphs[i].width + ATLAS_PAD * 2;
+    }
+  XftDrawDestroy (xftdraw);
+  XftColorFree (data->dpy, xgwa.visual, xgwa.colormap, &xftcolor);
+
+  image = XGetImage (data->dpy, p, 0, 0, width, height, ~0L, ZPixmap);
+  XFreePixmap (data->dpy, p);
+
+  buf = (unsigned char *) malloc (width * height * ATLAS_TEXEL);
+  if (!buf) abort();
+
+  for (i = 0, x = 0; i < count; i++)
+    {
+      int w = glyphs[i].width  + ATLAS_PAD * 2;
+      int h = glyphs[i].height + ATLAS_PAD * 2;
+      unsigned char *out = buf;
+      int xx, yy;
+      for (yy = 0; yy < h; yy++)
+        for (xx = 0; xx < w; xx++)
+          {
+            /* As in bitmap_to_texture(), use red, and treat it as alpha. */
+            unsigned long pixel = XGetPixel (image, x + xx, yy);
+            unsigned long r = pixel & xgwa.visual->red_mask;
+            pixel = ((r >> 24) | (r >> 16) | (r >> 8) | r) & 0xFF;
+# if ATLAS_TEXEL == 2
+            *out++ = 0xFF;
+# endif
+            *out++ = pixel;
+          }
+      glTexSubImage2D (GL_TEXTURE_2D, 0,
+                       glyphs[i].x - ATLAS_PAD, glyphs[i].y - ATLAS_PAD,
+                       w, h, ATLAS_FORMAT, GL_UNSIGNED_BYTE, buf);
+      x += w;
+    }
+
+  free (buf);
+  XDestroyImage (image);
+}
+
+
+/* Makes sure every character in the string is in the atlas, rendering
+   the ones that aren't there yet.  Leaves the atlas bound.  Returns False
+   if they didn't all fit.
+ */
+static Bool
+load_glyphs (texture_font_data *data, const char *string)
+{
+  const unsigned char *s = (const unsigned char *) string;
+  long L = strlen (string);
+  texfont_glyph *todo = 0;
+  int ntodo = 0;
+  Bool ok = True;
+  int i;
+
+  if (!data->atlas_size)
+    make_atlas (data);
+  else
+    glBindTexture (GL_TEXTURE_2D, data->atlas_texid);
+
+  while (L > 0)
+    {
+      unsigned long uc;
+      long n = utf8_decode (s, L, &uc);
+      char buf[10];
+      XGlyphInfo e;
+      texfont_glyph g;
+
+      s += n;
+      L -= n;
+      if (uc == 0 || uc == '\n' || uc == '\t' || find_glyph (data, uc))
+        continue;
+      for (i = 0; i < ntodo; i++)
+        if (todo[i].uc == uc) break;
+      if (i < ntodo) continue;
+
+      if (data->atlas_full_p)
+        {
+          ok = False;
+          break;
+        }
+
+      XftTextExtentsUtf8 (data->dpy, data->xftfont, (FcChar8 *) buf,
+                          utf8_encode (uc, buf, sizeof(buf)), &e);
+      memset (&g, 0, sizeof(g));
+      g.uc       = uc;
+      g.width    = e.width;
+      g.height   = e.height;
+      g.origin_x = e.x;
+      g.origin_y = e.y;
+      g.advance  = e.xOff;
+
+      if (g.width <= 0 || g.height <= 0)	/* e.g. space: no ink */
+        {
+          g.width = g.height = 0;
+          add_glyph (data, &g);
+        }
+      else if (place_glyph (data, &g))
+        {
+          if (!todo)
+            {
+              todo = (texfont_glyph *)
+                malloc (strlen (string) * sizeof(*todo));
+              if (!todo) abort();
+            }
+          todo[ntodo++] = g;
+        }
+      else
+        {
+          data->atlas_full_p = True;
+          ok = False;
+          break;
+        }
+    }
+
+  if (ntodo)
+    {
+      GLint oalign;
+      int start, end;
+      glGetIntegerv (GL_UNPACK_ALIGNMENT, &oalign);
+      glPixelStorei (GL_UNPACK_ALIGNMENT, 1);
+
+      /* In batches, to keep the Pixmap to a sensible width. */
+      for (start = 0; start < ntodo; start = end)
+        {
+          int w = 0;
+          for (end = start; end < ntodo; end++)
+            {
+              w += todo[end].width + ATLAS_PAD * 2;
+              if (w > 4096 && end > start) break;
+            }
+          rasterize_glyphs (data, todo + start, end - start);
+        }
+
+      glPixelStorei (GL_UNPACK_ALIGNMENT, oalign);
+      check_gl_error ("texture font atlas");
+
+      /* Even if a later one didn't fit, these are in the atlas now. */
+      for (i = 0; i < ntodo; i++)
+        add_glyph (data, &todo[i]);
+      free (todo);
+    }
+
+  return ok;
+}
+
+
+/* Called by iterate_texture_string() for each run of characters that
+   starts at X,Y (in X11 coordinates) to add a textured quad, as two
+   triangles, for each glyph.  The glyphs must be in the atlas already.
+ */
+static void
+append_glyph_quads (texture_font_data *data, const char *string, int len,
+                    int x, int y)
+{
+  const unsigned char *s = (const unsigned char *) string;
+  GLfloat scale = 1.0 / data->atlas_size;
+
+  while (len > 0)
+    {
+      unsigned long uc;
+      long n = utf8_decode (s, len, &uc);
+      const texfont_glyph *g = find_glyph (data, uc);
+      s += n;
+      len -= n;
+      if (!g) continue;
+
+      if (g->width)
+        {
+          GLfloat x0 = x - g->origin_x, x1 = x0 + g->width;
+          GLfloat y1 = -y + g->origin_y, y0 = y1 - g->height;
+          GLfloat s0 = g->x * scale, s1 = (g->x + g->width)  * scale;
+          GLfloat t0 = g->y * scale, t1 = (g->y + g->height) * scale;
+          GLfloat *v, *t;
+
+          if (data->quads_count >= data->quads_size)
+            {
+              data->quads_size = (data->quads_size
+                                  ? data->quads_size * 2 : 64);
+              data->quad_verts = (GLfloat *)
+                realloc (data->quad_verts,
+                         data->quads_size * 12 * sizeof(GLfloat));
+              data->quad_texcoords = (GLfloat *)
+                realloc (data->quad_texcoords,
+                         data->quads_size * 12 * sizeof(GLfloat));
+              if (!data->quad_verts || !data->quad_texcoords) abort();
+            }
+          v = data->quad_verts     + data->quads_count * 12;
+          t = data->quad_texcoords + data->quads_count * 12;
+          data->quads_count++;
+
+          /* Counterclockwise, like the quad in print_texture_string(). */
+          *v++ = x0; *v++ = y0;  *t++ = s0; *t++ = t1;
+          *v++ = x1; *v++ = y0;  *t++ = s1; *t++ = t1;
+          *v++ = x1; *v++ = y1;  *t++ = s1; *t++ = t0;
+          *v++ = x0; *v++ = y0;  *t++ = s0; *t++ = t1;
+          *v++ = x1; *v++ = y1;  *t++ = s1; *t++ = t0;
+          *v++ = x0; *v++ = y1;  *t++ = s0; *t++ = t0;
+        }
+      x += g->advance;
+    }
+}
+
+
+/* Draws the quads collected by append_glyph_quads(), with the same face
+   culling as the single quad in print_texture_string().
+ */
+static void
+draw_glyph_quads (texture_font_data *data, Bool draw_back_face_p)
+{
+# ifndef HAVE_JWZGLES
+  glPushClientAttrib (GL_CLIENT_VERTEX_ARRAY_BIT);
+# else
+  Bool varray_p = glIsEnabled (GL_VERTEX_ARRAY);
+  Bool tarray_p = glIsEnabled (GL_TEXTURE_COORD_ARRAY);
+  Bool narray_p = glIsEnabled (GL_NORMAL_ARRAY);
+  Bool carray_p = glIsEnabled (GL_COLOR_ARRAY);
+# endif
+
+  glEnableClientState (GL_VERTEX_ARRAY);
+  glEnableClientState (GL_TEXTURE_COORD_ARRAY);
+  glDisableClientState (GL_NORMAL_ARRAY);
+  glDisableClientState (GL_COLOR_ARRAY);
+  glVertexPointer (2, GL_FLOAT, 0, data->quad_verts);
+  glTexCoordPointer (2, GL_FLOAT, 0, data->quad_texcoords);
+
+  glEnable (GL_CULL_FACE);
+  glFrontFace (GL_CCW);
+  glDrawArrays (GL_TRIANGLES, 0, data->quads_count * 6);
+
+  if (draw_back_face_p)
+    {
+      glFrontFace (GL_CW);
+      glDrawArrays (GL_TRIANGLES, 0, data->quads_count * 6);
+      glDisable (GL_CULL_FACE);
+    }
+
+# ifndef HAVE_JWZGLES
+  glPopClientAttrib ();
+# else
+  if (!varray_p) glDisableClientState (GL_VERTEX_ARRAY);
+  if (!tarray_p) glDisableClientState (GL_TEXTURE_COORD_ARRAY);
+  if (narray_p)  glEnableClientState (GL_NORMAL_ARRAY);
+  if (carray_p)  glEnableClientState (GL_COLOR_ARRAY);
+# endif
+}
+
+
 /* Returns a cache entry for this string, with a valid texid.
    If the returned entry has a string in it, the texture is valid.
    Otherwise it is an empty entry waiting to be rendered.
@@ -534,7 +996,7 @@ string_to_texture (texture_font_data *data, const char *string,
   /* Measure the string and create a Pixmap of the proper size.
    */
   XGetWindowAttributes (data->dpy, window, &xgwa);
-  iterate_texture_string (data, string, 0, 0, 0, 0, &overall);
+  iterate_texture_string (data, string, 0, 0, 0, 0, False, &overall);
   width  = overall.rbearing - overall.lbearing;
   height = overall.ascent   + overall.descent;
   if (width  <= 0) width  = 1;
@@ -554,7 +1016,7 @@ string_to_texture (texture_font_data *data, const char *string,
   xftdraw = XftDrawCreate (data->dpy, p, xgwa.visual, xgwa.colormap);
   iterate_texture_string (data, string,
                           -overall.lbearing, overall.ascent,
-                          xftdraw, &xftcolor, 0);
+                          xftdraw, &xftcolor, False, 0);
   XftDrawDestroy (xftdraw);
   XftColorFree (data->dpy, xgwa.visual, xgwa.colormap, &xftcolor);
 
@@ -621,9 +1083,10 @@ void
 print_texture_string (texture_font_data *data, const char *string)
 {
   XCharStruct overall;
-  int tex_width, tex_height;
-  texfont_cache *cache;
+  int tex_width = 0, tex_height = 0;
+  texfont_cache *cache = 0;
   GLint old_texture;
+  Bool atlas_p;
 
   if (!*string) return;
 
@@ -632,22 +1095,35 @@ print_texture_string (texture_font_data *data, const char *string)
   /* Save the prevailing texture ID, and bind ours.  Restored at the end. */
   glGetIntegerv (GL_TEXTURE_BINDING_2D, &old_texture);
 
-  cache = get_cache (data, string);
-
-  glBindTexture (GL_TEXTURE_2D, cache->texid);
-  check_gl_error ("texture font binding");
-
-  /* Measure the string and make a pixmap that will fit it,
-     unless it's cached.
+  /* Normally, draw the string a glyph at a time out of the atlas.  Only if
+     the atlas is full, render the whole string into a texture of its own,
+     or use the one in the cache.
    */
-  if (cache->string)
+  atlas_p = load_glyphs (data, string);
+  if (atlas_p)
     {
-      overall    = data->cache->extents;
-      tex_width  = data->cache->tex_width;
-      tex_height = data->cache->tex_height;
+      data->quads_count = 0;
+      iterate_texture_string (data, string, 0, 0, 0, 0, True, 0);
     }
   else
-    string_to_texture (data, string, &overall, &tex_width, &tex_height);
+    {
+      cache = get_cache (data, string);
+
+      glBindTexture (GL_TEXTURE_2D, cache->texid);
+      check_gl_error ("texture font binding");
+
+      /* Measure the string and make a pixmap that will fit it,
+         unless it's cached.
+       */
+      if (cache->string)
+        {
+          overall    = data->cache->extents;
+          tex_width  = data->cache->tex_width;
+          tex_height = data->cache->tex_height;
+        }
+      else
+        string_to_texture (data, string, &overall, &tex_width, &tex_height);
+    }
 
   {
     int ofront, oblend;
@@ -681,38 +1157,48 @@ print_texture_string (texture_font_data *data, const char *string)
 
     enable_texture_string_parameters();
 
-    /* Draw a quad with that texture on it, possibly using a cached texture.
-       Position the XCharStruct origin at 0,0 in the scene.
-     */
-    qx0 =  overall.lbearing;
-    qy0 = -overall.descent;
-    qx1 =  overall.rbearing;
-    qy1 =  overall.ascent;
-
-    tx0 = 0;
-    ty1 = 0;
-    tx1 = (overall.rbearing - overall.lbearing) / (GLfloat) tex_width;
-    ty0 = (overall.ascent + overall.descent)    / (GLfloat) tex_height;
-
-    glEnable (GL_CULL_FACE);
-    glFrontFace (GL_CCW);
-    glBegin (GL_QUADS);
-    glTexCoord2f (tx0, ty0); glVertex3f (qx0, qy0, 0);
-    glTexCoord2f (tx1, ty0); glVertex3f (qx1, qy0, 0);
-    glTexCoord2f (tx1, ty1); glVertex3f (qx1, qy1, 0);
-    glTexCoord2f (tx0, ty1); glVertex3f (qx0, qy1, 0);
-    glEnd();
-
-    if (draw_back_face_p)
+    if (atlas_p)
+      {
+# ifndef ATLAS_MIPMAP
+        glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+# endif
+        draw_glyph_quads (data, draw_back_face_p);
+      }
+    else
       {
-        glFrontFace (GL_CW);
+        /* Draw a quad with that texture on it, possibly using a cached
+           texture.  Position the XCharStruct origin at 0,0 in the scene.
+         */
+        qx0 =  overall.lbearing;
+        qy0 = -overall.descent;
+        qx1 =  overall.rbearing;
+        qy1 =  overall.ascent;
+
+        tx0 = 0;
+        ty1 = 0;
+        tx1 = (overall.rbearing - overall.lbearing) / (GLfloat) tex_width;
+        ty0 = (overall.ascent + overall.descent)    / (GLfloat) tex_height;
+
+        glEnable (GL_CULL_FACE);
+        glFrontFace (GL_CCW);
         glBegin (GL_QUADS);
         glTexCoord2f (tx0, ty0); glVertex3f (qx0, qy0, 0);
         glTexCoord2f (tx1, ty0); glVertex3f (qx1, qy0, 0);
         glTexCoord2f (tx1, ty1); glVertex3f (qx1, qy1, 0);
         glTexCoord2f (tx0, ty1); glVertex3f (qx0, qy1, 0);
         glEnd();
-        glDisable (GL_CULL_FACE);
+
+        if (draw_back_face_p)
+          {
+            glFrontFace (GL_CW);
+            glBegin (GL_QUADS);
+            glTexCoord2f (tx0, ty0); glVertex3f (qx0, qy0, 0);
+            glTexCoord2f (tx1, ty0); glVertex3f (qx1, qy0, 0);
+            glTexCoord2f (tx1, ty1); glVertex3f (qx1, qy1, 0);
+            glTexCoord2f (tx0, ty1); glVertex3f (qx0, qy1, 0);
+            glEnd();
+            glDisable (GL_CULL_FACE);
+          }
       }
 
     glPopMatrix();
@@ -737,7 +1223,7 @@ print_texture_string (texture_font_data *data, const char *string)
 
     /* Store this string into the cache, unless that's where it came from.
      */
-    if (!cache->string)
+    if (cache && !cache->string)
       {
         cache->string     = strdup (string);
         cache->extents    = overall;
@@ -946,6 +1432,11 @@ free_texture_font (texture_font_data *data)
       free (data->cache);
       data->cache = next;
     }
+  if (data->atlas_size)
+    glDeleteTextures (1, &data->atlas_texid);
+  free (data->glyphs);
+  free (data->quad_verts);
+  free (data->quad_texcoords);
   if (data->xftfont)
     XftFontClose (data->dpy, data->xftfont);
   free (data);
@@ -30,12 +30,13 @@
 #endif /* HAVE_JWZGLES */
 
 #include "tube.h"
+#include "meshcache.h"
 
-typedef struct { GLfloat x, y, z; } XYZ;
+typedef mesh_xyz XYZ;
 
 
-static int
-unit_tube (int faces, int smooth, int caps_p, int wire_p)
+static cached_mesh *
+make_tube (int faces, int smooth, int caps_p, int wire_p)
 {
   int i;
   int polys = 0;
@@ -45,12 +46,13 @@ unit_tube (int faces, int smooth, int caps_p, int wire_p)
   GLfloat x, y, x0=0, y0=0;
   int z = 0;
 
-  int arraysize, out;
-  struct { XYZ p; XYZ n; GLfloat s, t; } *array;
+  int arraysize, out, base;
+  cached_mesh *m;
+  mesh_vertex *array;
 
-  arraysize = (faces+1) * 6;
-  array = (void *) calloc (arraysize, sizeof(*array));
-  if (! array) abort();
+  arraysize = (faces+1) * 6 + (faces+2) * 2;
+  m = new_cached_mesh (MESH_TUBE, faces, smooth, caps_p, wire_p, arraysize);
+  array = m->array;
   out = 0;
 
 
@@ -130,18 +132,9 @@ unit_tube (int faces, int smooth, int caps_p, int wire_p)
       if (out >= arraysize) abort();
     }
 
-  glEnableClientState (GL_VERTEX_ARRAY);
-  glEnableClientState (GL_NORMAL_ARRAY);
-  glEnableClientState (GL_TEXTURE_COORD_ARRAY);
-
-  glVertexPointer   (3, GL_FLOAT, sizeof(*array), &array[0].p);
-  glNormalPointer   (   GL_FLOAT, sizeof(*array), &array[0].n);
-  glTexCoordPointer (2, GL_FLOAT, sizeof(*array), &array[0].s);
-
-  glFrontFace(GL_CCW);
-  glDrawArrays ((wire_p ? GL_LINES :
-                 (smooth ? GL_TRIANGLE_STRIP : GL_TRIANGLES)),
-                0, out);
+  cached_mesh_add_draw (m, (wire_p ? GL_LINES :
+                            (smooth ? GL_TRIANGLE_STRIP : GL_TRIANGLES)),
+                        0, out);
 
 
   /* End caps
@@ -149,7 +142,8 @@ unit_tube (int faces, int smooth, int caps_p, int wire_p)
   if (caps_p)
     for (z = 0; z <= 1; z++)
       {
-        out = 0;
+        /* In wireframe, the cap points get the first side point's normal. */
+        base = out;
         if (! wire_p)
           {
             array[out].p.x = 0;
@@ -169,7 +163,7 @@ unit_tube (int faces, int smooth, int caps_p, int wire_p)
             GLfloat x = cos (th);
             GLfloat y = sin (th);
 
-            array[out] = array[0];  /* same normal and texture */
+            array[out] = array[wire_p ? 0 : base]; /* same normal, texture */
             array[out].p.x = x;
             array[out].p.y = z;
             array[out].p.z = y;
@@ -181,22 +175,17 @@ unit_tube (int faces, int smooth, int caps_p, int wire_p)
             if (out >= arraysize) abort();
           }
 
-        glVertexPointer   (3, GL_FLOAT, sizeof(*array), &array[0].p);
-        glNormalPointer   (   GL_FLOAT, sizeof(*array), &array[0].n);
-        glTexCoordPointer (2, GL_FLOAT, sizeof(*array), &array[0].s);
-
-        glFrontFace(GL_CCW);
-        glDrawArrays ((wire_p ? GL_LINE_LOOP : GL_TRIANGLE_FAN), 0, out);
+        cached_mesh_add_draw (m, (wire_p ? GL_LINE_LOOP : GL_TRIANGLE_FAN),
+                              base, out - base);
       }
 
-  free(array);
-
-  return polys;
+  m->polys = polys;
+  return m;
 }
 
 
-static int
-unit_cone (int faces, int smooth, int cap_p, int wire_p)
+static cached_mesh *
+make_cone (int faces, int smooth, int cap_p, int wire_p)
 {
   int i;
   int polys = 0;
@@ -205,12 +194,13 @@ unit_cone (int faces, int smooth, int cap_p, int wire_p)
   GLfloat th;
   GLfloat x, y, x0, y0;
 
-  int arraysize, out;
-  struct { XYZ p; XYZ n; GLfloat s, t; } *array;
+  int arraysize, out, base;
+  cached_mesh *m;
+  mesh_vertex *array;
 
-  arraysize = (faces+1) * 3;
-  array = (void *) calloc (arraysize, sizeof(*array));
-  if (! array) abort();
+  arraysize = (faces+1) * 3 + (faces+2);
+  m = new_cached_mesh (MESH_CONE, faces, smooth, cap_p, wire_p, arraysize);
+  array = m->array;
   out = 0;
 
 
@@ -274,23 +264,15 @@ unit_cone (int faces, int smooth, int cap_p, int wire_p)
       polys++;
     }
 
-  glEnableClientState (GL_VERTEX_ARRAY);
-  glEnableClientState (GL_NORMAL_ARRAY);
-  glEnableClientState (GL_TEXTURE_COORD_ARRAY);
-
-  glVertexPointer   (3, GL_FLOAT, sizeof(*array), &array[0].p);
-  glNormalPointer   (   GL_FLOAT, sizeof(*array), &array[0].n);
-  glTexCoordPointer (2, GL_FLOAT, sizeof(*array), &array[0].s);
-
-  glFrontFace(GL_CCW);
-  glDrawArrays ((wire_p ? GL_LINES : GL_TRIANGLES), 0, out);
+  cached_mesh_add_draw (m, (wire_p ? GL_LINES : GL_TRIANGLES), 0, out);
 
 
   /* End cap
    */
   if (cap_p)
     {
-      out = 0;
+      /* In wireframe, the cap points get the first side point's normal. */
+      base = out;
 
       if (! wire_p)
         {
@@ -309,7 +291,7 @@ unit_cone (int faces, int smooth, int cap_p, int wire_p)
           GLfloat x = cos (th);
           GLfloat y = sin (th);
 
-          array[out] = array[0];  /* same normal and texture */
+          array[out] = array[wire_p ? 0 : base]; /* same normal, texture */
           array[out].p.x = x;
           array[out].p.y = 0;
           array[out].p.z = y;
@@ -319,17 +301,42 @@ unit_cone (int faces, int smooth, int cap_p, int wire_p)
           if (out >= arraysize) abort();
         }
 
-      glVertexPointer   (3, GL_FLOAT, sizeof(*array), &array[0].p);
-      glNormalPointer   (   GL_FLOAT, sizeof(*array), &array[0].n);
-      glTexCoordPointer (2, GL_FLOAT, sizeof(*array), &array[0].s);
-
-      glFrontFace(GL_CCW);
-      glDrawArrays ((wire_p ? GL_LINE_LOOP : GL_TRIANGLE_FAN), 0, out);
+      cached_mesh_add_draw (m, (wire_p ? GL_LINE_LOOP : GL_TRIANGLE_FAN),
+                            base, out - base);
     }
 
-  free (array);
+  m->polys = polys;
+  return m;
+}
 
-  return polys;
+
+static int
+unit_tube (int faces, int smooth, int caps_p, int wire_p)
+{
+  cached_mesh *m;
+  smooth = !!smooth;
+  caps_p = !!caps_p;
+  wire_p = !!wire_p;
+  m = find_cached_mesh (MESH_TUBE, faces, smooth, caps_p, wire_p);
+  if (!m)
+    m = make_tube (faces, smooth, caps_p, wire_p);
+  glFrontFace (GL_CCW);
+  return draw_cached_mesh (m);
+}
+
+
+static int
+unit_cone (int faces, int smooth, int cap_p, int wire_p)
+{
+  cached_mesh *m;
+  smooth = !!smooth;
+  cap_p  = !!cap_p;
+  wire_p = !!wire_p;
+  m = find_cached_mesh (MESH_CONE, faces, smooth, cap_p, wire_p);
+  if (!m)
+    m = make_cone (faces, smooth, cap_p, wire_p);
+  glFrontFace (GL_CCW);
+  return draw_cached_mesh (m);
 }
 
 
@@ -32,6 +32,12 @@
 static XErrorHandler orig_ehandler = 0;
 static Bool got_error = 0;
 
+/* How many contexts init_GL has made.  A new context can have the same
+   address as one that has since been destroyed, so things that cache GL
+   objects per context (gllist.c) also look at this.
+ */
+unsigned long gl_context_generation = 0;
+
 static int
 BadValue_ehandler (Display *dpy, XErrorEvent *error)
 {
@@ -85,6 +91,8 @@ init_GL(ModeInfo * mi)
       exit(1);
     }
 
+  gl_context_generation++;
+
   glXMakeCurrent (dpy, window, glx_context);
 
   {
@@ -31,19 +31,30 @@ static const char sccsid[] = "@(#)julia.c	4.03 97/04/10 xlockmore";
 
 /*-
  * One thing to note is that batchcount is the *depth* of the search tree,
- * so the number of points computed is 2^batchcount - 1.  I use 8 or 9
+ * so the number of points computed is 2^(batchcount+1) - 1.  I use 8 or 9
  * on a dx266 and it looks okay.  The sinusoidal variation of the parameter
  * might not be as interesting as it could, but it still gives an idea of
  * the effect of the parameter.
+ *
+ * The tree is computed a level at a time rather than recursively: each
+ * level is a pair of arrays (real parts, imaginary parts), and the square
+ * roots are taken without any trig, so that the loop over a level runs four
+ * points at a time with SSE2 or NEON.  On a deep tree, the levels below
+ * a few are split among the threads, each taking its own share of the
+ * branches.
  */
 
+#include <errno.h>
+#include "thread_util.h"
+
 #ifdef STANDALONE
-# define DEFAULTS	"*count:		  1000   \n" \
+# define DEFAULTS	"*count:		  10     \n" \
 					"*cycles:		  20     \n" \
 					"*delay:		  10000  \n" \
 					"*ncolors:		  200    \n" \
 					"*fpsSolid:		  true   \n" \
 					"*ignoreRotation: True   \n" \
+					THREAD_DEFAULTS_XLOCK
 
 # define UNIFORM_COLORS
 # include "xlockmore.h"				/* in xscreensaver distribution */
@@ -51,14 +62,39 @@ static const char sccsid[] = "@(#)julia.c	4.03 97/04/10 xlockmore";
 # include "xlock.h"					/* in xlockmore distribution */
 #endif /* !STANDALONE */
 
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
+#if defined(__ARM_NEON) && defined(__aarch64__)
+# include <arm_neon.h>
+#endif
+
 
 #define DEF_MOUSE "False"
 
+#if HAVE_PTHREAD
+static XrmOptionDescRec opts[] =
+{
+	THREAD_OPTIONS
+};
+
+ENTRYPOINT ModeSpecOpt julia_opts =
+{sizeof opts / sizeof opts[0], opts, 0, NULL, NULL};
+#else  /* !HAVE_PTHREAD */
 ENTRYPOINT ModeSpecOpt julia_opts = { 0, };
+#endif /* !HAVE_PTHREAD */
 
 
 #define numpoints ((0x2<<jp->depth)-1)
 
+/* Deepest tree allowed: each of the cycles+1 buffers holds numpoints. */
+#define MAXDEPTH 16
+
+/* Trees at least this deep are split among the threads, and the split
+   happens at the first level with at least SPLITNODES branches per thread. */
+#define THREADDEPTH 13
+#define SPLITNODES 4
+
 typedef struct {
 	int         centerx;
 	int         centery;	/* center of the screen */
@@ -69,7 +105,6 @@ typedef struct {
 	int         circsize;
 	int         erase;
 	int         pix;
-	long        itree;
 	int         buffer;
 	int         nbuffers;
 	int         redrawing, redrawpos;
@@ -82,44 +117,250 @@ typedef struct {
     Bool        button_down_p;
     int         mouse_x, mouse_y;
 
+	float      *re[2], *im[2];	/* a level of the tree, and the next */
+	int         split;		/* level handed to the threads, or 0 */
+	int         cur;		/* which of re, im holds that level */
+	XPoint     *out;		/* where the threads' points go */
+	struct threadpool threadpool;
 } juliastruct;
 
+typedef struct {
+	juliastruct *jp;
+	unsigned    id;
+	float      *re[2], *im[2];
+} julia_thread;
+
 static juliastruct *julias = NULL;
 
 /* How many segments to draw per cycle when redrawing */
 #define REDRAWSTEP 3
 
+/* Stores the n points (re, im) into out, in window coordinates. */
 static void
-apply(juliastruct * jp, register double xr, register double xi, int d)
+julia_points(const juliastruct * jp, const float *re, const float *im,
+	     int n, XPoint * out)
 {
-	double      theta, r;
+	const float sx = 0.5 * jp->centerx, sy = 0.5 * jp->centery;
+	const float cx = jp->centerx, cy = jp->centery;
+	int         j = 0;
+
+#if defined(__SSE2__)
+	{
+		const __m128 sxv = _mm_set1_ps(sx), syv = _mm_set1_ps(sy);
+		const __m128 cxv = _mm_set1_ps(cx), cyv = _mm_set1_ps(cy);
+
+		for (; j + 4 <= n; j += 4) {
+			__m128i     x, y, xy;
+
+			x = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(re + j),
+								   sxv), cxv));
+			y = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(im + j),
+								   syv), cyv));
+			/* x0 x1 x2 x3 y0 y1 y2 y3, then x0 y0 x1 y1 ...: 4 XPoints. */
+			xy = _mm_packs_epi32(x, y);
+			xy = _mm_unpacklo_epi16(xy, _mm_unpackhi_epi64(xy, xy));
+			_mm_storeu_si128((__m128i *) (out + j), xy);
+		}
+	}
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+	{
+		for (; j + 4 <= n; j += 4) {
+			int16x4x2_t xy;
+
+			xy.val[0] = vqmovn_s32(vcvtq_s32_f32(
+				vmlaq_n_f32(vdupq_n_f32(cx), vld1q_f32(re + j), sx)));
+			xy.val[1] = vqmovn_s32(vcvtq_s32_f32(
+				vmlaq_n_f32(vdupq_n_f32(cy), vld1q_f32(im + j), sy)));
+			vst2_s16((int16_t *) (out + j), xy);
+		}
+	}
+#endif
+	for (; j < n; j++) {
+		out[j].x = (int) (re[j] * sx + cx);
+		out[j].y = (int) (im[j] * sy + cy);
+	}
+}
 
-	jp->pointBuffer[jp->buffer][jp->itree].x =
-		(int) (0.5 * xr * jp->centerx + jp->centerx);
-	jp->pointBuffer[jp->buffer][jp->itree].y =
-		(int) (0.5 * xi * jp->centery + jp->centery);
-	jp->itree++;
+/* Computes the level below the n points (re, im): the two square roots
+   of each point minus c, the first roots in [0, n) of (ore, oim), and
+   their negatives in [n, 2n).  Stores the 2n new points into out.
 
-	if (d > 0) {
-		xi -= jp->ci;
-		xr -= jp->cr;
+   For x + iy = (a + ib)^2, a = sqrt((|x + iy| + x) / 2) and
+   b = sqrt((|x + iy| - x) / 2), with the sign of y: this is the root with
+   a >= 0, the same one as sqrt(|x + iy|) * e^(i * atan2(y, x) / 2).
+ */
+static void
+julia_level(const juliastruct * jp, const float *re, const float *im,
+	    int n, float *ore, float *oim, XPoint * out)
+{
+	const float cr = jp->cr, ci = jp->ci;
+	int         j = 0;
+
+#if defined(__SSE2__)
+	{
+		const __m128 crv = _mm_set1_ps(cr), civ = _mm_set1_ps(ci);
+		const __m128 half = _mm_set1_ps(0.5), zero = _mm_setzero_ps();
+		const __m128 sign = _mm_set1_ps(-0.0);
+
+		for (; j + 4 <= n; j += 4) {
+			__m128      x, y, r, a, b;
+
+			x = _mm_sub_ps(_mm_loadu_ps(re + j), crv);
+			y = _mm_sub_ps(_mm_loadu_ps(im + j), civ);
+			r = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)));
+			a = _mm_sqrt_ps(_mm_max_ps(_mm_mul_ps(_mm_add_ps(r, x), half),
+						   zero));
+			b = _mm_sqrt_ps(_mm_max_ps(_mm_mul_ps(_mm_sub_ps(r, x), half),
+						   zero));
+			b = _mm_xor_ps(b, _mm_and_ps(_mm_cmplt_ps(y, zero), sign));
+			_mm_storeu_ps(ore + j, a);
+			_mm_storeu_ps(oim + j, b);
+			_mm_storeu_ps(ore + n + j, _mm_xor_ps(a, sign));
+			_mm_storeu_ps(oim + n + j, _mm_xor_ps(b, sign));
+		}
+	}
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+	{
+		const float32x4_t crv = vdupq_n_f32(cr), civ = vdupq_n_f32(ci);
+		const float32x4_t zero = vdupq_n_f32(0);
+
+		for (; j + 4 <= n; j += 4) {
+			float32x4_t x, y, r, a, b;
+
+			x = vsubq_f32(vld1q_f32(re + j), crv);
+			y = vsubq_f32(vld1q_f32(im + j), civ);
+			r = vsqrtq_f32(vaddq_f32(vmulq_f32(x, x), vmulq_f32(y, y)));
+			a = vsqrtq_f32(vmaxq_f32(vmulq_n_f32(vaddq_f32(r, x), 0.5),
+						 zero));
+			b = vsqrtq_f32(vmaxq_f32(vmulq_n_f32(vsubq_f32(r, x), 0.5),
+						 zero));
+			b = vbslq_f32(vcltq_f32(y, zero), vnegq_f32(b), b);
+			vst1q_f32(ore + j, a);
+			vst1q_f32(oim + j, b);
+			vst1q_f32(ore + n + j, vnegq_f32(a));
+			vst1q_f32(oim + n + j, vnegq_f32(b));
+		}
+	}
+#endif
+	for (; j < n; j++) {
+		float       x = re[j] - cr, y = im[j] - ci;
+		float       r = sqrt(x * x + y * y);
+		float       a = (r + x) * 0.5, b = (r - x) * 0.5;
+
+		a = (a > 0 ? sqrt(a) : 0);
+		b = (b > 0 ? sqrt(b) : 0);
+		if (y < 0)
+			b = -b;
+		ore[j] = a;
+		oim[j] = b;
+		ore[n + j] = -a;
+		oim[n + j] = -b;
+	}
 
-/* Avoid atan2: DOMAIN error message */
-		if (xi == 0.0 && xr == 0.0)
-			theta = 0.0;
-		else
-			theta = atan2(xi, xr) / 2.0;
+	julia_points(jp, ore, oim, 2 * n, out);
+}
+
+/* Grows the tree down `levels' levels from the n points in (re[0], im[0]),
+   storing every new point into out.  Each of re and im is a pair of
+   arrays with room for n << levels points.  Returns which of the pair
+   holds the last level.
+ */
+static int
+julia_subtrees(const juliastruct * jp, float *re[2], float *im[2], int n,
+	       int levels, XPoint * out)
+{
+	int         cur = 0;
+
+	while (levels-- > 0) {
+		julia_level(jp, re[cur], im[cur], n, re[!cur], im[!cur], out);
+		out += 2 * n;
+		n *= 2;
+		cur = !cur;
+	}
+	return cur;
+}
+
+/* Each thread takes an equal share of the branches at the split level. */
+static void
+julia_thread_range(const juliastruct * jp, unsigned id, int *n0, int *n1)
+{
+	int         nodes = 1 << jp->split;
+
+	*n0 = (int) (nodes * id / jp->threadpool.count);
+	*n1 = (int) (nodes * (id + 1) / jp->threadpool.count);
+}
+
+static int
+julia_thread_create(void *self_raw, struct threadpool *pool, unsigned id)
+{
+	julia_thread *self = (julia_thread *) self_raw;
+	juliastruct *jp;
+	int         n0, n1, i;
+
+	jp = GET_PARENT_OBJ(juliastruct, threadpool, pool);
+	self->jp = jp;
+	self->id = id;
+	julia_thread_range(jp, id, &n0, &n1);
+	for (i = 0; i < 2; i++) {
+		self->re[i] = (float *) malloc(sizeof(float) *
+					      ((n1 - n0 + 1) << (jp->depth - jp->split)));
+		self->im[i] = (float *) malloc(sizeof(float) *
+					      ((n1 - n0 + 1) << (jp->depth - jp->split)));
+		if (!self->re[i] || !self->im[i])
+			return ENOMEM;
+	}
+	return 0;
+}
+
+static void
+julia_thread_destroy(void *self_raw)
+{
+	julia_thread *self = (julia_thread *) self_raw;
+	int         i;
 
-		/*r = pow(xi * xi + xr * xr, 0.25); */
-		r = sqrt(sqrt(xi * xi + xr * xr));	/* 3 times faster */
+	for (i = 0; i < 2; i++) {
+		if (self->re[i])
+			(void) free((void *) self->re[i]);
+		if (self->im[i])
+			(void) free((void *) self->im[i]);
+	}
+}
 
-		xr = r * cos(theta);
-		xi = r * sin(theta);
+static void
+julia_thread_run(void *self_raw)
+{
+	julia_thread *self = (julia_thread *) self_raw;
+	const juliastruct *jp = self->jp;
+	int         levels = jp->depth - jp->split;
+	int         n0, n1;
+
+	julia_thread_range(jp, self->id, &n0, &n1);
+	if (n1 <= n0)
+		return;
+	(void) memcpy(self->re[0], jp->re[jp->cur] + n0, (n1 - n0) * sizeof(float));
+	(void) memcpy(self->im[0], jp->im[jp->cur] + n0, (n1 - n0) * sizeof(float));
+	(void) julia_subtrees(jp, self->re, self->im, n1 - n0, levels,
+			      jp->out + n0 * ((2 << levels) - 2));
+}
 
-		d--;
-		apply(jp, xr, xi, d);
-		apply(jp, -xr, -xi, d);
+/* Fills out with the whole tree below (xr, xi), numpoints in all. */
+static void
+julia_tree(juliastruct * jp, double xr, double xi, XPoint * out)
+{
+	jp->re[0][0] = xr;
+	jp->im[0][0] = xi;
+	julia_points(jp, jp->re[0], jp->im[0], 1, out);
+	out++;
+
+	if (!jp->split) {
+		(void) julia_subtrees(jp, jp->re, jp->im, 1, jp->depth, out);
+		return;
 	}
+
+	jp->cur = julia_subtrees(jp, jp->re, jp->im, 1, jp->split, out);
+	jp->out = out + (2 << jp->split) - 2;
+	threadpool_run(&jp->threadpool, julia_thread_run);
+	threadpool_wait(&jp->threadpool);
 }
 
 static void
@@ -172,8 +413,38 @@ init_julia(ModeInfo * mi)
 	jp->centery = MI_WIN_HEIGHT(mi) / 2;
 
 	jp->depth = MI_BATCHCOUNT(mi);
-	if (jp->depth > 10)
-		jp->depth = 10;
+	if (jp->depth > MAXDEPTH)
+		jp->depth = MAXDEPTH;
+	if (jp->depth < 0)
+		jp->depth = 0;
+
+	if (jp->depth >= THREADDEPTH && !jp->threadpool.count &&
+	    hardware_concurrency(display) > 1) {
+		static const struct threadpool_class cls = {
+			sizeof (julia_thread),
+			julia_thread_create,
+			julia_thread_destroy
+		};
+		unsigned    count = hardware_concurrency(display);
+
+		while ((1 << jp->split) < SPLITNODES * (int) count)
+			jp->split++;
+		if (jp->split > jp->depth - 2 ||
+		    threadpool_create(&jp->threadpool, &cls, display, count)) {
+			jp->threadpool.count = 0;	/* See the note in thread_util.h. */
+			jp->split = 0;
+		}
+	}
+	for (i = 0; i < 2; i++) {
+		if (!jp->re[i])
+			jp->re[i] = (float *) malloc(sizeof(float) *
+					(1 << (jp->split ? jp->split : jp->depth)));
+		if (!jp->im[i])
+			jp->im[i] = (float *) malloc(sizeof(float) *
+					(1 << (jp->split ? jp->split : jp->depth)));
+		if (!jp->re[i] || !jp->im[i])
+			return;
+	}
 
 
 #ifndef HAVE_JWXYZ
@@ -315,7 +586,7 @@ draw_julia (ModeInfo * mi)
 	Window      window = MI_WINDOW(mi);
 	GC          gc = MI_GC(mi);
 	juliastruct *jp = &julias[MI_SCREEN(mi)];
-	double      r, theta;
+	double      r, a;
 	register double xr = 0.0, xi = 0.0;
 	int         k = 64, rnd = 0, i, j;
 	XPoint     *xp = jp->pointBuffer[jp->buffer], old_circle, new_circle;
@@ -363,22 +634,17 @@ draw_julia (ModeInfo * mi)
 		if (!(k % 32))
 			rnd = LRAND();
 
-		/* complex sqrt: x^0.5 = radius^0.5*(cos(theta/2) + i*sin(theta/2)) */
+		/* complex sqrt, the same way as julia_level() */
 
 		xi -= jp->ci;
 		xr -= jp->cr;
 
-		/* Avoid atan2: DOMAIN error message */
-		if (xi == 0.0 && xr == 0.0)
-			theta = 0.0;
-		else
-			theta = atan2(xi, xr) / 2.0;
-
-		/*r = pow(xi * xi + xr * xr, 0.25); */
-		r = sqrt(sqrt(xi * xi + xr * xr));	/* 3 times faster */
-
-		xr = r * cos(theta);
-		xi = r * sin(theta);
+		r = sqrt(xr * xr + xi * xi);
+		a = (r - xr) / 2;
+		a = (a > 0 ? sqrt(a) : 0.0);
+		xr = (r + xr) / 2;
+		xr = (xr > 0 ? sqrt(xr) : 0.0);
+		xi = (xi < 0 ? -a : a);
 
 		if ((rnd >> (k % 32)) & 0x1) {
 			xi = -xi;
@@ -389,8 +655,7 @@ draw_julia (ModeInfo * mi)
 		xp++;
 	}
 
-	jp->itree = 0;
-	apply(jp, xr, xi, jp->depth);
+	julia_tree(jp, xr, xi, jp->pointBuffer[jp->buffer]);
 
 	XDrawPoints(display, window, gc,
 		    jp->pointBuffer[jp->buffer], numpoints, CoordModeOrigin);
@@ -425,12 +690,20 @@ release_julia (ModeInfo * mi)
 			juliastruct *jp = &julias[screen];
 			int         buffer;
 
+			if (jp->threadpool.count)
+				threadpool_destroy(&jp->threadpool);
 			if (jp->pointBuffer) {
 				for (buffer = 0; buffer < jp->nbuffers; buffer++)
 					if (jp->pointBuffer[buffer])
 						(void) free((void *) jp->pointBuffer[buffer]);
 				(void) free((void *) jp->pointBuffer);
 			}
+			for (buffer = 0; buffer < 2; buffer++) {
+				if (jp->re[buffer])
+					(void) free((void *) jp->re[buffer]);
+				if (jp->im[buffer])
+					(void) free((void *) jp->im[buffer]);
+			}
 			if (jp->stippledGC != None)
 				XFreeGC(display, jp->stippledGC);
 			if (jp->pixmap != None)
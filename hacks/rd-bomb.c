@@ -20,10 +20,14 @@
 #include <math.h>
 
 #include "screenhack.h"
+#include "parallel_image.h"
 
-#ifdef HAVE_XSHM_EXTENSION
-# include "xshm.h"
-#endif /* HAVE_XSHM_EXTENSION */
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
+#ifdef __ARM_NEON
+# include <arm_neon.h>
+#endif
 
 /* costs ~6% speed */
 #define dither_when_mapped 1
@@ -40,7 +44,8 @@ struct state {
 #endif
   Colormap cmap;
   int mapped;
-  int pdepth;
+  Bool dither;			/* color through mc rather than r1>>8 */
+  unsigned long pixels[256];	/* the pixel for each color index */
 
   int frame, epoch_time;
   unsigned short *r1, *r2, *r1b, *r2b;
@@ -49,16 +54,12 @@ struct state {
   int reaction;
   int diffusion;
 
-  char *pd;
   int array_width, array_height;
 
-#ifdef HAVE_XSHM_EXTENSION
   Bool use_shm;
-  XShmSegmentInfo shm_info;
-#endif
+  parallel_image *pimage;
 
   GC gc;
-  XImage *image;
   double array_x, array_y;
   double array_dx, array_dy;
   XWindowAttributes xgwa;
@@ -71,7 +72,7 @@ static void random_colors(struct state *st);
    pixel hack, 8-bit pixel grid, first/next frame interface
 
    pixack_init(int *size_h, int *size_v)
-   pixack_frame(char *pix_buf)
+   pixack_frame()
    */
 
 
@@ -128,24 +129,343 @@ pixack_init(struct state *st, int *size_h, int *size_v)
   *size_v = st->height;
 }
 
-#define test_pattern_hyper 0
+/* Steps cells [j0, j1) of one row: i1, i2 point at the row in the old
+   fields, and o1, o2 at the same row in the new ones. */
+static void
+rd_span(const struct state *st,
+        const unsigned short *i1, const unsigned short *i2,
+        unsigned short *o1, unsigned short *o2, int j0, int j1)
+{
+  int j;
+  int w2 = st->width + 2;
+  for (j = j0; j < j1; j++) {
+    int uvv, r1 = 0, r2 = 0;
+    switch (st->diffusion) {
+    case 0:
+      r1 = i1[j] + i1[j+1] + i1[j-1] + i1[j+w2] + i1[j-w2];
+      r1 = r1 / 5;
+      r2 = (i2[j]<<3) + i2[j+1] + i2[j-1] + i2[j+w2] + i2[j-w2];
+      r2 = r2 / 12;
+      break;
+    case 1:
+      r1 = i1[j+1] + i1[j-1] + i1[j+w2] + i1[j-w2];
+      r1 = r1 >> 2;
+      r2 = (i2[j]<<2) + i2[j+1] + i2[j-1] + i2[j+w2] + i2[j-w2];
+      r2 = r2 >> 3;
+      break;
+    case 2:
+      r1 = (i1[j]<<1) + (i1[j+1]<<1) + (i1[j-1]<<1) + i1[j+w2] + i1[j-w2];
+      r1 = r1 >> 3;
+      r2 = (i2[j]<<2) + i2[j+1] + i2[j-1] + i2[j+w2] + i2[j-w2];
+      r2 = r2 >> 3;
+      break;
+    }
+
+    /* John E. Pearson "Complex Patterns in a Simple System"
+       Science, July 1993 */
+
+    /* uvv = (((r1 * r2) >> bps) * r2) >> bps; */
+    /* avoid signed integer overflow */
+    uvv = ((((r1 >> 1)* r2) >> bps) * r2) >> (bps - 1);
+    switch (st->reaction) {  /* costs 4% */
+    case 0:
+      r1 += 4 * (((28 * (mx-r1)) >> 10) - uvv);
+      r2 += 4 * (uvv - ((80 * r2) >> 10));
+      break;
+    case 1:
+      r1 += 3 * (((27 * (mx-r1)) >> 10) - uvv);
+      r2 += 3 * (uvv - ((80 * r2) >> 10));
+      break;
+    case 2:
+      r1 += 2 * (((28 * (mx-r1)) >> 10) - uvv);
+      r2 += 3 * (uvv - ((80 * r2) >> 10));
+      break;
+    }
+    if (r1 > mx) r1 = mx;
+    if (r2 > mx) r2 = mx;
+    if (r1 < 0) r1 = 0;
+    if (r2 < 0) r2 = 0;
+    o1[j] = r1;
+    o2[j] = r2;
+  }
+}
+
+
+#if defined(__SSE2__) || defined(__ARM_NEON)
 
+/* The same as rd_span, 8 cells at a time, and with the same results:
+
+   - The sums of the stencil need 32 bits, and the divisions by 5 and 12
+     are done as (sum + 0.5) * (1/5) in floats, which truncates to the
+     exact quotient for every sum that can occur.
+   - Everything in the reaction is a 16 x 16 bit product shifted right
+     by 10 to 16, so each is the high half of the product, shifted left,
+     plus the top bits of the low half.
+   - The last multiply-add is done in 32 bits and clamped on the way
+     back to 16.
+
+   Returns the number of cells done, a multiple of 8.
+ */
+static int
+rd_span_simd(const struct state *st,
+             const unsigned short *i1, const unsigned short *i2,
+             unsigned short *o1, unsigned short *o2, int n)
+{
+  int w2 = st->width + 2;
+  int ka = (st->reaction == 1 ? 27 : 28);
+  int k1 = (st->reaction == 0 ? 4 : st->reaction == 1 ? 3 : 2);
+  int k2 = (st->reaction == 0 ? 4 : 3);
+  int j;
+
+# ifdef __SSE2__
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i ones = _mm_set1_epi16(-1);
+  const __m128i bias32 = _mm_set1_epi32(0x8000);
+  const __m128i bias16 = _mm_set1_epi16((short) 0x8000);
+  const __m128i kav = _mm_set1_epi16(ka);
+  const __m128i k80 = _mm_set1_epi16(80);
+  const __m128 half = _mm_set1_ps(0.5f);
+  const __m128 fifth = _mm_set1_ps(1.0f / 5);
+  const __m128 twelfth = _mm_set1_ps(1.0f / 12);
+
+#  define LO32(V) _mm_unpacklo_epi16((V), zero)
+#  define HI32(V) _mm_unpackhi_epi16((V), zero)
+#  define DIV(V,R) \
+    _mm_cvttps_epi32(_mm_mul_ps(_mm_add_ps(_mm_cvtepi32_ps(V), half), (R)))
+   /* Signed 32 to unsigned 16, clamped. */
+#  define PACK(L,H) \
+    _mm_xor_si128(_mm_packs_epi32(_mm_sub_epi32((L), bias32), \
+                                  _mm_sub_epi32((H), bias32)), bias16)
+   /* (A * B) >> S, for S <= 16 and a result that fits in 16 bits. */
+#  define MULSHR(A,B,S) \
+    _mm_or_si128(_mm_slli_epi16(_mm_mulhi_epu16((A), (B)), 16 - (S)), \
+                 _mm_srli_epi16(_mm_mullo_epi16((A), (B)), (S)))
+#  define TIMES(V,K) ((K) == 4 ? _mm_slli_epi32((V), 2) :                \
+                      (K) == 2 ? _mm_slli_epi32((V), 1) :                \
+                      _mm_add_epi32(_mm_slli_epi32((V), 1), (V)))
+
+  for (j = 0; j + 8 <= n; j += 8) {
+    const unsigned short *p1 = i1 + j, *p2 = i2 + j;
+    __m128i c1 = _mm_loadu_si128((const __m128i *) p1);
+    __m128i e1 = _mm_loadu_si128((const __m128i *) (p1 + 1));
+    __m128i x1 = _mm_loadu_si128((const __m128i *) (p1 - 1));
+    __m128i n1 = _mm_loadu_si128((const __m128i *) (p1 - w2));
+    __m128i s1 = _mm_loadu_si128((const __m128i *) (p1 + w2));
+    __m128i c2 = _mm_loadu_si128((const __m128i *) p2);
+    __m128i e2 = _mm_loadu_si128((const __m128i *) (p2 + 1));
+    __m128i x2 = _mm_loadu_si128((const __m128i *) (p2 - 1));
+    __m128i n2 = _mm_loadu_si128((const __m128i *) (p2 - w2));
+    __m128i s2 = _mm_loadu_si128((const __m128i *) (p2 + w2));
+    __m128i ns1l = _mm_add_epi32(LO32(n1), LO32(s1));
+    __m128i ns1h = _mm_add_epi32(HI32(n1), HI32(s1));
+    __m128i ew1l = _mm_add_epi32(LO32(e1), LO32(x1));
+    __m128i ew1h = _mm_add_epi32(HI32(e1), HI32(x1));
+    __m128i a2l = _mm_add_epi32(_mm_add_epi32(LO32(e2), LO32(x2)),
+                                _mm_add_epi32(LO32(n2), LO32(s2)));
+    __m128i a2h = _mm_add_epi32(_mm_add_epi32(HI32(e2), HI32(x2)),
+                                _mm_add_epi32(HI32(n2), HI32(s2)));
+    __m128i r1l, r1h, r2l, r2h, r1, r2, t, uvv, f1, f2;
+
+    switch (st->diffusion) {
+    case 0:
+      r1l = DIV(_mm_add_epi32(_mm_add_epi32(LO32(c1), ew1l), ns1l), fifth);
+      r1h = DIV(_mm_add_epi32(_mm_add_epi32(HI32(c1), ew1h), ns1h), fifth);
+      r2l = DIV(_mm_add_epi32(_mm_slli_epi32(LO32(c2), 3), a2l), twelfth);
+      r2h = DIV(_mm_add_epi32(_mm_slli_epi32(HI32(c2), 3), a2h), twelfth);
+      break;
+    case 1:
+      r1l = _mm_srli_epi32(_mm_add_epi32(ew1l, ns1l), 2);
+      r1h = _mm_srli_epi32(_mm_add_epi32(ew1h, ns1h), 2);
+      r2l = _mm_srli_epi32(_mm_add_epi32(_mm_slli_epi32(LO32(c2), 2), a2l), 3);
+      r2h = _mm_srli_epi32(_mm_add_epi32(_mm_slli_epi32(HI32(c2), 2), a2h), 3);
+      break;
+    default:
+      r1l = _mm_srli_epi32(_mm_add_epi32(_mm_slli_epi32(
+                             _mm_add_epi32(LO32(c1), ew1l), 1), ns1l), 3);
+      r1h = _mm_srli_epi32(_mm_add_epi32(_mm_slli_epi32(
+                             _mm_add_epi32(HI32(c1), ew1h), 1), ns1h), 3);
+      r2l = _mm_srli_epi32(_mm_add_epi32(_mm_slli_epi32(LO32(c2), 2), a2l), 3);
+      r2h = _mm_srli_epi32(_mm_add_epi32(_mm_slli_epi32(HI32(c2), 2), a2h), 3);
+      break;
+    }
+    r1 = PACK(r1l, r1h);
+    r2 = PACK(r2l, r2h);
+
+    t = _mm_mulhi_epu16(_mm_srli_epi16(r1, 1), r2);
+    uvv = MULSHR(t, r2, bps - 1);
+    f1 = MULSHR(_mm_xor_si128(r1, ones), kav, 10);	/* mx - r1 */
+    f2 = MULSHR(r2, k80, 10);
+
+    r1l = _mm_add_epi32(r1l, TIMES(_mm_sub_epi32(LO32(f1), LO32(uvv)), k1));
+    r1h = _mm_add_epi32(r1h, TIMES(_mm_sub_epi32(HI32(f1), HI32(uvv)), k1));
+    r2l = _mm_add_epi32(r2l, TIMES(_mm_sub_epi32(LO32(uvv), LO32(f2)), k2));
+    r2h = _mm_add_epi32(r2h, TIMES(_mm_sub_epi32(HI32(uvv), HI32(f2)), k2));
+    _mm_storeu_si128((__m128i *) (o1 + j), PACK(r1l, r1h));
+    _mm_storeu_si128((__m128i *) (o2 + j), PACK(r2l, r2h));
+  }
 
-/* returns the pixels.  called many times. */
+#  undef LO32
+#  undef HI32
+#  undef DIV
+#  undef PACK
+#  undef MULSHR
+#  undef TIMES
+
+# else /* __ARM_NEON */
+  const float32x4_t half = vdupq_n_f32(0.5f);
+  const float32x4_t fifth = vdupq_n_f32(1.0f / 5);
+  const float32x4_t twelfth = vdupq_n_f32(1.0f / 12);
+
+#  define DIV(V,R) \
+    vcvtq_u32_f32(vmulq_f32(vaddq_f32(vcvtq_f32_u32(V), half), (R)))
+#  define NARROW(L,H) vcombine_u16(vmovn_u32(L), vmovn_u32(H))
+   /* (A * B) >> S, for a result that fits in 16 bits. */
+#  define MULSHR(A,B,S) \
+    vcombine_u16(vshrn_n_u32(vmull_u16(vget_low_u16(A), vget_low_u16(B)), \
+                             (S)),                                        \
+                 vshrn_n_u32(vmull_u16(vget_high_u16(A), vget_high_u16(B)),\
+                             (S)))
+#  define DIFF(A,B,HALF) \
+    vreinterpretq_s32_u32(vsubl_u16(vget_##HALF##_u16(A), \
+                                    vget_##HALF##_u16(B)))
+#  define STEP(R,D,K) \
+    vqmovun_s32(vmlaq_n_s32(vreinterpretq_s32_u32(R), (D), (K)))
+
+  for (j = 0; j + 8 <= n; j += 8) {
+    const unsigned short *p1 = i1 + j, *p2 = i2 + j;
+    uint16x8_t c1 = vld1q_u16(p1), e1 = vld1q_u16(p1 + 1);
+    uint16x8_t x1 = vld1q_u16(p1 - 1);
+    uint16x8_t n1 = vld1q_u16(p1 - w2), s1 = vld1q_u16(p1 + w2);
+    uint16x8_t c2 = vld1q_u16(p2), e2 = vld1q_u16(p2 + 1);
+    uint16x8_t x2 = vld1q_u16(p2 - 1);
+    uint16x8_t n2 = vld1q_u16(p2 - w2), s2 = vld1q_u16(p2 + w2);
+    uint32x4_t ns1l = vaddl_u16(vget_low_u16(n1), vget_low_u16(s1));
+    uint32x4_t ns1h = vaddl_u16(vget_high_u16(n1), vget_high_u16(s1));
+    uint32x4_t ew1l = vaddl_u16(vget_low_u16(e1), vget_low_u16(x1));
+    uint32x4_t ew1h = vaddl_u16(vget_high_u16(e1), vget_high_u16(x1));
+    uint32x4_t a2l = vaddq_u32(vaddl_u16(vget_low_u16(e2), vget_low_u16(x2)),
+                               vaddl_u16(vget_low_u16(n2), vget_low_u16(s2)));
+    uint32x4_t a2h = vaddq_u32(vaddl_u16(vget_high_u16(e2),
+                                         vget_high_u16(x2)),
+                               vaddl_u16(vget_high_u16(n2),
+                                         vget_high_u16(s2)));
+    uint32x4_t c1l = vmovl_u16(vget_low_u16(c1));
+    uint32x4_t c1h = vmovl_u16(vget_high_u16(c1));
+    uint32x4_t c2l = vmovl_u16(vget_low_u16(c2));
+    uint32x4_t c2h = vmovl_u16(vget_high_u16(c2));
+    uint32x4_t r1l, r1h, r2l, r2h;
+    uint16x8_t r1, r2, t, uvv, f1, f2;
+
+    switch (st->diffusion) {
+    case 0:
+      r1l = DIV(vaddq_u32(vaddq_u32(c1l, ew1l), ns1l), fifth);
+      r1h = DIV(vaddq_u32(vaddq_u32(c1h, ew1h), ns1h), fifth);
+      r2l = DIV(vaddq_u32(vshlq_n_u32(c2l, 3), a2l), twelfth);
+      r2h = DIV(vaddq_u32(vshlq_n_u32(c2h, 3), a2h), twelfth);
+      break;
+    case 1:
+      r1l = vshrq_n_u32(vaddq_u32(ew1l, ns1l), 2);
+      r1h = vshrq_n_u32(vaddq_u32(ew1h, ns1h), 2);
+      r2l = vshrq_n_u32(vaddq_u32(vshlq_n_u32(c2l, 2), a2l), 3);
+      r2h = vshrq_n_u32(vaddq_u32(vshlq_n_u32(c2h, 2), a2h), 3);
+      break;
+    default:
+      r1l = vshrq_n_u32(vaddq_u32(vshlq_n_u32(vaddq_u32(c1l, ew1l), 1),
+                                  ns1l), 3);
+      r1h = vshrq_n_u32(vaddq_u32(vshlq_n_u32(vaddq_u32(c1h, ew1h), 1),
+                                  ns1h), 3);
+      r2l = vshrq_n_u32(vaddq_u32(vshlq_n_u32(c2l, 2), a2l), 3);
+      r2h = vshrq_n_u32(vaddq_u32(vshlq_n_u32(c2h, 2), a2h), 3);
+      break;
+    }
+    r1 = NARROW(r1l, r1h);
+    r2 = NARROW(r2l, r2h);
+
+    t = MULSHR(vshrq_n_u16(r1, 1), r2, bps);
+    uvv = MULSHR(t, r2, bps - 1);
+    f1 = MULSHR(vmvnq_u16(r1), vdupq_n_u16(ka), 10);	/* mx - r1 */
+    f2 = MULSHR(r2, vdupq_n_u16(80), 10);
+
+    vst1q_u16(o1 + j,
+              vcombine_u16(STEP(r1l, DIFF(f1, uvv, low), k1),
+                           STEP(r1h, DIFF(f1, uvv, high), k1)));
+    vst1q_u16(o2 + j,
+              vcombine_u16(STEP(r2l, DIFF(uvv, f2, low), k2),
+                           STEP(r2h, DIFF(uvv, f2, high), k2)));
+  }
+
+#  undef DIV
+#  undef NARROW
+#  undef MULSHR
+#  undef DIFF
+#  undef STEP
+# endif /* __ARM_NEON */
+
+  return j;
+}
+#endif /* __SSE2__ || __ARM_NEON */
+
+
+/* Steps rows [y0, y1) of the grid, and colors them into the image.
+   The halo (the wrapped-around edges) must already be filled in, and
+   only these rows of r1b and r2b are written, so the bands can be run
+   in parallel.
+ */
 static void
-pixack_frame(struct state *st, char *pix_buf) 
+rd_band(void *closure, int y0, int y1)
+{
+  struct state *st = (struct state *) closure;
+  XImage *image = st->pimage->image;
+  int w2 = st->width + 2;
+  int lsb = 1;
+  int direct;
+  int i, j;
+
+  lsb = (*(char *) &lsb == 1);
+  direct = (image->bits_per_pixel == 8 ? 8 :
+            image->byte_order != (lsb ? LSBFirst : MSBFirst) ? 0 :
+            image->bits_per_pixel == 16 ? 16 :
+            image->bits_per_pixel == 32 ? 32 : 0);
+
+  for (i = y0; i < y1; i++) {
+    int ii = i + 1;
+    char *line = image->data + image->bytes_per_line * i;
+    unsigned short *i1 = st->r1 + 1 + w2 * ii;
+    unsigned short *i2 = st->r2 + 1 + w2 * ii;
+    unsigned short *o1 = st->r1b + 1 + w2 * ii;
+    unsigned short *o2 = st->r2b + 1 + w2 * ii;
+
+    j = 0;
+#if defined(__SSE2__) || defined(__ARM_NEON)
+    j = rd_span_simd(st, i1, i2, o1, o2, st->width);
+#endif
+    rd_span(st, i1, i2, o1, o2, j, st->width);
+
+    /* Color the row while it is still in the cache. */
+    for (j = 0; j < st->width; j++) {
+      unsigned long p = st->pixels[st->dither ? st->mc[o1[j]] : o1[j] >> 8];
+      switch (direct) {
+      case 8:  ((unsigned char *)  line)[j] = p; break;
+      case 16: ((unsigned short *) line)[j] = p; break;
+      case 32: ((unsigned int *)   line)[j] = p; break;
+      default: XPutPixel(image, j, i, p); break;
+      }
+    }
+  }
+}
+
+
+/* steps the grid and renders it into the image.  called many times. */
+static void
+pixack_frame(struct state *st)
 {
   int i, j;
   int w2 = st->width + 2;
   unsigned short *t;
-#if test_pattern_hyper
-  if (st->frame&0x100)
-    sleep(1);
-#endif
 
   if (!(st->frame%st->epoch_time)) {
     int s;
-	  
+
     for (i = 0; i < st->npix; i++) {
       /* equilibrium */
       st->r1[i] = 65500;
@@ -191,99 +511,11 @@ pixack_frame(struct state *st, char *pix_buf)
     st->r1[w2 * i + st->width + 1] = st->r1[w2 * i + 1];
     st->r2[w2 * i + st->width + 1] = st->r2[w2 * i + 1];
   }
-  for (i = 0; i < st->height; i++) {
-    int ii = i + 1;
-    char *q = pix_buf + st->width * i;
-    short *qq = ((short *) pix_buf) + st->width * i;
-/*  long  *qqq = ((long *) pix_buf) + st->width * i;  -- crashes on Alpha */
-    int   *qqq = ((int  *) pix_buf) + st->width * i;
-    unsigned short *i1 = st->r1 + 1 + w2 * ii;
-    unsigned short *i2 = st->r2 + 1 + w2 * ii;
-    unsigned short *o1 = st->r1b + 1 + w2 * ii;
-    unsigned short *o2 = st->r2b + 1 + w2 * ii;
-    for (j = 0; j < st->width; j++) {
-#if test_pattern_hyper
-      int r1 = (i * j + (st->frame&127)*frame)&65535;
-#else
-      int uvv, r1 = 0, r2 = 0;
-      switch (st->diffusion) {
-      case 0:
-	r1 = i1[j] + i1[j+1] + i1[j-1] + i1[j+w2] + i1[j-w2];
-	r1 = r1 / 5;
-	r2 = (i2[j]<<3) + i2[j+1] + i2[j-1] + i2[j+w2] + i2[j-w2];
-	r2 = r2 / 12;
-	break;
-      case 1:
-	r1 = i1[j+1] + i1[j-1] + i1[j+w2] + i1[j-w2];
-	r1 = r1 >> 2;
-	r2 = (i2[j]<<2) + i2[j+1] + i2[j-1] + i2[j+w2] + i2[j-w2];
-	r2 = r2 >> 3;
-	break;
-      case 2:
-	r1 = (i1[j]<<1) + (i1[j+1]<<1) + (i1[j-1]<<1) + i1[j+w2] + i1[j-w2];
-	r1 = r1 >> 3;
-	r2 = (i2[j]<<2) + i2[j+1] + i2[j-1] + i2[j+w2] + i2[j-w2];
-	r2 = r2 >> 3;
-	break;
-      }
-
-      /* John E. Pearson "Complex Patterns in a Simple System"
-	 Science, July 1993 */
-
-      /* uvv = (((r1 * r2) >> bps) * r2) >> bps; */
-      /* avoid signed integer overflow */
-      uvv = ((((r1 >> 1)* r2) >> bps) * r2) >> (bps - 1);
-      switch (st->reaction) {  /* costs 4% */
-      case 0:
-	r1 += 4 * (((28 * (mx-r1)) >> 10) - uvv);
-	r2 += 4 * (uvv - ((80 * r2) >> 10));
-	break;
-      case 1:
-	r1 += 3 * (((27 * (mx-r1)) >> 10) - uvv);
-	r2 += 3 * (uvv - ((80 * r2) >> 10));
-	break;
-      case 2:
-	r1 += 2 * (((28 * (mx-r1)) >> 10) - uvv);
-	r2 += 3 * (uvv - ((80 * r2) >> 10));
-	break;
-      }
-      if (r1 > mx) r1 = mx;
-      if (r2 > mx) r2 = mx;
-      if (r1 < 0) r1 = 0;
-      if (r2 < 0) r2 = 0;
-      o1[j] = r1;
-      o2[j] = r2;
-#endif
 
-      /* this is terrible.  here i want to assume ncolors = 256.
-	 should lose double indirection */
+  parallel_image_run(st->pimage, st->height, rd_band, st);
 
-      if (st->mapped)
-#if dither_when_mapped
-	q[j] = st->colors[st->mc[r1]  % st->ncolors].pixel;
-#else
-      q[j] = st->colors[(r1>>8) % st->ncolors].pixel;
-#endif
-      else if (st->pdepth == 8)
-	q[j] = st->colors[(r1>>8) % st->ncolors].pixel;
-      else if (st->pdepth == 16)
-#if dither_when_mapped
-	qq[j] = st->colors[st->mc[r1] % st->ncolors].pixel;
-#else
-	qq[j] = st->colors[(r1>>8) % st->ncolors].pixel;
-#endif
-      else if (st->pdepth == 32)
-#if dither_when_mapped
-	qqq[j] = st->colors[st->mc[r1] % st->ncolors].pixel;
-#else
-	qqq[j] = st->colors[(r1>>8) % st->ncolors].pixel;
-#endif
-      else
-	abort();
-    }
-  }
   t = st->r1; st->r1 = st->r1b; st->r1b = t;
-  t = st->r2; st->r2 = st->r2b; st->r2b = t;  
+  t = st->r2; st->r2 = st->r2b; st->r2b = t;
 }
 
 
@@ -308,6 +540,7 @@ static const char *rd_defaults [] = {
 #else
   "*useSHM:	False",
 #endif
+  THREAD_DEFAULTS
 #ifdef HAVE_MOBILE
   "*ignoreRotation: True",
 #endif
@@ -327,6 +560,7 @@ static XrmOptionDescRec rd_options [] = {
   { "-ncolors",		".colors",	XrmoptionSepArg, 0 },
   { "-shm",		".useSHM",	XrmoptionNoArg, "True" },
   { "-no-shm",		".useSHM",	XrmoptionNoArg, "False" },
+  THREAD_OPTIONS
   { 0, 0, 0, 0 }
 };
 
@@ -363,6 +597,11 @@ random_colors(struct state *st)
     st->ncolors = n;
   }
 
+  {
+    int i;
+    for (i = 0; i < 256; i++)
+      st->pixels[i] = st->colors[i % st->ncolors].pixel;
+  }
 }
 
 
@@ -379,9 +618,7 @@ rd_init (Display *dpy, Window win)
 
   st->delay = get_integer_resource (st->dpy, "delay", "Float");
 
-#ifdef HAVE_XSHM_EXTENSION
   st->use_shm = get_boolean_resource(st->dpy, "useSHM", "Boolean");
-#endif
 
   XGetWindowAttributes (st->dpy, win, &st->xgwa);
   st->visual = st->xgwa.visual;
@@ -415,49 +652,6 @@ rd_init (Display *dpy, Window win)
   st->gc = XCreateGC(st->dpy, win, 0 /*GCFunction*/, &gcv);
   vdepth = visual_depth(DefaultScreenOfDisplay(st->dpy), st->xgwa.visual);
 
-  /* This code only deals with pixmap depths of 1, 8, 16, and 32.
-     Therefore, we assume that those depths will be supported by the
-     coresponding visual depths (that depth-24 dpys accept depth-32
-     pixmaps, and that depth-12 dpys accept depth-16 pixmaps.) */
-  st->pdepth = (vdepth == 1 ? 1 :
-	    vdepth <= 8 ? 8 :
-	    vdepth <= 16 ? 16 :
-	    32);
-
-  /* Ok, this like, sucks and stuff.  There are some XFree86 systems
-     that have depth-24 visuals, that do not accept depth-32 XImages!
-     Which if you ask me is just absurd, since all it would take is
-     for the server to truncate the bits in that case.  So, this crap
-     here detects the specific case of: we have chosen depth 32;
-     and the server does not support depth 32.  In that case, we
-     try and use depth 16 instead.
-
-     The real fix would be to rewrite this program to deal with
-     depth 24 directly (or even better, arbitrary depths, but that
-     would mean going through the XImage routines instead of messing
-     with the XImage->data directly.)
-
-     jwz, 18-Mar-99: well, the X servers I have access to these days do
-     support 32-deep images on deep visuals, so I no longer have the
-     ability to test this code -- but it was causing problems on the
-     visuals that I do have, and I think that's because I mistakenly
-     wrote `pfv[i].depth' when I meant to write `pfv[i].bits_per_pixel'.
-     The symptom I was seeing was that the grid was 64x64, but the
-     images were being drawn 32x32 -- so there was a black stripe on
-     every other row.  Wow, this code sucks so much.
-  */
-  if (st->pdepth == 32)
-    {
-      int i, pfvc = 0;
-      Bool ok = False;
-      XPixmapFormatValues *pfv = XListPixmapFormats (st->dpy, &pfvc);
-      for (i = 0; i < pfvc; i++)
-        if (pfv[i].bits_per_pixel == st->pdepth)
-          ok = True;
-      if (!ok)
-        st->pdepth = 16;
-    }
-
   st->cmap = st->xgwa.colormap;
   st->ncolors = get_integer_resource (st->dpy, "colors", "Integer");
 
@@ -485,35 +679,16 @@ rd_init (Display *dpy, Window win)
     }
   }
 
-  st->pd = malloc(st->npix * (st->pdepth == 1 ? 1 : (st->pdepth / 8)));
-  if (!st->pd) {
+  st->pimage = parallel_image_create(st->dpy, st->xgwa.visual, vdepth,
+                                     st->width, st->height, st->use_shm);
+  if (!st->pimage) {
     fprintf(stderr, "not enough memory for %d pixels.\n", st->npix);
     exit(1);
   }
 
-  st->image = 0;
-
-#ifdef HAVE_XSHM_EXTENSION
-  if (st->use_shm)
-    {
-      st->image = create_xshm_image(st->dpy, st->xgwa.visual, vdepth,
-				ZPixmap, 0, &st->shm_info, st->width, st->height);
-      if (!st->image)
-	st->use_shm = False;
-      else
-	{
-	  free(st->pd);
-	  st->pd = st->image->data;
-	}
-    }
-#endif /* HAVE_XSHM_EXTENSION */
-
-  if (!st->image)
-    {
-      st->image = XCreateImage(st->dpy, st->xgwa.visual, vdepth,
-			   ZPixmap, 0, st->pd,
-			   st->width, st->height, 8, 0);
-    }
+  /* Dither, except on 8-bit visuals without writable cells. */
+  st->dither = (dither_when_mapped &&
+                (st->mapped || st->pimage->image->bits_per_pixel > 8));
 
   return st;
 }
@@ -525,17 +700,12 @@ rd_draw (Display *dpy, Window win, void *closure)
   Bool bump = False;
 
   int i, j;
-  pixack_frame(st, st->pd);
+  pixack_frame(st);
   for (i = 0; i < st->array_width; i += st->width)
     for (j = 0; j < st->array_height; j += st->height)
-#ifdef HAVE_XSHM_EXTENSION
-      if (st->use_shm)
-        XShmPutImage(st->dpy, st->window, st->gc, st->image, 0, 0, i+st->array_x, j+st->array_y,
-                     st->width, st->height, False);
-      else
-#endif
-        XPutImage(st->dpy, win, st->gc, st->image, 0, 0, i+st->array_x, j+st->array_y,
-                  st->width, st->height);
+      parallel_image_put(st->pimage, win, st->gc, 0, 0,
+                         i+st->array_x, j+st->array_y,
+                         st->width, st->height);
 
   st->array_x += st->array_dx;
   st->array_y += st->array_dy;
@@ -586,6 +756,16 @@ rd_event (Display *dpy, Window window, void *closure, XEvent *event)
 static void
 rd_free (Display *dpy, Window window, void *closure)
 {
+  struct state *st = (struct state *) closure;
+  parallel_image_free (st->pimage);
+  XFreeGC (dpy, st->gc);
+  free (st->mc);
+  free (st->colors);
+  free (st->r1);
+  free (st->r2);
+  free (st->r1b);
+  free (st->r2b);
+  free (st);
 }
 
 XSCREENSAVER_MODULE_2 ("RDbomb", rdbomb, rd)
@@ -6,8 +6,21 @@
  * the above copyright notice appear in all copies and that both that
  * copyright notice and this permission notice appear in supporting
  * documentation.  No representations are made about the suitability of this
- * software for any purpose.  It is provided "as is" without express or 
+ * software for any purpose.  It is provided "as is" without express or
  * implied warranty.
+ *
+ * Frames are not written to disk: they are streamed as raw RGB into a pipe
+ * to ffmpeg.  Between the two is a small pipeline:
+ *
+ *   - The render thread reads back the frame (for GL, into a pixel buffer
+ *     object that isn't mapped until the following frame, so that it
+ *     doesn't stall) and drops it into a free slot;
+ *   - Worker threads convert the slots to packed top-to-bottom RGB (with
+ *     pixel_convert.c), and apply the fade in/out;
+ *   - A writer thread feeds the converted slots to ffmpeg, in order.
+ *
+ * The render thread only waits if all the slots are full, i.e., if ffmpeg
+ * is falling behind.
  */
 
 #ifdef HAVE_CONFIG_H
@@ -18,27 +31,48 @@
 # ifdef HAVE_JWXYZ
 #  include "jwxyz.h"
 # else /* !HAVE_JWXYZ -- real Xlib */
+#  define GL_GLEXT_PROTOTYPES 1
 #  include <GL/glx.h>
 #  include <GL/glu.h>
 # endif /* !HAVE_JWXYZ */
 # ifdef HAVE_JWZGLES
 #  include "jwzgles.h"
 # endif /* HAVE_JWZGLES */
+# if defined(GL_PIXEL_PACK_BUFFER) && !defined(HAVE_JWZGLES)
+#  define RECANIM_PBO
+# endif
 #endif /* USE_GL */
 
-#ifdef HAVE_GDK_PIXBUF
-# ifdef HAVE_GTK2
-#  include <gdk-pixbuf-xlib/gdk-pixbuf-xlib.h>
-# else  /* !HAVE_GTK2 */
-#  include <gdk-pixbuf/gdk-pixbuf-xlib.h>
-# endif /* !HAVE_GTK2 */
-#endif /* HAVE_GDK_PIXBUF */
-
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <unistd.h>
+
+#ifdef HAVE_PTHREAD
+# include <pthread.h>
+#endif /* HAVE_PTHREAD */
 
 #include "screenhackI.h"
 #include "recanim.h"
+#include "pixel_convert.h"
+
+#define RECANIM_SLOTS   6	/* frames in flight */
+#define RECANIM_WORKERS 4	/* at most this many conversion threads */
+
+typedef enum {
+  FRAME_FREE, FRAME_CAPTURED, FRAME_CONVERTING, FRAME_CONVERTED
+} frame_state;
+
+struct recanim_frame {
+  frame_state state;
+  int number;
+  Bool blank;			/* write black instead */
+# ifdef USE_GL
+  char *raw;			/* RGB, bottom to top, as from glReadPixels */
+# else  /* !USE_GL */
+  XImage *img;			/* as from XGetSubImage */
+# endif /* !USE_GL */
+  unsigned char *rgb;		/* RGB, top to bottom, as ffmpeg wants it */
+};
 
 struct record_anim_state {
   Screen *screen;
@@ -49,24 +83,328 @@ struct record_anim_state {
   char *title;
   int pct;
   int fade_frames;
+  char *outfile;
+  FILE *pipe;
+
+  struct recanim_frame frames[RECANIM_SLOTS];
+
 # ifdef USE_GL
-  char *data, *data2;
+#  ifdef RECANIM_PBO
+  GLuint pbo[2];
+  int pbo_p;			/* -1 until the first capture */
+  int pbo_pending;		/* frame number waiting in a PBO, or -1 */
+#  endif /* RECANIM_PBO */
 # else  /* !USE_GL */
-  XImage *img;
   Pixmap p;
   GC gc;
+  pixel_converter pc;
 # endif /* !USE_GL */
+
+# ifdef HAVE_PTHREAD
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;		/* any slot changed state */
+  pthread_t workers[RECANIM_WORKERS];
+  int nworkers;
+  pthread_t writer;
+  int next_write;		/* frame number the writer is waiting for */
+  int submitted;		/* frames handed to the pipeline */
+  Bool shutdown;
+# endif /* HAVE_PTHREAD */
 };
 
+
+/* Fade to black. Assumes data is 3-byte packed.
+ */
+static void
+fade_frame (record_anim_state *st, unsigned char *data, double ratio)
+{
+  int x, y, i;
+  int w = st->xgwa.width;
+  int h = st->xgwa.height;
+  unsigned char *s = data;
+  for (y = 0; y < h; y++)
+    for (x = 0; x < w; x++)
+      for (i = 0; i < 3; i++)
+        *s++ *= ratio;
+}
+
+
+/* Turns whatever was captured into f->rgb.  Runs on a worker thread,
+   so it must not touch the Display.
+ */
+static void
+convert_frame (record_anim_state *st, struct recanim_frame *f)
+{
+  int bytes_per_line = st->xgwa.width * 3;
+  int y;
+
+  if (f->blank)
+    {
+      memset (f->rgb, 0, bytes_per_line * st->xgwa.height);
+      return;
+    }
+
+# ifndef USE_GL
+  for (y = 0; y < f->img->height; y++)
+    pixel_convert_row_rgb (&st->pc, f->img, y, f->rgb + bytes_per_line * y);
+# else  /* USE_GL */
+
+  /* Flip vertically */
+  for (y = 0; y < st->xgwa.height; y++)
+    memcpy (f->rgb  + bytes_per_line * y,
+            f->raw  + bytes_per_line * (st->xgwa.height - y - 1),
+            bytes_per_line);
+
+# endif /* USE_GL */
+
+  if (f->number < st->fade_frames)
+    fade_frame (st, f->rgb, (double) f->number / st->fade_frames);
+  else if (f->number >= st->target_frames - st->fade_frames)
+    fade_frame (st, f->rgb,
+                (double) (st->target_frames - f->number - 1) /
+                st->fade_frames);
+}
+
+
+static void
+write_frame (record_anim_state *st, struct recanim_frame *f)
+{
+  size_t size = st->xgwa.width * st->xgwa.height * 3;
+  if (fwrite (f->rgb, 1, size, st->pipe) != size)
+    {
+      fprintf (stderr, "%s: writing frame %d to ffmpeg failed\n",
+               progname, f->number);
+      exit (1);
+    }
+}
+
+
+#ifdef HAVE_PTHREAD
+
+static void *
+worker_thread (void *arg)
+{
+  record_anim_state *st = (record_anim_state *) arg;
+  pthread_mutex_lock (&st->mutex);
+  while (1)
+    {
+      struct recanim_frame *f = 0;
+      int i;
+      for (i = 0; i < RECANIM_SLOTS; i++)
+        if (st->frames[i].state == FRAME_CAPTURED)
+          {
+            f = &st->frames[i];
+            break;
+          }
+
+      if (!f)
+        {
+          if (st->shutdown) break;
+          pthread_cond_wait (&st->cond, &st->mutex);
+          continue;
+        }
+
+      f->state = FRAME_CONVERTING;
+      pthread_mutex_unlock (&st->mutex);
+      convert_frame (st, f);
+      pthread_mutex_lock (&st->mutex);
+      f->state = FRAME_CONVERTED;
+      pthread_cond_broadcast (&st->cond);
+    }
+  pthread_mutex_unlock (&st->mutex);
+  return 0;
+}
+
+
+static void *
+writer_thread (void *arg)
+{
+  record_anim_state *st = (record_anim_state *) arg;
+  pthread_mutex_lock (&st->mutex);
+  while (1)
+    {
+      struct recanim_frame *f = &st->frames[st->next_write % RECANIM_SLOTS];
+
+      if (f->state != FRAME_CONVERTED || f->number != st->next_write)
+        {
+          if (st->shutdown && st->next_write >= st->submitted) break;
+          pthread_cond_wait (&st->cond, &st->mutex);
+          continue;
+        }
+
+      pthread_mutex_unlock (&st->mutex);
+      write_frame (st, f);
+      pthread_mutex_lock (&st->mutex);
+      f->state = FRAME_FREE;
+      st->next_write++;
+      pthread_cond_broadcast (&st->cond);
+    }
+  pthread_mutex_unlock (&st->mutex);
+  return 0;
+}
+
+#endif /* HAVE_PTHREAD */
+
+
+/* Returns the slot for the given frame, once the writer is done with
+   whatever was in it before.
+ */
+static struct recanim_frame *
+acquire_frame (record_anim_state *st, int number)
+{
+  struct recanim_frame *f = &st->frames[number % RECANIM_SLOTS];
+# ifdef HAVE_PTHREAD
+  pthread_mutex_lock (&st->mutex);
+  while (f->state != FRAME_FREE)
+    pthread_cond_wait (&st->cond, &st->mutex);
+  pthread_mutex_unlock (&st->mutex);
+# endif /* HAVE_PTHREAD */
+  f->number = number;
+  f->blank = False;
+  return f;
+}
+
+
+static void
+submit_frame (record_anim_state *st, struct recanim_frame *f)
+{
+# ifdef HAVE_PTHREAD
+  pthread_mutex_lock (&st->mutex);
+  f->state = FRAME_CAPTURED;
+  st->submitted++;
+  pthread_cond_broadcast (&st->cond);
+  pthread_mutex_unlock (&st->mutex);
+# else  /* !HAVE_PTHREAD */
+  convert_frame (st, f);
+  write_frame (st, f);
+# endif /* !HAVE_PTHREAD */
+}
+
+
+#ifdef RECANIM_PBO
+/* glReadPixels into a PBO returns right away; we map it one frame later,
+   by which time the GPU has (probably) finished the copy.  This has to
+   wait for the first capture, since there's no GL context yet when
+   screenhack_record_anim_init is called.  If the buffers can't be made,
+   read into client memory instead.
+ */
+static void
+init_pbo (record_anim_state *st)
+{
+  int i;
+
+  for (i = 0; i < 16 && glGetError() != GL_NO_ERROR; i++)
+    ;				/* Forget errors that aren't ours. */
+  glGenBuffers (2, st->pbo);
+  for (i = 0; i < 2; i++)
+    {
+      glBindBuffer (GL_PIXEL_PACK_BUFFER, st->pbo[i]);
+      glBufferData (GL_PIXEL_PACK_BUFFER,
+                    st->xgwa.width * st->xgwa.height * 3, 0, GL_STREAM_READ);
+    }
+  glBindBuffer (GL_PIXEL_PACK_BUFFER, 0);
+
+  st->pbo_p = (st->pbo[0] && st->pbo[1] && glGetError() == GL_NO_ERROR);
+  if (! st->pbo_p)
+    {
+      if (st->pbo[0] || st->pbo[1])
+        glDeleteBuffers (2, st->pbo);
+      st->pbo[0] = st->pbo[1] = 0;
+      for (i = 0; i < 16 && glGetError() != GL_NO_ERROR; i++)
+        ;
+    }
+}
+
+
+/* Copies the frame that was read into a PBO last time out into its slot.
+ */
+static void
+collect_pbo (record_anim_state *st)
+{
+  int n = st->pbo_pending;
+  struct recanim_frame *f;
+  const void *data;
+
+  if (n < 0) return;
+  st->pbo_pending = -1;
+
+  f = acquire_frame (st, n);
+  glBindBuffer (GL_PIXEL_PACK_BUFFER, st->pbo[n & 1]);
+  data = glMapBuffer (GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+  if (data)
+    {
+      memcpy (f->raw, data, st->xgwa.width * st->xgwa.height * 3);
+      glUnmapBuffer (GL_PIXEL_PACK_BUFFER);
+    }
+  else
+    f->blank = True;
+  glBindBuffer (GL_PIXEL_PACK_BUFFER, 0);
+  submit_frame (st, f);
+}
+#endif /* RECANIM_PBO */
+
+
+static void
+start_ffmpeg (record_anim_state *st)
+{
+  struct stat s;
+  char cmd[1024];
+  const char *soundtrack = 0;
+
+  st->outfile = (char *) malloc (strlen (progname) + 10);
+  sprintf (st->outfile, "%s.%s", progname, "mp4");
+  unlink (st->outfile);
+
+# define ST "images/drives-200.mp3"
+  soundtrack = ST;
+  if (stat (soundtrack, &s)) soundtrack = 0;
+  if (! soundtrack) soundtrack = "../" ST;
+  if (stat (soundtrack, &s)) soundtrack = 0;
+  if (! soundtrack) soundtrack = "../../" ST;
+  if (stat (soundtrack, &s)) soundtrack = 0;
+
+  sprintf (cmd,
+           "ffmpeg"
+           " -f rawvideo -pix_fmt rgb24"
+           " -s %dx%d"
+           " -framerate 30"	/* rate of input: must be before -i */
+           " -i -"
+           " -r 30",		/* rate of output: must be after -i */
+           st->xgwa.width, st->xgwa.height);
+  if (soundtrack)
+    sprintf (cmd + strlen(cmd),
+             " -i '%s' -map 0:v:0 -map 1:a:0 -acodec libfaac",
+             soundtrack);
+  sprintf (cmd + strlen(cmd),
+           " -c:v libx264"
+           " -profile:v high"
+           " -crf 18"
+           " -pix_fmt yuv420p"
+           " '%s'"
+           " 2>&-",
+           st->outfile);
+  fprintf (stderr, "%s: exec: %s\n", progname, cmd);
+
+  st->pipe = popen (cmd, "w");
+  if (!st->pipe)
+    {
+      char buf[1024];
+      sprintf (buf, "%s: popen ffmpeg", progname);
+      perror (buf);
+      exit (1);
+    }
+}
+
+
 record_anim_state *
 screenhack_record_anim_init (Screen *screen, Window window, int target_frames)
 {
-  Display *dpy = DisplayOfScreen (screen);
-  record_anim_state *st;
-
 # ifndef USE_GL
+  Display *dpy = DisplayOfScreen (screen);
   XGCValues gcv;
 # endif /* !USE_GL */
+  record_anim_state *st;
+  int i;
 
   if (target_frames <= 0) return 0;
 
@@ -81,77 +419,73 @@ screenhack_record_anim_init (Screen *screen, Window window, int target_frames)
   if (st->fade_frames >= (st->target_frames / 2) - 30)
     st->fade_frames = 0;
 
-# ifdef HAVE_GDK_PIXBUF
-  {
-    Window root;
-    int x, y;
-    unsigned int w, h, d, bw;
-    XGetGeometry (dpy, window, &root, &x, &y, &w, &h, &bw, &d);
-    gdk_pixbuf_xlib_init_with_depth (dpy, screen_number (screen), d);
-
-#  ifdef HAVE_GTK2
-#   if !GLIB_CHECK_VERSION(2, 36 ,0)
-    g_type_init();
-#   endif
-#  else  /* !HAVE_GTK2 */
-    xlib_rgb_init (dpy, screen);
-#  endif /* !HAVE_GTK2 */
-  }
-# else  /* !HAVE_GDK_PIXBUF */
-#  error GDK_PIXBUF is required
-# endif /* !HAVE_GDK_PIXBUF */
-
-  XGetWindowAttributes (dpy, st->window, &st->xgwa);
+  XGetWindowAttributes (DisplayOfScreen (screen), st->window, &st->xgwa);
 
+  for (i = 0; i < RECANIM_SLOTS; i++)
+    {
+      struct recanim_frame *f = &st->frames[i];
+      f->rgb = (unsigned char *) calloc (st->xgwa.width, st->xgwa.height * 3);
 # ifdef USE_GL
+      f->raw = (char *) calloc (st->xgwa.width, st->xgwa.height * 3);
+# else  /* !USE_GL */
+      f->img = XCreateImage (dpy, st->xgwa.visual, st->xgwa.depth, ZPixmap,
+                             0, 0, st->xgwa.width, st->xgwa.height, 8, 0);
+      f->img->data = (char *) calloc (f->img->height, f->img->bytes_per_line);
+# endif /* !USE_GL */
+    }
 
-  st->data  = (char *) calloc (st->xgwa.width, st->xgwa.height * 3);
-  st->data2 = (char *) calloc (st->xgwa.width, st->xgwa.height * 3);
-
-# else    /* !USE_GL */
-
+# ifdef USE_GL
+#  ifdef RECANIM_PBO
+  st->pbo_p = -1;
+  st->pbo_pending = -1;
+#  endif /* RECANIM_PBO */
+# else  /* !USE_GL */
   st->gc = XCreateGC (dpy, st->window, 0, &gcv);
   st->p = XCreatePixmap (dpy, st->window,
                          st->xgwa.width, st->xgwa.height, st->xgwa.depth);
-  st->img = XCreateImage (dpy, st->xgwa.visual, st->xgwa.depth, ZPixmap,
-                          0, 0, st->xgwa.width, st->xgwa.height, 8, 0);
-  st->img->data = (char *) calloc (st->img->height, st->img->bytes_per_line);
+  if (! pixel_converter_init (&st->pc, st->frames[0].img))
+    {
+      fprintf (stderr, "%s: can only record TrueColor visuals\n", progname);
+      exit (1);
+    }
 # endif /* !USE_GL */
 
+  start_ffmpeg (st);
+
+# ifdef HAVE_PTHREAD
+  pthread_mutex_init (&st->mutex, 0);
+  pthread_cond_init (&st->cond, 0);
+  {
+    long n = sysconf (_SC_NPROCESSORS_ONLN);
+    if (n < 1) n = 1;
+    if (n > RECANIM_WORKERS) n = RECANIM_WORKERS;
+    for (i = 0; i < n; i++)
+      if (! pthread_create (&st->workers[i], 0, worker_thread, st))
+        st->nworkers++;
+  }
+  if (st->nworkers == 0 ||
+      pthread_create (&st->writer, 0, writer_thread, st))
+    {
+      fprintf (stderr, "%s: unable to start threads\n", progname);
+      exit (1);
+    }
+# endif /* HAVE_PTHREAD */
 
 # ifndef HAVE_JWXYZ
-  XFetchName (dpy, st->window, &st->title);
+  XFetchName (DisplayOfScreen (screen), st->window, &st->title);
 # endif /* !HAVE_JWXYZ */
 
   return st;
 }
 
 
-/* Fade to black. Assumes data is 3-byte packed.
- */
-static void
-fade_frame (record_anim_state *st, unsigned char *data, double ratio)
-{
-  int x, y, i;
-  int w = st->xgwa.width;
-  int h = st->xgwa.height;
-  unsigned char *s = data;
-  for (y = 0; y < h; y++)
-    for (x = 0; x < w; x++)
-      for (i = 0; i < 3; i++)
-        *s++ *= ratio;
-}
-
-
 void
 screenhack_record_anim (record_anim_state *st)
 {
-  int bytes_per_line = st->xgwa.width * 3;
-
 # ifndef USE_GL
 
   Display *dpy = DisplayOfScreen (st->screen);
-  char *data = (char *) st->img->data;
+  struct recanim_frame *f = acquire_frame (st, st->frame_count);
 
   /* Under XQuartz we can't just do XGetImage on the Window, we have to
      go through an intermediate Pixmap first.  I don't understand why.
@@ -161,33 +495,11 @@ screenhack_record_anim (record_anim_state *st)
   XCopyArea (dpy, st->window, st->p, st->gc, 0, 0,
              st->xgwa.width, st->xgwa.height, 0, 0);
   XGetSubImage (dpy, st->p, 0, 0, st->xgwa.width, st->xgwa.height,
-                ~0L, ZPixmap, st->img, 0, 0);
+                ~0L, ZPixmap, f->img, 0, 0);
+  submit_frame (st, f);
 
-  /* Convert BGRA to RGB */
-  {
-    const char *in = st->img->data;
-    char *out = st->img->data;
-    int x, y;
-    int w = st->img->width;
-    int h = st->img->height;
-    for (y = 0; y < h; y++)
-      {
-        const char *in2 = in;
-        for (x = 0; x < w; x++)
-          {
-            *out++ = in2[2];
-            *out++ = in2[1];
-            *out++ = in2[0];
-            in2 += 4;
-          }
-        in += st->img->bytes_per_line;
-      }
-  }
 # else  /* USE_GL */
 
-  char *data = st->data2;
-  int y;
-
 # ifdef HAVE_JWZGLES
 #  undef glReadPixels /* Kludge -- unimplemented in the GLES compat layer */
 # endif
@@ -196,56 +508,41 @@ screenhack_record_anim (record_anim_state *st)
      since it is the front buffer when we were drawing in the back buffer.
      Leave it black. */
   /* glDrawBuffer (GL_BACK); */
-  if (st->frame_count != 0)
-    glReadPixels (0, 0, st->xgwa.width, st->xgwa.height,
-                  GL_RGB, GL_UNSIGNED_BYTE, st->data);
-
-  /* Flip vertically */
-  for (y = 0; y < st->xgwa.height; y++)
-    memcpy (data      + bytes_per_line * y,
-            st->data  + bytes_per_line * (st->xgwa.height - y - 1),
-            bytes_per_line);
+  if (st->frame_count == 0)
+    {
+      struct recanim_frame *f = acquire_frame (st, st->frame_count);
+      f->blank = True;
+      submit_frame (st, f);
+    }
+  else
+    {
+      /* The rows of f->raw are packed, with no padding to 4 bytes. */
+      glPixelStorei (GL_PACK_ALIGNMENT, 1);
+
+#  ifdef RECANIM_PBO
+      if (st->pbo_p < 0)
+        init_pbo (st);
+      if (st->pbo_p)
+        {
+          glBindBuffer (GL_PIXEL_PACK_BUFFER, st->pbo[st->frame_count & 1]);
+          glReadPixels (0, 0, st->xgwa.width, st->xgwa.height,
+                        GL_RGB, GL_UNSIGNED_BYTE, 0);
+          glBindBuffer (GL_PIXEL_PACK_BUFFER, 0);
+          collect_pbo (st);		/* the previous frame */
+          st->pbo_pending = st->frame_count;
+        }
+      else
+#  endif /* RECANIM_PBO */
+        {
+          struct recanim_frame *f = acquire_frame (st, st->frame_count);
+          glReadPixels (0, 0, st->xgwa.width, st->xgwa.height,
+                        GL_RGB, GL_UNSIGNED_BYTE, f->raw);
+          submit_frame (st, f);
+        }
+    }
 
 # endif /* USE_GL */
 
-
-  if (st->frame_count < st->fade_frames)
-    fade_frame (st, (unsigned char *) data,
-                (double) st->frame_count / st->fade_frames);
-  else if (st->frame_count >= st->target_frames - st->fade_frames)
-    fade_frame (st, (unsigned char *) data,
-                (double) (st->target_frames - st->frame_count - 1) /
-                st->fade_frames);
-
-# ifdef HAVE_GDK_PIXBUF
-  {
-    const char *type = "png";
-    char fn[1024];
-    GError *error = 0;
-    GdkPixbuf *pixbuf;
-
-    pixbuf = gdk_pixbuf_new_from_data ((guchar *) data,
-                                       GDK_COLORSPACE_RGB, False, /* alpha */
-                                       8, /* bits per sample */
-                                       st->xgwa.width, st->xgwa.height,
-                                       bytes_per_line,
-                                       0, 0);
-
-    sprintf (fn, "%s-%06d.%s", progname, st->frame_count, type);
-    gdk_pixbuf_save (pixbuf, fn, type, &error, NULL);
-
-    if (error)
-      {
-        fprintf (stderr, "%s: %s: %s\n", progname, fn, error->message);
-        exit (1);
-      }
-
-    g_object_unref (pixbuf);
-  }
-# else  /* !HAVE_GDK_PIXBUF */
-#  error GDK_PIXBUF is required
-# endif /* !HAVE_GDK_PIXBUF */
-
 # ifndef HAVE_JWXYZ
   {  /* Put percent done in window title */
     int pct = 100 * (st->frame_count + 1) / st->target_frames;
@@ -276,71 +573,60 @@ screenhack_record_anim_free (record_anim_state *st)
 
   struct stat s;
   int i;
-  const char *type = "png";
-  char cmd[1024];
-  char fn[1024];
-  const char *soundtrack = 0;
+
+# ifdef RECANIM_PBO
+  if (st->pbo_p > 0)
+    {
+      collect_pbo (st);
+      glDeleteBuffers (2, st->pbo);
+    }
+# endif /* RECANIM_PBO */
+
+  /* Let the pipeline drain. */
+# ifdef HAVE_PTHREAD
+  pthread_mutex_lock (&st->mutex);
+  st->shutdown = True;
+  pthread_cond_broadcast (&st->cond);
+  pthread_mutex_unlock (&st->mutex);
+  for (i = 0; i < st->nworkers; i++)
+    pthread_join (st->workers[i], 0);
+  pthread_join (st->writer, 0);
+  pthread_cond_destroy (&st->cond);
+  pthread_mutex_destroy (&st->mutex);
+# endif /* HAVE_PTHREAD */
 
   fprintf (stderr, "%s: wrote %d frames\n", progname, st->frame_count);
 
+  for (i = 0; i < RECANIM_SLOTS; i++)
+    {
+      struct recanim_frame *f = &st->frames[i];
+      free (f->rgb);
 # ifdef USE_GL
-  free (st->data);
-  free (st->data2);
+      free (f->raw);
 # else  /* !USE_GL */
-  free (st->img->data);
-  st->img->data = 0;
-  XDestroyImage (st->img);
+      free (f->img->data);
+      f->img->data = 0;
+      XDestroyImage (f->img);
+# endif /* !USE_GL */
+    }
+
+# ifndef USE_GL
   XFreeGC (dpy, st->gc);
   XFreePixmap (dpy, st->p);
 # endif /* !USE_GL */
 
-  sprintf (fn, "%s.%s", progname, "mp4");
-  unlink (fn);
-
-# define ST "images/drives-200.mp3"
-  soundtrack = ST;
-  if (stat (soundtrack, &s)) soundtrack = 0;
-  if (! soundtrack) soundtrack = "../" ST;
-  if (stat (soundtrack, &s)) soundtrack = 0;
-  if (! soundtrack) soundtrack = "../../" ST;
-  if (stat (soundtrack, &s)) soundtrack = 0;
-
-  sprintf (cmd,
-           "ffmpeg"
-           " -framerate 30"	/* rate of input: must be before -i */
-           " -i '%s-%%06d.%s'"
-           " -r 30",		/* rate of output: must be after -i */
-           progname, type);
-  if (soundtrack)
-    sprintf (cmd + strlen(cmd),
-             " -i '%s' -map 0:v:0 -map 1:a:0 -acodec libfaac",
-             soundtrack);
-  sprintf (cmd + strlen(cmd),
-           " -c:v libx264"
-           " -profile:v high"
-           " -crf 18"
-           " -pix_fmt yuv420p"
-           " '%s'"
-           " 2>&-",
-           fn);
-  fprintf (stderr, "%s: exec: %s\n", progname, cmd);
-  system (cmd);
+  pclose (st->pipe);
 
-  if (stat (fn, &s))
+  if (stat (st->outfile, &s))
     {
-      fprintf (stderr, "%s: %s was not created\n", progname, fn);
+      fprintf (stderr, "%s: %s was not created\n", progname, st->outfile);
       exit (1);
     }
 
-  fprintf (stderr, "%s: wrote %s (%.1f MB)\n", progname, fn,
+  fprintf (stderr, "%s: wrote %s (%.1f MB)\n", progname, st->outfile,
            s.st_size / (float) (1024 * 1024));
 
-  for (i = 0; i < st->frame_count; i++)
-    {
-      sprintf (fn, "%s-%06d.%s", progname, i, type);
-      unlink (fn);
-    }
-
+  free (st->outfile);
   if (st->title)
     free (st->title);
   free (st);
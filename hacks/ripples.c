@@ -47,9 +47,7 @@
 
 typedef enum {ripple_drop, ripple_blob, ripple_box, ripple_stir} ripple_mode;
 
-#ifdef HAVE_XSHM_EXTENSION
-#include "xshm.h"
-#endif /* HAVE_XSHM_EXTENSION */
+#include "parallel_image.h"
 
 #define TABLE 256
 
@@ -59,7 +57,8 @@ struct state {
   GC gc;
   Visual *visual;
 
-  XImage *orig_map, *buffer_map;
+  XImage *orig_map, *buffer_map;   /* buffer_map belongs to pimage */
+  parallel_image *pimage;
   int ctab[256];
   Colormap colormap;
   Screen *screen;
@@ -94,14 +93,15 @@ struct state {
   int duration;
   time_t start_time;
 
-  void (*draw_transparent) (struct state *st, short *src);
+  void (*draw_transparent) (struct state *st, short *src, int y0, int y1);
+
+  /* What ripple_band() is currently working on. */
+  int ripple_pass;
+  short *ripple_src, *ripple_dest;
 
   async_load_state *img_loader;
 
-#ifdef HAVE_XSHM_EXTENSION
   Bool use_shm;
-  XShmSegmentInfo shm_info;
-#endif /* HAVE_XSHM_EXTENSION */
 };
 
 
@@ -146,12 +146,13 @@ map_color(struct state *st, int grey)
 
 
 static void
-draw_ripple(struct state *st, short *src)
+draw_ripple(struct state *st, short *src, int y0, int y1)
 {
   int across, down;
-  char *dirty = st->dirty_buffer;
+  char *dirty = st->dirty_buffer + y0 * st->width;
 
-  for (down = 0; down < st->height - 1; down++, src += 1, dirty += 1)
+  src += y0 * st->width;
+  for (down = y0; down < y1; down++, src += 1, dirty += 1)
     for (across = 0; across < st->width - 1; across++, src++, dirty++) {
       int v1, v2, v3, v4;
       v1 = (int)*src;
@@ -184,13 +185,13 @@ draw_ripple(struct state *st, short *src)
 
 /* Uses the horizontal gradient as an offset to create a warp effect  */
 static void
-draw_transparent_vanilla(struct state *st, short *src)
+draw_transparent_vanilla(struct state *st, short *src, int y0, int y1)
 {
   int across, down, pixel;
   char *dirty = st->dirty_buffer;
 
-  pixel = 0;
-  for (down = 0; down < st->height - 2; down++, pixel += 2)
+  pixel = y0 * st->width;
+  for (down = y0; down < y1; down++, pixel += 2)
     for (across = 0; across < st->width-2; across++, pixel++) {
       int gradx, grady, gradx1, grady1;
       int x0, x1, x2, y1, y2;
@@ -324,13 +325,13 @@ grayscale(struct state *st, unsigned long color)
 
 
 static void
-draw_transparent_light(struct state *st, short *src)
+draw_transparent_light(struct state *st, short *src, int y0, int y1)
 {
   int across, down, pixel;
   char *dirty = st->dirty_buffer;
 
-  pixel = 0;
-  for (down = 0; down < st->height - 2; down++, pixel += 2)
+  pixel = y0 * st->width;
+  for (down = y0; down < y1; down++, pixel += 2)
     for (across = 0; across < st->width-2; across++, pixel++) {
       int gradx, grady, gradx1, grady1;
       int x0, x1, x2, y1, y2;
@@ -546,40 +547,21 @@ setup_X(struct state *st)
     exit(1);
   }
 
-  st->buffer_map = 0;
-
-#ifdef HAVE_XSHM_EXTENSION
-  if (st->use_shm) {
-    st->buffer_map = create_xshm_image(st->dpy, xgwa.visual, depth,
-				   ZPixmap, 0, &st->shm_info, st->bigwidth, st->bigheight);
-    if (!st->buffer_map) {
-      st->use_shm = False;
-      fprintf(stderr, "create_xshm_image failed\n");
-    }
-  }
-#endif /* HAVE_XSHM_EXTENSION */
-
-  if (!st->buffer_map) {
-    st->buffer_map = XCreateImage(st->dpy, xgwa.visual,
-			      depth, ZPixmap, 0, 0,
-			      st->bigwidth, st->bigheight, 8, 0);
-    st->buffer_map->data = (char *)
-      calloc(st->buffer_map->height, st->buffer_map->bytes_per_line);
+  st->pimage = parallel_image_create(st->dpy, xgwa.visual, depth,
+                                     st->bigwidth, st->bigheight, st->use_shm);
+  if (!st->pimage) {
+    fprintf(stderr, "%s: out of memory\n", progname);
+    exit(1);
   }
+  st->buffer_map = st->pimage->image;
 }
 
 
 static void
 DisplayImage(struct state *st)
 {
-#ifdef HAVE_XSHM_EXTENSION
-  if (st->use_shm)
-    XShmPutImage(st->dpy, st->window, st->gc, st->buffer_map, 0, 0, 0, 0,
-		 st->bigwidth, st->bigheight, False);
-  else
-#endif /* HAVE_XSHM_EXTENSION */
-    XPutImage(st->dpy, st->window, st->gc, st->buffer_map, 0, 0, 0, 0,
-	      st->bigwidth, st->bigheight);
+  parallel_image_put(st->pimage, st->window, st->gc, 0, 0, 0, 0,
+                     st->bigwidth, st->bigheight);
 }
 
 
@@ -835,9 +817,15 @@ init_ripples(struct state *st, int ndrops, int splash)
     }
     else
     {  
-    /* There's got to be a better way of doing this  XCopyArea? */
-    memcpy(st->buffer_map->data, st->orig_map->data,
-           st->bigheight * st->buffer_map->bytes_per_line);
+    /* There's got to be a better way of doing this  XCopyArea?
+       (The two images may be padded differently, so go by rows.) */
+    int down;
+    int bpl = MIN(st->buffer_map->bytes_per_line,
+                  st->orig_map->bytes_per_line);
+    for (down = 0; down < st->bigheight; down++)
+      memcpy(st->buffer_map->data + down * st->buffer_map->bytes_per_line,
+             st->orig_map->data + down * st->orig_map->bytes_per_line,
+             bpl);
     }
   } else {
     int across, down, color;
@@ -888,35 +876,33 @@ init_ripples(struct state *st, int ndrops, int splash)
  n>4 (eg 8 or 12) more fluid, waves die out slowly
  */
 
+/* Each pass below only reads the previous pass's output (or the previous
+   frame's), so the rows of a pass can be done in parallel: ripple_band()
+   does one pass over rows [y0, y1) of the interior.
+ */
 static void
-ripple(struct state *st)
+ripple_band(void *closure, int y0, int y1)
 {
+  struct state *st = (struct state *) closure;
+  short *src = st->ripple_src;
+  short *dest = st->ripple_dest;
   int across, down, pixel;
-  short *src, *dest;
 
-  if (st->draw_toggle == 0) {
-    src = st->bufferA;
-    dest = st->bufferB;
-    st->draw_toggle = 1;
-  } else {
-    src = st->bufferB;
-    dest = st->bufferA;
-    st->draw_toggle = 0;
-  }
-
-  switch (st->draw_count) {
-  case 0: case 1:
-    pixel = 1 * st->width + 1;
-    for (down = 1; down < st->height - 1; down++, pixel += 2 * 1)
+  switch (st->ripple_pass) {
+  case 0:
+    for (down = y0 + 1; down < y1 + 1; down++) {
+      pixel = down * st->width + 1;
       for (across = 1; across < st->width - 1; across++, pixel++) {
         st->temp[pixel] =
           (((src[pixel - 1] + src[pixel + 1] +
              src[pixel - st->width] + src[pixel + st->width]) / 2)) - dest[pixel];
       }
-
+    }
+    break;
+  case 1:
     /* Smooth the output */
-    pixel = 1 * st->width + 1;
-    for (down = 1; down < st->height - 1; down++, pixel += 2 * 1)
+    for (down = y0 + 1; down < y1 + 1; down++) {
+      pixel = down * st->width + 1;
       for (across = 1; across < st->width - 1; across++, pixel++) {
         if (st->temp[pixel] != 0) { /* Close enough for government work */
           int damp =
@@ -929,24 +915,62 @@ ripple(struct state *st)
         } else
           dest[pixel] = 0;
       }
+    }
     break;
-  case 2: case 3:
-    pixel = 1 * st->width + 1;
-    for (down = 1; down < st->height - 1; down++, pixel += 2 * 1)
+  case 2:
+    for (down = y0 + 1; down < y1 + 1; down++) {
+      pixel = down * st->width + 1;
       for (across = 1; across < st->width - 1; across++, pixel++) {
         int damp =
           (((src[pixel - 1] + src[pixel + 1] +
              src[pixel - st->width] + src[pixel + st->width]) / 2)) - dest[pixel];
         dest[pixel] = damp - (damp >> st->fluidity);
       }
+    }
+    break;
+  case 3:
+    if (st->transparent)
+      st->draw_transparent(st, dest, y0, y1);
+    else
+      draw_ripple(st, dest, y0, y1);
+    break;
+  default:
+    abort();
+  }
+}
+
+
+static void
+ripple(struct state *st)
+{
+  if (st->draw_toggle == 0) {
+    st->ripple_src = st->bufferA;
+    st->ripple_dest = st->bufferB;
+    st->draw_toggle = 1;
+  } else {
+    st->ripple_src = st->bufferB;
+    st->ripple_dest = st->bufferA;
+    st->draw_toggle = 0;
+  }
+
+  switch (st->draw_count) {
+  case 0: case 1:
+    st->ripple_pass = 0;
+    parallel_image_run(st->pimage, st->height - 2, ripple_band, st);
+    st->ripple_pass = 1;
+    parallel_image_run(st->pimage, st->height - 2, ripple_band, st);
+    break;
+  case 2: case 3:
+    st->ripple_pass = 2;
+    parallel_image_run(st->pimage, st->height - 2, ripple_band, st);
     break;
   }
   if (++st->draw_count > 3) st->draw_count = 0;
 
-  if (st->transparent)
-    st->draw_transparent(st, dest);
-  else
-    draw_ripple(st, dest);
+  st->ripple_pass = 3;
+  parallel_image_run(st->pimage,
+                     (st->transparent ? st->height - 2 : st->height - 1),
+                     ripple_band, st);
 }
 
 
@@ -968,9 +992,7 @@ ripples_init (Display *disp, Window win)
   st->fluidity = get_integer_resource(disp, "fluidity", "Integer");
   st->transparent = get_boolean_resource(disp, "water", "Boolean");
   st->grayscale_p = get_boolean_resource(disp, "grayscale", "Boolean");
-#ifdef HAVE_XSHM_EXTENSION
   st->use_shm = get_boolean_resource(disp, "useSHM", "Boolean");
-#endif /* HAVE_XSHM_EXTENSION */
   st->light = get_integer_resource(disp, "light", "Integer");
 
   if (st->delay < 0) st->delay = 0;
@@ -1090,6 +1112,7 @@ static void
 ripples_free (Display *dpy, Window window, void *closure)
 {
   struct state *st = (struct state *) closure;
+  parallel_image_free (st->pimage);
   free (st);
 }
 
@@ -1118,6 +1141,7 @@ static const char *ripples_defaults[] =
   "*ignoreRotation: True",
   "*rotateImages:   True",
 #endif
+  THREAD_DEFAULTS
   0
 };
 
@@ -1137,6 +1161,7 @@ static XrmOptionDescRec ripples_options[] =
   {"-grayscale",	".grayscale",	XrmoptionNoArg, "True"},
   {"-shm",	".useSHM",	XrmoptionNoArg, "True"},
   {"-no-shm",	".useSHM",	XrmoptionNoArg, "False"},
+  THREAD_OPTIONS
   {0, 0, 0, 0}
 };
 
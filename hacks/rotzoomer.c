@@ -29,9 +29,7 @@
 #include <math.h>
 #include "screenhack.h"
 
-#ifdef HAVE_XSHM_EXTENSION
-#include "xshm.h"
-#endif
+#include "parallel_image.h"
 
 struct zoom_area {
   int w, h;		/* rectangle width and height */
@@ -52,7 +50,8 @@ struct state {
 
   GC gc;
   Visual *visual;
-  XImage *orig_map, *buffer_map;
+  XImage *orig_map, *buffer_map;   /* buffer_map belongs to pimage */
+  parallel_image *pimage;
   Colormap colormap;
 
   int width, height;
@@ -69,30 +68,32 @@ struct state {
   async_load_state *img_loader;
   Pixmap pm;
 
-#ifdef HAVE_XSHM_EXTENSION
+  /* What rotzoom_band() is currently working on. */
+  struct zoom_area *band_za;
+  int band_c, band_s;
+
   Bool use_shm;
-  XShmSegmentInfo shm_info;
-#endif
 };
 
 
+/* Draws rows [y0, y1) of the zoom box, counting from its top edge.
+   Each output pixel depends only on orig_map, so the rows of the box
+   are split among threads.
+ */
 static void
-rotzoom (struct state *st, struct zoom_area *za)
+rotzoom_band (void *closure, int y0, int y1)
 {
-  int x, y, c, s, zoom, z;
-  int x2 = za->x + za->w - 1, y2 = za->y + za->h - 1;
+  struct state *st = (struct state *) closure;
+  struct zoom_area *za = st->band_za;
+  int x, y;
+  int c = st->band_c, s = st->band_s;
+  int x2 = za->x + za->w - 1;
   int ox = 0, oy = 0;
   int w2 = (za->w/2) * (za->w/2);
 
-  z = 8100 * sin (M_PI * za->a2 / 8192);
-  zoom = 8192 + z;
-
-  for (y = za->y; y <= y2; y++) {
+  for (y = za->y + y0; y < za->y + y1; y++) {
     for (x = za->x; x <= x2; x++) {
       Bool copyp = True;
-      double a = M_PI * za->a1 / 8192;
-      c = zoom * cos (a);
-      s = zoom * sin (a);
       if (st->circle) {
         int cx = za->x + za->w / 2;
         int cy = za->y + za->h / 2;
@@ -131,15 +132,33 @@ rotzoom (struct state *st, struct zoom_area *za)
     }
   }
 
+  if (y1 == za->h) {
+    za->ox = ox;		/* Save state for next iteration */
+    za->oy = oy;
+  }
+}
+
+
+static void
+rotzoom (struct state *st, struct zoom_area *za)
+{
+  int x, y, zoom, z;
+  double a = M_PI * za->a1 / 8192;
+
+  z = 8100 * sin (M_PI * za->a2 / 8192);
+  zoom = 8192 + z;
+
+  st->band_za = za;
+  st->band_c = zoom * cos (a);
+  st->band_s = zoom * sin (a);
+  parallel_image_run (st->pimage, za->h, rotzoom_band, st);
+
   za->a1 += za->inc1;		/* Rotation angle */
   za->a1 &= 0x3fff;
 
   za->a2 += za->inc2;		/* Zoom */
   za->a2 &= 0x3fff;
 
-  za->ox = ox;			/* Save state for next iteration */
-  za->oy = oy;
-
   if (st->circle && za->n <= 1)
     {
       /* Done rotating the circle: copy the bits from the working set back
@@ -331,13 +350,7 @@ update_position (struct zoom_area *za)
 static void
 DisplayImage (struct state *st, int x, int y, int w, int h)
 {
-#ifdef HAVE_XSHM_EXTENSION
-  if (st->use_shm)
-    XShmPutImage (st->dpy, st->window, st->gc, st->buffer_map, x, y, x, y,
-                  w, h, False);
-  else
-#endif /* HAVE_XSHM_EXTENSION */
-    XPutImage(st->dpy, st->window, st->gc, st->buffer_map, x, y, x, y, w, h);
+  parallel_image_put (st->pimage, st->window, st->gc, x, y, x, y, w, h);
 }
 
 
@@ -386,9 +399,16 @@ init_hack (struct state *st)
     st->zoom_box[i] = create_zoom (st);
   }
 
-  if (st->height && st->orig_map->data)
-    memcpy (st->buffer_map->data, st->orig_map->data,
-	    st->height * st->buffer_map->bytes_per_line);
+  /* The two images may be padded differently, so go by rows. */
+  if (st->height && st->orig_map->data) {
+    int bpl = st->buffer_map->bytes_per_line;
+    if (bpl > st->orig_map->bytes_per_line)
+      bpl = st->orig_map->bytes_per_line;
+    for (i = 0; i < st->height; i++)
+      memcpy (st->buffer_map->data + i * st->buffer_map->bytes_per_line,
+              st->orig_map->data + i * st->orig_map->bytes_per_line,
+              bpl);
+  }
 
   DisplayImage(st, 0, 0, st->width, st->height);
 }
@@ -487,25 +507,13 @@ setup_X (struct state *st)
   st->img_loader = load_image_async_simple (0, xgwa.screen, st->window,
                                             st->pm, 0, 0);
 
-  st->buffer_map = 0;
-
-#ifdef HAVE_XSHM_EXTENSION
-  if (st->use_shm) {
-    st->buffer_map = create_xshm_image(st->dpy, xgwa.visual, depth,
-                                       ZPixmap, 0, &st->shm_info, st->width, st->height);
-    if (!st->buffer_map) {
-      st->use_shm = False;
-      fprintf(stderr, "create_xshm_image failed\n");
-    }
-  }
-#endif /* HAVE_XSHM_EXTENSION */
-
-  if (!st->buffer_map) {
-    st->buffer_map = XCreateImage(st->dpy, xgwa.visual,
-                                  depth, ZPixmap, 0, 0, st->width, st->height, 8, 0);
-    st->buffer_map->data = (char *)calloc (st->buffer_map->height,
-                                           st->buffer_map->bytes_per_line);
+  st->pimage = parallel_image_create (st->dpy, xgwa.visual, depth,
+                                      st->width, st->height, st->use_shm);
+  if (!st->pimage) {
+    fprintf (stderr, "%s: out of memory\n", progname);
+    exit (1);
   }
+  st->buffer_map = st->pimage->image;
 }
 
 
@@ -515,9 +523,7 @@ rotzoomer_init (Display *dpy, Window window)
   struct state *st = (struct state *) calloc (1, sizeof(*st));
   st->dpy = dpy;
   st->window = window;
-#ifdef HAVE_XSHM_EXTENSION
   st->use_shm = get_boolean_resource (st->dpy, "useSHM", "Boolean");
-#endif
   st->num_zoom = get_integer_resource (st->dpy, "numboxes", "Integer");
 
   set_mode(st);
@@ -571,6 +577,7 @@ rotzoomer_free (Display *dpy, Window window, void *closure)
 {
   struct state *st = (struct state *) closure;
   if (st->pm) XFreePixmap (dpy, st->pm);
+  parallel_image_free (st->pimage);
   free (st);
 }
 
@@ -593,6 +600,7 @@ static const char *rotzoomer_defaults[] = {
   "*ignoreRotation: True",
   "*rotateImages:   True",
 #endif
+  THREAD_DEFAULTS
   0
 };
 
@@ -609,6 +617,7 @@ static XrmOptionDescRec rotzoomer_options[] = {
   { "-delay",	".delay",	XrmoptionSepArg, 0      },
   {"-duration",	".duration",	XrmoptionSepArg, 0      },
   { "-n",	".numboxes",	XrmoptionSepArg, 0      },
+  THREAD_OPTIONS
   { 0, 0, 0, 0 }
 };
 
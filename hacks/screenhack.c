@@ -112,6 +112,10 @@
 #include "vroot.h"
 #include "fps.h"
 
+#ifdef HAVE_SYS_SELECT_H
+# include <sys/select.h>	/* for wait_for_x_input() */
+#endif
+
 #ifdef HAVE_RECORD_ANIM
 # include "recanim.h"
 #endif
@@ -157,6 +161,10 @@ static XrmOptionDescRec default_options [] = {
   { "-record-animation", ".recordAnim", XrmoptionSepArg, 0 },
 # endif /* HAVE_RECORD_ANIM */
 
+  { "-benchmark", ".benchmark",		XrmoptionSepArg, 0 },
+  { "-seed",	".seed",		XrmoptionSepArg, 0 },
+  { "-frames-in-flight", ".framesInFlight", XrmoptionSepArg, 0 },
+
   { 0, 0, 0, 0 }
 };
 
@@ -262,6 +270,62 @@ MapNotify_event_p (Display *dpy, XEvent *event, XPointer window)
 
 static Atom XA_WM_PROTOCOLS, XA_WM_DELETE_WINDOW;
 
+
+/* With "-frames-in-flight N", we don't XSync after every frame.  Instead,
+   each frame ends by sending a ClientMessage to ourselves, by way of a
+   private InputOnly window.  The server delivers that event only once it
+   has processed everything before it, so it acts as a fence: the next
+   frame can be drawn while the server is still working on this one, and
+   we only block when N frames are outstanding.  Over remote X, this saves
+   a full round trip per frame.
+ */
+static struct {
+  int max_in_flight;		/* 0 means XSync every frame */
+  Window window;
+  Atom atom;
+  unsigned long sent, done;
+} frame_fence;
+
+static void
+frame_fence_init (Display *dpy, int max_in_flight)
+{
+  XSetWindowAttributes attrs;
+  if (max_in_flight <= 0) return;
+  frame_fence.max_in_flight = max_in_flight;
+  frame_fence.atom = XInternAtom (dpy, "_XSCREENSAVER_FRAME_FENCE", False);
+  frame_fence.window = XCreateWindow (dpy, DefaultRootWindow (dpy),
+                                      -1, -1, 1, 1, 0, 0, InputOnly,
+                                      CopyFromParent, 0, &attrs);
+}
+
+static void
+frame_fence_send (Display *dpy)
+{
+  XEvent event;
+  memset (&event, 0, sizeof(event));
+  event.xclient.type = ClientMessage;
+  event.xclient.window = frame_fence.window;
+  event.xclient.message_type = frame_fence.atom;
+  event.xclient.format = 32;
+  event.xclient.data.l[0] = (long) ++frame_fence.sent;
+  /* An empty event mask means "deliver to the window's creator": us. */
+  XSendEvent (dpy, frame_fence.window, False, 0, &event);
+  XFlush (dpy);
+}
+
+static Bool
+frame_fence_event_p (XEvent *event)
+{
+  if (! frame_fence.window ||
+      event->xany.type != ClientMessage ||
+      event->xclient.window != frame_fence.window)
+    return False;
+  if ((unsigned long) event->xclient.data.l[0] > frame_fence.done)
+    frame_fence.done = (unsigned long) event->xclient.data.l[0];
+  return True;
+}
+
+
 /* Dead-trivial event handling: exits if "q" or "ESC" are typed.
    Exit if the WM_PROTOCOLS WM_DELETE_WINDOW ClientMessage is received.
    Returns False if the screen saver should now terminate.
@@ -448,7 +512,9 @@ screenhack_table_handle_events (Display *dpy,
       XEvent event;
       XNextEvent (dpy, &event);
 
-      if (event.xany.type == ConfigureNotify)
+      if (frame_fence_event_p (&event))
+        ;
+      else if (event.xany.type == ConfigureNotify)
         {
           if (event.xany.window == window)
             ft->reshape_cb (dpy, window, closure,
@@ -477,11 +543,64 @@ screenhack_table_handle_events (Display *dpy,
 }
 
 
+/* Seconds on a clock that doesn't jump when the wall clock is reset.
+ */
+static double
+monotonic_time (void)
+{
+# ifdef CLOCK_MONOTONIC
+  struct timespec now;
+  if (clock_gettime (CLOCK_MONOTONIC, &now) == 0)
+    return (now.tv_sec + ((double) now.tv_nsec * 0.000000001));
+# endif
+  {
+    struct timeval now;
+# ifdef GETTIMEOFDAY_TWO_ARGS
+    struct timezone tzp;
+    gettimeofday(&now, &tzp);
+# else
+    gettimeofday(&now);
+# endif
+    return (now.tv_sec + ((double) now.tv_usec * 0.000001));
+  }
+}
+
+
+/* Sleep for up to `usecs', but wake up as soon as there is input from the
+   X server.  Returns the number of microseconds actually slept.
+ */
+static unsigned long
+wait_for_x_input (Display *dpy, unsigned long usecs)
+{
+  double start = monotonic_time();
+  double slept;
+# ifdef HAVE_SELECT
+  int fd = ConnectionNumber (dpy);
+  fd_set fds;
+  struct timeval tv;
+  FD_ZERO (&fds);
+  FD_SET (fd, &fds);
+  tv.tv_sec  = usecs / 1000000L;
+  tv.tv_usec = usecs % 1000000L;
+  (void) select (fd + 1, &fds, 0, 0, &tv);
+# else  /* !HAVE_SELECT */
+  usleep (usecs);
+# endif /* !HAVE_SELECT */
+  slept = (monotonic_time() - start) * 1000000;
+  return (slept < 0 ? 0 : (unsigned long) slept);
+}
+
+
+/* Sleep until `deadline' (in monotonic_time seconds), handling events as
+   they arrive.  The time taken by the draw_cb and the XSync has already
+   eaten into the frame, so the sleep is only whatever is left of it;
+   but we still wake up at least every 1/30th second to service Xt timers.
+ */
 static Boolean
 usleep_and_process_events (Display *dpy,
                            const struct xscreensaver_function_table *ft,
                            Window window, fps_state *fpst, void *closure,
-                           unsigned long delay
+                           unsigned long delay, double deadline
 #ifdef DEBUG_PAIR
                          , Window window2, fps_state *fpst2, void *closure2,
                            unsigned long delay2
@@ -491,34 +610,66 @@ usleep_and_process_events (Display *dpy,
 # endif
                            )
 {
-  do {
-    unsigned long quantum = 33333;  /* 30 fps */
-    if (quantum > delay) 
-      quantum = delay;
-    delay -= quantum;
-
+  if (! frame_fence.max_in_flight)
     XSync (dpy, False);
+  else
+    {
+      /* Block (without counting it as sleep) until few enough frames
+         are still in the server's queue. */
+      frame_fence_send (dpy);
+      while (frame_fence.sent - frame_fence.done >=
+             (unsigned long) frame_fence.max_in_flight)
+        {
+          if (! screenhack_table_handle_events (dpy, ft, window, closure
+#ifdef DEBUG_PAIR
+                                                , window2, closure2
+#endif
+                                                ))
+            return False;
+          if (frame_fence.sent - frame_fence.done >=
+              (unsigned long) frame_fence.max_in_flight)
+            wait_for_x_input (dpy, 33333);
+        }
+    }
 
 #ifdef HAVE_RECORD_ANIM
-    if (anim_state) screenhack_record_anim (anim_state);
+  /* The video runs at 30 fps of the hack's idea of time, not ours: emit
+     one frame per 1/30th second of requested delay, however long the
+     drawing actually took. */
+  if (anim_state)
+    {
+      unsigned long quantum = 33333;
+      do {
+        screenhack_record_anim (anim_state);
+        delay = (delay > quantum ? delay - quantum : 0);
+      } while (delay > 0);
+    }
 #endif
 
-    if (quantum > 0)
-      {
-        usleep (quantum);
-        if (fpst) fps_slept (fpst, quantum);
+  while (1)
+    {
+      unsigned long quantum = 33333;  /* 30 fps */
+      double remaining;
+
+      if (! screenhack_table_handle_events (dpy, ft, window, closure
 #ifdef DEBUG_PAIR
-        if (fpst2) fps_slept (fpst2, quantum);
+                                            , window2, closure2
 #endif
-      }
+                                            ))
+        return False;
 
-    if (! screenhack_table_handle_events (dpy, ft, window, closure
+      remaining = (deadline - monotonic_time()) * 1000000;
+      if (remaining <= 0)
+        break;
+      if (quantum > remaining)
+        quantum = remaining;
+
+      quantum = wait_for_x_input (dpy, quantum);
+      if (fpst) fps_slept (fpst, quantum);
 #ifdef DEBUG_PAIR
-                                          , window2, closure2
+      if (fpst2) fps_slept (fpst2, quantum);
 #endif
-                                          ))
-      return False;
-  } while (delay > 0);
+    }
 
   return True;
 }
@@ -532,6 +683,78 @@ screenhack_do_fps (Display *dpy, Window w, fps_state *fpst, void *closure)
 }
 
 
+/* With "-benchmark N", draw exactly N frames as fast as possible, ignoring
+   the delay returned by draw_cb, and then write the time spent in each
+   draw_cb (and in the XSync that follows it, i.e., the time the server
+   took to catch up) to stdout as JSON.  Combined with "-seed", two runs
+   of the same hack on the same display (e.g., Xvfb) draw the same frames,
+   so the numbers can be compared from build to build.
+ */
+static void
+run_screenhack_benchmark (Display *dpy, Window window, void *closure,
+                          fps_state *fpst,
+                          void (*fps_cb) (Display *, Window, fps_state *,
+                                          void *),
+                          const struct xscreensaver_function_table *ft,
+                          int frames, unsigned int seed)
+{
+  XWindowAttributes xgwa;
+  double *draw_times = (double *) calloc (frames, sizeof(*draw_times));
+  double *sync_times = (double *) calloc (frames, sizeof(*sync_times));
+  double start, total, draw_total = 0, draw_max = 0;
+  int i, n;
+
+  if (!draw_times || !sync_times) abort();
+
+  start = monotonic_time();
+  for (n = 0; n < frames; n++)
+    {
+      double t0 = monotonic_time(), t1, t2;
+      ft->draw_cb (dpy, window, closure);   /* delay is ignored */
+      t1 = monotonic_time();
+      if (fpst) fps_cb (dpy, window, fpst, closure);
+      XSync (dpy, False);
+      t2 = monotonic_time();
+
+      draw_times[n] = t1 - t0;
+      sync_times[n] = t2 - t1;
+      draw_total += draw_times[n];
+      if (draw_times[n] > draw_max) draw_max = draw_times[n];
+
+      if (! screenhack_table_handle_events (dpy, ft, window, closure
+#ifdef DEBUG_PAIR
+                                            , 0, 0
+#endif
+                                            ))
+        {
+          n++;
+          break;
+        }
+    }
+  total = monotonic_time() - start;
+
+  XGetWindowAttributes (dpy, window, &xgwa);
+  fprintf (stdout,
+           "{ \"hack\": \"%s\", \"seed\": %u,"
+           " \"width\": %d, \"height\": %d,\n"
+           "  \"frames\": %d, \"total_secs\": %.6f,"
+           " \"draw_mean_usecs\": %.1f, \"draw_max_usecs\": %.1f,\n",
+           progname, seed, xgwa.width, xgwa.height, n, total,
+           (n ? draw_total / n : 0) * 1000000, draw_max * 1000000);
+  fprintf (stdout, "  \"draw_usecs\": [");
+  for (i = 0; i < n; i++)
+    fprintf (stdout, "%s%.1f", (i ? ", " : ""), draw_times[i] * 1000000);
+  fprintf (stdout, "],\n  \"sync_usecs\": [");
+  for (i = 0; i < n; i++)
+    fprintf (stdout, "%s%.1f", (i ? ", " : ""), sync_times[i] * 1000000);
+  fprintf (stdout, "] }\n");
+  fflush (stdout);
+
+  free (draw_times);
+  free (sync_times);
+}
+
+
 static void
 run_screenhack_table (Display *dpy, 
                       Window window,
@@ -541,6 +764,7 @@ run_screenhack_table (Display *dpy,
 # ifdef HAVE_RECORD_ANIM
                       record_anim_state *anim_state,
 # endif
+                      int benchmark_frames, unsigned int seed,
                       const struct xscreensaver_function_table *ft)
 {
 
@@ -555,6 +779,7 @@ run_screenhack_table (Display *dpy,
 
   void *closure = init_cb (dpy, window, ft->setup_arg);
   fps_state *fpst = fps_init (dpy, window);
+  double deadline;
 
 #ifdef DEBUG_PAIR
   void *closure2 = 0;
@@ -568,11 +793,31 @@ run_screenhack_table (Display *dpy,
 
   if (! fps_cb) fps_cb = screenhack_do_fps;
 
+  frame_fence_init (dpy, get_integer_resource (dpy, "framesInFlight",
+                                               "Integer"));
+
+  deadline = monotonic_time();
+
+  if (benchmark_frames > 0)
+    {
+      run_screenhack_benchmark (dpy, window, closure, fpst, fps_cb, ft,
+                                benchmark_frames, seed);
+      goto DONE;
+    }
+
   while (1)
     {
-      unsigned long delay = ft->draw_cb (dpy, window, closure);
+      unsigned long delay;
 #ifdef DEBUG_PAIR
       unsigned long delay2 = 0;
+#endif
+      if (fpst) fps_frame_begin (fpst);
+#ifdef DEBUG_PAIR
+      if (fpst2) fps_frame_begin (fpst2);
+#endif
+
+      delay = ft->draw_cb (dpy, window, closure);
+#ifdef DEBUG_PAIR
       if (window2) delay2 = ft->draw_cb (dpy, window2, closure2);
 #endif
 
@@ -581,8 +826,18 @@ run_screenhack_table (Display *dpy,
       if (fpst2) fps_cb (dpy, window, fpst2, closure);
 #endif
 
+      /* Frames are paced against absolute deadlines, so time spent
+         drawing comes out of the sleep instead of being added to it.
+         If the hack can't keep up, don't try to catch up later. */
+      deadline += delay * 0.000001;
+      {
+        double now = monotonic_time();
+        if (deadline < now) deadline = now;
+      }
+
       if (! usleep_and_process_events (dpy, ft,
-                                       window, fpst, closure, delay
+                                       window, fpst, closure,
+                                       delay, deadline
 #ifdef DEBUG_PAIR
                                        , window2, fpst2, closure2, delay2
 #endif
@@ -591,8 +846,14 @@ run_screenhack_table (Display *dpy,
 #endif
                                        ))
         break;
+
+      if (fpst) fps_frame_end (fpst);
+#ifdef DEBUG_PAIR
+      if (fpst2) fps_frame_end (fpst2);
+#endif
     }
 
+ DONE:
 #ifdef HAVE_RECORD_ANIM
   /* Exiting before target frames hit: write the video anyway. */
   if (anim_state) screenhack_record_anim_free (anim_state);
@@ -600,6 +861,7 @@ run_screenhack_table (Display *dpy,
 
   ft->free_cb (dpy, window, closure);
   if (fpst) fps_free (fpst);
+  if (frame_fence.window) XDestroyWindow (dpy, frame_fence.window);
 
 #ifdef DEBUG_PAIR
   if (window2) ft->free_cb (dpy, window2, closure2);
@@ -714,6 +976,8 @@ main (int argc, char **argv)
   XEvent event;
   Boolean dont_clear;
   char version[255];
+  int benchmark_frames;
+  unsigned int seed;
 
   fix_fds();
 
@@ -949,9 +1213,17 @@ main (int argc, char **argv)
 
   /* This is the one and only place that the random-number generator is
      seeded in any screenhack.  You do not need to seed the RNG again,
-     it is done for you before your code is invoked. */
+     it is done for you before your code is invoked.
+
+     Normally the seed comes from the clock, but "-seed N" pins it, and
+     "-benchmark" implies a fixed seed so that runs are repeatable.
+   */
+  benchmark_frames = get_integer_resource (dpy, "benchmark", "Integer");
+  seed = (unsigned int) get_integer_resource (dpy, "seed", "Seed");
+  if (benchmark_frames > 0 && seed == 0)
+    seed = 1;
 # undef ya_rand_init
-  ya_rand_init (0);
+  ya_rand_init (seed);
 
 
 #ifdef HAVE_RECORD_ANIM
@@ -969,6 +1241,7 @@ main (int argc, char **argv)
 # ifdef HAVE_RECORD_ANIM
                         anim_state,
 # endif
+                        benchmark_frames, seed,
                         ft);
 
 #ifdef HAVE_RECORD_ANIM
@@ -48,6 +48,8 @@ static const char sccsid[] = "@(#)strange.c	5.00 2000/11/01 xlockmore";
 # include "xlock.h"		/* from the xlockmore distribution */
 #endif /* !STANDALONE */
 
+#include "point_plot.h"
+
 #ifdef MODE_strange
 #define DEF_CURVE  "10"
 #define DEF_POINTS "5500"
@@ -134,16 +136,13 @@ typedef struct _ATTRACTOR {
 	Pixmap      dbuf;	/* jwz */
 	GC          dbuf_gc;
 	#ifdef useAccumulator
-		int **accMap;
+		point_plot *plot;	/* Hits per pixel, drawn client-side */
+		unsigned long palette[NUM_COLS];
 	#endif
 } ATTRACTOR;
 
 static ATTRACTOR *Root = (ATTRACTOR *) NULL; 
 
-#ifdef useAccumulator
-static XColor* cols;
-#endif
-
 #ifdef POINTS_HISTORY
 static int numOldPoints;
 static int* oldPointsX;
@@ -267,6 +266,12 @@ free_strange(Display *display, ATTRACTOR *A)
 		(void) free((void *) A->Fold);
 		A->Fold = (PRM *) NULL;
 	}
+#ifdef useAccumulator
+	if (A->plot != NULL) {
+		point_plot_free(A->plot);
+		A->plot = (point_plot *) NULL;
+	}
+#endif
 }
 
 ENTRYPOINT void
@@ -300,14 +305,8 @@ draw_strange(ModeInfo * mi)
 	/* We collect the accumulation of the orbits in the 2d int array field. */
 #ifndef POINTS_HISTORY
 	#ifdef useAccumulator
-		if (useAccumulator) {
-			for (i=0;i<A->Width;i++) {
-				for (j=0;j<A->Height;j++) {
-					A->accMap[i][j] = 0;
-
-				}
-			}
-		}
+		if (useAccumulator)
+			point_plot_clear(A->plot);
 	#endif
 #endif
 
@@ -333,19 +332,14 @@ draw_strange(ModeInfo * mi)
 			int mx,my;
 			mx = (short) ( A->Width*0.1 + A->Width*0.8 * (xo - xmin) / (xmax - xmin) );
 			my = (short) ( A->Width*0.1 + (A->Height - A->Width*0.2) * (yo - ymin) / (ymax - ymin) );
-			if (mx>=0 && my>=0 && mx<A->Width && my<A->Height) {
-				A->accMap[mx][my]++;
-			}
+			POINT_PLOT_ADD(A->plot, mx, my);
 #ifdef POINTS_HISTORY
 		/* #define clearOldPoint(i) { if (startedClearing) { field[oldPoints[i].x][oldPoints[i].y]--; } }
 		#define saveUnplot(X,Y) { clearOldPoint(oldPointsIndex) oldPoints[oldPointsIndex].x = X; oldPoints[oldPointsIndex].y = Y; oldPointsIndex = (oldPointsIndex + 1) % numOldPoints; if (oldPointsIndex==0) { startedClearing=1; } }
 		saveUnplot(mx,my) */
 		if (startedClearing) {
-			int oldX = oldPointsX[oldPointsIndex];
-			int oldY = oldPointsY[oldPointsIndex];
-			if (oldX>=0 && oldY>=0 && oldX<A->Width && oldY<A->Height) {
-				A->accMap[oldX][oldY]--;
-			}
+			POINT_PLOT_REMOVE(A->plot, oldPointsX[oldPointsIndex],
+				oldPointsY[oldPointsIndex]);
 		}
 		oldPointsX[oldPointsIndex] = mx;
 		oldPointsY[oldPointsIndex] = my;
@@ -381,49 +375,20 @@ draw_strange(ModeInfo * mi)
 	#ifdef useAccumulator
 	if (useAccumulator) {
 		float colorScale;
-		int col;
 		#ifdef VARY_SPEED_TO_AVOID_BOREDOM
-		int pixelCount = 0;
+		long pixelCount;
 		#endif
 		colorScale = (A->Width*A->Height/640.0/480.0*800000.0/(float)A->Max_Pt*(float)NUM_COLS/256);
-		if (A->dbuf != None) {
-			XSetForeground(display, A->dbuf_gc, 0);
-			XFillRectangle(display, A->dbuf, A->dbuf_gc, 0, 0, A->Width, A->Height);
-		} else {
-			XSetForeground(display, gc, MI_BLACK_PIXEL(mi));
-			XFillRectangle(display, window, gc, 0, 0, A->Width, A->Height);
-		}
-		for (i=0;i<A->Width;i++) {
-			for (j=0;j<A->Height;j++) {
-				if (A->accMap[i][j]>0) {
-					col = (float)A->accMap[i][j] * colorScale;
-					if (col>NUM_COLS-1) {
-						col = NUM_COLS-1;
-					}
-					#ifdef VARY_SPEED_TO_AVOID_BOREDOM
-					if (col>0) {
-						if (col<NUM_COLS-1)  /* we don't count maxxed out pixels */
-							pixelCount++;
-					}
-					#endif
-					if (MI_NPIXELS(mi) < 2)
-						XSetForeground(display, gc, MI_WHITE_PIXEL(mi));
-					else
-						/*XSetForeground(display, gc, MI_PIXEL(mi, A->Col % MI_NPIXELS(mi)));*/
-						XSetForeground(display, gc, cols[col].pixel);
-					if (A->dbuf != None) {
-						XSetForeground(display, A->dbuf_gc, cols[col].pixel);
-						XDrawPoint(display, A->dbuf, A->dbuf_gc, i, j);
-					} else {
-						XSetForeground(display, gc, cols[col].pixel);
-						XDrawPoint(display, window, gc, i, j);
-					}
-				}
-			}
-		}
-		if (A->dbuf != None) {
-			XCopyArea(display, A->dbuf, window, gc, 0, 0, A->Width, A->Height, 0, 0);
-		}
+		/* Color the pixels by how often they were hit, all at once on the
+		   client side, rather than with a protocol request per pixel.
+		   The pixels that are neither the dimmest nor maxed out are the
+		   ones that make it look interesting. */
+		#ifdef VARY_SPEED_TO_AVOID_BOREDOM
+		pixelCount =
+		#endif
+			point_plot_render(A->plot, A->palette, NUM_COLS, colorScale,
+				MI_BLACK_PIXEL(mi));
+		point_plot_put(A->plot, window, gc);
 		#ifdef VARY_SPEED_TO_AVOID_BOREDOM
 			/* Increaase the rate of change of the parameters if the attractor has become visually boring. */
 			if ((xmax - xmin < DBL_To_PRM(.2)) && (ymax - ymin < DBL_To_PRM(.2))) {
@@ -564,13 +529,12 @@ init_strange(ModeInfo * mi)
 #ifndef NO_DBUF
 	if (Attractor->dbuf != None)
 		XFreePixmap(display, Attractor->dbuf);
+	Attractor->dbuf = None;
 #ifdef useAccumulator
-#define colorDepth ( useAccumulator ? MI_DEPTH(mi) : 1 )
-#else
-#define colorDepth 1
+	if (!useAccumulator)	/* that one draws into a point_plot instead */
 #endif
 	Attractor->dbuf = XCreatePixmap(display, window,
-	     Attractor->Width, Attractor->Height, colorDepth);
+	     Attractor->Width, Attractor->Height, 1);
 	/* Allocation checked */
 	if (Attractor->dbuf != None) {
 		XGCValues   gcv;
@@ -607,52 +571,39 @@ init_strange(ModeInfo * mi)
 	#define A Attractor
 	if (useAccumulator) {
 		XWindowAttributes xgwa;
-		int i,j;
+		XColor col;
+		int i;
 		XGetWindowAttributes (display, window, &xgwa);
-		/* cmap = xgwa.colormap; */
-		/* cmap = XCreateColormap(display, window, MI_VISUAL(mi), AllocAll); */
-		Attractor->accMap = (int**)calloc(Attractor->Width,sizeof(int*));
-		for (i=0;i<Attractor->Width;i++) {
-			Attractor->accMap[i] = (int*)calloc(Attractor->Height,sizeof(int));
-			for (j=0;j<Attractor->Height;j++) {
-				Attractor->accMap[i][j] = 0;
-			}
+		if (Attractor->plot != NULL)
+			point_plot_free(Attractor->plot);
+		if ((Attractor->plot = point_plot_create(display, xgwa.visual,
+				xgwa.depth, Attractor->Width, Attractor->Height)) == NULL) {
+			free_strange(display, Attractor);
+			return;
 		}
 #ifdef POINTS_HISTORY
 		numOldPoints = A->Max_Pt * MERGE_FRAMES;
 		oldPointsX = (int*)calloc(numOldPoints,sizeof(int));
 		oldPointsY = (int*)calloc(numOldPoints,sizeof(int));
 #endif
-		cols = (XColor*)calloc(NUM_COLS,sizeof(XColor));
 		for (i=0;i<NUM_COLS;i++) {
 			float li;
 			#define MINBLUE 1
 			#define FULLBLUE 128
 			li = MINBLUE + (255.0-MINBLUE) * log(1.0 + ACC_GAMMA*(float)i/NUM_COLS) / log(1.0 + ACC_GAMMA);
 			if (li<FULLBLUE) {
-				cols[i].red = 0;
-				cols[i].green = 0;
-				cols[i].blue = 65536*li/FULLBLUE;
+				col.red = 0;
+				col.green = 0;
+				col.blue = 65536*li/FULLBLUE;
 			} else {
-				cols[i].red = 65536*(li-FULLBLUE)/(256-FULLBLUE);
-				cols[i].green = 65536*(li-FULLBLUE)/(256-FULLBLUE);
-				cols[i].blue = 65535;
+				col.red = 65536*(li-FULLBLUE)/(256-FULLBLUE);
+				col.green = 65536*(li-FULLBLUE)/(256-FULLBLUE);
+				col.blue = 65535;
 			}
-			XAllocColor (display, xgwa.colormap, &cols[i]);
-			/*
-			if (!XAllocColor(MI_DISPLAY(mi), cmap, &cols[i])) {
-			if (!XAllocColor(display, cmap, &cols[i])) {
-				cols[i].pixel = WhitePixel (display, DefaultScreen (display));
-				cols[i].red = cols[i].green = cols[i].blue = 0xFFFF;
-			}
-			*/
+			col.pixel = MI_WHITE_PIXEL(mi);
+			XAllocColor (display, xgwa.colormap, &col);
+			Attractor->palette[i] = col.pixel;
 		}
-		/*
-		XSetWindowColormap(display, window, cmap);
-		(void) XSetWMColormapWindows(display, window, &window, 1);
-		XInstallColormap(display, cmap);
-		XStoreColors(display, cmap, cols, 256);
-		*/
 	}
 	#undef A
 #endif
@@ -677,14 +628,6 @@ release_strange(ModeInfo * mi)
 	if (Root != NULL) {
 		int         screen;
 
-#ifdef useAccumulator
-		int i;
-		(void) free((void *) cols);
-		for (i=0;i<Root->Width;i++) {
-			(void) free((void *) Root->accMap[i]);
-		}
-		(void) free((void *) Root->accMap);
-#endif
 #ifdef POINTS_HISTORY
 		free(oldPointsX);
 		free(oldPointsY);
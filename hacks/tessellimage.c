@@ -40,6 +40,9 @@ struct state {
   int thresh, dthresh;
   Pixmap cache[256];
 
+  delaunay_mesh *mesh;	/* control points down to threshes[mesh_thresh] */
+  int mesh_thresh;
+
   async_load_state *img_loader;
   XRectangle geom;
   Bool button_down_p;
@@ -210,6 +213,11 @@ flush_cache (struct state *st)
       XFreePixmap (st->dpy, st->deltap);
       st->deltap = 0;
     }
+  if (st->mesh)
+    {
+      delaunay_mesh_free (st->mesh);
+      st->mesh = 0;
+    }
 }
 
 
@@ -429,7 +437,7 @@ typedef struct {
 } voronoi_polygon;
 
 static voronoi_polygon *
-delaunay_to_voronoi (int np, XYZ *p, int nv, ITRIANGLE *v)
+delaunay_to_voronoi (int np, const XYZ *p, int nv, ITRIANGLE *v)
 {
   struct tri_list {
     int count, size;
@@ -585,8 +593,10 @@ tessellate (struct state *st)
     {
       int threshold = st->threshes[st->thresh];
       int vsize = st->vsizes[st->thresh];
+      int above = -1;	/* points over this are already in the mesh */
       ITRIANGLE *v;
-      XYZ *p = 0;
+      const XYZ *p;
+      XYZ *np = 0;
       int nv = 0;
       int ntri = 0;
       int x, y, i;
@@ -597,13 +607,28 @@ tessellate (struct state *st)
 #endif
 
       /* Create a control point at every pixel where the delta is above
-         the current threshold.  Triangulate from those. */
+         the current threshold.  Triangulate from those.  The thresholds
+         go down as thresh goes up, so if the mesh we already have is for
+         a higher threshold, just add the pixels that are new at this one;
+         otherwise start over. */
 
       vsize += 8;  /* corners of screen + corners of image */
 
-      p = (XYZ *) calloc (vsize+4, sizeof(*p));
-      v = (ITRIANGLE *) calloc (3*(vsize+4), sizeof(*v));
-      if (!p || !v)
+      if (st->mesh && st->thresh > st->mesh_thresh)
+        above = st->threshes[st->mesh_thresh];
+      else if (st->mesh)
+        {
+          delaunay_mesh_free (st->mesh);
+          st->mesh = 0;
+        }
+
+      if (! st->mesh)
+        st->mesh = delaunay_mesh_create (0, 0,
+                                         st->delta->width-1,
+                                         st->delta->height-1);
+      np = (XYZ *) calloc (vsize, sizeof(*np));
+      v = (ITRIANGLE *) calloc (2*vsize, sizeof(*v));
+      if (!st->mesh || !np || !v)
         {
           fprintf (stderr, "%s: out of memory (%d)\n", progname, vsize);
           abort();
@@ -615,18 +640,19 @@ tessellate (struct state *st)
       if (st->geom.width  <= 0) st->geom.width  = st->delta->width;
       if (st->geom.height <= 0) st->geom.height = st->delta->height;
 
-      for (y = 0; y <= 1; y++)
-        for (x = 0; x <= 1; x++)
-          {
-            p[nv].x = x ? st->delta->width-1  : 0;
-            p[nv].y = y ? st->delta->height-1 : 0;
-            p[nv].z = XGetPixel (st->delta, (int) p[nv].x, (int) p[nv].y);
-            nv++;
-            p[nv].x = st->geom.x + (x ? st->geom.width-1  : 0);
-            p[nv].y = st->geom.y + (y ? st->geom.height-1 : 0);
-            p[nv].z = XGetPixel (st->delta, (int) p[nv].x, (int) p[nv].y);
-            nv++;
-          }
+      if (above < 0)
+        for (y = 0; y <= 1; y++)
+          for (x = 0; x <= 1; x++)
+            {
+              np[nv].x = x ? st->delta->width-1  : 0;
+              np[nv].y = y ? st->delta->height-1 : 0;
+              np[nv].z = XGetPixel (st->delta, (int) np[nv].x, (int) np[nv].y);
+              nv++;
+              np[nv].x = st->geom.x + (x ? st->geom.width-1  : 0);
+              np[nv].y = st->geom.y + (y ? st->geom.height-1 : 0);
+              np[nv].z = XGetPixel (st->delta, (int) np[nv].x, (int) np[nv].y);
+              nv++;
+            }
 
       /* Add control points for every pixel that exceeds the threshold.
        */
@@ -634,24 +660,27 @@ tessellate (struct state *st)
         for (x = 0; x < st->delta->width; x++)
           {
             unsigned long px = XGetPixel (st->delta, x, y);
-            if (px >= threshold)
+            if (px >= threshold && (above < 0 || px < above))
               {
                 if (nv >= vsize) abort();
-                p[nv].x = x;
-                p[nv].y = y;
-                p[nv].z = px;
+                np[nv].x = x;
+                np[nv].y = y;
+                np[nv].z = px;
                 nv++;
               }
           }
 
-      if (nv != vsize) abort();
-
-      qsort (p, nv, sizeof(*p), delaunay_xyzcompare);
-      if (delaunay (nv, p, v, &ntri))
+      if (delaunay_mesh_add (st->mesh, nv, np))
         {
           fprintf (stderr, "%s: out of memory\n", progname);
           abort();
         }
+      free (np);
+      st->mesh_thresh = st->thresh;
+
+      p = delaunay_mesh_points (st->mesh, &nv);
+      if (nv != vsize) abort();
+      ntri = delaunay_mesh_triangles (st->mesh, v);
 
       /* Create the output pixmap based on that triangulation. */
 
@@ -741,7 +770,6 @@ tessellate (struct state *st)
         }
 #endif /* !DO_VORONOI */
 
-      free (p);
       free (v);
 
       if (st->cache_p && !st->cache[st->thresh])
@@ -16,9 +16,7 @@
 #include <math.h>
 #include "screenhack.h"
 
-#ifdef HAVE_XSHM_EXTENSION
-#include "xshm.h"
-#endif
+#include "parallel_image.h"
 
 #define FLOAT double
 
@@ -62,6 +60,7 @@ struct state {
   Screen *screen;       	   /* the screen to draw on */
   XImage *sourceImage;  	   /* image source of stuff to draw */
   XImage *workImage;    	   /* work area image, used when rendering */
+  parallel_image *pimage;	   /* owns workImage, and renders in bands */
 
   GC backgroundGC;        	 /* GC for the background color */
   GC foregroundGC;        	 /* GC for the foreground color */
@@ -81,9 +80,6 @@ struct state {
   Pixmap pm;
 
   Bool useShm;		/* whether or not to use xshm */
-#ifdef HAVE_XSHM_EXTENSION
-  XShmSegmentInfo shmInfo;
-#endif
 };
 
 
@@ -131,28 +127,18 @@ grabImage_done (struct state *st)
                                  st->windowWidth, st->windowHeight,
 			     ~0L, ZPixmap);
 
-    if (st->workImage) XDestroyImage (st->workImage);
-    st->workImage = NULL;
-
-#ifdef HAVE_XSHM_EXTENSION
-    if (st->useShm) 
+    if (!st->pimage)
     {
-	st->workImage = create_xshm_image (st->dpy, xwa.visual, xwa.depth,
-				       ZPixmap, 0, &st->shmInfo, 
-				       st->windowWidth, st->windowHeight);
-	if (!st->workImage) 
+	st->pimage = parallel_image_create (st->dpy, xwa.visual, xwa.depth,
+					    st->windowWidth, st->windowHeight,
+					    st->useShm);
+	if (!st->pimage)
 	{
-	    st->useShm = False;
-	    fprintf (stderr, "create_xshm_image failed\n");
+	    fprintf (stderr, "%s: out of memory\n", progname);
+	    exit (1);
 	}
+	st->workImage = st->pimage->image;
     }
-
-    if (st->workImage == NULL)
-#endif /* HAVE_XSHM_EXTENSION */
-
-	/* just use XSubImage to acquire the right visual, depth, etc;
-	 * easier than the other alternatives */
-	st->workImage = XSubImage (st->sourceImage, 0, 0, st->windowWidth, st->windowHeight);
 }
 
 /* set up the system */
@@ -455,8 +441,8 @@ static void sortTiles (struct state *st)
     qsort (st->sortedTiles, st->tileCount, sizeof (Tile *), sortTilesComparator);
 }
 
-/* render the given tile */
-static void renderTile (struct state *st, Tile *t)
+/* render the rows [y0, y1) of the given tile */
+static void renderTile (struct state *st, Tile *t, int y0, int y1)
 {
     /* note: the zoom as stored per tile is log-based (centered on 0, with
      * 0 being no zoom, but the range for zoom-as-drawn is 0.4..2.5,
@@ -485,8 +471,8 @@ static void renderTile (struct state *st, Tile *t)
 
     if (minX < 0) minX = 0;
     if (maxX > st->windowWidth) maxX = st->windowWidth;
-    if (minY < 0) minY = 0;
-    if (maxY > st->windowHeight) maxY = st->windowHeight;
+    if (minY < y0) minY = y0;
+    if (maxY > y1) maxY = y1;
 
     sinAng /= zoom;
     cosAng /= zoom;
@@ -521,30 +507,32 @@ static void renderTile (struct state *st, Tile *t)
     }
 }
 
-/* render and display the current model */
-static void renderFrame (struct state *st)
+/* render the rows [y0, y1) of the current model; every band draws all
+ * of the tiles, in the same order, clipped to its own rows */
+static void renderBand (void *closure, int y0, int y1)
 {
+    struct state *st = (struct state *) closure;
     int n;
 
     /* This assumes black is zero. */
-    memset (st->workImage->data, 0, 
-	    st->workImage->bytes_per_line * st->workImage->height);
-
-    sortTiles (st);
+    memset (st->workImage->data + y0 * st->workImage->bytes_per_line, 0,
+	    st->workImage->bytes_per_line * (y1 - y0));
 
     for (n = 0; n < st->tileCount; n++)
     {
-	renderTile (st, st->sortedTiles[n]);
+	renderTile (st, st->sortedTiles[n], y0, y1);
     }
+}
 
-#ifdef HAVE_XSHM_EXTENSION
-    if (st->useShm)
-	XShmPutImage (st->dpy, st->window, st->backgroundGC, st->workImage, 0, 0, 0, 0,
-		      st->windowWidth, st->windowHeight, False);
-    else
-#endif /* HAVE_XSHM_EXTENSION */
-	XPutImage (st->dpy, st->window, st->backgroundGC, st->workImage, 
-		   0, 0, 0, 0, st->windowWidth, st->windowHeight);
+/* render and display the current model */
+static void renderFrame (struct state *st)
+{
+    sortTiles (st);
+
+    parallel_image_run (st->pimage, st->windowHeight, renderBand, st);
+
+    parallel_image_put (st->pimage, st->window, st->backgroundGC,
+			0, 0, 0, 0, st->windowWidth, st->windowHeight);
 }
 
 /* set up the model */
@@ -656,6 +644,7 @@ twang_free (Display *dpy, Window window, void *closure)
 {
   struct state *st = (struct state *) closure;
   if (st->pm) XFreePixmap (dpy, st->pm);
+  if (st->pimage) parallel_image_free (st->pimage);
   free (st);
 }
 
@@ -734,9 +723,7 @@ static void initParams (struct state *st)
 	problems = 1;
     }
 
-#ifdef HAVE_XSHM_EXTENSION
     st->useShm = get_boolean_resource (st->dpy, "useSHM", "Boolean");
-#endif
 
     if (problems)
     {
@@ -782,6 +769,7 @@ static const char *twang_defaults [] = {
   "*ignoreRotation: True",
   "*rotateImages:   True",
 #endif
+    THREAD_DEFAULTS
     0
 };
 
@@ -799,6 +787,7 @@ static XrmOptionDescRec twang_options [] = {
   { "-transference",     ".transference",   XrmoptionSepArg, 0 },
   { "-shm",              ".useSHM",         XrmoptionNoArg, "True" },
   { "-no-shm",           ".useSHM",         XrmoptionNoArg, "False" },
+  THREAD_OPTIONS
   { 0, 0, 0, 0 }
 };
 
@@ -75,7 +75,7 @@ struct state {
   Bool            bloom;
   XImage          *xim;
 #ifdef HAVE_XSHM_EXTENSION
-  XShmSegmentInfo shminfo;
+  xshm_ring       *ring;	/* xim is whichever of these is current */
 #endif /* HAVE_XSHM_EXTENSION */
   GC              gc;
   int             ctab[256];
@@ -125,14 +125,24 @@ MakeImage(struct state *st)
 {
   XGCValues gcv;
 
-  /* #### This probably leaks SHM every time the window is resized. */
+#ifdef HAVE_XSHM_EXTENSION
+  if (st->ring)
+    {
+      destroy_xshm_ring (st->dpy, st->ring);
+      st->xim = 0;
+    }
+#endif /* HAVE_XSHM_EXTENSION */
+
   if (st->xim)
     XDestroyImage (st->xim);
 
 #ifdef HAVE_XSHM_EXTENSION
+  /* Render each frame into the next image of the ring, so that we don't
+     scribble on the one that the server may still be reading. */
   st->shared = True;
-  st->xim = create_xshm_image (st->dpy, st->visual, st->depth, ZPixmap, NULL,
-                           &st->shminfo, st->width, st->height);
+  st->ring = create_xshm_ring (st->dpy, st->visual, st->depth, ZPixmap,
+                               st->width, st->height, 3);
+  st->xim = (st->ring ? xshm_ring_image (st->dpy, st->ring) : 0);
 #else  /* !HAVE_XSHM_EXTENSION */
   st->xim = 0;
 #endif /* !HAVE_XSHM_EXTENSION */
@@ -205,8 +215,9 @@ DisplayImage(struct state *st)
 {
 #ifdef HAVE_XSHM_EXTENSION
   if (st->shared)
-    XShmPutImage(st->dpy, st->window, st->gc, st->xim, 0,(st->top - 1) << 1, 0,
-                 (st->top - 1) << 1, st->width, st->height - ((st->top - 1) << 1), False);
+    xshm_ring_put(st->dpy, st->ring, st->window, st->gc, 0,(st->top - 1) << 1,
+                  0, (st->top - 1) << 1, st->width,
+                  st->height - ((st->top - 1) << 1));
   else
 #endif /* HAVE_XSHM_EXTENSION */
     XPutImage(st->dpy, st->window, st->gc, st->xim, 0, (st->top - 1) << 1, 0,
@@ -745,6 +756,10 @@ xflame_draw (Display *dpy, Window win, void *closure)
                    st->fheight - st->theimy - st->baseline, st->theimx, st->theimy);
 
   FlameAdvance(st);
+#ifdef HAVE_XSHM_EXTENSION
+  if (st->shared)
+    st->xim = xshm_ring_image(st->dpy, st->ring);
+#endif /* HAVE_XSHM_EXTENSION */
   Flame2Image(st);
   DisplayImage(st);
 
@@ -54,8 +54,8 @@ xlockmore_setup (struct xscreensaver_function_table *xsft, void *arg)
   const char *xlockmore_defaults;
   ModeSpecOpt *xlockmore_opts = xlmft->opts;
 
-# undef ya_rand_init
-  ya_rand_init (0);
+  /* Don't seed the RNG here: screenhack.c does that once the command line
+     has been parsed, so that "-seed" and "-benchmark" can pin it. */
 
   xsft->init_cb    = (void *(*) (Display *, Window)) xlockmore_init;
   xsft->draw_cb    = xlockmore_draw;
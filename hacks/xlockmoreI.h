@@ -59,6 +59,7 @@ typedef struct ModeInfo ModeInfo;
 
 
   extern GLXContext *init_GL (ModeInfo *);
+  extern unsigned long gl_context_generation;
   extern void xlockmore_reset_gl_state(void);
   extern void clear_gl_error (void);
   extern void check_gl_error (const char *type);
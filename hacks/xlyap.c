@@ -39,6 +39,7 @@
 #include "screenhack.h"
 #include "yarandom.h"
 #include "hsv.h"
+#include "parallel_image.h"
 
 #undef countof
 #define countof(x) (sizeof((x))/sizeof((*x)))
@@ -78,9 +79,13 @@ static const char *xlyap_defaults [] = {
   "*delay:              10000",
   "*linger:             5",
   "*colors:             200",
+#ifdef HAVE_XSHM_EXTENSION
+  "*useSHM:             True",
+#endif
 #ifdef HAVE_MOBILE
   "*ignoreRotation:     True",
 #endif
+  THREAD_DEFAULTS
   0
 };
 
@@ -110,6 +115,11 @@ static XrmOptionDescRec xlyap_options [] = {
   { "-w", ".aRange",            XrmoptionSepArg, 0 },   /* r */
   { "-delay", ".delay",         XrmoptionSepArg, 0 },   /* delay */
   { "-linger", ".linger",       XrmoptionSepArg, 0 },   /* linger */
+#ifdef HAVE_XSHM_EXTENSION
+  { "-shm",    ".useSHM",       XrmoptionNoArg, "True" },
+  { "-no-shm", ".useSHM",       XrmoptionNoArg, "False" },
+#endif
+  THREAD_OPTIONS
   { 0, 0, 0, 0 }
 };
 
@@ -119,7 +129,6 @@ static XrmOptionDescRec xlyap_options [] = {
 #define Max(x,y) ((x > y)?x:y)
 
 #ifdef SIXTEEN_COLORS
-# define MAXPOINTS  128
 # ifdef BIGMEM
 #  define MAXFRAMES 4
 # else  /* !BIGMEM */
@@ -127,7 +136,6 @@ static XrmOptionDescRec xlyap_options [] = {
 # endif /* !BIGMEM */
 # define MAXCOLOR 16
 #else  /* !SIXTEEN_COLORS */
-# define MAXPOINTS  256
 # ifdef BIGMEM
 #  define MAXFRAMES 8
 # else  /* !BIGMEM */
@@ -143,6 +151,18 @@ static XrmOptionDescRec xlyap_options [] = {
 #define NUMMAPS 5
 #define NBUILTINS 22
 
+/* The picture is computed in TILE_SIZE squares, a batch of them per frame,
+ * and the batch is split among the threads.  The tiles are visited
+ * several times: the first pass computes one exponent per START_STEP
+ * square block of pixels and paints the whole block with it, and each
+ * pass after that halves the block size, only computing the pixels that
+ * the passes before it didn't.  So a blocky version of the picture shows
+ * up quickly, and then sharpens.
+ */
+#define TILE_SIZE 32
+#define START_STEP 8
+#define BATCH_EXPONENTS 1024    /* per thread per frame, roughly */
+
 #ifndef TRUE
 # define TRUE 1
 # define FALSE 0
@@ -168,11 +188,6 @@ typedef struct {
 /*  rubber_band_data_t rubber_band;*/
 } image_data_t;
 
-typedef struct points_t {
-  XPoint data[MAXCOLOR][MAXPOINTS];
-  int npoints[MAXCOLOR];
-} points_t;
-
 
 typedef double (*PFD)(double,double);
 
@@ -196,10 +211,12 @@ struct state {
   int dwell, settle;
   int width, height, xposition, yposition;
 
-  points_t Points;
 /*  image_data_t rubber_data;*/
 
-  GC Data_GC[MAXCOLOR]/*, RubberGC*/;
+  GC gc/*, RubberGC*/;
+  int depth;
+  parallel_image *pimage;
+  unsigned long pixels[MAXCOLOR];
   PFD map, deriv;
 
   int aflag, bflag, wflag, hflag, Rflag;
@@ -208,9 +225,9 @@ struct state {
   int   funcmaxindex;
   double  min_a, min_b, a_range, b_range, minlyap;
   double  max_a, max_b;
-  double  start_x, lyapunov, a_inc, b_inc, a, b;
+  double  start_x, a_inc, b_inc;
   int   numcolors, numfreecols, lowrange;
-  xy_t  point;
+  int   tiles_x, ntiles, tile, step;    /* progress of the current picture */
 #ifdef BACKING_PIXMAP
   Pixmap  pixmap;
 #endif
@@ -220,14 +237,13 @@ struct state {
   double  a_maximums[MAXFRAMES], b_maximums[MAXFRAMES];
   double  minexp, maxexp, prob;
   int     expind[MAXFRAMES], resized[MAXFRAMES];
+  int     done[MAXFRAMES];      /* finished at full resolution */
   int     numwheels, force, Force, negative;
   int     rgb_max, nostart, stripe_interval;
-  int     save, show, useprod, spinlength;
+  int     show, useprod, spinlength;
   int     maxframe, frame, dorecalc, mapindex, run;
   char    *outname;
 
-  int sendpoint_index;
-
   int   forcing[MAXINDEX];
   int   Forcing[FUNCMAXINDEX];
 
@@ -279,19 +295,20 @@ static void show_defaults(struct state *);
 static void TrackRubberBand(struct state *, image_data_t *, XEvent *);
 static void EndRubberBand(struct state *, image_data_t *, XEvent *);*/
 /*static void CreateXorGC(struct state *);*/
-static void InitBuffer(struct state *);
-static void BufferPoint(struct state *, int color, int x, int y);
-static void FlushBuffer(struct state *);
 static void init_data(struct state *);
 static void init_color(struct state *);
 static void parseargs(struct state *);
 static void Clear(struct state *);
 static void setupmem(struct state *);
-static int complyap(struct state *);
+static double complyap(const struct state *, double a, double b,
+                       unsigned int *seed);
+static Bool complyap_batch(struct state *);
 static Bool Getkey(struct state *, XKeyEvent *);
-static int sendpoint(struct state *, double expo);
+static int lyapcolor(const struct state *, double expo);
+static void put_image(struct state *, int x, int y, int w, int h);
 /*static void save_to_file(struct state *);*/
-static void setforcing(struct state *);
+static void setforcing(const struct state *, int *forcing,
+                       unsigned int *seed);
 static void check_params(struct state *, int mapnum, int parnum);
 static void usage(struct state *);
 static void Destroy_frame(struct state *);
@@ -317,40 +334,25 @@ static void print_values(struct state *);
  * calculate the logarithm of the absolute value of the derivative at that
  * point. Then average them over some large number of iterations. Some small
  * speed up is achieved by utilizing the fact that log(a*b) = log(a) + log(b).
+ * This computes the exponent at one point (a,b) of the parameter space.
  */
-static int
-complyap(struct state *st)
+static double
+complyap(const struct state *st, double a, double b, unsigned int *seed)
 {
   int i, bindex;
   double total, prod, x, dx, r;
+  int forcing[MAXINDEX];
+  const int *force = st->forcing;
 
-  if (st->maxcolor > MAXCOLOR)
-    abort();
-
-  if (!st->run)
-    return TRUE;
-  st->a += st->a_inc;
-  if (st->a >= st->max_a) {
-    if (sendpoint(st, st->lyapunov) == TRUE)
-      return FALSE;
-    else {
-      FlushBuffer(st);
-      /*      if (savefile)
-              save_to_file(); */
-      return TRUE;
-    }
-  }
-  if (st->b >= st->max_b) {
-    FlushBuffer(st);
-    /*    if (savefile)
-          save_to_file();*/
-    return TRUE;
+  if (st->Rflag) {      /* Each point gets its own random forcing. */
+    setforcing(st, forcing, seed);
+    force = forcing;
   }
   prod = 1.0;
   total = 0.0;
   bindex = 0;
   x = st->start_x;
-  r = (st->forcing[bindex]) ? st->b : st->a;
+  r = (force[bindex]) ? b : a;
 #ifdef MAPS
   findex = 0;
   map = Maps[st->Forcing[findex]];
@@ -360,9 +362,9 @@ complyap(struct state *st)
     if (++bindex >= st->maxindex) { /* some initial "noise" in the */
       bindex = 0;    /* iterations. How can we optimize */
       if (st->Rflag)      /* the value of settle ??? */
-        setforcing(st);
+        setforcing(st, forcing, seed);
     }
-    r = (st->forcing[bindex]) ? st->b : st->a;
+    r = (force[bindex]) ? b : a;
 #ifdef MAPS
     if (++findex >= funcmaxindex)
       findex = 0;
@@ -391,9 +393,9 @@ complyap(struct state *st)
       if (++bindex >= st->maxindex) {
         bindex = 0;
         if (st->Rflag)
-          setforcing(st);
+          setforcing(st, forcing, seed);
       }
-      r = (st->forcing[bindex]) ? st->b : st->a;
+      r = (force[bindex]) ? b : a;
 #ifdef MAPS
       if (++findex >= funcmaxindex)
         findex = 0;
@@ -402,7 +404,6 @@ complyap(struct state *st)
 #endif
     }
     total += log(prod);
-    st->lyapunov = (total * M_LOG2E) / (double)i;   
   }
   else {        /* use log(a) + log(b) */
     for (i=0;i<st->dwell;i++) {
@@ -418,9 +419,9 @@ complyap(struct state *st)
       if (++bindex >= st->maxindex) {
         bindex = 0;
         if (st->Rflag)
-          setforcing(st);
+          setforcing(st, forcing, seed);
       }
-      r = (st->forcing[bindex]) ? st->b : st->a;
+      r = (force[bindex]) ? b : a;
 #ifdef MAPS
       if (++findex >= funcmaxindex)
         findex = 0;
@@ -428,17 +429,98 @@ complyap(struct state *st)
       deriv = Derivs[st->Forcing[findex]];
 #endif
     }
-    st->lyapunov = (total * M_LOG2E) / (double)i;
   }
+  return (total * M_LOG2E) / (double)i;
+}
 
-  if (sendpoint(st, st->lyapunov) == TRUE)
-    return FALSE;
-  else {
-    FlushBuffer(st);
-    /*    if (savefile)
-          save_to_file();*/
+/* Computes the tiles [st->tile + t0, st->tile + t1) of the current pass.
+ * This runs on several threads at once, so it only writes to its own
+ * tiles of the exponent array and the image.
+ */
+static void
+complyap_tiles(void *closure, int t0, int t1)
+{
+  struct state *st = (struct state *) closure;
+  XImage *image = st->pimage->image;
+  double *exps = st->exponents[st->frame];
+  int step = st->step;
+  int t;
+
+  for (t = st->tile + t0; t < st->tile + t1; t++) {
+    int x0 = (t % st->tiles_x) * TILE_SIZE;
+    int y0 = (t / st->tiles_x) * TILE_SIZE;
+    int x1 = Min(x0 + TILE_SIZE, st->width);
+    int y1 = Min(y0 + TILE_SIZE, st->height);
+    int x, y, bx, by;
+    for (y = y0; y < y1; y += step)
+      for (x = x0; x < x1; x += step) {
+        unsigned int seed;
+        double expo;
+        unsigned long pixel;
+        /* The corners of the bigger blocks were done by the last pass. */
+        if (step < START_STEP && !(x & step) && !(y & step))
+          continue;
+        seed = y * st->width + x + 1;
+        expo = complyap(st, st->min_a + x * st->a_inc,
+                        st->min_b + y * st->b_inc, &seed);
+        pixel = st->pixels[lyapcolor(st, expo)];
+        for (by = y; by < Min(y + step, y1); by++)
+          for (bx = x; bx < Min(x + step, x1); bx++) {
+            exps[by * st->width + bx] = expo;
+            XPutPixel(image, bx, by, pixel);
+          }
+      }
+  }
+}
+
+/* Computes and shows the next batch of tiles.  Returns TRUE when the
+ * picture is finished.
+ */
+static Bool
+complyap_batch(struct state *st)
+{
+  int per_tile, n, t;
+
+  if (st->maxcolor > MAXCOLOR)
+    abort();
+
+  if (!st->run || !st->step)
     return TRUE;
+
+  per_tile = (TILE_SIZE / st->step) * (TILE_SIZE / st->step);
+  n = st->pimage->threadpool.count * Max(1, BATCH_EXPONENTS / per_tile);
+  n = Min(n, st->ntiles - st->tile);
+  parallel_image_run(st->pimage, n, complyap_tiles, st);
+
+  /* Runs of tiles along the same row go out as one rectangle. */
+  for (t = st->tile; t < st->tile + n; ) {
+    int row = t / st->tiles_x;
+    int end = t + 1;
+    int x0, x1, y0, y1;
+    while (end < st->tile + n && end / st->tiles_x == row)
+      end++;
+    x0 = (t % st->tiles_x) * TILE_SIZE;
+    x1 = Min(((end - 1) % st->tiles_x + 1) * TILE_SIZE, st->width);
+    y0 = row * TILE_SIZE;
+    y1 = Min(y0 + TILE_SIZE, st->height);
+    put_image(st, x0, y0, x1 - x0, y1 - y0);
+    t = end;
+  }
+  st->tile += n;
+
+  /* Once the first pass is past a row, it has an exponent for every pixel
+     of that row, so redraw() can use them. */
+  if (st->step == START_STEP)
+    st->expind[st->frame] =
+      Min((st->tile / st->tiles_x) * TILE_SIZE, st->height) * st->width;
+
+  if (st->tile >= st->ntiles) {
+    st->tile = 0;
+    st->step /= 2;
+    if (st->step == 0)
+      st->done[st->frame] = 1;
   }
+  return (st->step == 0);
 }
 
 static double
@@ -522,15 +604,13 @@ init_data(struct state *st)
   st->lowrange = st->mincolindex - st->startcolor;
   st->a_inc = st->a_range / (double)st->width;
   st->b_inc = st->b_range / (double)st->height;
-  st->point.x = -1;
-  st->point.y = 0;
-  st->a = /*st->rubber_data.p_min = */st->min_a;
-  st->b = /*st->rubber_data.q_min = */st->min_b;
-/*  st->rubber_data.p_max = st->max_a;
+/*  st->rubber_data.p_min = st->min_a;
+  st->rubber_data.q_min = st->min_b;
+  st->rubber_data.p_max = st->max_a;
   st->rubber_data.q_max = st->max_b;*/
   if (st->show)
     show_defaults(st);
-  InitBuffer(st);
+  Redraw(st);
 }
 
 #if 0
@@ -561,14 +641,12 @@ init_color(struct state *st)
                        st->colors, &st->ncolors, True, NULL, True);
 
   for (i = 0; i < st->maxcolor; i++) {
-    if (! st->Data_GC[i]) {
-      XGCValues gcv;
-      gcv.background = BlackPixelOfScreen(st->screen);
-      st->Data_GC[i] = XCreateGC(st->dpy, st->canvas, GCBackground, &gcv);
-    }
-    XSetForeground(st->dpy, st->Data_GC[i],
-                   st->colors[((int) ((i / ((float)st->maxcolor)) *
-                                      st->ncolors))].pixel);
+    if (st->ncolors > 0)
+      st->pixels[i] = st->colors[((int) ((i / ((float)st->maxcolor)) *
+                                         st->ncolors))].pixel;
+    else
+      st->pixels[i] = (i ? WhitePixelOfScreen(st->screen)
+                       : BlackPixelOfScreen(st->screen));
   }
 }
 
@@ -621,7 +699,7 @@ parseargs(struct state *st)
 
   s = get_string_resource(st->dpy, "randomForce", "Float");
   if (s && *s) {
-    st->prob=atof(s); st->Rflag++; setforcing(st);
+    st->prob=atof(s); st->Rflag++;
   }
 
   st->settle = get_integer_resource(st->dpy, "settle", "Integer");
@@ -838,9 +916,8 @@ Getkey(struct state *st, XKeyEvent *event)
     case '[': st->settle /= 2; if (st->settle < 1) st->settle = 1; return True;
     case ']': st->settle *= 2; return True;
     case 'd': go_down(st); return True;
-    case 'D': FlushBuffer(st); return True;
     case 'e':
-    case 'E': FlushBuffer(st);
+    case 'E':
       st->dorecalc = (!st->dorecalc);
       if (st->dorecalc)
         recalc(st);
@@ -890,13 +967,12 @@ Getkey(struct state *st, XKeyEvent *event)
       st->a_maximums[0] = st->max_a; st->b_maximums[0] = st->max_b;
       st->a_inc = st->a_range / (double)st->width;
       st->b_inc = st->b_range / (double)st->height;
-      st->point.x = -1;
-      st->point.y = 0;
-      st->a = /*st->rubber_data.p_min = */st->min_a;
-      st->b = /*st->rubber_data.q_min = */st->min_b;
-/*      st->rubber_data.p_max = st->max_a;
+/*      st->rubber_data.p_min = st->min_a;
+      st->rubber_data.q_min = st->min_b;
+      st->rubber_data.p_max = st->max_a;
       st->rubber_data.q_max = st->max_b;*/
       Clear(st);
+      Redraw(st);
       return True;
     case 'M': if (st->minlyap > 0.005)
         st->minlyap -= 0.005;
@@ -905,13 +981,11 @@ Getkey(struct state *st, XKeyEvent *event)
       return True;
     case 'p':
     case 'P': st->negative = (!st->negative);
-      FlushBuffer(st); redraw(st, st->exponents[st->frame], 
-                              st->expind[st->frame], 1);
+      redraw(st, st->exponents[st->frame], st->expind[st->frame], 1);
       return True;
-    case 'r': FlushBuffer(st); redraw(st, st->exponents[st->frame], 
-                                      st->expind[st->frame], 1);
+    case 'r': redraw(st, st->exponents[st->frame], st->expind[st->frame], 1);
       return True;
-    case 'R': FlushBuffer(st); Redraw(st); return True;
+    case 'R': Redraw(st); return True;
     case 's':
       st->spinlength=st->spinlength/2;
 #if 0
@@ -976,9 +1050,10 @@ Getkey(struct state *st, XKeyEvent *event)
  * also greatly effect what details are seen. Play around with this.
  */
 static int
-sendpoint(struct state *st, double expo)
+lyapcolor(const struct state *st, double expo)
 {
   double tmpexpo;
+  int index;
 
   if (st->maxcolor > MAXCOLOR)
     abort();
@@ -992,47 +1067,32 @@ sendpoint(struct state *st, double expo)
     expo = maxexp;
 #endif
 
-  st->point.x++;
   tmpexpo = (st->negative) ? expo : -1.0 * expo;
   if (tmpexpo > 0) {
     if (!mono_p) {
-      st->sendpoint_index = (int)(tmpexpo*st->lowrange/st->maxexp);
-      st->sendpoint_index = ((st->sendpoint_index % st->lowrange) + 
-                             st->startcolor);
+      index = (int)(tmpexpo*st->lowrange/st->maxexp);
+      index = ((index % st->lowrange) + st->startcolor);
     }
     else
-      st->sendpoint_index = 0;
+      index = 0;
   }
   else {
     if (!mono_p) {
-      st->sendpoint_index = (int)(tmpexpo*st->numfreecols/st->minexp);
-      st->sendpoint_index = ((st->sendpoint_index % st->numfreecols)
-                             + st->mincolindex);
+      index = (int)(tmpexpo*st->numfreecols/st->minexp);
+      index = ((index % st->numfreecols) + st->mincolindex);
     }
     else
-      st->sendpoint_index = 1;
+      index = 1;
   }
-  BufferPoint(st, st->sendpoint_index, st->point.x, st->point.y);
-  if (st->save) {
-    if (st->frame > MAXFRAMES)
-      abort();
-    st->exponents[st->frame][st->expind[st->frame]++] = expo;
-  }
-  if (st->point.x >= st->width) {
-    st->point.y++;
-    st->point.x = 0;
-    if (st->save) {
-      st->b += st->b_inc;
-      st->a = st->min_a;
-    }
-    if (st->point.y >= st->height)
-      return FALSE;
-    else
-      return TRUE;
-  }
-  return TRUE;
-}
 
+  /* Guard against bogus color values. Shouldn't be necessary but paranoia
+     is good. */
+  if (index < 0)
+    index = 0;
+  else if (index >= st->maxcolor)
+    index = st->maxcolor - 1;
+  return index;
+}
 
 static void
 resize(struct state *st)
@@ -1045,6 +1105,7 @@ resize(struct state *st)
   if ((new_w == st->width) && (new_h == st->height))
     return;
   st->width = new_w; st->height = new_h;
+  st->depth = d;
   XClearWindow(st->dpy, st->canvas);
 #ifdef BACKING_PIXMAP
   if (st->pixmap)
@@ -1053,61 +1114,58 @@ resize(struct state *st)
 #endif
   st->a_inc = st->a_range / (double)st->width;
   st->b_inc = st->b_range / (double)st->height;
-  st->point.x = -1;
-  st->point.y = 0;
-  st->run = 1;
-  st->a = /*st->rubber_data.p_min = */st->min_a;
-  st->b = /*st->rubber_data.q_min = */st->min_b;
-/*  st->rubber_data.p_max = st->max_a;
+/*  st->rubber_data.p_min = st->min_a;
+  st->rubber_data.q_min = st->min_b;
+  st->rubber_data.p_max = st->max_a;
   st->rubber_data.q_max = st->max_b;*/
   freemem(st);
   setupmem(st);
   for (n=0;n<MAXFRAMES;n++)
     if ((n <= st->maxframe) && (n != st->frame))
       st->resized[n] = 1;
-  InitBuffer(st);
   Clear(st);
   Redraw(st);
 }
 
+/* Recolors the first `index' pixels of the picture from their saved
+ * exponents.  If cont is false, the picture in exparray is the one being
+ * shown now: it is left alone if it was finished, and otherwise computed
+ * again.
+ */
 static void
 redraw(struct state *st, double *exparray, int index, int cont)
 {
-  int i, x_sav, y_sav;
-
-  x_sav = st->point.x;
-  y_sav = st->point.y;
-
-  st->point.x = -1;
-  st->point.y = 0;
+  XImage *image = st->pimage->image;
+  int rows = Min(index / st->width, st->height);
+  int x, y;
 
-  st->save=0;
-  for (i=0;i<index;i++)
-    sendpoint(st, exparray[i]);
-  st->save=1;
+  for (y = 0; y < rows; y++)
+    for (x = 0; x < st->width; x++)
+      XPutPixel(image, x, y,
+                st->pixels[lyapcolor(st, exparray[y * st->width + x])]);
+  if (rows > 0)
+    put_image(st, 0, 0, st->width, rows);
 
-  if (cont) {
-    st->point.x = x_sav;
-    st->point.y = y_sav;
-  }
-  else {
-    st->a = st->point.x * st->a_inc + st->min_a;
-    st->b = st->point.y * st->b_inc + st->min_b;
+  if (!cont) {
+    if (st->done[st->frame])
+      st->step = 0;
+    else
+      Redraw(st);
   }
-  FlushBuffer(st);
 }
 
+/* Starts computing the current picture over again. */
 static void
 Redraw(struct state *st)
 {
-  FlushBuffer(st);
-  st->point.x = -1;
-  st->point.y = 0;
+  st->tiles_x = (st->width + TILE_SIZE - 1) / TILE_SIZE;
+  st->ntiles = st->tiles_x * ((st->height + TILE_SIZE - 1) / TILE_SIZE);
+  st->tile = 0;
+  st->step = START_STEP;
   st->run = 1;
-  st->a = st->min_a;
-  st->b = st->min_b;
   st->expind[st->frame] = 0;
   st->resized[st->frame] = 0;
+  st->done[st->frame] = 0;
 }
 
 static void
@@ -1129,10 +1187,9 @@ Clear(struct state *st)
 {
   XClearWindow(st->dpy, st->canvas);
 #ifdef BACKING_PIXMAP
-  XCopyArea(st->dpy, st->canvas, st->pixmap, st->Data_GC[0],
+  XCopyArea(st->dpy, st->canvas, st->pixmap, st->gc,
             0, 0, st->width, st->height, 0, 0);
 #endif
-  InitBuffer(st);
 }
 
 static void
@@ -1256,15 +1313,10 @@ set_new_params(struct state *st, image_data_t *data)
   st->b_minimums[st->frame] = st->min_b = data->q_min;
   st->a_inc = st->a_range / (double)st->width;
   st->b_inc = st->b_range / (double)st->height;
-  st->point.x = -1;
-  st->point.y = 0;
-  st->run = 1;
-  st->a = st->min_a;
-  st->b = st->min_b;
   st->a_maximums[st->frame] = st->max_a = data->p_max;
   st->b_maximums[st->frame] = st->max_b = data->q_max;
-  st->expind[st->frame] = 0;
   Clear(st);
+  Redraw(st);
 }
 #endif
 
@@ -1297,10 +1349,6 @@ jumpwin(struct state *st)
   st->b_range = st->max_b - st->min_b;
   st->a_inc = st->a_range / (double)st->width;
   st->b_inc = st->b_range / (double)st->height;
-  st->point.x = -1;
-  st->point.y = 0;
-  st->a = st->min_a;
-  st->b = st->min_b;
   Clear(st);
   if (st->resized[st->frame])
     Redraw(st);
@@ -1323,6 +1371,7 @@ Destroy_frame(struct state *st)
   for (i=st->frame; i<st->maxframe; i++) {
     st->exponents[st->frame] = st->exponents[st->frame+1];
     st->expind[st->frame] = st->expind[st->frame+1];
+    st->done[st->frame] = st->done[st->frame+1];
     st->a_minimums[st->frame] = st->a_minimums[st->frame+1];
     st->b_minimums[st->frame] = st->b_minimums[st->frame+1];
     st->a_maximums[st->frame] = st->a_maximums[st->frame+1];
@@ -1333,62 +1382,12 @@ Destroy_frame(struct state *st)
 }
 
 static void
-InitBuffer(struct state *st)
-{
-  int i;
-
-  for (i = 0 ; i < st->maxcolor; ++i)
-    st->Points.npoints[i] = 0;
-}
-
-static void
-BufferPoint(struct state *st, int color, int x, int y)
-{
-  if (st->maxcolor > MAXCOLOR)
-    abort();
-
-  /* Guard against bogus color values. Shouldn't be necessary but paranoia
-     is good. */
-  if (color < 0)
-    color = 0;
-  else if (color >= st->maxcolor)
-    color = st->maxcolor - 1;
-
-  if (st->Points.npoints[color] == MAXPOINTS)
-    {
-      XDrawPoints(st->dpy, st->canvas, st->Data_GC[color],
-                  st->Points.data[color], st->Points.npoints[color], 
-                  CoordModeOrigin);
-#ifdef BACKING_PIXMAP
-      XDrawPoints(st->dpy, st->pixmap, st->Data_GC[color],
-                  st->Points.data[color], st->Points.npoints[color], 
-                  CoordModeOrigin);
-#endif
-      st->Points.npoints[color] = 0;
-    }
-  st->Points.data[color][st->Points.npoints[color]].x = x;
-  st->Points.data[color][st->Points.npoints[color]].y = y;
-  ++st->Points.npoints[color];
-}
-
-static void
-FlushBuffer(struct state *st)
+put_image(struct state *st, int x, int y, int w, int h)
 {
-  int color;
-
-  for (color = 0; color < st->maxcolor; ++color)
-    if (st->Points.npoints[color])
-      {
-        XDrawPoints(st->dpy, st->canvas, st->Data_GC[color],
-                    st->Points.data[color], st->Points.npoints[color],
-                    CoordModeOrigin);
+  parallel_image_put(st->pimage, st->canvas, st->gc, x, y, x, y, w, h);
 #ifdef BACKING_PIXMAP
-        XDrawPoints(st->dpy, st->pixmap, st->Data_GC[color],
-                    st->Points.data[color], st->Points.npoints[color],
-                    CoordModeOrigin);
+  parallel_image_put(st->pimage, st->pixmap, st->gc, x, y, x, y, w, h);
 #endif
-        st->Points.npoints[color] = 0;
-      }
 }
 
 static void
@@ -1398,7 +1397,6 @@ print_help(struct state *st)
   printf("Mouse buttons allow rubber-banding of a zoom box\n");
   printf("< halves the 'dwell', > doubles the 'dwell'\n");
   printf("[ halves the 'settle', ] doubles the 'settle'\n");
-  printf("D flushes the drawing buffer\n");
   printf("e or E recalculates color indices\n");
   printf("f or F saves exponents to a file\n");
   printf("h or H or ? displays this message\n");
@@ -1456,6 +1454,9 @@ freemem(struct state *st)
   int i;
   for (i=0;i<MAXFRAMES;i++)
     free(st->exponents[i]);
+  if (st->pimage)
+    parallel_image_free(st->pimage);
+  st->pimage = 0;
 }
 
 static void
@@ -1469,14 +1470,25 @@ setupmem(struct state *st)
       exit(-1);
     }
   }
+  st->pimage = parallel_image_create(st->dpy, st->visual, st->depth,
+                                     st->width, st->height, True);
+  if (!st->pimage) {
+    fprintf(stderr,"Error creating image.\n");
+    exit(-1);
+  }
 }
 
+/* This runs on several threads at once, so it uses its own generator
+ * rather than random().
+ */
 static void
-setforcing(struct state *st)
+setforcing(const struct state *st, int *forcing, unsigned int *seed)
 {
   int i;
-  for (i=0;i<MAXINDEX;i++)
-    st->forcing[i] = (random() > st->prob) ? 0 : 1;
+  for (i=0;i<MAXINDEX;i++) {
+    *seed = *seed * 1103515245 + 12345;
+    forcing[i] = ((*seed >> 1) > st->prob) ? 0 : 1;
+  }
 }
 
 /****************************************************************************/
@@ -1488,6 +1500,7 @@ do_defaults (struct state *st)
 
   memset (st->expind,  0, sizeof(st->expind));
   memset (st->resized, 0, sizeof(st->resized));
+  memset (st->done,    0, sizeof(st->done));
 
   st->aflag = 0;
   st->bflag = 0;
@@ -1530,7 +1543,6 @@ do_defaults (struct state *st)
   st->rgb_max=65000;
   st->nostart=1;
   st->stripe_interval=7;
-  st->save=1;
   st->useprod=1;
   st->spinlength=256;
   st->run=1;
@@ -1788,6 +1800,7 @@ xlyap_init (Display *d, Window window)
   st->visual = xgwa.visual;
   st->screen = xgwa.screen;
   st->cmap = xgwa.colormap;
+  st->depth = xgwa.depth;
 
   do_defaults(st);
   parseargs(st);
@@ -1816,6 +1829,7 @@ xlyap_init (Display *d, Window window)
    * Create the window to display the Lyapunov exponents
    */
   st->canvas = window;
+  st->gc = XCreateGC(st->dpy, window, 0, 0);
   init_color(st);
 
 #ifdef BACKING_PIXMAP
@@ -1838,7 +1852,6 @@ static unsigned long
 xlyap_draw (Display *dpy, Window window, void *closure)
 {
   struct state *st = (struct state *) closure;
-  int i;
 
   if (!st->run && st->reset_countdown) {
     st->reset_countdown--;
@@ -1856,13 +1869,11 @@ xlyap_draw (Display *dpy, Window window, void *closure)
     }
   }
 
-  for (i = 0; i < 1000; i++)
-    if (complyap(st) == TRUE)
-      {
-        st->run = 0;
-        st->reset_countdown = st->linger;
-        break;
-      }
+  if (complyap_batch(st) == TRUE)
+    {
+      st->run = 0;
+      st->reset_countdown = st->linger;
+    }
   return st->delay;
 }
 
@@ -1912,7 +1923,6 @@ xlyap_event (Display *dpy, Window window, void *closure, XEvent *event)
 static void
 xlyap_free (Display *dpy, Window window, void *closure)
 {
-  int i;
   struct state *st = (struct state *) closure;
 
   freemem (st);
@@ -1921,8 +1931,7 @@ xlyap_free (Display *dpy, Window window, void *closure)
   XFreePixmap (st->dpy, st->pixmap);
 #endif
 /*  XFreeGC (st->dpy, st->RubberGC);*/
-  for (i = 0; i < st->maxcolor; i++)
-    XFreeGC (st->dpy, st->Data_GC[i]);
+  XFreeGC (st->dpy, st->gc);
 
   free (st);
 }
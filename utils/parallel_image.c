@@ -0,0 +1,173 @@
+/* xscreensaver, Copyright (c) 2026 Jamie Zawinski <jwz@jwz.org>
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation.  No representations are made about the suitability of this
+ * software for any purpose.  It is provided "as is" without express or
+ * implied warranty.
+ */
+
+/* A full-window XImage rendered in horizontal bands by a threadpool.
+   See parallel_image.h.
+ */
+
+#include "utils.h"
+
+#include "parallel_image.h"
+#include "resources.h"
+#include "visual.h"
+
+struct parallel_image_thread {
+  parallel_image *owner;
+  unsigned id;
+};
+
+
+static int
+parallel_image_thread_create (void *self_raw, struct threadpool *pool,
+                              unsigned id)
+{
+  struct parallel_image_thread *self =
+    (struct parallel_image_thread *) self_raw;
+  self->owner = GET_PARENT_OBJ (parallel_image, threadpool, pool);
+  self->id = id;
+  return 0;
+}
+
+
+static void
+parallel_image_thread_destroy (void *self_raw)
+{
+}
+
+
+static void
+parallel_image_thread_run (void *self_raw)
+{
+  struct parallel_image_thread *self =
+    (struct parallel_image_thread *) self_raw;
+  parallel_image *pi = self->owner;
+  unsigned n = pi->threadpool.count;
+  int y0 = (int) (((long) pi->rows * self->id) / n);
+  int y1 = (int) (((long) pi->rows * (self->id + 1)) / n);
+  if (y1 > y0)
+    pi->kernel (pi->closure, y0, y1);
+}
+
+
+parallel_image *
+parallel_image_create (Display *dpy, Visual *visual, unsigned int depth,
+                       unsigned int width, unsigned int height, Bool shm_p)
+{
+  static const struct threadpool_class cls = {
+    sizeof (struct parallel_image_thread),
+    parallel_image_thread_create,
+    parallel_image_thread_destroy
+  };
+
+  /* Pad each scan line out to a whole number of cache lines, so that
+     the bands written by different threads never share one. */
+  unsigned align = thread_memory_alignment (dpy) * 8 - 1;
+  unsigned bpp = get_bits_per_pixel (dpy, depth);
+  unsigned wbits = (width * bpp + align) & ~align;
+
+  parallel_image *pi = (parallel_image *) calloc (1, sizeof(*pi));
+  if (!pi) return 0;
+  pi->dpy = dpy;
+  pi->width = width;
+  pi->height = height;
+
+# ifdef HAVE_XSHM_EXTENSION
+  if (shm_p)
+    {
+      pi->image = create_xshm_image (dpy, visual, depth, ZPixmap, 0,
+                                     &pi->shm_info, wbits / bpp, height);
+      if (pi->image)
+        pi->shm_p = True;
+    }
+# endif /* HAVE_XSHM_EXTENSION */
+
+  if (!pi->image)
+    {
+      pi->image = XCreateImage (dpy, visual, depth, ZPixmap, 0, 0,
+                                width, height, 8, wbits / 8);
+      if (!pi->image ||
+          thread_malloc ((void **) &pi->image->data, dpy,
+                         pi->image->height * pi->image->bytes_per_line))
+        {
+          if (pi->image)
+            {
+              pi->image->data = 0;
+              XDestroyImage (pi->image);
+            }
+          free (pi);
+          return 0;
+        }
+    }
+
+  memset (pi->image->data, 0, pi->image->height * pi->image->bytes_per_line);
+
+  if (threadpool_create (&pi->threadpool, &cls, dpy,
+                         hardware_concurrency (dpy)))
+    {
+      pi->threadpool.count = 0;  /* See the note in thread_util.h. */
+      parallel_image_free (pi);
+      return 0;
+    }
+
+  return pi;
+}
+
+
+void
+parallel_image_free (parallel_image *pi)
+{
+  if (pi->threadpool.count)
+    threadpool_destroy (&pi->threadpool);
+
+  if (pi->image)
+    {
+# ifdef HAVE_XSHM_EXTENSION
+      if (pi->shm_p)
+        destroy_xshm_image (pi->dpy, pi->image, &pi->shm_info);
+      else
+# endif /* HAVE_XSHM_EXTENSION */
+        {
+          thread_free (pi->image->data);
+          pi->image->data = 0;
+          XDestroyImage (pi->image);
+        }
+    }
+  free (pi);
+}
+
+
+void
+parallel_image_run (parallel_image *pi, int rows,
+                    parallel_image_kernel kernel, void *closure)
+{
+  if (rows <= 0) return;
+  pi->rows = rows;
+  pi->kernel = kernel;
+  pi->closure = closure;
+  threadpool_run (&pi->threadpool, parallel_image_thread_run);
+  threadpool_wait (&pi->threadpool);
+}
+
+
+void
+parallel_image_put (parallel_image *pi, Drawable d, GC gc,
+                    int src_x, int src_y, int dest_x, int dest_y,
+                    unsigned int width, unsigned int height)
+{
+# ifdef HAVE_XSHM_EXTENSION
+  if (pi->shm_p)
+    XShmPutImage (pi->dpy, d, gc, pi->image, src_x, src_y, dest_x, dest_y,
+                  width, height, False);
+  else
+# endif /* HAVE_XSHM_EXTENSION */
+    XPutImage (pi->dpy, d, gc, pi->image, src_x, src_y, dest_x, dest_y,
+               width, height);
+}
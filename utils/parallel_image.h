@@ -0,0 +1,87 @@
+/* xscreensaver, Copyright (c) 2026 Jamie Zawinski <jwz@jwz.org>
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation.  No representations are made about the suitability of this
+ * software for any purpose.  It is provided "as is" without express or
+ * implied warranty.
+ */
+
+/* A full-window XImage that is rendered in horizontal bands, one band per
+   CPU core, using the threadpool from thread_util.h.
+
+   Many hacks compute every pixel of a frame on the client side and then
+   blit the result.  If each row of output depends only on the previous
+   frame (and not on other rows of the frame being drawn), that work can
+   be split up: parallel_image_run() calls a kernel once per thread, each
+   time with a different range of rows, and returns when they are all done.
+
+   The XImage is an XShm image when possible, with a plain XImage as the
+   fallback.  Its rows are padded out to the cache line size, so threads
+   working on adjacent bands never write to the same cache line.  This
+   means that image->bytes_per_line may be larger than it would be for an
+   XImage of the same width created by other means: don't memcpy between
+   the two without checking.
+
+   The kernel must not make any Xlib calls other than XGetPixel and
+   XPutPixel, since Xlib is not thread-safe here.
+ */
+
+#ifndef __XSCREENSAVER_PARALLEL_IMAGE_H__
+#define __XSCREENSAVER_PARALLEL_IMAGE_H__
+
+#include "thread_util.h"
+
+#ifdef HAVE_XSHM_EXTENSION
+# include "xshm.h"
+#endif /* HAVE_XSHM_EXTENSION */
+
+typedef void (*parallel_image_kernel) (void *closure, int y0, int y1);
+
+typedef struct parallel_image {
+  Display *dpy;
+  XImage *image;
+  int width, height;		/* the image may be wider than this */
+
+# ifdef HAVE_XSHM_EXTENSION
+  Bool shm_p;
+  XShmSegmentInfo shm_info;
+# endif /* HAVE_XSHM_EXTENSION */
+
+  struct threadpool threadpool;
+
+  /* The job currently being run by parallel_image_run(). */
+  parallel_image_kernel kernel;
+  void *closure;
+  int rows;
+} parallel_image;
+
+/* Creates a width x height image and a thread per CPU.  If shm_p is true,
+   XShm is tried first (and the "useSHM" resource is honored).
+   Returns 0 if memory could not be allocated.
+ */
+extern parallel_image *parallel_image_create (Display *, Visual *,
+                                              unsigned int depth,
+                                              unsigned int width,
+                                              unsigned int height,
+                                              Bool shm_p);
+extern void parallel_image_free (parallel_image *);
+
+/* Splits [0, rows) into one contiguous band per thread, and calls
+   kernel (closure, y0, y1) for each band in parallel.  `rows' is in
+   whatever units the kernel likes (e.g., the image height, or the height
+   of a half-resolution grid).  Returns when all bands are done.
+ */
+extern void parallel_image_run (parallel_image *, int rows,
+                                parallel_image_kernel, void *closure);
+
+/* Copies a rectangle of the image to the drawable, with XShmPutImage
+   or XPutImage as appropriate.
+ */
+extern void parallel_image_put (parallel_image *, Drawable, GC,
+                                int src_x, int src_y, int dest_x, int dest_y,
+                                unsigned int width, unsigned int height);
+
+#endif /* __XSCREENSAVER_PARALLEL_IMAGE_H__ */
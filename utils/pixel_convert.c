@@ -0,0 +1,540 @@
+/* xscreensaver, Copyright (c) 2026 Jamie Zawinski <jwz@jwz.org>
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation.  No representations are made about the suitability of this
+ * software for any purpose.  It is provided "as is" without express or
+ * implied warranty.
+ */
+
+/* Converting XImage scan lines to packed RGBA or RGB.  See pixel_convert.h.
+
+   The vector versions are chosen at compile time, the same way fireworkx.c
+   does it: SSE2 is always there on x86_64, and NEON on arm64.  (The RGB
+   output on x86 wants SSSE3's byte shuffle, which is only used if the
+   compiler was told it could.)  Every vector loop leaves the ragged end
+   of the row to the scalar code.
+ */
+
+#include "utils.h"
+
+#ifdef HAVE_INTTYPES_H
+# include <inttypes.h>
+#else
+  typedef unsigned int   uint32_t;
+  typedef unsigned short uint16_t;
+#endif
+
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
+#ifdef __SSSE3__
+# include <tmmintrin.h>
+#endif
+/* The NEON loops de-interleave bytes assuming the pixels are stored
+   little-endian, so leave big-endian ARM to the scalar code. */
+#if defined(__ARM_NEON) && !defined(__ARM_BIG_ENDIAN) && \
+    (!defined(__BYTE_ORDER__) || __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+# define PIXCONV_NEON
+# include <arm_neon.h>
+#endif
+
+#include "pixel_convert.h"
+
+
+static Bool
+bigendian (void)
+{
+  union { int i; char c[sizeof(int)]; } u;
+  u.i = 1;
+  return !u.c[0];
+}
+
+
+/* Given a bitmask, returns the position and width of the field.
+ */
+static void
+decode_mask (unsigned long mask, int *pos_ret, int *size_ret)
+{
+  int i;
+  *pos_ret = *size_ret = 0;
+  for (i = 0; i < 32; i++)
+    if (mask & (1L << i))
+      {
+        int j = 0;
+        *pos_ret = i;
+        for (; i < 32; i++, j++)
+          if (! (mask & (1L << i)))
+            break;
+        *size_ret = j;
+        return;
+      }
+}
+
+
+/* Given a value and a field-width of 8 or less, repeats the bits to fill
+   out 8 bits, so that all-ones maps to 0xFF.
+ */
+static unsigned char
+spread_bits (unsigned int value, int width)
+{
+  unsigned int result = 0;
+  int shift = 8 - width;
+  if (width <= 0) return 0;
+  for (; shift > -width; shift -= width)
+    result |= (shift >= 0 ? value << shift : value >> -shift);
+  return result & 0xFF;
+}
+
+
+Bool
+pixel_converter_init (pixel_converter *pc, const XImage *image)
+{
+  unsigned long masks[3];
+  Bool native_p = (image->byte_order == (bigendian() ? MSBFirst : LSBFirst));
+  int i, j;
+
+  masks[0] = image->red_mask;
+  masks[1] = image->green_mask;
+  masks[2] = image->blue_mask;
+
+  memset (pc, 0, sizeof(*pc));
+  if (!masks[0] || !masks[1] || !masks[2])
+    return False;
+
+  for (i = 0; i < 3; i++)
+    {
+      int pos, size;
+      decode_mask (masks[i], &pos, &size);
+      if (size > 8)		/* e.g., 10-10-10: keep the top 8 bits */
+        {
+          pos += size - 8;
+          size = 8;
+        }
+      pc->shift[i] = pos;
+      pc->mask[i] = (1L << size) - 1;
+      for (j = 0; j < 256; j++)
+        pc->spread[i][j] = spread_bits (j & pc->mask[i], size);
+    }
+
+  pc->native_p = native_p;
+  pc->kind = PIXCONV_GENERIC;
+  if (native_p && image->bits_per_pixel == 32 &&
+      masks[0] == 0xFF0000 && masks[1] == 0xFF00 && masks[2] == 0xFF)
+    pc->kind = PIXCONV_XRGB32;
+  else if (native_p && image->bits_per_pixel == 32 &&
+           masks[0] == 0xFF && masks[1] == 0xFF00 && masks[2] == 0xFF0000)
+    pc->kind = PIXCONV_XBGR32;
+  else if (native_p && image->bits_per_pixel == 16 &&
+           masks[0] == 0xF800 && masks[1] == 0x07E0 && masks[2] == 0x001F)
+    pc->kind = PIXCONV_RGB565;
+
+  return True;
+}
+
+
+/* Converts pixels [x, width) of row y.  `bytes' is 3 or 4.
+ */
+static void
+convert_row_scalar (const pixel_converter *pc, const XImage *image, int y,
+                    int x, unsigned char *out, int bytes)
+{
+  const char *row = image->data + y * image->bytes_per_line;
+  int bpp = image->bits_per_pixel;
+  Bool msb = (image->byte_order == MSBFirst);
+
+  out += x * bytes;
+  for (; x < image->width; x++)
+    {
+      unsigned long p;
+
+      if (pc->native_p && bpp == 32)
+        p = ((const uint32_t *) row)[x];
+      else if (pc->native_p && bpp == 16)
+        p = ((const uint16_t *) row)[x];
+      else if (bpp == 8)
+        p = ((const unsigned char *) row)[x];
+      else if (bpp == 24)
+        {
+          const unsigned char *s = (const unsigned char *) row + x * 3;
+          p = (msb
+               ? ((unsigned long) s[0] << 16) | (s[1] << 8) | s[2]
+               : ((unsigned long) s[2] << 16) | (s[1] << 8) | s[0]);
+        }
+      else
+        p = XGetPixel ((XImage *) image, x, y);
+
+      out[0] = pc->spread[0][(p >> pc->shift[0]) & pc->mask[0]];
+      out[1] = pc->spread[1][(p >> pc->shift[1]) & pc->mask[1]];
+      out[2] = pc->spread[2][(p >> pc->shift[2]) & pc->mask[2]];
+      if (bytes == 4)
+        out[3] = 0xFF;
+      out += bytes;
+    }
+}
+
+
+void
+pixel_convert_row_rgba (const pixel_converter *pc, const XImage *image,
+                        int y, unsigned char *out)
+{
+# if defined(__SSE2__) || defined(PIXCONV_NEON)
+  const char *row = image->data + y * image->bytes_per_line;
+# endif
+  int x = 0;
+
+  switch (pc->kind) {
+  case PIXCONV_XRGB32:
+  case PIXCONV_XBGR32:
+    {
+# if defined(__SSE2__)
+      const __m128i lo  = _mm_set1_epi32 (0xFF);
+      const __m128i mid = _mm_set1_epi32 (0xFF00);
+      const __m128i a   = _mm_set1_epi32 ((int) 0xFF000000UL);
+      for (; x + 4 <= image->width; x += 4)
+        {
+          __m128i v = _mm_loadu_si128 ((const __m128i *) (row + x * 4));
+          if (pc->kind == PIXCONV_XRGB32)
+            v = _mm_or_si128 (
+                  _mm_or_si128 (_mm_and_si128 (_mm_srli_epi32 (v, 16), lo),
+                                _mm_and_si128 (v, mid)),
+                  _mm_slli_epi32 (_mm_and_si128 (v, lo), 16));
+          _mm_storeu_si128 ((__m128i *) (out + x * 4), _mm_or_si128 (v, a));
+        }
+# elif defined(PIXCONV_NEON)
+      for (; x + 16 <= image->width; x += 16)
+        {
+          uint8x16x4_t v = vld4q_u8 ((const uint8_t *) row + x * 4);
+          uint8x16x4_t o;
+          if (pc->kind == PIXCONV_XRGB32)	/* B G R x in memory */
+            {
+              o.val[0] = v.val[2];
+              o.val[1] = v.val[1];
+              o.val[2] = v.val[0];
+            }
+          else
+            {
+              o.val[0] = v.val[0];
+              o.val[1] = v.val[1];
+              o.val[2] = v.val[2];
+            }
+          o.val[3] = vdupq_n_u8 (0xFF);
+          vst4q_u8 (out + x * 4, o);
+        }
+# endif
+    }
+    break;
+
+  case PIXCONV_RGB565:
+    {
+# if defined(__SSE2__)
+      const __m128i m6 = _mm_set1_epi16 (0x3F);
+      const __m128i m5 = _mm_set1_epi16 (0x1F);
+      const __m128i a  = _mm_set1_epi16 ((short) 0xFF00);
+      for (; x + 8 <= image->width; x += 8)
+        {
+          __m128i v = _mm_loadu_si128 ((const __m128i *) (row + x * 2));
+          __m128i r = _mm_srli_epi16 (v, 11);
+          __m128i g = _mm_and_si128 (_mm_srli_epi16 (v, 5), m6);
+          __m128i b = _mm_and_si128 (v, m5);
+          __m128i rg, ba;
+          r = _mm_or_si128 (_mm_slli_epi16 (r, 3), _mm_srli_epi16 (r, 2));
+          g = _mm_or_si128 (_mm_slli_epi16 (g, 2), _mm_srli_epi16 (g, 4));
+          b = _mm_or_si128 (_mm_slli_epi16 (b, 3), _mm_srli_epi16 (b, 2));
+          rg = _mm_or_si128 (r, _mm_slli_epi16 (g, 8));
+          ba = _mm_or_si128 (b, a);
+          _mm_storeu_si128 ((__m128i *) (out + x * 4),
+                            _mm_unpacklo_epi16 (rg, ba));
+          _mm_storeu_si128 ((__m128i *) (out + x * 4 + 16),
+                            _mm_unpackhi_epi16 (rg, ba));
+        }
+# endif
+    }
+    break;
+
+  default:
+    break;
+  }
+
+  convert_row_scalar (pc, image, y, x, out, 4);
+}
+
+
+void
+pixel_convert_row_rgb (const pixel_converter *pc, const XImage *image,
+                       int y, unsigned char *out)
+{
+# if defined(__SSSE3__) || defined(PIXCONV_NEON)
+  const char *row = image->data + y * image->bytes_per_line;
+# endif
+  int x = 0;
+
+  if (pc->kind == PIXCONV_XRGB32 || pc->kind == PIXCONV_XBGR32)
+    {
+# if defined(__SSSE3__)
+      const __m128i shuf = (pc->kind == PIXCONV_XRGB32
+                            ? _mm_setr_epi8 (2, 1, 0, 6, 5, 4, 10, 9, 8,
+                                             14, 13, 12, -1, -1, -1, -1)
+                            : _mm_setr_epi8 (0, 1, 2, 4, 5, 6, 8, 9, 10,
+                                             12, 13, 14, -1, -1, -1, -1));
+      /* Each store writes 16 bytes of which 12 are pixels, so stop while
+         there are still two pixels' worth of room past the end. */
+      for (; x + 6 <= image->width; x += 4)
+        {
+          __m128i v = _mm_loadu_si128 ((const __m128i *) (row + x * 4));
+          _mm_storeu_si128 ((__m128i *) (out + x * 3),
+                            _mm_shuffle_epi8 (v, shuf));
+        }
+# elif defined(PIXCONV_NEON)
+      for (; x + 16 <= image->width; x += 16)
+        {
+          uint8x16x4_t v = vld4q_u8 ((const uint8_t *) row + x * 4);
+          uint8x16x3_t o;
+          if (pc->kind == PIXCONV_XRGB32)
+            {
+              o.val[0] = v.val[2];
+              o.val[1] = v.val[1];
+              o.val[2] = v.val[0];
+            }
+          else
+            {
+              o.val[0] = v.val[0];
+              o.val[1] = v.val[1];
+              o.val[2] = v.val[2];
+            }
+          vst3q_u8 (out + x * 3, o);
+        }
+# endif
+    }
+
+  convert_row_scalar (pc, image, y, x, out, 3);
+}
+
+
+#ifdef SELFTEST
+
+/* Checks both converters against XGetPixel for each of the layouts a
+   TrueColor visual is likely to have, at every width up to a few vector
+   lengths (to hit the ragged ends), then times them on a 1080p image.
+
+   Usage: test-pixel-convert [width height]
+ */
+
+#include <sys/time.h>
+
+#undef countof
+#define countof(x) (sizeof((x))/sizeof((*x)))
+
+static double
+double_time (void)
+{
+  struct timeval now;
+  gettimeofday (&now, 0);
+  return (now.tv_sec + ((double) now.tv_usec * 0.000001));
+}
+
+static const struct {
+  const char *name;
+  int depth, bpp, byte_order;
+  unsigned long masks[3];
+} layouts[] = {
+  { "xRGB 32 LSB",	24, 32, LSBFirst, { 0xFF0000, 0x00FF00, 0x0000FF } },
+  { "xRGB 32 MSB",	24, 32, MSBFirst, { 0xFF0000, 0x00FF00, 0x0000FF } },
+  { "xBGR 32 LSB",	24, 32, LSBFirst, { 0x0000FF, 0x00FF00, 0xFF0000 } },
+  { "xBGR 32 MSB",	24, 32, MSBFirst, { 0x0000FF, 0x00FF00, 0xFF0000 } },
+  { "RGB 10-10-10",	30, 32, LSBFirst, { 0x3FF00000, 0xFFC00, 0x3FF } },
+  { "RGB 24 LSB",	24, 24, LSBFirst, { 0xFF0000, 0x00FF00, 0x0000FF } },
+  { "RGB 24 MSB",	24, 24, MSBFirst, { 0xFF0000, 0x00FF00, 0x0000FF } },
+  { "RGB 565 LSB",	16, 16, LSBFirst, { 0xF800, 0x07E0, 0x001F } },
+  { "RGB 565 MSB",	16, 16, MSBFirst, { 0xF800, 0x07E0, 0x001F } },
+  { "RGB 555 LSB",	15, 16, LSBFirst, { 0x7C00, 0x03E0, 0x001F } },
+  { "RGB 332",		 8,  8, LSBFirst, { 0xE0, 0x1C, 0x03 } },
+};
+
+
+/* An XImage of random pixels, without a display. */
+static XImage *
+make_image (int i, int width, int height, int pad)
+{
+  XImage *image = (XImage *) calloc (1, sizeof(*image));
+  int j;
+  image->width = width;
+  image->height = height;
+  image->format = ZPixmap;
+  image->byte_order = layouts[i].byte_order;
+  image->bitmap_unit = 32;
+  image->bitmap_bit_order = layouts[i].byte_order;
+  image->bitmap_pad = 32;
+  image->depth = layouts[i].depth;
+  image->bits_per_pixel = layouts[i].bpp;
+  image->bytes_per_line = ((width * layouts[i].bpp + 31) / 32) * 4 + pad;
+  image->red_mask   = layouts[i].masks[0];
+  image->green_mask = layouts[i].masks[1];
+  image->blue_mask  = layouts[i].masks[2];
+  image->data = (char *) malloc (image->bytes_per_line * height);
+  for (j = 0; j < image->bytes_per_line * height; j++)
+    image->data[j] = random();
+  if (! XInitImage (image)) abort();
+  return image;
+}
+
+static void
+free_image (XImage *image)
+{
+  free (image->data);
+  free (image);
+}
+
+
+/* What the converters should produce: the top 8 bits of each field, with
+   narrower fields widened by repeating their bits. */
+static void
+reference_pixel (XImage *image, int x, int y, unsigned char rgb[3])
+{
+  unsigned long masks[3];
+  unsigned long p = XGetPixel (image, x, y);
+  int i;
+  masks[0] = image->red_mask;
+  masks[1] = image->green_mask;
+  masks[2] = image->blue_mask;
+  for (i = 0; i < 3; i++)
+    {
+      unsigned long m = masks[i], v = p;
+      unsigned int out = 0;
+      int width = 0, shift;
+      while (!(m & 1)) m >>= 1, v >>= 1;
+      v &= m;
+      while (m) m >>= 1, width++;
+      if (width > 8)
+        {
+          v >>= width - 8;
+          width = 8;
+        }
+      for (shift = 8 - width; shift > -width; shift -= width)
+        out |= (shift >= 0 ? v << shift : v >> -shift);
+      rgb[i] = out & 0xFF;
+    }
+}
+
+
+static int
+check_layout (int i)
+{
+  int errors = 0;
+  int width;
+  for (width = 1; width <= 70; width++)
+    {
+      int height = 3, x, y;
+      XImage *image = make_image (i, width, height, (width % 3) * 4);
+      unsigned char *rgba = (unsigned char *) malloc (width * 4 + 32);
+      unsigned char *rgb  = (unsigned char *) malloc (width * 3 + 32);
+      pixel_converter pc;
+
+      if (! pixel_converter_init (&pc, image)) abort();
+      for (y = 0; y < height; y++)
+        {
+          memset (rgba, 0xA5, width * 4 + 32);
+          memset (rgb,  0xA5, width * 3 + 32);
+          pixel_convert_row_rgba (&pc, image, y, rgba);
+          pixel_convert_row_rgb  (&pc, image, y, rgb);
+
+          for (x = 0; x < width; x++)
+            {
+              unsigned char want[3];
+              reference_pixel (image, x, y, want);
+              if (memcmp (rgba + x*4, want, 3) || rgba[x*4+3] != 0xFF ||
+                  memcmp (rgb  + x*3, want, 3))
+                {
+                  if (errors++ < 5)
+                    fprintf (stderr,
+                             "%s: width %d: pixel %d,%d is %02X%02X%02X"
+                             " / %02X%02X%02X%02X, should be %02X%02X%02X\n",
+                             layouts[i].name, width, x, y,
+                             rgb[x*3], rgb[x*3+1], rgb[x*3+2],
+                             rgba[x*4], rgba[x*4+1], rgba[x*4+2],
+                             rgba[x*4+3], want[0], want[1], want[2]);
+                }
+            }
+          for (x = 0; x < 32; x++)
+            if (rgba[width*4 + x] != 0xA5 || rgb[width*3 + x] != 0xA5)
+              {
+                if (errors++ < 5)
+                  fprintf (stderr, "%s: width %d: wrote past end of row\n",
+                           layouts[i].name, width);
+                break;
+              }
+        }
+
+      free (rgba);
+      free (rgb);
+      free_image (image);
+    }
+  return errors;
+}
+
+
+/* Megapixels per second for whole frames of each kind. */
+static void
+time_layout (int i, int width, int height)
+{
+  XImage *image = make_image (i, width, height, 0);
+  unsigned char *out = (unsigned char *) malloc (width * 4 + 32);
+  pixel_converter pc;
+  double t0, rates[3];
+  int pass, y, x;
+
+  if (! pixel_converter_init (&pc, image)) abort();
+  for (pass = 0; pass < 3; pass++)
+    {
+      int frames = 0;
+      t0 = double_time();
+      do {
+        for (y = 0; y < height; y++)
+          if (pass == 0)
+            pixel_convert_row_rgba (&pc, image, y, out);
+          else if (pass == 1)
+            pixel_convert_row_rgb (&pc, image, y, out);
+          else
+            for (x = 0; x < width; x++)
+              reference_pixel (image, x, y, out + x*3);
+        frames++;
+      } while (double_time() - t0 < 0.25);
+      rates[pass] = ((double) frames * width * height /
+                     (double_time() - t0) / 1000000);
+    }
+
+  fprintf (stderr, "%-14s %s  RGBA %7.1f  RGB %7.1f  XGetPixel %6.1f"
+           " Mpixels/sec\n",
+           layouts[i].name, (pc.kind == PIXCONV_GENERIC ? "   " : "vec"),
+           rates[0], rates[1], rates[2]);
+
+  free (out);
+  free_image (image);
+}
+
+
+int
+main (int argc, char **argv)
+{
+  int width  = (argc > 1 ? atoi (argv[1]) : 1920);
+  int height = (argc > 2 ? atoi (argv[2]) : 1080);
+  int errors = 0;
+  int i;
+
+  for (i = 0; i < countof(layouts); i++)
+    errors += check_layout (i);
+  if (errors)
+    {
+      fprintf (stderr, "%d errors\n", errors);
+      return 1;
+    }
+  fprintf (stderr, "OK\n");
+
+  for (i = 0; i < countof(layouts); i++)
+    time_layout (i, width, height);
+  return 0;
+}
+
+#endif /* SELFTEST */
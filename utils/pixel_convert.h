@@ -0,0 +1,57 @@
+/* xscreensaver, Copyright (c) 2026 Jamie Zawinski <jwz@jwz.org>
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation.  No representations are made about the suitability of this
+ * software for any purpose.  It is provided "as is" without express or
+ * implied warranty.
+ */
+
+/* Converting the scan lines of TrueColor XImages to packed RGBA or RGB
+   bytes, e.g. for texture loading or video recording.
+
+   The common layouts (32 bit xRGB or xBGR, and 16 bit 5-6-5, in the
+   client's byte order) are done many pixels at a time with SSE2 or NEON
+   when the compiler has those enabled.  Everything else goes through the
+   general mask-and-shift code, which is still much faster than XGetPixel.
+ */
+
+#ifndef __XSCREENSAVER_PIXEL_CONVERT_H__
+#define __XSCREENSAVER_PIXEL_CONVERT_H__
+
+typedef enum {
+  PIXCONV_GENERIC,	/* any TrueColor layout */
+  PIXCONV_XRGB32,	/* 0x00RRGGBB */
+  PIXCONV_XBGR32,	/* 0x00BBGGRR */
+  PIXCONV_RGB565	/* 0bRRRRRGGGGGGBBBBB */
+} pixel_convert_kind;
+
+typedef struct {
+  pixel_convert_kind kind;
+  Bool native_p;		/* image is in the client's byte order */
+  int shift[3];			/* R, G, B: shift right by this... */
+  unsigned long mask[3];	/* ...then AND with this for the field */
+  unsigned char spread[3][256];	/* n-bit field to 8 bits */
+} pixel_converter;
+
+/* Sets up a converter for images with the layout of this one.  Returns
+   False if it isn't a TrueColor image (i.e., it has no color masks).
+ */
+extern Bool pixel_converter_init (pixel_converter *, const XImage *);
+
+/* Converts row y of the image into width * 4 bytes, R, G, B, A in
+   memory order, with A = 0xFF.
+ */
+extern void pixel_convert_row_rgba (const pixel_converter *,
+                                    const XImage *, int y,
+                                    unsigned char *out);
+
+/* Converts row y of the image into width * 3 bytes, R, G, B.
+ */
+extern void pixel_convert_row_rgb (const pixel_converter *,
+                                   const XImage *, int y,
+                                   unsigned char *out);
+
+#endif /* __XSCREENSAVER_PIXEL_CONVERT_H__ */
@@ -0,0 +1,220 @@
+/* xscreensaver, Copyright (c) 2026 Jamie Zawinski <jwz@jwz.org>
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation.  No representations are made about the suitability of this
+ * software for any purpose.  It is provided "as is" without express or
+ * implied warranty.
+ */
+
+/* A density buffer of plotted points, tone-mapped into an XImage.
+   See point_plot.h.
+ */
+
+#include "utils.h"
+
+#include "point_plot.h"
+
+#define POINT_PLOT_MAX_LUT 65536
+
+
+point_plot *
+point_plot_create (Display *dpy, Visual *visual, unsigned int depth,
+                   int width, int height)
+{
+  point_plot *pp = (point_plot *) calloc (1, sizeof(*pp));
+  if (!pp) return 0;
+  pp->dpy = dpy;
+  pp->width = width;
+  pp->height = height;
+
+  pp->density = (unsigned int *)
+    calloc ((size_t) width * height, sizeof(*pp->density));
+  if (!pp->density)
+    {
+      free (pp);
+      return 0;
+    }
+
+# ifdef HAVE_XSHM_EXTENSION
+  pp->ring = create_xshm_ring (dpy, visual, depth, ZPixmap,
+                               width, height, 3);
+  if (pp->ring)
+    pp->image = xshm_ring_image (dpy, pp->ring);
+# endif /* HAVE_XSHM_EXTENSION */
+
+  if (!pp->image)
+    {
+      pp->image = XCreateImage (dpy, visual, depth, ZPixmap, 0, 0,
+                                width, height, 32, 0);
+      if (pp->image)
+        pp->image->data = (char *)
+          calloc (pp->image->height, pp->image->bytes_per_line);
+      if (!pp->image || !pp->image->data)
+        {
+          point_plot_free (pp);
+          return 0;
+        }
+    }
+
+  return pp;
+}
+
+
+void
+point_plot_free (point_plot *pp)
+{
+# ifdef HAVE_XSHM_EXTENSION
+  if (pp->ring)
+    destroy_xshm_ring (pp->dpy, pp->ring);
+  else
+# endif /* HAVE_XSHM_EXTENSION */
+  if (pp->image)
+    XDestroyImage (pp->image);	/* also frees data */
+
+  if (pp->density) free (pp->density);
+  if (pp->lut) free (pp->lut);
+  if (pp->lut_mid) free (pp->lut_mid);
+  if (pp->lut_palette) free (pp->lut_palette);
+  free (pp);
+}
+
+
+void
+point_plot_clear (point_plot *pp)
+{
+  memset (pp->density, 0, (size_t) pp->width * pp->height *
+          sizeof(*pp->density));
+}
+
+
+/* Fills in the table of pixels for hit counts below the point where
+   they all get the last color, unless it is already made from these.
+ */
+static Bool
+point_plot_lut (point_plot *pp, const unsigned long *palette, int npalette,
+                double scale, unsigned long bg)
+{
+  double top = (scale > 0 ? (npalette - 1) / scale + 2 : POINT_PLOT_MAX_LUT);
+  int size = (top < POINT_PLOT_MAX_LUT ? (int) top : POINT_PLOT_MAX_LUT);
+  int i;
+
+  if (pp->lut_size &&
+      pp->lut_npalette == npalette &&
+      pp->lut_scale == scale &&
+      pp->lut_bg == bg &&
+      !memcmp (pp->lut_palette, palette, npalette * sizeof(*palette)))
+    return True;
+
+  {
+    unsigned long *copy = (unsigned long *)
+      realloc (pp->lut_palette, npalette * sizeof(*copy));
+    if (!copy) return False;
+    pp->lut_palette = copy;
+  }
+  pp->lut_npalette = 0;	/* not valid until filled in */
+
+  if (size < 2) size = 2;
+  if (size > pp->lut_size)
+    {
+      unsigned long *lut = (unsigned long *)
+        realloc (pp->lut, size * sizeof(*lut));
+      unsigned char *mid;
+      if (!lut) return False;
+      pp->lut = lut;
+      mid = (unsigned char *) realloc (pp->lut_mid, size);
+      if (!mid) return False;
+      pp->lut_mid = mid;
+    }
+  pp->lut_size = size;
+
+  pp->lut[0] = bg;
+  pp->lut_mid[0] = 0;
+  for (i = 1; i < size; i++)
+    {
+      double c = i * scale;
+      int ci = (c < npalette - 1 ? (int) c : npalette - 1);
+      pp->lut[i] = palette[ci];
+      pp->lut_mid[i] = (ci > 0 && ci < npalette - 1);
+    }
+
+  memcpy (pp->lut_palette, palette, npalette * sizeof(*palette));
+  pp->lut_npalette = npalette;
+  pp->lut_scale = scale;
+  pp->lut_bg = bg;
+  return True;
+}
+
+
+long
+point_plot_render (point_plot *pp, const unsigned long *palette, int npalette,
+                   double scale, unsigned long bg)
+{
+  XImage *image;
+  long mid = 0;
+  int lsb = 1;
+  Bool direct_p;
+  int x, y;
+
+# ifdef HAVE_XSHM_EXTENSION
+  if (pp->ring)
+    pp->image = xshm_ring_image (pp->dpy, pp->ring);
+# endif /* HAVE_XSHM_EXTENSION */
+  image = pp->image;
+
+  if (npalette <= 0 ||
+      !point_plot_lut (pp, palette, npalette, scale, bg))
+    return 0;
+
+  /* Store 32-bit pixels directly if we can, instead of with XPutPixel. */
+  lsb = (*(char *) &lsb == 1);
+  direct_p = (image->bits_per_pixel == 32 && sizeof(unsigned int) == 4 &&
+              image->byte_order == (lsb ? LSBFirst : MSBFirst));
+
+  for (y = 0; y < pp->height; y++)
+    {
+      const unsigned int *in = pp->density + (size_t) y * pp->width;
+      unsigned int *out = (unsigned int *)
+        (image->data + (size_t) y * image->bytes_per_line);
+      for (x = 0; x < pp->width; x++)
+        {
+          unsigned int d = in[x];
+          unsigned long p;
+          if (d < (unsigned int) pp->lut_size)
+            {
+              p = pp->lut[d];
+              mid += pp->lut_mid[d];
+            }
+          else
+            {
+              double c = d * scale;
+              int ci = (c < npalette - 1 ? (int) c : npalette - 1);
+              p = palette[ci];
+              mid += (ci > 0 && ci < npalette - 1);
+            }
+
+          if (direct_p)
+            out[x] = p;
+          else
+            XPutPixel (image, x, y, p);
+        }
+    }
+
+  return mid;
+}
+
+
+void
+point_plot_put (point_plot *pp, Drawable d, GC gc)
+{
+# ifdef HAVE_XSHM_EXTENSION
+  if (pp->ring)
+    xshm_ring_put (pp->dpy, pp->ring, d, gc, 0, 0, 0, 0,
+                   pp->width, pp->height);
+  else
+# endif /* HAVE_XSHM_EXTENSION */
+    XPutImage (pp->dpy, d, gc, pp->image, 0, 0, 0, 0,
+               pp->width, pp->height);
+}
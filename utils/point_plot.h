@@ -0,0 +1,88 @@
+/* xscreensaver, Copyright (c) 2026 Jamie Zawinski <jwz@jwz.org>
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation.  No representations are made about the suitability of this
+ * software for any purpose.  It is provided "as is" without express or
+ * implied warranty.
+ */
+
+/* A client-side surface for hacks that plot huge numbers of points, such
+   as strange attractors.
+
+   Drawing each point (or each lit pixel) with XDrawPoint, or even with
+   big XDrawPoints batches per color, sends every one of them through the
+   X protocol.  Instead, the hack counts the hits on each pixel in a
+   density buffer, and once per frame point_plot_render() turns the counts
+   into colors through a palette, and point_plot_put() sends the whole
+   thing as one image: through a ring of XShm images when possible, so
+   that the next frame can be rendered while the server reads this one.
+ */
+
+#ifndef __XSCREENSAVER_POINT_PLOT_H__
+#define __XSCREENSAVER_POINT_PLOT_H__
+
+#ifdef HAVE_XSHM_EXTENSION
+# include "xshm.h"
+#endif /* HAVE_XSHM_EXTENSION */
+
+typedef struct point_plot {
+  Display *dpy;
+  int width, height;
+  unsigned int *density;	/* Hits per pixel, width * height, by rows */
+  XImage *image;		/* The image to render the next frame into */
+
+# ifdef HAVE_XSHM_EXTENSION
+  xshm_ring *ring;
+# endif /* HAVE_XSHM_EXTENSION */
+
+  /* point_plot_render() caches the hit-count-to-pixel table here, and
+     builds it again only when its arguments change. */
+  unsigned long *lut;
+  unsigned char *lut_mid;
+  int lut_size;
+  unsigned long *lut_palette;	/* a copy of the palette it was made from */
+  int lut_npalette;
+  double lut_scale;
+  unsigned long lut_bg;
+} point_plot;
+
+/* Count a hit at x,y, or take one away.  Points outside are ignored. */
+#define POINT_PLOT_ADD(PP,X,Y) do {					\
+    int _x = (X), _y = (Y);						\
+    if (_x >= 0 && _y >= 0 && _x < (PP)->width && _y < (PP)->height)	\
+      (PP)->density[_y * (PP)->width + _x]++;				\
+  } while (0)
+#define POINT_PLOT_REMOVE(PP,X,Y) do {					\
+    int _x = (X), _y = (Y);						\
+    if (_x >= 0 && _y >= 0 && _x < (PP)->width && _y < (PP)->height &&	\
+        (PP)->density[_y * (PP)->width + _x])				\
+      (PP)->density[_y * (PP)->width + _x]--;				\
+  } while (0)
+
+/* Creates a width x height surface with no hits on it.  The "useSHM"
+   resource is honored.  Returns 0 if memory could not be allocated.
+ */
+extern point_plot *point_plot_create (Display *, Visual *,
+                                      unsigned int depth,
+                                      int width, int height);
+extern void point_plot_free (point_plot *);
+
+/* Forgets all hits. */
+extern void point_plot_clear (point_plot *);
+
+/* Colors the next frame: pixels with no hits are `bg', and the others are
+   palette[hits * scale], or the last color if that is past the end.
+   Returns the number of pixels that got neither the first nor the last
+   color, which is a rough measure of how interesting the picture is.
+ */
+extern long point_plot_render (point_plot *,
+                               const unsigned long *palette, int npalette,
+                               double scale, unsigned long bg);
+
+/* Sends the frame last rendered to the drawable, at 0,0. */
+extern void point_plot_put (point_plot *, Drawable, GC);
+
+#endif /* __XSCREENSAVER_POINT_PLOT_H__ */
@@ -16,9 +16,10 @@
    get allocated and shut down cleanly.
 
    This code currently deals only with shared XImages, not with shared Pixmaps.
-   It also doesn't use "completion events", but so far that doesn't seem to
-   be a problem (and I'm not entirely clear on when they would actually be
-   needed, anyway.)
+   A single shared XImage doesn't use "completion events": it's the caller's
+   job to XSync before writing into the image again, which the screenhack
+   main loop does after every frame.  The xshm_ring functions do use them,
+   so that several images can be in flight at once.
 
    If you don't have man pages for this extension, see
    http://www.x.org/X11R6.8.1/docs/Xext/
@@ -226,4 +227,155 @@ destroy_xshm_image (Display *dpy, XImage *image, XShmSegmentInfo *shm_info)
 }
 
 
+/* A ring of shared XImages; see xshm.h.
+ */
+
+#define XSHM_RING_MAX 3
+
+struct xshm_ring_slot {
+  XImage *image;
+  XShmSegmentInfo shm_info;
+  Bool busy;		/* the server may still be reading it */
+  unsigned long serial;	/* request number of the XShmPutImage */
+};
+
+struct xshm_ring {
+  int count;
+  int current;		/* the slot handed out by xshm_ring_image() */
+  int completion_type;
+  struct xshm_ring_slot slots[XSHM_RING_MAX];
+};
+
+
+xshm_ring *
+create_xshm_ring (Display *dpy, Visual *visual,
+                  unsigned int depth, int format,
+                  unsigned int width, unsigned int height,
+                  int count)
+{
+  xshm_ring *ring;
+  int i;
+
+  if (count < 1) count = 1;
+  if (count > XSHM_RING_MAX) count = XSHM_RING_MAX;
+
+  ring = (xshm_ring *) calloc (1, sizeof(*ring));
+  if (!ring) return 0;
+
+  for (i = 0; i < count; i++)
+    {
+      struct xshm_ring_slot *slot = &ring->slots[i];
+      slot->image = create_xshm_image (dpy, visual, depth, format, 0,
+                                       &slot->shm_info, width, height);
+      if (!slot->image)
+        break;
+      memset (slot->image->data, 0,
+              slot->image->bytes_per_line * slot->image->height);
+      ring->count++;
+    }
+
+  /* A ring of one is no better than create_xshm_image(), but a ring of two
+     where we wanted three is still worth having. */
+  if (ring->count == 0)
+    {
+      free (ring);
+      return 0;
+    }
+
+  ring->completion_type = XShmGetEventBase (dpy) + ShmCompletion;
+  return ring;
+}
+
+
+void
+destroy_xshm_ring (Display *dpy, xshm_ring *ring)
+{
+  int i;
+  for (i = 0; i < ring->count; i++)
+    destroy_xshm_image (dpy, ring->slots[i].image, &ring->slots[i].shm_info);
+  free (ring);
+}
+
+
+static Bool
+xshm_ring_completion_p (Display *dpy, XEvent *event, XPointer closure)
+{
+  xshm_ring *ring = (xshm_ring *) closure;
+  int i;
+  if (event->type != ring->completion_type)
+    return False;
+  for (i = 0; i < ring->count; i++)
+    if (((XShmCompletionEvent *) event)->shmseg ==
+        ring->slots[i].shm_info.shmseg)
+      return True;
+  return False;
+}
+
+
+/* Marks as free every image whose XShmPutImage the server has finished.
+
+   The screenhack main loop reads and discards events every frame, so
+   usually the ShmCompletion events are gone before we look for them.
+   But reading any event or reply tells Xlib the serial number of the
+   last request the server processed, and an image is free once that has
+   caught up with its put.  Any completion events still in the queue are
+   pulled out too (which also reads whatever has arrived), so that the
+   hack's event handler doesn't have to wade through them.
+ */
+static void
+xshm_ring_reap (Display *dpy, xshm_ring *ring)
+{
+  XEvent event;
+  unsigned long done;
+  int i;
+
+  while (XCheckIfEvent (dpy, &event, xshm_ring_completion_p,
+                        (XPointer) ring))
+    ;
+
+  done = LastKnownRequestProcessed (dpy);
+  for (i = 0; i < ring->count; i++)
+    if (ring->slots[i].busy &&
+        (long) (done - ring->slots[i].serial) >= 0)
+      ring->slots[i].busy = False;
+}
+
+
+XImage *
+xshm_ring_image (Display *dpy, xshm_ring *ring)
+{
+  struct xshm_ring_slot *slot = &ring->slots[ring->current];
+
+  if (slot->busy)
+    xshm_ring_reap (dpy, ring);
+
+  if (slot->busy)
+    {
+      /* The server is still reading it.  Once XSync returns, it has
+         processed every request we've sent. */
+      int i;
+      XSync (dpy, False);
+      xshm_ring_reap (dpy, ring);
+      for (i = 0; i < ring->count; i++)
+        ring->slots[i].busy = False;
+    }
+
+  return slot->image;
+}
+
+
+void
+xshm_ring_put (Display *dpy, xshm_ring *ring, Drawable d, GC gc,
+               int src_x, int src_y, int dest_x, int dest_y,
+               unsigned int width, unsigned int height)
+{
+  struct xshm_ring_slot *slot = &ring->slots[ring->current];
+  slot->serial = NextRequest (dpy);
+  XShmPutImage (dpy, d, gc, slot->image, src_x, src_y, dest_x, dest_y,
+                width, height, True);
+  slot->busy = True;
+  ring->current = (ring->current + 1) % ring->count;
+}
+
+
 #endif /* HAVE_XSHM_EXTENSION */
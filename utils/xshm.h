@@ -17,6 +17,7 @@
  */
 
 #ifndef __XSCREENSAVER_XSHM_H__
+#define __XSCREENSAVER_XSHM_H__
 
 #ifdef HAVE_XSHM_EXTENSION
 
@@ -32,6 +33,37 @@ extern XImage *create_xshm_image (Display *dpy, Visual *visual,
 extern void destroy_xshm_image (Display *dpy, XImage *image,
                                 XShmSegmentInfo *shm_info);
 
+/* A ring of 2 or 3 shared XImages, so that the client can render the next
+   frame into one while the server is still reading the last from another.
+
+   Call xshm_ring_image() to get the image to draw into, then
+   xshm_ring_put() to send it to the server.  That image stays busy until
+   Xlib has seen an event or reply from a later request than the put (the
+   put's own ShmCompletion event will do), so it doesn't matter whether
+   the hack's event loop reads the completion events before the ring
+   does.  xshm_ring_image() only waits (by doing an XSync) if the image it
+   is about to hand out is still busy after that.
+
+   Each image in the ring keeps whatever was last drawn into it, which is
+   not necessarily the previous frame: hacks that only redraw the parts
+   that changed can't use this.
+
+   Returns 0 if XSHM is not available, in which case the caller should
+   fall back to a single XImage.
+ */
+typedef struct xshm_ring xshm_ring;
+
+extern xshm_ring *create_xshm_ring (Display *dpy, Visual *visual,
+                                    unsigned int depth, int format,
+                                    unsigned int width, unsigned int height,
+                                    int count);
+extern void destroy_xshm_ring (Display *dpy, xshm_ring *ring);
+extern XImage *xshm_ring_image (Display *dpy, xshm_ring *ring);
+extern void xshm_ring_put (Display *dpy, xshm_ring *ring,
+                           Drawable d, GC gc,
+                           int src_x, int src_y, int dest_x, int dest_y,
+                           unsigned int width, unsigned int height);
+
 #endif /* HAVE_XSHM_EXTENSION */
 
 #endif /* __XSCREENSAVER_XSHM_H__ */